@@ -0,0 +1,283 @@
+/*____________________________________________________________________
+|
+| File: adpcm.cpp
+|
+| Description: Codes 16-bit samples as IMA ADPCM, 4 bits a sample, so
+|   sounds take about a quarter of the memory.
+|
+|   Each channel is cut into blocks of ADPCM_BLOCK_SAMPLES samples.  A
+|   block starts from a real sample and carries its step index, so
+|   blocks decode on their own and errors don't build up past one.
+|
+|   Decoding a block is one long chain (each sample needs the one
+|   before), so with SSE2 4 blocks are decoded at once, one per lane.
+|
+|   Only uses the C library.
+|
+| Functions: Adpcm_Size
+|            Adpcm_Encode
+|            Adpcm_Decode
+|             Decode_Block
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <string.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define ADPCM_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "adpcm.h"
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Decode_Block (const unsigned char *block, short *samples, int stride, int count);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define CLAMP(_x_,_lo_,_hi_) (((_x_) < (_lo_)) ? (_lo_) : (((_x_) > (_hi_)) ? (_hi_) : (_x_)))
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static const int index_table [16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const int step_table [89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/*____________________________________________________________________
+|
+| Function: Adpcm_Size
+|
+| Input: Called from ____
+| Output: Returns the bytes needed to code a number of frames.
+|___________________________________________________________________*/
+
+unsigned Adpcm_Size (int num_frames, int channels)
+{
+  return ((unsigned)((num_frames + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES) * channels * ADPCM_BLOCK_BYTES);
+}
+
+/*____________________________________________________________________
+|
+| Function: Adpcm_Encode
+|
+| Input: Called from ____
+| Output: Codes samples as IMA ADPCM.  Past the last frame blocks are
+|   filled with the last sample.
+|___________________________________________________________________*/
+
+void Adpcm_Encode (const short *samples, int num_frames, int channels, unsigned char *data)
+{
+  int b, c, i, f, n, sample, diff, step, predictor, index, num_blocks;
+  int step_index [2] = { 0, 0 };
+  unsigned char *block;
+
+  if (num_frames <= 0)
+    return;
+
+  num_blocks = (num_frames + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES;
+  for (b=0; b<num_blocks; b++)
+    for (c=0; c<channels; c++) {
+      block = data + (b * channels + c) * ADPCM_BLOCK_BYTES;
+      f = b * ADPCM_BLOCK_SAMPLES;
+      predictor = samples[f * channels + c];
+      index = step_index[c];
+      block[0] = (unsigned char)(predictor & 0xFF);
+      block[1] = (unsigned char)((predictor >> 8) & 0xFF);
+      block[2] = (unsigned char) index;
+      block[3] = 0;
+      memset (block + 4, 0, ADPCM_BLOCK_SAMPLES / 2);
+
+      for (i=0; i<ADPCM_BLOCK_SAMPLES; i++) {
+        sample = samples[((f + i < num_frames) ? f + i : num_frames - 1) * channels + c];
+        step = step_table[index];
+        // Code the difference in steps, then decode it the way the decoder will
+        diff = sample - predictor;
+        n = 0;
+        if (diff < 0) {
+          n = 8;
+          diff = -diff;
+        }
+        if (diff >= step) {
+          n |= 4;
+          diff -= step;
+        }
+        if (diff >= (step >> 1)) {
+          n |= 2;
+          diff -= step >> 1;
+        }
+        if (diff >= (step >> 2))
+          n |= 1;
+
+        diff = step >> 3;
+        if (n & 4)
+          diff += step;
+        if (n & 2)
+          diff += step >> 1;
+        if (n & 1)
+          diff += step >> 2;
+        predictor += (n & 8) ? -diff : diff;
+        predictor = CLAMP (predictor, -32768, 32767);
+        index += index_table[n];
+        index = CLAMP (index, 0, 88);
+
+        block[4 + i/2] |= (unsigned char)(n << ((i & 1) * 4));
+      }
+      step_index[c] = index;
+    }
+}
+
+/*____________________________________________________________________
+|
+| Function: Adpcm_Decode
+|
+| Input: Called from ____
+| Output: Decodes IMA ADPCM into samples.
+|___________________________________________________________________*/
+
+void Adpcm_Decode (const unsigned char *data, int num_frames, int channels, short *samples)
+{
+  int b, c, i, j, count, num_blocks;
+
+  // Blocks in order, block b is channel b % channels, frames (b / channels) * ADPCM_BLOCK_SAMPLES on
+  num_blocks = (num_frames + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES * channels;
+  b = 0;
+#ifdef ADPCM_SSE2
+  int k;
+  const unsigned char *p[4];
+  __m128i predictor, index, step, n, diff, mask, steps, three, four, two, one, minus_one, max_index, zero;
+#ifdef _MSC_VER
+  __declspec(align(16)) int lane_index [4];
+  __declspec(align(16)) int decoded [ADPCM_BLOCK_SAMPLES][4];
+#else
+  int lane_index [4] __attribute__ ((aligned (16)));
+  int decoded [ADPCM_BLOCK_SAMPLES][4] __attribute__ ((aligned (16)));
+#endif
+
+  one       = _mm_set1_epi32 (1);
+  two       = _mm_set1_epi32 (2);
+  three     = _mm_set1_epi32 (3);
+  four      = _mm_set1_epi32 (4);
+  minus_one = _mm_set1_epi32 (-1);
+  max_index = _mm_set1_epi32 (88);
+  zero      = _mm_setzero_si128 ();
+
+  for (; b+4<=num_blocks; b+=4) {
+    for (k=0; k<4; k++)
+      p[k] = data + (b + k) * ADPCM_BLOCK_BYTES;
+    predictor = _mm_setr_epi32 ((short)(p[0][0] | (p[0][1] << 8)), (short)(p[1][0] | (p[1][1] << 8)),
+                                (short)(p[2][0] | (p[2][1] << 8)), (short)(p[3][0] | (p[3][1] << 8)));
+    index     = _mm_setr_epi32 (p[0][2], p[1][2], p[2][2], p[3][2]);
+
+    for (i=0; i<ADPCM_BLOCK_SAMPLES; i++) {
+      // The code of this sample in each block
+      j = 4 + i/2;
+      n = _mm_setr_epi32 (p[0][j], p[1][j], p[2][j], p[3][j]);
+      if (i & 1)
+        n = _mm_srli_epi32 (n, 4);
+      n = _mm_and_si128 (n, _mm_set1_epi32 (15));
+
+      // No gather in SSE2, look up the steps one at a time
+      _mm_store_si128 ((__m128i *) lane_index, index);
+      step = _mm_setr_epi32 (step_table[lane_index[0]], step_table[lane_index[1]], step_table[lane_index[2]], step_table[lane_index[3]]);
+
+      diff = _mm_srli_epi32 (step, 3);
+      mask = _mm_cmpeq_epi32 (_mm_and_si128 (n, four), four);
+      diff = _mm_add_epi32 (diff, _mm_and_si128 (mask, step));
+      steps = _mm_and_si128 (_mm_cmpeq_epi32 (_mm_and_si128 (n, two), two), _mm_srli_epi32 (step, 1));
+      diff = _mm_add_epi32 (diff, steps);
+      steps = _mm_and_si128 (_mm_cmpeq_epi32 (_mm_and_si128 (n, one), one), _mm_srli_epi32 (step, 2));
+      diff = _mm_add_epi32 (diff, steps);
+      // Negate where the sign bit is set
+      steps = _mm_cmpeq_epi32 (_mm_and_si128 (n, _mm_set1_epi32 (8)), _mm_set1_epi32 (8));
+      diff = _mm_sub_epi32 (_mm_xor_si128 (diff, steps), steps);
+      predictor = _mm_add_epi32 (predictor, diff);
+      // Clamp to 16-bit by packing with saturation and widening back
+      predictor = _mm_packs_epi32 (predictor, predictor);
+      predictor = _mm_srai_epi32 (_mm_unpacklo_epi16 (predictor, predictor), 16);
+      _mm_store_si128 ((__m128i *) decoded[i], predictor);
+
+      // Index moves down 1 for small codes, up 2 to 8 for large ones
+      index = _mm_add_epi32 (index, _mm_or_si128 (_mm_and_si128 (mask, _mm_slli_epi32 (_mm_add_epi32 (_mm_and_si128 (n, three), one), 1)),
+                                                  _mm_andnot_si128 (mask, minus_one)));
+      // Index is -1 to 96, the 16-bit min and max clamp it
+      index = _mm_min_epi16 (_mm_max_epi16 (index, zero), max_index);
+    }
+
+    for (k=0; k<4; k++) {
+      c = (b + k) % channels;
+      j = (b + k) / channels * ADPCM_BLOCK_SAMPLES;
+      count = (num_frames - j < ADPCM_BLOCK_SAMPLES) ? num_frames - j : ADPCM_BLOCK_SAMPLES;
+      for (i=0; i<count; i++)
+        samples[(j + i) * channels + c] = (short) decoded[i][k];
+    }
+  }
+#endif
+
+  // The rest one at a time
+  for (; b<num_blocks; b++) {
+    c = b % channels;
+    j = b / channels * ADPCM_BLOCK_SAMPLES;
+    count = (num_frames - j < ADPCM_BLOCK_SAMPLES) ? num_frames - j : ADPCM_BLOCK_SAMPLES;
+    Decode_Block (data + b * ADPCM_BLOCK_BYTES, samples + j * channels + c, channels, count);
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Decode_Block
+|
+| Input: Called from Adpcm_Decode()
+| Output: Decodes the first count samples of a block, stride samples
+|   apart.
+|___________________________________________________________________*/
+
+static void Decode_Block (const unsigned char *block, short *samples, int stride, int count)
+{
+  int i, n, step, diff, predictor, index;
+
+  predictor = (short)(block[0] | (block[1] << 8));
+  index = block[2];
+
+  for (i=0; i<count; i++) {
+    n = (block[4 + i/2] >> ((i & 1) * 4)) & 15;
+    step = step_table[index];
+    diff = step >> 3;
+    if (n & 4)
+      diff += step;
+    if (n & 2)
+      diff += step >> 1;
+    if (n & 1)
+      diff += step >> 2;
+    predictor += (n & 8) ? -diff : diff;
+    predictor = CLAMP (predictor, -32768, 32767);
+    index += index_table[n];
+    index = CLAMP (index, 0, 88);
+    samples[i * stride] = (short) predictor;
+  }
+}
@@ -0,0 +1,22 @@
+/*____________________________________________________________________
+|
+| File: adpcm.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// Each channel is coded in blocks of ADPCM_BLOCK_SAMPLES samples, a block is a 16-bit starting sample, a step index
+//   byte, a 0 byte, then a 4-bit code per sample (low nibble first).  Blocks of all channels at the same time follow
+//   each other.
+#define ADPCM_BLOCK_SAMPLES  256
+#define ADPCM_BLOCK_BYTES    (4 + ADPCM_BLOCK_SAMPLES / 2)
+
+// Returns the bytes to code num_frames frames
+unsigned Adpcm_Size (int num_frames, int channels);
+
+// Codes 16-bit samples (channels interleaved) as IMA ADPCM into data (Adpcm_Size() bytes)
+void Adpcm_Encode (const short *samples, int num_frames, int channels, unsigned char *data);
+
+// Decodes IMA ADPCM back to 16-bit samples (channels interleaved)
+void Adpcm_Decode (const unsigned char *data, int num_frames, int channels, short *samples);
@@ -0,0 +1,575 @@
+/*____________________________________________________________________
+|
+| File: arena.cpp
+|
+| Description: Memory for data that only lives for a frame (visible
+|   lists, sort keys, scratch) without calling malloc() each frame.
+|
+|   Each thread gets its own arena, so allocating takes no lock: it
+|   rounds the end of the used part up to the alignment and moves it
+|   past the new allocation.  Nothing is freed on its own.  A marker
+|   taken with Arena_Get_Marker() frees everything after it, for
+|   scratch used inside one function, and Arena_Reset() frees it all at
+|   the end of the frame.
+|
+|   If a frame needs more than the arena holds, overflow blocks are
+|   added (big ones, in large pages when the OS gives them).  At the
+|   reset the arena is made big enough for that frame in one block and
+|   the frame is counted in the stats, so the program can warn.
+|
+|   Arenas come from the OS a page at a time, so alignments up to the
+|   page size work.
+|
+|   Only uses the C library and the OS.
+|
+| Functions: Arena_Init
+|            Arena_Free
+|            Arena_Alloc
+|             Next_Block
+|            Arena_Alloc_Zero
+|            Arena_Get_Marker
+|            Arena_Free_To_Marker
+|            Arena_Reset
+|            Arena_Get_Stats
+|            Arena_Get_Total_Stats
+|             Get_Arena
+|             Alloc_Pages
+|             Free_Pages
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define LARGE_PAGE_SIZE (2 * 1024 * 1024)    // without Windows, asked for with madvise()
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  unsigned char *base;
+  unsigned       size;
+  bool           large;                      // in large pages
+} Block;
+
+typedef struct Arena {
+  Block          blocks [ARENA_MAX_BLOCKS];  // 0 is the arena, the rest overflow blocks
+  int            num_blocks;
+  int            current;                    // block being allocated from
+  unsigned       used;                       // bytes used in the current block
+  unsigned       before;                     // bytes used in the blocks before it
+  bool           overflowed;                 // in this frame
+  int            generation;                 // of Arena_Init() it was made in
+  ArenaStats     stats;
+  struct Arena  *next;
+} Arena;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static bool   Next_Block (Arena *a, unsigned bytes);
+static Arena *Get_Arena ();
+static void  *Alloc_Pages (unsigned *bytes, bool *large);
+static void   Free_Pages (void *p, unsigned bytes);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#ifdef _WIN32
+#define LOCK()   EnterCriticalSection (&arena_critsection)
+#define UNLOCK() LeaveCriticalSection (&arena_critsection)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define LOCK()   pthread_mutex_lock (&arena_mutex)
+#define UNLOCK() pthread_mutex_unlock (&arena_mutex)
+#define THREAD_LOCAL __thread
+#endif
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static bool                 running = false;
+
+#ifdef _WIN32
+static CRITICAL_SECTION     arena_critsection;   // guards the list and the stats updated at each reset
+#else
+static pthread_mutex_t      arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned             arena_size;
+static Arena               *arenas;              // every thread's
+static int                  arena_generation = 0;
+
+static THREAD_LOCAL Arena  *thread_arena = NULL;
+static THREAD_LOCAL int     thread_generation;
+
+/*____________________________________________________________________
+|
+| Function: Arena_Init
+|
+| Input: Called from Program_Run()
+| Output: Sets the size of each thread's arena (0 = the default).  Call
+|   before any thread allocates.
+|___________________________________________________________________*/
+
+void Arena_Init (unsigned bytes)
+{
+  if (running)
+    return;
+
+#ifdef _WIN32
+  InitializeCriticalSection (&arena_critsection);
+#endif
+  arena_size = (bytes != 0) ? bytes : ARENA_DEFAULT_SIZE;
+  arenas = NULL;
+  running = true;
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Free
+|
+| Input: Called from Program_Run()
+| Output: Frees every thread's arena.  Call once the threads have
+|   stopped allocating.
+|___________________________________________________________________*/
+
+void Arena_Free ()
+{
+  int i;
+  Arena *a, *next;
+
+  if (!running)
+    return;
+
+  LOCK ();
+  for (a=arenas; a; a=next) {
+    next = a->next;
+    for (i=0; i<a->num_blocks; i++)
+      Free_Pages (a->blocks[i].base, a->blocks[i].size);
+    free (a);
+  }
+  arenas = NULL;
+  // Threads still pointing at their arena make a new one if they allocate again
+  arena_generation++;
+  UNLOCK ();
+
+#ifdef _WIN32
+  DeleteCriticalSection (&arena_critsection);
+#endif
+  running = false;
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Alloc
+|
+| Input: Called from ____
+| Output: Returns memory from the calling thread's arena, aligned to
+|   alignment bytes (a power of 2, 0 = ARENA_ALIGN), or NULL if there
+|   is no more memory.
+|___________________________________________________________________*/
+
+void *Arena_Alloc (unsigned bytes, unsigned alignment)
+{
+  unsigned start;
+  Block *b;
+  Arena *a;
+
+  a = Get_Arena ();
+  if (a == NULL)
+    return (NULL);
+
+  if (alignment == 0)
+    alignment = ARENA_ALIGN;
+
+  b = &a->blocks[a->current];
+  start = (a->used + alignment - 1) & ~(alignment - 1);
+  if ((start < a->used) || (start > b->size) || (bytes > b->size - start)) {
+    if (!Next_Block (a, bytes))
+      return (NULL);
+    b = &a->blocks[a->current];
+    start = 0;
+  }
+  a->used = start + bytes;
+
+  a->stats.allocations++;
+  if (a->before + a->used > a->stats.peak)
+    a->stats.peak = a->before + a->used;
+
+  return (b->base + start);
+}
+
+/*____________________________________________________________________
+|
+| Function: Next_Block
+|
+| Input: Called from Arena_Alloc()
+| Output: Moves on to an overflow block with room for bytes, adding
+|   one if needed.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+static bool Next_Block (Arena *a, unsigned bytes)
+{
+  int i;
+  unsigned size;
+  bool large;
+  void *p;
+
+  // Blocks added earlier this frame are still there after freeing to a marker
+  for (i=a->current+1; i<a->num_blocks; i++)
+    if (a->blocks[i].size >= bytes)
+      break;
+
+  if (i == a->num_blocks) {
+    if (a->num_blocks == ARENA_MAX_BLOCKS)
+      return (false);
+    // At least as big as the arena, so a frame needs only a few
+    size = (bytes > a->blocks[0].size) ? bytes : a->blocks[0].size;
+    p = Alloc_Pages (&size, &large);
+    if (p == NULL)
+      return (false);
+    a->blocks[i].base  = (unsigned char *) p;
+    a->blocks[i].size  = size;
+    a->blocks[i].large = large;
+    a->num_blocks++;
+  }
+
+  a->before    += a->used;
+  a->used       = 0;
+  a->current    = i;
+  a->overflowed = true;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Alloc_Zero
+|
+| Input: Called from ____
+| Output: Returns cleared memory from the calling thread's arena, or
+|   NULL if there is no more memory.
+|___________________________________________________________________*/
+
+void *Arena_Alloc_Zero (unsigned bytes, unsigned alignment)
+{
+  void *p;
+
+  p = Arena_Alloc (bytes, alignment);
+  if (p)
+    memset (p, 0, bytes);
+
+  return (p);
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Get_Marker
+|
+| Input: Called from ____
+| Output: Returns the current point in the calling thread's arena.
+|___________________________________________________________________*/
+
+ArenaMarker Arena_Get_Marker ()
+{
+  ArenaMarker marker;
+  Arena *a;
+
+  marker.block  = 0;
+  marker.used   = 0;
+  marker.before = 0;
+
+  a = Get_Arena ();
+  if (a) {
+    marker.block  = a->current;
+    marker.used   = a->used;
+    marker.before = a->before;
+  }
+
+  return (marker);
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Free_To_Marker
+|
+| Input: Called from ____
+| Output: Frees everything the calling thread allocated since the
+|   marker was got.  Markers must be freed to in the reverse order
+|   they were got, and not past a reset.
+|___________________________________________________________________*/
+
+void Arena_Free_To_Marker (ArenaMarker marker)
+{
+  Arena *a;
+
+  a = Get_Arena ();
+  if (a == NULL)
+    return;
+
+  a->current = marker.block;
+  a->used    = marker.used;
+  a->before  = marker.before;
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Reset
+|
+| Input: Called from Program_Run(), Sim_Thread()
+| Output: Frees everything in the calling thread's arena and ends its
+|   frame in the stats.  If the frame overflowed, the arena is made
+|   big enough for it (with a quarter more) in one block.
+|___________________________________________________________________*/
+
+void Arena_Reset ()
+{
+  int i;
+  unsigned size, peak;
+  bool large;
+  void *p;
+  Arena *a;
+
+  a = Get_Arena ();
+  if (a == NULL)
+    return;
+
+  peak = a->stats.peak;
+
+  if (a->num_blocks > 1) {
+    for (i=1; i<a->num_blocks; i++)
+      Free_Pages (a->blocks[i].base, a->blocks[i].size);
+    a->num_blocks = 1;
+    size = peak + peak / 4;
+    if (size > a->blocks[0].size) {
+      // Keep the old arena if a bigger one can't be had
+      p = Alloc_Pages (&size, &large);
+      if (p) {
+        Free_Pages (a->blocks[0].base, a->blocks[0].size);
+        a->blocks[0].base  = (unsigned char *) p;
+        a->blocks[0].size  = size;
+        a->blocks[0].large = large;
+      }
+    }
+  }
+
+  LOCK ();
+  a->stats.size        = a->blocks[0].size;
+  a->stats.large_pages = a->blocks[0].large;
+  a->stats.last_peak   = peak;
+  if (peak > a->stats.max_peak)
+    a->stats.max_peak = peak;
+  a->stats.frames++;
+  if (a->overflowed)
+    a->stats.overflows++;
+  UNLOCK ();
+
+  a->current           = 0;
+  a->used              = 0;
+  a->before            = 0;
+  a->overflowed        = false;
+  a->stats.peak        = 0;
+  a->stats.allocations = 0;
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets the stats of the calling thread's arena.
+|___________________________________________________________________*/
+
+void Arena_Get_Stats (ArenaStats *stats)
+{
+  Arena *a;
+
+  memset (stats, 0, sizeof(ArenaStats));
+
+  a = Get_Arena ();
+  if (a == NULL)
+    return;
+
+  // Only this thread changes its stats
+  *stats = a->stats;
+  stats->used = a->before + a->used;
+}
+
+/*____________________________________________________________________
+|
+| Function: Arena_Get_Total_Stats
+|
+| Input: Called from Program_Run()
+| Output: Gets the stats of every thread's arena as of its last reset,
+|   sizes and counts added up, peaks the largest.  Returns # of
+|   arenas.
+|___________________________________________________________________*/
+
+int Arena_Get_Total_Stats (ArenaStats *stats)
+{
+  int n;
+  Arena *a;
+
+  memset (stats, 0, sizeof(ArenaStats));
+  if (!running)
+    return (0);
+
+  n = 0;
+  LOCK ();
+  for (a=arenas; a; a=a->next) {
+    stats->size      += a->stats.size;
+    stats->frames    += a->stats.frames;
+    stats->overflows += a->stats.overflows;
+    if (a->stats.last_peak > stats->last_peak)
+      stats->last_peak = a->stats.last_peak;
+    if (a->stats.max_peak > stats->max_peak)
+      stats->max_peak = a->stats.max_peak;
+    n++;
+  }
+  UNLOCK ();
+
+  return (n);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Arena
+|
+| Input: Called from Arena_Alloc(), Arena_Get_Marker(),
+|   Arena_Free_To_Marker(), Arena_Reset(), Arena_Get_Stats()
+| Output: Returns the calling thread's arena, making it the first time,
+|   or NULL if not running or out of memory.
+|___________________________________________________________________*/
+
+static Arena *Get_Arena ()
+{
+  unsigned size;
+  bool large;
+  void *p;
+  Arena *a;
+
+  if (thread_arena && (thread_generation == arena_generation))
+    return (thread_arena);
+  if (!running)
+    return (NULL);
+
+  a = (Arena *) calloc (1, sizeof(Arena));
+  if (a == NULL)
+    return (NULL);
+  size = arena_size;
+  p = Alloc_Pages (&size, &large);
+  if (p == NULL) {
+    free (a);
+    return (NULL);
+  }
+  a->blocks[0].base    = (unsigned char *) p;
+  a->blocks[0].size    = size;
+  a->blocks[0].large   = large;
+  a->num_blocks        = 1;
+  a->stats.size        = size;
+  a->stats.large_pages = large;
+
+  LOCK ();
+  a->generation = arena_generation;
+  a->next = arenas;
+  arenas = a;
+  UNLOCK ();
+
+  thread_arena      = a;
+  thread_generation = a->generation;
+
+  return (a);
+}
+
+/*____________________________________________________________________
+|
+| Function: Alloc_Pages
+|
+| Input: Called from Next_Block(), Arena_Reset(), Get_Arena()
+| Output: Returns bytes of memory from the OS, in large pages if it's
+|   big enough and the OS gives them (bytes is then rounded up), or
+|   NULL if out of memory.
+|___________________________________________________________________*/
+
+static void *Alloc_Pages (unsigned *bytes, bool *large)
+{
+  void *p;
+
+  *large = false;
+
+#ifdef _WIN32
+  SIZE_T large_size;
+
+  // Needs the lock pages in memory privilege, which most users don't have
+  large_size = GetLargePageMinimum ();
+  if ((large_size != 0) && (*bytes >= large_size)) {
+    SIZE_T size = (*bytes + large_size - 1) & ~(large_size - 1);
+    p = VirtualAlloc (NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (p) {
+      *bytes = (unsigned) size;
+      *large = true;
+      return (p);
+    }
+  }
+  p = VirtualAlloc (NULL, *bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  if (*bytes >= LARGE_PAGE_SIZE)
+    *bytes = (*bytes + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+  p = mmap (NULL, *bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return (NULL);
+#ifdef MADV_HUGEPAGE
+  // Only a hint, transparent huge pages may be turned off
+  if ((*bytes >= LARGE_PAGE_SIZE) && (madvise (p, *bytes, MADV_HUGEPAGE) == 0))
+    *large = true;
+#endif
+#endif
+
+  return (p);
+}
+
+/*____________________________________________________________________
+|
+| Function: Free_Pages
+|
+| Input: Called from Arena_Free(), Arena_Reset()
+| Output: Gives memory from Alloc_Pages() back to the OS.
+|___________________________________________________________________*/
+
+static void Free_Pages (void *p, unsigned bytes)
+{
+#ifdef _WIN32
+  VirtualFree (p, 0, MEM_RELEASE);
+#else
+  munmap (p, bytes);
+#endif
+}
@@ -0,0 +1,66 @@
+/*____________________________________________________________________
+|
+| File: arena.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define ARENA_DEFAULT_SIZE  (1024 * 1024)   // bytes of each thread's arena if Arena_Init() isn't called
+#define ARENA_ALIGN         16              // alignment when 0 is asked for
+#define ARENA_MAX_BLOCKS    16              // the arena plus overflow blocks in one frame
+
+#ifdef _MSC_VER
+#define ARENA_ALIGNOF(_type_) __alignof(_type_)
+#else
+#define ARENA_ALIGNOF(_type_) __alignof__(_type_)
+#endif
+
+// Arrays of plain data (no constructors or destructors run) from the calling thread's arena
+#define ARENA_ARRAY(_type_,_count_)      ((_type_ *) Arena_Alloc ((unsigned)((_count_) * sizeof(_type_)), ARENA_ALIGNOF(_type_)))
+#define ARENA_ARRAY_ZERO(_type_,_count_) ((_type_ *) Arena_Alloc_Zero ((unsigned)((_count_) * sizeof(_type_)), ARENA_ALIGNOF(_type_)))
+
+typedef struct {
+  int      block;                  // allocations after this point are freed
+  unsigned used;
+  unsigned before;
+} ArenaMarker;
+
+typedef struct {
+  unsigned size;                   // bytes in the arena, without overflow blocks
+  unsigned used;                   // bytes in use now
+  unsigned peak;                   // most bytes in use this frame
+  unsigned last_peak;              // most bytes in use in the last frame
+  unsigned max_peak;               // most bytes in use in any frame
+  int      allocations;            // this frame
+  int      frames;                 // reset so far
+  int      overflows;              // frames that didn't fit (the arena is then made bigger)
+  bool     large_pages;            // arena is in large pages
+} ArenaStats;
+
+// Sets the size of arenas made from now on, each thread gets one the first time it allocates
+void Arena_Init (unsigned bytes);
+
+// Frees every thread's arena, only once no thread allocates any more
+void Arena_Free ();
+
+// Allocates from the calling thread's arena, alignment is a power of 2 (0 = ARENA_ALIGN), returns NULL if out of memory
+void *Arena_Alloc (unsigned bytes, unsigned alignment);
+
+// The same, cleared to 0
+void *Arena_Alloc_Zero (unsigned bytes, unsigned alignment);
+
+// Returns a point to free back to
+ArenaMarker Arena_Get_Marker ();
+
+// Frees everything allocated since the marker was got
+void Arena_Free_To_Marker (ArenaMarker marker);
+
+// Frees everything in the calling thread's arena, call at the end of each frame
+void Arena_Reset ();
+
+// Gets stats of the calling thread's arena
+void Arena_Get_Stats (ArenaStats *stats);
+
+// Gets stats of all arenas (bytes added, peaks the largest), as of the last reset of each, returns # of arenas
+int Arena_Get_Total_Stats (ArenaStats *stats);
@@ -0,0 +1,652 @@
+/*____________________________________________________________________
+|
+| File: asset.cpp
+|
+| Description: A cache of loaded models and textures.  An asset is
+|   found by the hash of its file contents plus its load options, so
+|   loading the same file again (or a copy of it under another name)
+|   returns the asset already loaded.  Load options that only change how
+|   textures are loaded are ignored for a model loaded without textures,
+|   so those loads share one object.
+|
+|   Assets are reference counted.  An asset with no references isn't
+|   freed right away, it goes on an LRU list and is only freed when the
+|   memory of all loaded assets goes over the budget, least recently
+|   used first.  Memory of an asset is an estimate: file size for a
+|   model, 32 bits per pixel plus mipmaps for a texture.
+|
+|   File hashes are remembered by name along with size and write time,
+|   so a file is only read to hash it the first time or after it
+|   changes.
+|
+|   An asset remembers the files it was loaded from.  When one of them
+|   changes, Asset_Reload() loads the asset again into the same slot,
+|   so handles to it stay good and get the new object or texture.
+|
+| Functions: Asset_Init
+|            Asset_Free
+|            Asset_Load_Object
+|            Asset_Load_Texture
+|             Find_Asset
+|             New_Asset
+|             Get_File_Hash
+|             Free_Asset
+|             Enforce_Budget
+|             LRU_Remove
+|             Get_Asset
+|            Asset_Set_File_Hash
+|             Find_File
+|            Asset_Reload
+|            Asset_Get_Object
+|            Asset_Get_Texture
+|            Asset_Add_Ref
+|            Asset_Release
+|            Asset_Get_Stats
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+
+#include "dp.h"
+
+#include "bmp.h"
+#include "filemap.h"
+#include "asset.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MAX_ASSETS     256
+#define MAX_FILES      256
+#define MAX_PATH_SIZE  260
+
+#define ASSET_FREE     0
+#define ASSET_OBJECT   1
+#define ASSET_TEXTURE  2
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  int                type;          // ASSET_FREE = slot not used
+  unsigned long long hash [2];      // contents of model or color file, alpha file (0 = none)
+  unsigned           format, flags;
+  unsigned           generation;    // changes when slot is reused, so old handles don't work
+  int                refs;
+  int                files [2];     // index in file_hashes of model or color file, alpha file (-1 = none)
+  unsigned           bytes;
+  int                prev, next;    // in LRU list (unused assets only)
+  gx3dObject        *object;
+  gx3dTexture        texture;
+} Asset;
+
+typedef struct {
+  char               name [MAX_PATH_SIZE];
+  unsigned           size;
+  unsigned long long time, hash;
+} FileHash;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static Asset *Find_Asset (int type, unsigned long long hash0, unsigned long long hash1, unsigned format, unsigned flags);
+static Asset *New_Asset ();
+static bool   Get_File_Hash (const char *filename, unsigned long long *hash, unsigned *size);
+static void   Free_Asset (Asset *a);
+static void   Enforce_Budget ();
+static void   LRU_Remove (Asset *a);
+static Asset *Get_Asset (AssetHandle handle);
+static int    Find_File (const char *filename);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define HANDLE_OF(_a_) (((_a_)->generation << 16) | (unsigned)((_a_) - assets + 1))
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static Asset      assets [MAX_ASSETS];
+static FileHash   file_hashes [MAX_FILES];
+static int        num_file_hashes;
+static int        lru_head, lru_tail;     // most, least recently used
+static AssetStats asset_stats;
+
+/*____________________________________________________________________
+|
+| Function: Asset_Init
+|
+| Input: Called from Program_Run()
+| Output: Starts the cache with a memory budget in bytes.
+|___________________________________________________________________*/
+
+void Asset_Init (unsigned budget)
+{
+  memset (assets, 0, sizeof(assets));
+  num_file_hashes = 0;
+  lru_head = -1;
+  lru_tail = -1;
+  memset (&asset_stats, 0, sizeof(asset_stats));
+  asset_stats.budget = budget;
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Free
+|
+| Input: Called from Program_Run()
+| Output: Frees every asset, referenced or not.
+|___________________________________________________________________*/
+
+void Asset_Free ()
+{
+  int i;
+
+  for (i=0; i<MAX_ASSETS; i++)
+    if (assets[i].type != ASSET_FREE)
+      Free_Asset (&assets[i]);
+  lru_head = -1;
+  lru_tail = -1;
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Load_Object
+|
+| Input: Called from ____
+| Output: Returns a handle to a model, loading it if it isn't already
+|   loaded.  Returns 0 on any error.
+|___________________________________________________________________*/
+
+AssetHandle Asset_Load_Object (const char *filename, unsigned vertex_format, unsigned flags)
+{
+  unsigned long long hash;
+  unsigned size;
+  Asset *a;
+
+  if (NOT Get_File_Hash (filename, &hash, &size))
+    return (0);
+
+  // Mipmap option doesn't matter if textures aren't loaded
+  if (flags & gx3d_DONT_LOAD_TEXTURES)
+    flags &= ~gx3d_DONT_GENERATE_MIPMAPS;
+
+  a = Find_Asset (ASSET_OBJECT, hash, 0, vertex_format, flags);
+  if (a == NULL) {
+    a = New_Asset ();
+    if (a == NULL)
+      return (0);
+    gx3d_ReadLWO2File ((char *)filename, &a->object, vertex_format, flags);
+    if (a->object == NULL)
+      return (0);
+    a->type     = ASSET_OBJECT;
+    a->hash[0]  = hash;
+    a->hash[1]  = 0;
+    a->files[0] = Find_File (filename);
+    a->files[1] = -1;
+    a->format  = vertex_format;
+    a->flags   = flags;
+    a->bytes   = size;
+    asset_stats.bytes += a->bytes;
+    asset_stats.num_assets++;
+    asset_stats.misses++;
+    Enforce_Budget ();
+  }
+
+  return (HANDLE_OF (a));
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Load_Texture
+|
+| Input: Called from ____
+| Output: Returns a handle to a texture, loading it if it isn't already
+|   loaded.  Returns 0 on any error.
+|___________________________________________________________________*/
+
+AssetHandle Asset_Load_Texture (const char *color_file, const char *alpha_file, unsigned flags)
+{
+  int dx, dy, bitdepth;
+  unsigned long long color_hash, alpha_hash;
+  unsigned size;
+  Asset *a;
+
+  if (NOT Get_File_Hash (color_file, &color_hash, &size))
+    return (0);
+  alpha_hash = 0;
+  if (alpha_file AND (NOT Get_File_Hash (alpha_file, &alpha_hash, &size)))
+    return (0);
+
+  a = Find_Asset (ASSET_TEXTURE, color_hash, alpha_hash, 0, flags);
+  if (a == NULL) {
+    a = New_Asset ();
+    if (a == NULL)
+      return (0);
+    a->texture = gx3d_InitTexture_File ((char *)color_file, (char *)alpha_file, flags);
+    if (a->texture == 0)
+      return (0);
+    a->type     = ASSET_TEXTURE;
+    a->hash[0]  = color_hash;
+    a->hash[1]  = alpha_hash;
+    a->files[0] = Find_File (color_file);
+    a->files[1] = alpha_file ? Find_File (alpha_file) : -1;
+    a->format  = 0;
+    a->flags   = flags;
+    // 32 bits per pixel, mipmaps add a third
+    a->bytes = 0;
+    if (Bmp_Read_Info (color_file, &dx, &dy, &bitdepth))
+      a->bytes = dx * dy * 4 / 3 * 4;
+    asset_stats.bytes += a->bytes;
+    asset_stats.num_assets++;
+    asset_stats.misses++;
+    Enforce_Budget ();
+  }
+
+  return (HANDLE_OF (a));
+}
+
+/*____________________________________________________________________
+|
+| Function: Find_Asset
+|
+| Input: Called from Asset_Load_Object(), Asset_Load_Texture()
+| Output: Returns a loaded asset with the same contents and options
+|   after adding a reference to it, or NULL if not found.
+|___________________________________________________________________*/
+
+static Asset *Find_Asset (int type, unsigned long long hash0, unsigned long long hash1, unsigned format, unsigned flags)
+{
+  int i;
+  Asset *a;
+
+  for (i=0; i<MAX_ASSETS; i++) {
+    a = &assets[i];
+    if ((a->type == type) AND (a->hash[0] == hash0) AND (a->hash[1] == hash1) AND (a->format == format) AND (a->flags == flags)) {
+      if (a->refs == 0)
+        LRU_Remove (a);
+      a->refs++;
+      asset_stats.hits++;
+      return (a);
+    }
+  }
+
+  return (NULL);
+}
+
+/*____________________________________________________________________
+|
+| Function: New_Asset
+|
+| Input: Called from Asset_Load_Object(), Asset_Load_Texture()
+| Output: Returns a free slot with 1 reference.  If there are no free
+|   slots the least recently used unused asset is freed.  Returns NULL
+|   if every slot is in use.
+|___________________________________________________________________*/
+
+static Asset *New_Asset ()
+{
+  int i;
+  Asset *a = NULL;
+
+  for (i=0; (i < MAX_ASSETS) AND (a == NULL); i++)
+    if (assets[i].type == ASSET_FREE)
+      a = &assets[i];
+  if ((a == NULL) AND (lru_tail != -1)) {
+    a = &assets[lru_tail];
+    Free_Asset (a);
+    asset_stats.evictions++;
+  }
+  if (a) {
+    a->refs    = 1;
+    a->object  = NULL;
+    a->texture = 0;
+  }
+
+  return (a);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_File_Hash
+|
+| Input: Called from Asset_Load_Object(), Asset_Load_Texture()
+| Output: Gets the hash of a file's contents, from the table if the
+|   file hasn't changed since it was hashed.  Returns true on success,
+|   else false.
+|___________________________________________________________________*/
+
+static bool Get_File_Hash (const char *filename, unsigned long long *hash, unsigned *size)
+{
+  int i;
+  unsigned long long time;
+  const void *data;
+  FileHash *f;
+
+  if (NOT File_Get_Info (filename, size, &time))
+    return (false);
+
+  f = NULL;
+  for (i=0; i<num_file_hashes; i++)
+    if (strcmp (file_hashes[i].name, filename) == 0) {
+      f = &file_hashes[i];
+      if ((f->size == *size) AND (f->time == time)) {
+        *hash = f->hash;
+        return (true);
+      }
+      break;
+    }
+
+  data = File_Map (filename, size);
+  if (data == NULL)
+    return (false);
+  *hash = File_Hash (data, *size);
+  File_Unmap (data, *size);
+
+  Asset_Set_File_Hash (filename, *size, time, *hash);
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Free_Asset
+|
+| Input: Called from Asset_Free(), New_Asset(), Enforce_Budget()
+| Output: Frees an asset and its slot.
+|___________________________________________________________________*/
+
+static void Free_Asset (Asset *a)
+{
+  if (a->refs == 0)
+    LRU_Remove (a);
+  if (a->type == ASSET_OBJECT)
+    gx3d_FreeObject (a->object);
+  else if (a->type == ASSET_TEXTURE)
+    gx3d_FreeTexture (a->texture);
+  asset_stats.bytes -= a->bytes;
+  asset_stats.num_assets--;
+  a->type = ASSET_FREE;
+  a->refs = 0;
+  a->generation = (a->generation + 1) & 0xFFFF;
+}
+
+/*____________________________________________________________________
+|
+| Function: Enforce_Budget
+|
+| Input: Called from Asset_Load_Object(), Asset_Load_Texture(),
+|   Asset_Release()
+| Output: Frees unused assets, least recently used first, until memory
+|   is under budget.  Assets in use are never freed, so memory can stay
+|   over budget.
+|___________________________________________________________________*/
+
+static void Enforce_Budget ()
+{
+  while ((asset_stats.bytes > asset_stats.budget) AND (lru_tail != -1)) {
+    Free_Asset (&assets[lru_tail]);
+    asset_stats.evictions++;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: LRU_Remove
+|
+| Input: Called from Find_Asset(), Free_Asset()
+| Output: Removes an asset from the LRU list.
+|___________________________________________________________________*/
+
+static void LRU_Remove (Asset *a)
+{
+  if (a->prev != -1)
+    assets[a->prev].next = a->next;
+  else
+    lru_head = a->next;
+  if (a->next != -1)
+    assets[a->next].prev = a->prev;
+  else
+    lru_tail = a->prev;
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Asset
+|
+| Input: Called from Asset_Get_Object(), Asset_Get_Texture(),
+|   Asset_Add_Ref(), Asset_Release()
+| Output: Returns the asset of a handle, or NULL if the handle is 0 or
+|   its asset was freed.
+|___________________________________________________________________*/
+
+static Asset *Get_Asset (AssetHandle handle)
+{
+  unsigned slot = (handle & 0xFFFF) - 1;
+  Asset *a;
+
+  if (slot >= MAX_ASSETS)
+    return (NULL);
+  a = &assets[slot];
+  if ((a->type == ASSET_FREE) OR (a->generation != (handle >> 16)))
+    return (NULL);
+
+  return (a);
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Set_File_Hash
+|
+| Input: Called from Get_File_Hash(), Stream_Update(), Asset_Reload()
+| Output: Remembers the hash of a file, so a file hashed elsewhere
+|   (like on a loading thread) isn't read again.
+|___________________________________________________________________*/
+
+void Asset_Set_File_Hash (const char *filename, unsigned size, unsigned long long write_time, unsigned long long hash)
+{
+  int i;
+  FileHash *f = NULL;
+
+  i = Find_File (filename);
+  if (i != -1)
+    f = &file_hashes[i];
+
+  // Remember it (if room)
+  if ((f == NULL) AND (num_file_hashes < MAX_FILES) AND (strlen (filename) < MAX_PATH_SIZE)) {
+    f = &file_hashes[num_file_hashes++];
+    strcpy (f->name, filename);
+  }
+  if (f) {
+    f->size = size;
+    f->time = write_time;
+    f->hash = hash;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Find_File
+|
+| Input: Called from Asset_Load_Object(), Asset_Load_Texture(),
+|   Asset_Set_File_Hash(), Asset_Reload()
+| Output: Returns the index of a file in the hash table, or -1 if not
+|   found.
+|___________________________________________________________________*/
+
+static int Find_File (const char *filename)
+{
+  int i;
+
+  for (i=0; i<num_file_hashes; i++)
+    if (strcmp (file_hashes[i].name, filename) == 0)
+      return (i);
+
+  return (-1);
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Reload
+|
+| Input: Called from Program_Run()
+| Output: Loads every asset using a file again, if the file's contents
+|   changed, into the same slot.  The old object or texture is freed,
+|   so call between frames.  An asset that fails to load keeps the old
+|   one.  Returns # of assets loaded again.
+|___________________________________________________________________*/
+
+int Asset_Reload (const char *filename, unsigned size, unsigned long long write_time, unsigned long long hash)
+{
+  int i, j, f, n, dx, dy, bitdepth;
+  gx3dObject *object;
+  gx3dTexture texture;
+  Asset *a;
+
+  f = Find_File (filename);
+  if ((f == -1) OR (file_hashes[f].hash == hash)) {
+    Asset_Set_File_Hash (filename, size, write_time, hash);
+    return (0);
+  }
+  Asset_Set_File_Hash (filename, size, write_time, hash);
+
+  n = 0;
+  for (i=0; i<MAX_ASSETS; i++) {
+    a = &assets[i];
+    if ((a->type == ASSET_FREE) OR ((a->files[0] != f) AND (a->files[1] != f)))
+      continue;
+    if (a->type == ASSET_OBJECT) {
+      object = NULL;
+      gx3d_ReadLWO2File ((char *)filename, &object, a->format, a->flags);
+      if (object == NULL)
+        continue;
+      gx3d_FreeObject (a->object);
+      a->object = object;
+      asset_stats.bytes += size - a->bytes;
+      a->bytes = size;
+    }
+    else {
+      texture = gx3d_InitTexture_File (file_hashes[a->files[0]].name, (a->files[1] != -1) ? file_hashes[a->files[1]].name : NULL, a->flags);
+      if (texture == 0)
+        continue;
+      gx3d_FreeTexture (a->texture);
+      a->texture = texture;
+      if (Bmp_Read_Info (file_hashes[a->files[0]].name, &dx, &dy, &bitdepth)) {
+        asset_stats.bytes += dx * dy * 4 / 3 * 4 - a->bytes;
+        a->bytes = dx * dy * 4 / 3 * 4;
+      }
+    }
+    for (j=0; j<2; j++)
+      if (a->files[j] == f)
+        a->hash[j] = hash;
+    n++;
+  }
+
+  return (n);
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Get_Object
+|
+| Input: Called from ____
+| Output: Returns the object of a handle, or NULL if none.
+|___________________________________________________________________*/
+
+gx3dObject *Asset_Get_Object (AssetHandle handle)
+{
+  Asset *a = Get_Asset (handle);
+
+  return (a ? a->object : NULL);
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Get_Texture
+|
+| Input: Called from ____
+| Output: Returns the texture of a handle, or 0 if none.
+|___________________________________________________________________*/
+
+gx3dTexture Asset_Get_Texture (AssetHandle handle)
+{
+  Asset *a = Get_Asset (handle);
+
+  return (a ? a->texture : 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Add_Ref
+|
+| Input: Called from ____
+| Output: Adds a reference to an asset.
+|___________________________________________________________________*/
+
+void Asset_Add_Ref (AssetHandle handle)
+{
+  Asset *a = Get_Asset (handle);
+
+  if (a) {
+    if (a->refs == 0)
+      LRU_Remove (a);
+    a->refs++;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Release
+|
+| Input: Called from ____
+| Output: Removes a reference.  An asset with no references goes on the
+|   front of the LRU list.
+|___________________________________________________________________*/
+
+void Asset_Release (AssetHandle handle)
+{
+  Asset *a = Get_Asset (handle);
+
+  if (a AND (a->refs > 0)) {
+    if (--a->refs == 0) {
+      a->prev = -1;
+      a->next = lru_head;
+      if (lru_head != -1)
+        assets[lru_head].prev = (int)(a - assets);
+      else
+        lru_tail = (int)(a - assets);
+      lru_head = (int)(a - assets);
+      Enforce_Budget ();
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Asset_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets hit/miss/evict counters and memory use.
+|___________________________________________________________________*/
+
+void Asset_Get_Stats (AssetStats *stats)
+{
+  *stats = asset_stats;
+}
@@ -0,0 +1,50 @@
+/*____________________________________________________________________
+|
+| File: asset.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// Handle to a loaded asset, 0 = none
+typedef unsigned AssetHandle;
+
+typedef struct {
+  int      hits;        // loads that found the asset already loaded
+  int      misses;      // loads that had to read files
+  int      evictions;   // unused assets freed to stay under the budget
+  int      num_assets;  // loaded now
+  unsigned bytes;       // estimated memory of loaded assets
+  unsigned budget;
+} AssetStats;
+
+// Starts the cache, unused assets are kept until their memory goes over budget (bytes)
+void Asset_Init (unsigned budget);
+
+// Frees every asset
+void Asset_Free ();
+
+// Loads a model (like gx3d_ReadLWO2File), returns 0 on any error
+AssetHandle Asset_Load_Object (const char *filename, unsigned vertex_format, unsigned flags);
+
+// Loads a texture (like gx3d_InitTexture_File), returns 0 on any error
+AssetHandle Asset_Load_Texture (const char *color_file, const char *alpha_file, unsigned flags);
+
+// Remembers the hash of a file's contents, so loading it doesn't read it again
+void Asset_Set_File_Hash (const char *filename, unsigned size, unsigned long long write_time, unsigned long long hash);
+
+// Loads every asset using a file again if its contents (hash) changed, handles stay the same, returns # of assets loaded
+int Asset_Reload (const char *filename, unsigned size, unsigned long long write_time, unsigned long long hash);
+
+// Gets the object or texture of a handle
+gx3dObject *Asset_Get_Object (AssetHandle handle);
+gx3dTexture Asset_Get_Texture (AssetHandle handle);
+
+// Adds a reference to an asset
+void Asset_Add_Ref (AssetHandle handle);
+
+// Removes a reference, an asset with no references may be freed
+void Asset_Release (AssetHandle handle);
+
+// Gets hit/miss/evict counters and memory use
+void Asset_Get_Stats (AssetStats *stats);
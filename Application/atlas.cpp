@@ -0,0 +1,422 @@
+/*____________________________________________________________________
+|
+| File: atlas.cpp
+|
+| Description: Builds a texture atlas from animation frames so all the
+|   frames can be drawn from one texture.  Each frame is a color BMP and
+|   an optional alpha (_fa) BMP.  The atlas is written as a color + alpha
+|   BMP pair that loads with gx3d_InitTexture_File() like any other
+|   texture.  A frame is picked at draw time with a texture matrix that
+|   maps the object's 0-1 texture coordinates into the frame's rect.
+|
+|   Each frame sits in a gutter of padding pixels filled with copies of
+|   its edge pixels, so filtering and the smaller mip levels blend a
+|   frame's edge with itself rather than with the frame next to it.  A
+|   frame that fits a power of 2 cell on its own but not with its gutter
+|   (512 + 8) is scaled down to fit it (504 + 8), else three 512x512
+|   frames would need a 1024x2048 atlas instead of 1024x1024.
+|
+|   The atlas files are only rewritten when a frame file is newer (or
+|   the atlas is a different size), so normally a build just reads BMP
+|   headers and packs the rects.
+|
+| Functions: Atlas_Build
+|             Pack_Frames
+|             Atlas_Is_Up_To_Date
+|             Fit_To_Cell
+|             Write_Atlas
+|             Scale_Frame
+|             Fill_Gutter
+|            Atlas_Get_Texture_Matrix
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+
+#include "dp.h"
+
+#include "bmp.h"
+#include "atlas.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  int src_dx, src_dy;   // size in the frame file
+  int dx, dy;           // size in the atlas
+  int x, y;             // position in atlas
+} AtlasFrame;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int  Pack_Frames (int num_frames, AtlasFrame *frames, int padding, int atlas_dx, int atlas_dy);
+static bool Atlas_Is_Up_To_Date (int num_frames, const char **color_files, const char **alpha_files, const char *atlas_color_file, const char *atlas_alpha_file, int atlas_dx, int atlas_dy);
+static int  Write_Atlas (int num_frames, AtlasFrame *frames, const char **color_files, const char **alpha_files, int padding, int atlas_dx, int atlas_dy, const char *atlas_color_file, const char *atlas_alpha_file);
+static int  Fit_To_Cell (int size, int padding);
+static void Scale_Frame (byte *src, AtlasFrame *frame, byte *atlas, int atlas_dx);
+static void Fill_Gutter (byte *atlas, int atlas_dx, AtlasFrame *frame, int padding);
+
+/*____________________________________________________________________
+|
+| Function: Atlas_Build
+|
+| Input: Called from Program_Run()
+| Output: Packs frames into the smallest power of 2 atlas they fit in
+|   and writes the atlas files if they are out of date.  Returns true on
+|   success, else false.
+|___________________________________________________________________*/
+
+int Atlas_Build (
+  int          num_frames,
+  const char **color_files,
+  const char **alpha_files,      // NULL entries are opaque
+  int          padding,          // gutter pixels between frames (and around the edge)
+  const char  *atlas_color_file,
+  const char  *atlas_alpha_file,
+  AtlasRect   *rects,            // returns area of each frame
+  AtlasReport *report )
+{
+  int i, bitdepth, dx, dy, used, size, best_dx, best_dy;
+  AtlasFrame frames[ATLAS_MAX_FRAMES];
+
+  if ((num_frames <= 0) OR (num_frames > ATLAS_MAX_FRAMES) OR (padding < 0))
+    return (FALSE);
+
+  // Get frame sizes, shrinking any that only overflow their cell by the gutter
+  used = 0;
+  for (i=0; i<num_frames; i++) {
+    if (NOT Bmp_Read_Info (color_files[i], &frames[i].src_dx, &frames[i].src_dy, &bitdepth))
+      return (FALSE);
+    frames[i].dx = Fit_To_Cell (frames[i].src_dx, padding);
+    frames[i].dy = Fit_To_Cell (frames[i].src_dy, padding);
+    used += (frames[i].dx + padding) * (frames[i].dy + padding);
+  }
+
+/*____________________________________________________________________
+|
+| Try power of 2 sizes, smallest area first (squarer first on a tie)
+|___________________________________________________________________*/
+
+  best_dx = 0;
+  best_dy = 0;
+  for (size=1; (size <= ATLAS_MAX_SIZE * ATLAS_MAX_SIZE) AND (best_dx == 0); size*=2) {
+    if (size < used)
+      continue;
+    for (dx=1; dx<=ATLAS_MAX_SIZE; dx*=2) {
+      dy = size / dx;
+      if ((dy > ATLAS_MAX_SIZE) OR (dy < 1))
+        continue;
+      if (Pack_Frames (num_frames, frames, padding, dx, dy)) {
+        // Keep the squarest layout of this area
+        if ((best_dx == 0) OR (abs (dx - dy) < abs (best_dx - best_dy))) {
+          best_dx = dx;
+          best_dy = dy;
+        }
+      }
+    }
+  }
+  if (best_dx == 0)
+    return (FALSE);
+  Pack_Frames (num_frames, frames, padding, best_dx, best_dy);
+
+/*____________________________________________________________________
+|
+| Build rect table and report
+|___________________________________________________________________*/
+
+  for (i=0; i<num_frames; i++) {
+    rects[i].u  = (float)frames[i].x  / best_dx;
+    rects[i].v  = (float)frames[i].y  / best_dy;
+    rects[i].du = (float)frames[i].dx / best_dx;
+    rects[i].dv = (float)frames[i].dy / best_dy;
+  }
+  report->dx          = best_dx;
+  report->dy          = best_dy;
+  report->used_pixels = 0;
+  report->scaled      = 0;
+  for (i=0; i<num_frames; i++) {
+    report->used_pixels += frames[i].dx * frames[i].dy;
+    if ((frames[i].dx != frames[i].src_dx) OR (frames[i].dy != frames[i].src_dy))
+      report->scaled++;
+  }
+  report->efficiency  = (float)report->used_pixels / ((float)best_dx * best_dy);
+  report->rebuilt     = false;
+
+  // Write atlas files?
+  if (NOT Atlas_Is_Up_To_Date (num_frames, color_files, alpha_files, atlas_color_file, atlas_alpha_file, best_dx, best_dy)) {
+    if (NOT Write_Atlas (num_frames, frames, color_files, alpha_files, padding, best_dx, best_dy, atlas_color_file, atlas_alpha_file))
+      return (FALSE);
+    report->rebuilt = true;
+  }
+
+  return (TRUE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pack_Frames
+|
+| Input: Called from Atlas_Build()
+| Output: Shelf packs frames (tallest first) into an atlas of the given
+|   size, each in a cell padding pixels bigger with the frame in the
+|   middle.  Returns true if they all fit.
+|___________________________________________________________________*/
+
+static int Pack_Frames (int num_frames, AtlasFrame *frames, int padding, int atlas_dx, int atlas_dy)
+{
+  int i, j, n, x, y, shelf_dy;
+  int order[ATLAS_MAX_FRAMES];
+
+  // Sort by height, tallest first (insertion sort keeps equal frames in order)
+  for (i=0; i<num_frames; i++) {
+    n = i;
+    for (j=i; (j > 0) AND (frames[order[j-1]].dy < frames[i].dy); j--)
+      order[j] = order[j-1];
+    order[j] = n;
+  }
+
+  x = 0;
+  y = 0;
+  shelf_dy = 0;
+  for (i=0; i<num_frames; i++) {
+    n = order[i];
+    // Start a new shelf?
+    if (x + frames[n].dx + padding > atlas_dx) {
+      x = 0;
+      y += shelf_dy;
+      shelf_dy = 0;
+    }
+    if ((frames[n].dx + padding > atlas_dx) OR (y + frames[n].dy + padding > atlas_dy))
+      return (FALSE);
+    frames[n].x = x + padding / 2;
+    frames[n].y = y + padding / 2;
+    x += frames[n].dx + padding;
+    if (frames[n].dy + padding > shelf_dy)
+      shelf_dy = frames[n].dy + padding;
+  }
+
+  return (TRUE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Fit_To_Cell
+|
+| Input: Called from Atlas_Build()
+| Output: Returns the size of a frame side in the atlas.  If the side
+|   fits a power of 2 but not with its gutter, it is shrunk so it does,
+|   unless that would leave less than half of it.
+|___________________________________________________________________*/
+
+static int Fit_To_Cell (int size, int padding)
+{
+  int cell;
+
+  for (cell=1; cell<size; cell*=2);
+  if ((size + padding > cell) AND (cell - padding >= size / 2))
+    size = cell - padding;
+
+  return (size);
+}
+
+/*____________________________________________________________________
+|
+| Function: Atlas_Is_Up_To_Date
+|
+| Input: Called from Atlas_Build()
+| Output: Returns true if both atlas files exist, are the size packed
+|   and are newer than all of the frame files.
+|___________________________________________________________________*/
+
+static bool Atlas_Is_Up_To_Date (int num_frames, const char **color_files, const char **alpha_files, const char *atlas_color_file, const char *atlas_alpha_file, int atlas_dx, int atlas_dy)
+{
+  int i, dx, dy, bitdepth;
+  WIN32_FILE_ATTRIBUTE_DATA color_info, alpha_info, frame_info;
+
+  // Packed with another padding, say
+  if (NOT Bmp_Read_Info (atlas_color_file, &dx, &dy, &bitdepth))
+    return (false);
+  if ((dx != atlas_dx) OR (dy != atlas_dy))
+    return (false);
+
+  if (NOT GetFileAttributesEx (atlas_color_file, GetFileExInfoStandard, &color_info))
+    return (false);
+  if (NOT GetFileAttributesEx (atlas_alpha_file, GetFileExInfoStandard, &alpha_info))
+    return (false);
+
+  for (i=0; i<num_frames; i++) {
+    if (NOT GetFileAttributesEx (color_files[i], GetFileExInfoStandard, &frame_info))
+      return (false);
+    if ((CompareFileTime (&frame_info.ftLastWriteTime, &color_info.ftLastWriteTime) > 0) OR
+        (CompareFileTime (&frame_info.ftLastWriteTime, &alpha_info.ftLastWriteTime) > 0))
+      return (false);
+    if (alpha_files[i]) {
+      if (NOT GetFileAttributesEx (alpha_files[i], GetFileExInfoStandard, &frame_info))
+        return (false);
+      if (CompareFileTime (&frame_info.ftLastWriteTime, &alpha_info.ftLastWriteTime) > 0)
+        return (false);
+    }
+  }
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Write_Atlas
+|
+| Input: Called from Atlas_Build()
+| Output: Decodes frame pixels into place (scaled frames through a
+|   scratch buffer), fills their gutters and writes the atlas color and
+|   alpha files.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+static int Write_Atlas (int num_frames, AtlasFrame *frames, const char **color_files, const char **alpha_files, int padding, int atlas_dx, int atlas_dy, const char *atlas_color_file, const char *atlas_alpha_file)
+{
+  int i, ok;
+  byte *atlas, *src;
+
+  // Unused area is black and fully transparent
+  atlas = (byte *) calloc (atlas_dx * atlas_dy, 4);
+  if (atlas == NULL)
+    return (FALSE);
+
+  // Decode each frame straight into place, alpha is the red channel of the alpha map
+  ok = TRUE;
+  for (i=0; ok AND (i<num_frames); i++) {
+    if ((frames[i].dx == frames[i].src_dx) AND (frames[i].dy == frames[i].src_dy))
+      ok = Bmp_Decode (color_files[i], alpha_files[i], atlas + (frames[i].y * atlas_dx + frames[i].x) * 4, frames[i].dx, frames[i].dy, atlas_dx * 4);
+    else {
+      src = (byte *) malloc (frames[i].src_dx * frames[i].src_dy * 4);
+      ok = (src != NULL) AND Bmp_Decode (color_files[i], alpha_files[i], src, frames[i].src_dx, frames[i].src_dy, frames[i].src_dx * 4);
+      if (ok)
+        Scale_Frame (src, &frames[i], atlas, atlas_dx);
+      free (src);
+    }
+    if (ok AND padding)
+      Fill_Gutter (atlas, atlas_dx, &frames[i], padding);
+  }
+
+  if (ok)
+    ok = Bmp_Write (atlas_color_file, atlas, atlas_dx, atlas_dy, BMP_WRITE_COLOR) AND
+         Bmp_Write (atlas_alpha_file, atlas, atlas_dx, atlas_dy, BMP_WRITE_ALPHA);
+
+  free (atlas);
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Scale_Frame
+|
+| Input: Called from Write_Atlas()
+| Output: Resamples a decoded frame into its place in the atlas, with
+|   bilinear filtering (frames are only shrunk by a few pixels).
+|___________________________________________________________________*/
+
+static void Scale_Frame (byte *src, AtlasFrame *frame, byte *atlas, int atlas_dx)
+{
+  int x, y, c, x0, y0, x1, y1;
+  float sx, sy, fx, fy, scale_x, scale_y;
+  byte *dst, *p00, *p01, *p10, *p11;
+
+  scale_x = (float)frame->src_dx / frame->dx;
+  scale_y = (float)frame->src_dy / frame->dy;
+  for (y=0; y<frame->dy; y++) {
+    // Pixel centers line up with pixel centers
+    sy = (y + 0.5f) * scale_y - 0.5f;
+    if (sy < 0)
+      sy = 0;
+    y0 = (int)sy;
+    y1 = (y0 + 1 < frame->src_dy) ? y0 + 1 : y0;
+    fy = sy - y0;
+    dst = atlas + ((frame->y + y) * atlas_dx + frame->x) * 4;
+    for (x=0; x<frame->dx; x++, dst+=4) {
+      sx = (x + 0.5f) * scale_x - 0.5f;
+      if (sx < 0)
+        sx = 0;
+      x0 = (int)sx;
+      x1 = (x0 + 1 < frame->src_dx) ? x0 + 1 : x0;
+      fx = sx - x0;
+      p00 = src + (y0 * frame->src_dx + x0) * 4;
+      p01 = src + (y0 * frame->src_dx + x1) * 4;
+      p10 = src + (y1 * frame->src_dx + x0) * 4;
+      p11 = src + (y1 * frame->src_dx + x1) * 4;
+      for (c=0; c<4; c++)
+        dst[c] = (byte)((p00[c] * (1 - fx) + p01[c] * fx) * (1 - fy) + (p10[c] * (1 - fx) + p11[c] * fx) * fy + 0.5f);
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Fill_Gutter
+|
+| Input: Called from Write_Atlas()
+| Output: Copies a frame's edge pixels out over its cell (padding / 2
+|   pixels left and above, the rest right and below), corners from the
+|   corner pixels.
+|___________________________________________________________________*/
+
+static void Fill_Gutter (byte *atlas, int atlas_dx, AtlasFrame *frame, int padding)
+{
+  int x, y, sx, sy, x0, y0, x1, y1;
+
+  x0 = frame->x - padding / 2;
+  y0 = frame->y - padding / 2;
+  x1 = x0 + frame->dx + padding;
+  y1 = y0 + frame->dy + padding;
+
+  for (y=y0; y<y1; y++) {
+    // Nearest row of the frame
+    sy = y;
+    if (sy < frame->y)
+      sy = frame->y;
+    else if (sy >= frame->y + frame->dy)
+      sy = frame->y + frame->dy - 1;
+    for (x=x0; x<x1; x++) {
+      // Inside the frame?
+      if ((y == sy) AND (x >= frame->x) AND (x < frame->x + frame->dx)) {
+        x = frame->x + frame->dx - 1;
+        continue;
+      }
+      sx = x;
+      if (sx < frame->x)
+        sx = frame->x;
+      else if (sx >= frame->x + frame->dx)
+        sx = frame->x + frame->dx - 1;
+      memcpy (atlas + (y * atlas_dx + x) * 4, atlas + (sy * atlas_dx + sx) * 4, 4);
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Atlas_Get_Texture_Matrix
+|
+| Input: Called from ____
+| Output: Gets a texture matrix that maps 0-1 texture coordinates into
+|   a frame's rect (scale, then translate).
+|___________________________________________________________________*/
+
+void Atlas_Get_Texture_Matrix (AtlasRect *rect, gx3dMatrix *m)
+{
+  gx3dMatrix ms, mt;
+
+  gx3d_GetScaleMatrix (&ms, rect->du, rect->dv, 1);
+  gx3d_GetTranslateTextureMatrix (&mt, rect->u, rect->v);
+  gx3d_MultiplyMatrix (&ms, &mt, m);
+}
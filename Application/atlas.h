@@ -0,0 +1,38 @@
+/*____________________________________________________________________
+|
+| File: atlas.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define ATLAS_MAX_FRAMES 64
+#define ATLAS_MAX_SIZE   4096
+
+// Area of one frame in the atlas, in texture coordinates
+typedef struct {
+  float u, v;
+  float du, dv;
+} AtlasRect;
+
+typedef struct {
+  int   dx, dy;       // atlas size
+  int   used_pixels;  // pixels covered by frames
+  int   scaled;       // frames shrunk so they fit a power of 2 cell with their gutter
+  float efficiency;   // used_pixels / atlas pixels
+  bool  rebuilt;      // true if atlas files were written, false if they were up to date
+} AtlasReport;
+
+// Packs frames (color + alpha BMP files) into one atlas color + alpha BMP pair, returns true on success
+int Atlas_Build (
+  int          num_frames,
+  const char **color_files,
+  const char **alpha_files,      // NULL entries are opaque
+  int          padding,          // gutter pixels between frames (and around the edge) filled with their edge pixels, frames may be shrunk to make room
+  const char  *atlas_color_file,
+  const char  *atlas_alpha_file,
+  AtlasRect   *rects,            // returns area of each frame
+  AtlasReport *report );
+
+// Gets a texture matrix that maps 0-1 texture coordinates into a frame
+void Atlas_Get_Texture_Matrix (AtlasRect *rect, gx3dMatrix *m);
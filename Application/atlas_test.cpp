@@ -0,0 +1,375 @@
+/*____________________________________________________________________
+|
+| File: atlas_test.cpp
+|
+| Description: Packs the ghost animation frames with atlas.cpp, the way
+|   the game does, and checks the atlas: its size, that no frame's cell
+|   overlaps another and that every gutter pixel is a copy of the
+|   nearest edge pixel of its frame, in color and alpha.
+|
+|   Then counts the state changes transparent.cpp makes drawing 10,000
+|   ghosts, half near (blended, back to front) and half far (alpha
+|   tested), each on a random animation frame:
+|     atlas          one texture, a texture matrix per frame, the far
+|                    ghosts in order of frame (as main.cpp adds them)
+|     atlas unsorted the same with the far ghosts in ghost order
+|     textures       a texture per frame, no texture matrix
+|   The gx3d calls go to a null device in this file that counts them,
+|   so only the calls are measured, not what the driver does with them.
+|
+|   A standalone program, not part of the game build.  Build it in
+|   Application\ with the game's include path (the gx headers, not the
+|   gx libraries):
+|     cl /EHsc /I c:\dev2012w7\inc atlas_test.cpp atlas.cpp bmp.cpp filemap.cpp transparent.cpp arena.cpp
+|   Run from the project directory (it reads Objects\Images\ and writes
+|   atlas_test.bmp and atlas_test_fa.bmp).  Returns 0 if the atlas
+|   checked out and the atlas runs set the texture once per draw and
+|   the texture matrix at most once per frame for the far ghosts.
+|
+| Functions: main
+|             Check_Atlas
+|             Draw_Ghosts
+|             Draw_Ghost
+|             Get_Time
+|            gx3d null device (texture and matrix calls used by
+|             atlas.cpp and transparent.cpp)
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+
+#include "dp.h"
+
+#include "arena.h"
+#include "bmp.h"
+#include "atlas.h"
+#include "transparent.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define NUM_FRAMES   3
+#define PADDING      8          // as main.cpp packs the ghost atlas
+#define NUM_GHOSTS   10000
+#define NEAR_DEPTH   500        // ghosts nearer than this are blended
+#define FAR_PLANE    1000
+#define DRAWS        100        // of each case, for the time
+
+#define CASE_ATLAS          0
+#define CASE_ATLAS_UNSORTED 1
+#define CASE_TEXTURES       2
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  int texture_sets, matrix_sets;    // while alpha testing (far ghosts)
+} DeviceCounts;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int    Check_Atlas (AtlasRect *rects, AtlasReport *report);
+static int    Draw_Ghosts (int type, float *depth, int *frame, gx3dMatrix *frame_matrix);
+static void   Draw_Ghost (void *params, int item);
+static double Get_Time ();
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static const char *color_files[NUM_FRAMES] = { "Objects\\Images\\ghost.bmp", "Objects\\Images\\ghost1.bmp", "Objects\\Images\\ghost2.bmp" };
+static const char *alpha_files[NUM_FRAMES] = { "Objects\\Images\\ghost_fa.bmp", "Objects\\Images\\ghost_fa1.bmp", "Objects\\Images\\ghost_fa2.bmp" };
+
+// Null device counts, [0] blended and [1] tested
+static DeviceCounts device_counts[2];
+static int          alpha_testing;
+static int          draws;
+
+/*____________________________________________________________________
+|
+| Function: main
+|
+| Input: Called from the OS
+| Output: Builds and checks the atlas, then draws the ghosts each way
+|   and prints the state changes.  Returns 0 if all checks passed.
+|___________________________________________________________________*/
+
+int main ()
+{
+  int i, failed;
+  float depth[NUM_GHOSTS];
+  int frame[NUM_GHOSTS];
+  AtlasRect rects[NUM_FRAMES];
+  AtlasReport report;
+  gx3dMatrix frame_matrix[NUM_FRAMES];
+
+  // Always rebuild
+  remove ("atlas_test.bmp");
+  remove ("atlas_test_fa.bmp");
+  if (NOT Atlas_Build (NUM_FRAMES, color_files, alpha_files, PADDING, "atlas_test.bmp", "atlas_test_fa.bmp", rects, &report)) {
+    printf ("can't build the atlas from Objects\\Images\\ghost*.bmp\n");
+    return (1);
+  }
+  printf ("atlas %dx%d, %d of %d pixels used (%.1f%%), %d of %d frames scaled to fit\n", report.dx, report.dy, report.used_pixels,
+          report.dx * report.dy, report.efficiency * 100, report.scaled, NUM_FRAMES);
+  failed = Check_Atlas (rects, &report);
+  for (i=0; i<NUM_FRAMES; i++)
+    Atlas_Get_Texture_Matrix (&rects[i], &frame_matrix[i]);
+
+  // The same ghosts for every case
+  srand (1);
+  for (i=0; i<NUM_GHOSTS; i++) {
+    depth[i] = 1 + (float)rand () / RAND_MAX * (FAR_PLANE - 2);
+    frame[i] = rand () % NUM_FRAMES;
+  }
+
+  Arena_Init (0);
+  Transparent_Init (NUM_GHOSTS);
+  printf ("%d ghosts, %d draws of each:\n", NUM_GHOSTS, DRAWS);
+  for (i=CASE_ATLAS; i<=CASE_TEXTURES; i++)
+    failed += Draw_Ghosts (i, depth, frame, frame_matrix);
+  Transparent_Free ();
+  Arena_Free ();
+
+  return (failed ? 1 : 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Check_Atlas
+|
+| Input: Called from main()
+| Output: Reads the atlas back and checks the frame cells and their
+|   gutters.  Returns # of errors.
+|___________________________________________________________________*/
+
+static int Check_Atlas (AtlasRect *rects, AtlasReport *report)
+{
+  int i, j, x, y, sx, sy, errors, half;
+  int x0[NUM_FRAMES], y0[NUM_FRAMES], x1[NUM_FRAMES], y1[NUM_FRAMES];
+  byte *atlas, *p, *q;
+
+  atlas = (byte *) malloc (report->dx * report->dy * 4);
+  if (atlas == NULL)
+    return (1);
+  if (NOT Bmp_Decode ("atlas_test.bmp", "atlas_test_fa.bmp", atlas, report->dx, report->dy, report->dx * 4)) {
+    printf ("can't read the atlas back\n");
+    free (atlas);
+    return (1);
+  }
+
+  errors = 0;
+  half = PADDING / 2;
+  for (i=0; i<NUM_FRAMES; i++) {
+    // Frame in pixels
+    x0[i] = (int)(rects[i].u * report->dx + 0.5f);
+    y0[i] = (int)(rects[i].v * report->dy + 0.5f);
+    x1[i] = x0[i] + (int)(rects[i].du * report->dx + 0.5f);
+    y1[i] = y0[i] + (int)(rects[i].dv * report->dy + 0.5f);
+    if ((x0[i] < half) OR (y0[i] < half) OR (x1[i] + half > report->dx) OR (y1[i] + half > report->dy)) {
+      printf ("frame %d's cell is outside the atlas\n", i);
+      errors++;
+      continue;
+    }
+    // Cells with their gutters must not overlap
+    for (j=0; j<i; j++)
+      if ((x0[i] - half < x1[j] + half) AND (x0[j] - half < x1[i] + half) AND
+          (y0[i] - half < y1[j] + half) AND (y0[j] - half < y1[i] + half)) {
+        printf ("frames %d and %d overlap\n", j, i);
+        errors++;
+      }
+    // Each gutter pixel must be the nearest frame pixel
+    for (y=y0[i]-half; y<y1[i]+half; y++)
+      for (x=x0[i]-half; x<x1[i]+half; x++) {
+        sx = (x < x0[i]) ? x0[i] : ((x >= x1[i]) ? x1[i] - 1 : x);
+        sy = (y < y0[i]) ? y0[i] : ((y >= y1[i]) ? y1[i] - 1 : y);
+        p = atlas + (y * report->dx + x) * 4;
+        q = atlas + (sy * report->dx + sx) * 4;
+        if (memcmp (p, q, 4) != 0) {
+          printf ("frame %d: gutter pixel %d,%d isn't a copy of %d,%d\n", i, x, y, sx, sy);
+          errors++;
+          y = y1[i] + half;
+          break;
+        }
+      }
+  }
+  free (atlas);
+  printf ("cells and gutters %s\n", errors ? "FAILED" : "ok");
+
+  return (errors);
+}
+
+/*____________________________________________________________________
+|
+| Function: Draw_Ghosts
+|
+| Input: Called from main()
+| Output: Adds and draws the ghosts DRAWS times one way, and prints the
+|   state changes of a draw and the time.  Returns # of errors.
+|___________________________________________________________________*/
+
+static int Draw_Ghosts (int type, float *depth, int *frame, gx3dMatrix *frame_matrix)
+{
+  int i, j, n, errors;
+  double start, t;
+  gx3dTexture texture, frame_texture[NUM_FRAMES];
+  gx3dMatrix *matrix;
+  static const char *names[] = { "atlas", "atlas unsorted", "textures" };
+
+  // Textures are only compared, any distinct handles will do
+  texture = (gx3dTexture)(size_t) 1;
+  for (i=0; i<NUM_FRAMES; i++)
+    frame_texture[i] = (gx3dTexture)(size_t)(i + 2);
+
+  start = Get_Time ();
+  for (n=0; n<DRAWS; n++) {
+    memset (device_counts, 0, sizeof(device_counts));
+    draws = 0;
+    Transparent_Begin (0, FAR_PLANE);
+    for (i=0; i<NUM_GHOSTS; i++)
+      if (depth[i] < NEAR_DEPTH) {
+        if (type == CASE_TEXTURES)
+          Transparent_Add (TRANSPARENT_BLENDED, depth[i], frame_texture[frame[i]], NULL, Draw_Ghost, NULL, i);
+        else
+          Transparent_Add (TRANSPARENT_BLENDED, depth[i], texture, &frame_matrix[frame[i]], Draw_Ghost, NULL, i);
+      }
+    // Far ghosts, by frame unless unsorted
+    for (j=0; j<((type == CASE_ATLAS_UNSORTED) ? 1 : NUM_FRAMES); j++)
+      for (i=0; i<NUM_GHOSTS; i++)
+        if ((depth[i] >= NEAR_DEPTH) AND ((type == CASE_ATLAS_UNSORTED) OR (frame[i] == j))) {
+          matrix = (type == CASE_TEXTURES) ? NULL : &frame_matrix[frame[i]];
+          Transparent_Add (TRANSPARENT_TESTED, 0, (type == CASE_TEXTURES) ? frame_texture[frame[i]] : texture, matrix, Draw_Ghost, NULL, i);
+        }
+    Transparent_Draw ();
+    Arena_Reset ();
+  }
+  t = (Get_Time () - start) / DRAWS;
+
+  printf ("  %-14s  %5d state changes: far %4d texture + %4d matrix, near %4d texture + %4d matrix, %d drawn, %.2f ms\n", names[type],
+          Transparent_Get_State_Changes (), device_counts[1].texture_sets, device_counts[1].matrix_sets,
+          device_counts[0].texture_sets, device_counts[0].matrix_sets, draws, t);
+
+  errors = 0;
+  if (draws != NUM_GHOSTS)
+    errors++;
+  if ((type == CASE_ATLAS) AND ((device_counts[0].texture_sets + device_counts[1].texture_sets != 1) OR (device_counts[1].matrix_sets > NUM_FRAMES)))
+    errors++;
+  if (errors)
+    printf ("  FAILED\n");
+
+  return (errors);
+}
+
+/*____________________________________________________________________
+|
+| Function: Draw_Ghost
+|
+| Input: Called from Transparent_Draw()
+| Output: Counts a draw.
+|___________________________________________________________________*/
+
+static void Draw_Ghost (void *params, int item)
+{
+  draws++;
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Draw_Ghosts()
+| Output: Returns the time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+}
+
+/*____________________________________________________________________
+|
+| gx3d null device: texture state is counted, matrices are built as
+| the real functions would (row vectors, texture translate in row 2)
+|___________________________________________________________________*/
+
+void gx3d_SetTexture (int stage, gx3dTexture texture)
+{
+  device_counts[alpha_testing].texture_sets++;
+}
+
+void gx3d_EnableTextureMatrix (int stage)
+{
+}
+
+void gx3d_DisableTextureMatrix (int stage)
+{
+}
+
+void gx3d_SetTextureMatrix (int stage, gx3dMatrix *m)
+{
+  device_counts[alpha_testing].matrix_sets++;
+}
+
+void gx3d_EnableAlphaTesting (int reference_value)
+{
+  alpha_testing = 1;
+}
+
+void gx3d_DisableAlphaTesting ()
+{
+  alpha_testing = 0;
+}
+
+void gx3d_GetScaleMatrix (gx3dMatrix *m, float x, float y, float z)
+{
+  memset (m, 0, sizeof(gx3dMatrix));
+  m->_00 = x;
+  m->_11 = y;
+  m->_22 = z;
+  m->_33 = 1;
+}
+
+void gx3d_GetTranslateTextureMatrix (gx3dMatrix *m, float u, float v)
+{
+  gx3d_GetScaleMatrix (m, 1, 1, 1);
+  m->_20 = u;
+  m->_21 = v;
+}
+
+void gx3d_MultiplyMatrix (gx3dMatrix *m1, gx3dMatrix *m2, gx3dMatrix *result)
+{
+  int i, j, k;
+  float *a, *b, *r;
+  gx3dMatrix t;
+
+  a = (float *) m1;
+  b = (float *) m2;
+  r = (float *) &t;
+  for (i=0; i<4; i++)
+    for (j=0; j<4; j++) {
+      r[i*4+j] = 0;
+      for (k=0; k<4; k++)
+        r[i*4+j] += a[i*4+k] * b[k*4+j];
+    }
+  *result = t;
+}
@@ -0,0 +1,831 @@
+/*____________________________________________________________________
+|
+| File: audio.cpp
+|
+| Description: Plays sounds on an audio thread so the game thread
+|   never waits on the mixer or the sound device.
+|
+|   The game thread doesn't call the mixer.  Each Audio_ call writes a
+|   small command into a ring that only the game thread writes and only
+|   the audio thread reads, so neither side takes a lock: the game
+|   thread moves the head after writing a command, the audio thread
+|   moves the tail after reading it.  Voice handles are given out by
+|   the game thread, so playing a sound returns at once.
+|
+|   The audio thread keeps AUDIO_BUFFERS buffers queued on the sound
+|   device (waveOut).  Before mixing each buffer it applies every
+|   command waiting.  Changes only store the new volume or position,
+|   which spatial.cpp and voices.cpp use once per buffer, so only the
+|   last change to a voice in a buffer costs anything.  Without Windows
+|   there is no device and the thread paces itself by the clock, for
+|   timing.
+|
+|   A buffer that isn't mixed by the time the device needs it is
+|   counted as a glitch.
+|
+|   Only uses the C library, the OS and mixer.cpp, voices.cpp and
+|   spatial.cpp.
+|
+| Functions: Audio_Init
+|            Audio_Free
+|            Audio_Load_Sound
+|            Audio_Start
+|             Audio_Thread
+|             Mix_Buffer
+|             Apply_Commands
+|             Copy_Output
+|            Audio_Play
+|            Audio_Play_3D
+|             Start_Voice
+|            Audio_Set_Volume
+|            Audio_Set_Position
+|            Audio_Set_Listener
+|            Audio_Stop
+|            Audio_Is_Playing
+|             Push
+|            Audio_Get_Stats
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "mixer.h"
+#include "voices.h"
+#include "spatial.h"
+#include "audio.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define COMMAND_PLAY      0
+#define COMMAND_STOP      1
+#define COMMAND_VOLUME    2
+#define COMMAND_POSITION  3
+#define COMMAND_LISTENER  4
+
+#define NOT_ENDED         0xFFFFFFFF
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  int        type;
+  AudioVoice voice;
+  MixerSound sound;
+  float      f [9];                 // play: volume, priority, 3d (0 or 1), x, y, z, min, max
+                                    // volume: volume, position: x, y, z, listener: x, y, z, forward, up
+} Command;
+
+// Audio thread side of a voice
+typedef struct {
+  unsigned     generation;
+  VirtualVoice voice;               // 0 = not playing
+  int          emitter;             // -1 = not 3D
+  float        volume;
+  int          changed;             // buffer of the last change
+} Slot;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+#ifdef _WIN32
+static unsigned __stdcall Audio_Thread (void *params);
+#else
+static void *Audio_Thread (void *params);
+#endif
+static void       Mix_Buffer (short *samples);
+static void       Apply_Commands ();
+static void       Copy_Output (const short *samples, int num_frames, void *data);
+static AudioVoice Start_Voice (Command *c);
+static bool       Push (Command *c);
+static double     Get_Time ();
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define HANDLE_OF(_i_,_g_) (((_g_) << 16) | (unsigned)((_i_) + 1))
+
+// Values shared between the threads without a lock
+#ifdef _WIN32
+// Volatile reads and writes are acquire and release with Visual C++
+#define LOAD_ACQUIRE(_x_)      (*(volatile unsigned *)&(_x_))
+#define STORE_RELEASE(_x_,_v_) (*(volatile unsigned *)&(_x_) = (_v_))
+#define YIELD()                Sleep (0)
+#else
+#define LOAD_ACQUIRE(_x_)      __atomic_load_n (&(_x_), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(_x_,_v_) __atomic_store_n (&(_x_), (_v_), __ATOMIC_RELEASE)
+#define YIELD()                sched_yield ()
+#endif
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static bool       audio_init = false;
+static bool       started;
+static unsigned   stopping;
+static int        audio_rate;
+static int        buffer_frames;
+
+#ifdef _WIN32
+static HWAVEOUT   device;
+static HANDLE     audio_thread;
+static HANDLE     done_event;       // set by the device when a buffer is played
+static HANDLE     stop_event;
+static WAVEHDR    headers [AUDIO_BUFFERS];
+#else
+static pthread_t  audio_thread;
+#endif
+static short     *buffer;           // AUDIO_BUFFERS buffers
+static short     *fill;             // buffer being mixed into
+static int        fill_frames;
+
+// Ring of commands, head and tail apart so the threads don't share a cache line
+static Command    queue [AUDIO_QUEUE_SIZE];
+static struct {
+  unsigned head;                    // commands written, by the game thread
+  char     pad1 [60];
+  unsigned tail;                    // commands read, by the audio thread
+  char     pad2 [60];
+} ring;
+
+// Game thread side of voices
+static unsigned   generation [AUDIO_MAX_VOICES];
+static bool       used [AUDIO_MAX_VOICES];
+static int        next_voice;
+static unsigned   ended [AUDIO_MAX_VOICES];   // generation that ended, written by the audio thread
+static int        game_commands, game_dropped;
+
+// Audio thread side
+static Slot       slots [AUDIO_MAX_VOICES];
+static int        listener_changed;
+static AudioStats audio_stats;
+
+/*____________________________________________________________________
+|
+| Function: Audio_Init
+|
+| Input: Called from ____
+| Output: Starts the mixer, voices and spatialization.  Returns true
+|   on success, else false.
+|___________________________________________________________________*/
+
+bool Audio_Init (int rate)
+{
+  int i;
+
+  if (audio_init)
+    return (false);
+
+  if (!Mixer_Init (rate, MIXER_SINK_CALLBACK, NULL, Copy_Output, NULL))
+    return (false);
+  if (!Voice_Init (AUDIO_MAX_VOICES, AUDIO_MAX_REAL, rate)) {
+    Mixer_Free ();
+    return (false);
+  }
+  if (!Spatial_Init (AUDIO_MAX_VOICES)) {
+    Voice_Free ();
+    Mixer_Free ();
+    return (false);
+  }
+
+  audio_rate    = rate;
+  buffer_frames = rate * AUDIO_BUFFER_MS / 1000;
+  buffer = (short *) malloc (AUDIO_BUFFERS * buffer_frames * 2 * sizeof(short));
+  if (buffer == NULL) {
+    Spatial_Free ();
+    Voice_Free ();
+    Mixer_Free ();
+    return (false);
+  }
+
+  ring.head = 0;
+  ring.tail = 0;
+  for (i=0; i<AUDIO_MAX_VOICES; i++) {
+    generation[i] = 0;
+    used[i]       = false;
+    ended[i]      = NOT_ENDED;
+    slots[i].voice   = 0;
+    slots[i].emitter = -1;
+    slots[i].changed = -1;
+  }
+  next_voice       = 0;
+  game_commands    = 0;
+  game_dropped     = 0;
+  listener_changed = -1;
+  memset (&audio_stats, 0, sizeof(audio_stats));
+  started  = false;
+  stopping = 0;
+  audio_init = true;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Free
+|
+| Input: Called from ____
+| Output: Stops the audio thread, closes the device and frees all
+|   sounds.
+|___________________________________________________________________*/
+
+void Audio_Free ()
+{
+#ifdef _WIN32
+  int i;
+#endif
+
+  if (!audio_init)
+    return;
+
+  if (started) {
+    STORE_RELEASE (stopping, 1);
+#ifdef _WIN32
+    SetEvent (stop_event);
+    WaitForSingleObject (audio_thread, INFINITE);
+    CloseHandle (audio_thread);
+    waveOutReset (device);
+    for (i=0; i<AUDIO_BUFFERS; i++)
+      waveOutUnprepareHeader (device, &headers[i], sizeof(WAVEHDR));
+    waveOutClose (device);
+    CloseHandle (done_event);
+    CloseHandle (stop_event);
+#else
+    pthread_join (audio_thread, NULL);
+#endif
+  }
+
+  Spatial_Free ();
+  Voice_Free ();
+  Mixer_Free ();
+  free (buffer);
+  buffer = NULL;
+  audio_init = false;
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Load_Sound
+|
+| Input: Called from ____
+| Output: Loads a wave file as a sound, kept as ADPCM if compress is
+|   true.  Returns the sound, or 0 on error or once the audio thread
+|   has started.
+|___________________________________________________________________*/
+
+MixerSound Audio_Load_Sound (const char *filename, bool loop, bool compress)
+{
+  if ((!audio_init) || started)
+    return (0);
+
+  return (Mixer_Load_Sound (filename, loop, compress));
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Start
+|
+| Input: Called from ____
+| Output: Opens the sound device and starts the audio thread.  Returns
+|   true on success, else false.
+|___________________________________________________________________*/
+
+bool Audio_Start ()
+{
+#ifdef _WIN32
+  int i;
+  WAVEFORMATEX wfx;
+#endif
+
+  if ((!audio_init) || started)
+    return (false);
+
+#ifdef _WIN32
+  memset (&wfx, 0, sizeof(wfx));
+  wfx.wFormatTag      = WAVE_FORMAT_PCM;
+  wfx.nChannels       = 2;
+  wfx.nSamplesPerSec  = audio_rate;
+  wfx.wBitsPerSample  = 16;
+  wfx.nBlockAlign     = 4;
+  wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
+
+  done_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  stop_event = CreateEvent (NULL, TRUE, FALSE, NULL);
+  if (waveOutOpen (&device, WAVE_MAPPER, &wfx, (DWORD_PTR)done_event, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+    CloseHandle (done_event);
+    CloseHandle (stop_event);
+    return (false);
+  }
+  for (i=0; i<AUDIO_BUFFERS; i++) {
+    memset (&headers[i], 0, sizeof(WAVEHDR));
+    headers[i].lpData         = (LPSTR)(buffer + i * buffer_frames * 2);
+    headers[i].dwBufferLength = buffer_frames * 2 * sizeof(short);
+    waveOutPrepareHeader (device, &headers[i], sizeof(WAVEHDR));
+    // Mark as played so the thread fills it first
+    headers[i].dwFlags |= WHDR_DONE;
+  }
+  audio_thread = (HANDLE) _beginthreadex (NULL, 0, Audio_Thread, NULL, 0, NULL);
+  if (audio_thread == 0) {
+    for (i=0; i<AUDIO_BUFFERS; i++)
+      waveOutUnprepareHeader (device, &headers[i], sizeof(WAVEHDR));
+    waveOutClose (device);
+    CloseHandle (done_event);
+    CloseHandle (stop_event);
+    return (false);
+  }
+#else
+  if (pthread_create (&audio_thread, NULL, Audio_Thread, NULL) != 0)
+    return (false);
+#endif
+  started = true;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Thread
+|
+| Input: Called from Audio_Start() through _beginthreadex() or
+|   pthread_create()
+| Output: Mixes buffers as the device plays them, until stopped.
+|___________________________________________________________________*/
+
+#ifdef _WIN32
+static unsigned __stdcall Audio_Thread (void *params)
+{
+  int i, done;
+  bool first;
+  HANDLE events[2];
+
+  events[0] = stop_event;
+  events[1] = done_event;
+  first = true;
+
+  for (;;) {
+    done = 0;
+    for (i=0; i<AUDIO_BUFFERS; i++)
+      if (headers[i].dwFlags & WHDR_DONE)
+        done++;
+    // The device ran out of buffers
+    if ((done == AUDIO_BUFFERS) && (!first))
+      audio_stats.glitches++;
+    first = false;
+    for (i=0; i<AUDIO_BUFFERS; i++)
+      if (headers[i].dwFlags & WHDR_DONE) {
+        Mix_Buffer ((short *) headers[i].lpData);
+        headers[i].dwFlags &= ~WHDR_DONE;
+        waveOutWrite (device, &headers[i], sizeof(WAVEHDR));
+      }
+    if (WaitForMultipleObjects (2, events, FALSE, INFINITE) == WAIT_OBJECT_0)
+      break;
+  }
+
+  return (0);
+}
+#else
+static void *Audio_Thread (void *params)
+{
+  int n;
+  double start, due, now;
+  struct timespec t;
+
+  // No device, buffer n is played from start + n buffers on, after the first AUDIO_BUFFERS are queued
+  start = Get_Time () + AUDIO_BUFFERS * AUDIO_BUFFER_MS;
+  for (n=0; !LOAD_ACQUIRE (stopping); n++) {
+    // Wait until the device is done with the buffer
+    due = start + (n - AUDIO_BUFFERS) * AUDIO_BUFFER_MS;
+    now = Get_Time ();
+    if (due > now) {
+      t.tv_sec  = (time_t)((due - now) / 1000);
+      t.tv_nsec = (long)((due - now - t.tv_sec * 1000) * 1000000);
+      nanosleep (&t, NULL);
+    }
+    Mix_Buffer (buffer + (n % AUDIO_BUFFERS) * buffer_frames * 2);
+    if (Get_Time () > start + n * AUDIO_BUFFER_MS)
+      audio_stats.glitches++;
+  }
+
+  return (NULL);
+}
+#endif
+
+/*____________________________________________________________________
+|
+| Function: Mix_Buffer
+|
+| Input: Called from Audio_Thread()
+| Output: Applies waiting commands and mixes a buffer.
+|___________________________________________________________________*/
+
+static void Mix_Buffer (short *samples)
+{
+  int i;
+  float gain, pan, pitch;
+  double start;
+  Slot *s;
+
+  start = Get_Time ();
+  Apply_Commands ();
+
+  // Voices that ended, then gains of the rest
+  Spatial_Update (AUDIO_BUFFER_MS);
+  for (i=0; i<AUDIO_MAX_VOICES; i++) {
+    s = &slots[i];
+    if (s->voice == 0)
+      continue;
+    if (!Voice_Is_Playing (s->voice)) {
+      if (s->emitter != -1)
+        Spatial_Remove_Emitter (s->emitter);
+      s->voice   = 0;
+      s->emitter = -1;
+      STORE_RELEASE (ended[i], s->generation);
+      continue;
+    }
+    if (s->emitter != -1) {
+      Spatial_Get_Emitter (s->emitter, &gain, &pan, &pitch);
+      Voice_Set (s->voice, s->volume * gain, pan, pitch);
+    }
+    else
+      Voice_Set (s->voice, s->volume, 0, 1);
+  }
+  Voice_Update ();
+
+  fill = samples;
+  fill_frames = 0;
+  Mixer_Update (buffer_frames);
+
+  audio_stats.buffers++;
+  audio_stats.mix_time = (float)(Get_Time () - start);
+}
+
+/*____________________________________________________________________
+|
+| Function: Apply_Commands
+|
+| Input: Called from Mix_Buffer()
+| Output: Applies all commands in the ring.  Changes only store values
+|   used once the buffer is mixed, so later ones replace earlier ones.
+|___________________________________________________________________*/
+
+static void Apply_Commands ()
+{
+  int index;
+  unsigned head, tail;
+  Command *c;
+  Slot *s;
+
+  head = LOAD_ACQUIRE (ring.head);
+  for (tail=ring.tail; tail!=head; tail++) {
+    c = &queue[tail & (AUDIO_QUEUE_SIZE - 1)];
+    if (c->type == COMMAND_LISTENER) {
+      Spatial_Set_Listener (c->f[0], c->f[1], c->f[2], c->f[3], c->f[4], c->f[5], c->f[6], c->f[7], c->f[8]);
+      if (listener_changed == audio_stats.buffers)
+        audio_stats.coalesced++;
+      listener_changed = audio_stats.buffers;
+      continue;
+    }
+    index = (int)(c->voice & 0xFFFF) - 1;
+    s = &slots[index];
+
+    if (c->type == COMMAND_PLAY) {
+      s->generation = c->voice >> 16;
+      s->volume     = c->f[0];
+      s->changed    = -1;
+      s->voice      = Voice_Play (c->sound, 1, c->f[1]);
+      s->emitter    = -1;
+      if (s->voice && (c->f[2] != 0)) {
+        s->emitter = Spatial_Add_Emitter (c->f[3], c->f[4], c->f[5], c->f[6], c->f[7], 1, 0);
+        if (s->emitter == -1) {
+          Voice_Stop (s->voice);
+          s->voice = 0;
+        }
+      }
+      if (s->voice == 0)
+        STORE_RELEASE (ended[index], s->generation);
+    }
+    // The rest are for a voice still playing
+    else if ((s->voice == 0) || (s->generation != (c->voice >> 16)))
+      continue;
+    else if (c->type == COMMAND_STOP) {
+      Voice_Stop (s->voice);
+      if (s->emitter != -1)
+        Spatial_Remove_Emitter (s->emitter);
+      s->voice   = 0;
+      s->emitter = -1;
+    }
+    else {
+      if (c->type == COMMAND_VOLUME)
+        s->volume = c->f[0];
+      else if (s->emitter != -1)
+        Spatial_Set_Emitter_Position (s->emitter, c->f[0], c->f[1], c->f[2]);
+      if (s->changed == audio_stats.buffers)
+        audio_stats.coalesced++;
+      s->changed = audio_stats.buffers;
+    }
+  }
+  STORE_RELEASE (ring.tail, head);
+}
+
+/*____________________________________________________________________
+|
+| Function: Copy_Output
+|
+| Input: Called from Mixer_Update()
+| Output: Copies mixed frames into the buffer being mixed.
+|___________________________________________________________________*/
+
+static void Copy_Output (const short *samples, int num_frames, void *data)
+{
+  memcpy (fill + fill_frames * 2, samples, num_frames * 2 * sizeof(short));
+  fill_frames += num_frames;
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Play
+|
+| Input: Called from ____
+| Output: Starts a sound.  Returns the voice, or 0 if too many are
+|   playing or the queue is full.
+|___________________________________________________________________*/
+
+AudioVoice Audio_Play (MixerSound sound, float volume, float priority)
+{
+  Command c;
+
+  c.type  = COMMAND_PLAY;
+  c.sound = sound;
+  c.f[0]  = volume;
+  c.f[1]  = priority;
+  c.f[2]  = 0;
+
+  return (Start_Voice (&c));
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Play_3D
+|
+| Input: Called from ____
+| Output: Starts a sound at a position.  Returns the voice, or 0 if
+|   too many are playing or the queue is full.
+|___________________________________________________________________*/
+
+AudioVoice Audio_Play_3D (MixerSound sound, float volume, float priority, float x, float y, float z, float min_distance, float max_distance)
+{
+  Command c;
+
+  c.type  = COMMAND_PLAY;
+  c.sound = sound;
+  c.f[0]  = volume;
+  c.f[1]  = priority;
+  c.f[2]  = 1;
+  c.f[3]  = x;
+  c.f[4]  = y;
+  c.f[5]  = z;
+  c.f[6]  = min_distance;
+  c.f[7]  = max_distance;
+
+  return (Start_Voice (&c));
+}
+
+/*____________________________________________________________________
+|
+| Function: Start_Voice
+|
+| Input: Called from Audio_Play(), Audio_Play_3D()
+| Output: Gives out a voice handle and queues the command to play it.
+|   Returns the voice, or 0 if none is free or the queue is full.
+|___________________________________________________________________*/
+
+static AudioVoice Start_Voice (Command *c)
+{
+  int i, n;
+
+  if (!audio_init)
+    return (0);
+
+  // Next voice not in use, or whose sound has ended
+  for (n=0; n<AUDIO_MAX_VOICES; n++) {
+    i = (next_voice + n) % AUDIO_MAX_VOICES;
+    if ((!used[i]) || (LOAD_ACQUIRE (ended[i]) == generation[i]))
+      break;
+  }
+  if (n == AUDIO_MAX_VOICES)
+    return (0);
+  next_voice = (i + 1) % AUDIO_MAX_VOICES;
+
+  generation[i] = (generation[i] + 1) & 0xFFFF;
+  c->voice = HANDLE_OF (i, generation[i]);
+  used[i] = Push (c);
+  if (!used[i])
+    return (0);
+
+  return (c->voice);
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Set_Volume
+|
+| Input: Called from ____
+| Output: Changes the volume of a sound.
+|___________________________________________________________________*/
+
+void Audio_Set_Volume (AudioVoice voice, float volume)
+{
+  Command c;
+
+  c.type  = COMMAND_VOLUME;
+  c.voice = voice;
+  c.f[0]  = volume;
+  if (Audio_Is_Playing (voice) && (!Push (&c)))
+    game_dropped++;
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Set_Position
+|
+| Input: Called from ____
+| Output: Moves a 3D sound.
+|___________________________________________________________________*/
+
+void Audio_Set_Position (AudioVoice voice, float x, float y, float z)
+{
+  Command c;
+
+  c.type  = COMMAND_POSITION;
+  c.voice = voice;
+  c.f[0]  = x;
+  c.f[1]  = y;
+  c.f[2]  = z;
+  if (Audio_Is_Playing (voice) && (!Push (&c)))
+    game_dropped++;
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Set_Listener
+|
+| Input: Called from ____
+| Output: Moves the listener.
+|___________________________________________________________________*/
+
+void Audio_Set_Listener (float x, float y, float z, float fx, float fy, float fz, float ux, float uy, float uz)
+{
+  Command c;
+
+  if (!audio_init)
+    return;
+
+  c.type  = COMMAND_LISTENER;
+  c.voice = 0;
+  c.f[0]  = x;
+  c.f[1]  = y;
+  c.f[2]  = z;
+  c.f[3]  = fx;
+  c.f[4]  = fy;
+  c.f[5]  = fz;
+  c.f[6]  = ux;
+  c.f[7]  = uy;
+  c.f[8]  = uz;
+  if (!Push (&c))
+    game_dropped++;
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Stop
+|
+| Input: Called from ____
+| Output: Stops a sound.  If the queue is full, waits for room.
+|___________________________________________________________________*/
+
+void Audio_Stop (AudioVoice voice)
+{
+  Command c;
+
+  if (!Audio_Is_Playing (voice))
+    return;
+
+  c.type  = COMMAND_STOP;
+  c.voice = voice;
+  while (!Push (&c))
+    YIELD ();
+  used[(voice & 0xFFFF) - 1] = false;
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Is_Playing
+|
+| Input: Called from Audio_Set_Volume(), Audio_Set_Position(),
+|   Audio_Stop(), ____
+| Output: Returns true if a sound is still playing.
+|___________________________________________________________________*/
+
+bool Audio_Is_Playing (AudioVoice voice)
+{
+  int index;
+
+  index = (int)(voice & 0xFFFF) - 1;
+  if ((!audio_init) || (index < 0) || (index >= AUDIO_MAX_VOICES) || (!used[index]) || (generation[index] != (voice >> 16)))
+    return (false);
+
+  return (LOAD_ACQUIRE (ended[index]) != generation[index]);
+}
+
+/*____________________________________________________________________
+|
+| Function: Push
+|
+| Input: Called from Start_Voice(), Audio_Set_Volume(),
+|   Audio_Set_Position(), Audio_Set_Listener(), Audio_Stop()
+| Output: Adds a command to the ring.  Returns false if it is full.
+|___________________________________________________________________*/
+
+static bool Push (Command *c)
+{
+  unsigned head;
+
+  head = ring.head;
+  if (head - LOAD_ACQUIRE (ring.tail) == AUDIO_QUEUE_SIZE)
+    return (false);
+  queue[head & (AUDIO_QUEUE_SIZE - 1)] = *c;
+  STORE_RELEASE (ring.head, head + 1);
+  game_commands++;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Audio_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.  Those kept by the audio thread may
+|   be a buffer behind.
+|___________________________________________________________________*/
+
+void Audio_Get_Stats (AudioStats *stats)
+{
+  *stats = audio_stats;
+  stats->commands = game_commands;
+  stats->dropped  = game_dropped;
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Audio_Thread(), Mix_Buffer()
+| Output: Returns a time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
@@ -0,0 +1,63 @@
+/*____________________________________________________________________
+|
+| File: audio.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define AUDIO_QUEUE_SIZE   4096    // commands from the game thread not yet applied, a power of 2
+#define AUDIO_MAX_VOICES   1024    // playing at once, mixed or not
+#define AUDIO_MAX_REAL     64      // mixed at once, the most audible (voices.cpp)
+#define AUDIO_BUFFERS      3       // device buffers
+#define AUDIO_BUFFER_MS    20      // commands are applied once per buffer
+
+typedef unsigned AudioVoice;       // 0 = none
+
+typedef struct {
+  int   commands;                  // sent by the game thread
+  int   coalesced;                 // changes replaced by a later one before being mixed
+  int   dropped;                   // changes dropped because the queue was full
+  int   buffers;                   // mixed
+  int   glitches;                  // buffers not ready when the device needed them
+  float mix_time;                  // milliseconds applying commands and mixing the last buffer
+} AudioStats;
+
+// Starts the mixer (rate frames per second), voices and spatialization, returns true on success
+bool Audio_Init (int rate);
+
+// Stops the audio thread and frees everything
+void Audio_Free ();
+
+// Loads a wave file, only before Audio_Start(), kept as IMA ADPCM (a quarter the memory) if compress is true,
+//   returns 0 on error.  While a compressed sound plays it also has a decoded copy, so only compress sounds that
+//   don't play all the time
+MixerSound Audio_Load_Sound (const char *filename, bool loop, bool compress);
+
+// Opens the sound device and starts the audio thread, returns true on success
+bool Audio_Start ();
+
+// Starts a sound, volume is 0-1 and more, priority scales how audible it counts when picking voices to mix,
+//   returns 0 if too many are playing or the queue is full
+AudioVoice Audio_Play (MixerSound sound, float volume, float priority);
+
+// The same for a sound at a position, heard at full volume out to min_distance and no quieter past max_distance
+AudioVoice Audio_Play_3D (MixerSound sound, float volume, float priority, float x, float y, float z, float min_distance, float max_distance);
+
+// Changes the volume of a sound
+void Audio_Set_Volume (AudioVoice voice, float volume);
+
+// Moves a sound played with Audio_Play_3D()
+void Audio_Set_Position (AudioVoice voice, float x, float y, float z);
+
+// Moves the listener, forward and up are unit vectors
+void Audio_Set_Listener (float x, float y, float z, float forward_x, float forward_y, float forward_z, float up_x, float up_y, float up_z);
+
+// Stops a sound
+void Audio_Stop (AudioVoice voice);
+
+// Returns true if a sound is still playing (as far as the audio thread has told)
+bool Audio_Is_Playing (AudioVoice voice);
+
+// Gets counts and times
+void Audio_Get_Stats (AudioStats *stats);
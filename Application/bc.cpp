@@ -0,0 +1,560 @@
+/*____________________________________________________________________
+|
+| File: bc.cpp
+|
+| Description: BC1 and BC3 (DXT1 and DXT5) block compression.  Each
+|   4x4 block of pixels is stored as 2 colors and a 2-bit index per
+|   pixel choosing one of 4 colors on the line between them.  BC3 adds
+|   an alpha block: 2 alpha values and a 3-bit index per pixel choosing
+|   one of 8 values between them.
+|
+|   The encoder fits the color line along the principal axis of the
+|   block's colors, picks the nearest color for each pixel, then moves
+|   the 2 colors to the least squares best fit for those picks and keeps
+|   the result if it is better.  Nearest colors are found 4 pixels at a
+|   time with SSE2 where it is available.
+|
+|   Only uses the C library so it can be built into tools as well as
+|   the game.
+|
+| Functions: Bc1_Encode_Block
+|             Encode_Color
+|             Fit_Colors
+|             Refine_Colors
+|             Pick_Indices
+|             To_565
+|             From_565
+|            Bc3_Encode_Block
+|             Encode_Alpha
+|            Bc1_Decode_Block
+|             Decode_Color
+|            Bc3_Decode_Block
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define BC_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bc.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef unsigned char byte_t;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Encode_Color (const byte_t *rgba, byte_t *block);
+static void Fit_Colors (const float *r, const float *g, const float *b, unsigned short *c0, unsigned short *c1);
+static bool Refine_Colors (const float *r, const float *g, const float *b, const byte_t *indices, unsigned short *c0, unsigned short *c1);
+static float Pick_Indices (const float *r, const float *g, const float *b, unsigned short c0, unsigned short c1, byte_t *indices);
+static unsigned short To_565 (float r, float g, float b);
+static void From_565 (unsigned short c, float *rgb);
+static void Encode_Alpha (const byte_t *rgba, byte_t *block);
+static void Decode_Color (const byte_t *block, byte_t *rgba, bool four_colors);
+
+/*____________________________________________________________________
+|
+| Function: Bc1_Encode_Block
+|
+| Input: Called from ____
+| Output: Encodes 4x4 RGBA pixels into a BC1 block, alpha is ignored.
+|___________________________________________________________________*/
+
+void Bc1_Encode_Block (const unsigned char *rgba, unsigned char *block)
+{
+  Encode_Color (rgba, block);
+}
+
+/*____________________________________________________________________
+|
+| Function: Encode_Color
+|
+| Input: Called from Bc1_Encode_Block(), Bc3_Encode_Block()
+| Output: Encodes the colors of 4x4 pixels into an 8-byte color block,
+|   always in 4 color mode (first color greater than the second).
+|___________________________________________________________________*/
+
+static void Encode_Color (const byte_t *rgba, byte_t *block)
+{
+  int i;
+  unsigned bits;
+  unsigned short c0, c1, r0, r1, t;
+  float r[16], g[16], b[16], error, refined_error;
+  byte_t indices[16], refined[16];
+
+  for (i=0; i<16; i++) {
+    r[i] = rgba[i*4];
+    g[i] = rgba[i*4+1];
+    b[i] = rgba[i*4+2];
+  }
+
+  Fit_Colors (r, g, b, &c0, &c1);
+  error = Pick_Indices (r, g, b, c0, c1, indices);
+
+  // Best fit the colors to the picks, keep it if it is better
+  r0 = c0;
+  r1 = c1;
+  if (Refine_Colors (r, g, b, indices, &r0, &r1)) {
+    refined_error = Pick_Indices (r, g, b, r0, r1, refined);
+    if (refined_error < error) {
+      c0 = r0;
+      c1 = r1;
+      memcpy (indices, refined, 16);
+    }
+  }
+
+  // First color must be the greater for 4 color mode, swapping the colors swaps picks 0/1 and 2/3
+  if (c0 < c1) {
+    t  = c0;
+    c0 = c1;
+    c1 = t;
+    for (i=0; i<16; i++)
+      indices[i] ^= 1;
+  }
+  else if (c0 == c1)
+    memset (indices, 0, 16);
+
+  bits = 0;
+  for (i=0; i<16; i++)
+    bits |= (unsigned)indices[i] << (i*2);
+  block[0] = (byte_t) c0;
+  block[1] = (byte_t)(c0 >> 8);
+  block[2] = (byte_t) c1;
+  block[3] = (byte_t)(c1 >> 8);
+  block[4] = (byte_t) bits;
+  block[5] = (byte_t)(bits >> 8);
+  block[6] = (byte_t)(bits >> 16);
+  block[7] = (byte_t)(bits >> 24);
+}
+
+/*____________________________________________________________________
+|
+| Function: Fit_Colors
+|
+| Input: Called from Encode_Color()
+| Output: Gets 2 colors at the ends of the line through the pixels
+|   along their principal axis, moved in by 1/16 of the line so the
+|   end colors are not wasted on a single extreme pixel.
+|___________________________________________________________________*/
+
+static void Fit_Colors (const float *r, const float *g, const float *b, unsigned short *c0, unsigned short *c1)
+{
+  int i;
+  float mean[3], cov[6], axis[3], v[3], d, p, pmin, pmax, inset;
+
+  mean[0] = mean[1] = mean[2] = 0;
+  for (i=0; i<16; i++) {
+    mean[0] += r[i];
+    mean[1] += g[i];
+    mean[2] += b[i];
+  }
+  mean[0] /= 16;
+  mean[1] /= 16;
+  mean[2] /= 16;
+
+  // Covariance (rr, rg, rb, gg, gb, bb)
+  memset (cov, 0, sizeof(cov));
+  for (i=0; i<16; i++) {
+    v[0] = r[i] - mean[0];
+    v[1] = g[i] - mean[1];
+    v[2] = b[i] - mean[2];
+    cov[0] += v[0] * v[0];
+    cov[1] += v[0] * v[1];
+    cov[2] += v[0] * v[2];
+    cov[3] += v[1] * v[1];
+    cov[4] += v[1] * v[2];
+    cov[5] += v[2] * v[2];
+  }
+
+  // All pixels the same color
+  if (cov[0] + cov[3] + cov[5] < 1e-3f) {
+    *c0 = *c1 = To_565 (mean[0], mean[1], mean[2]);
+    return;
+  }
+
+  // Principal axis by power iteration, from the covariance column of the channel that varies most
+  //   (a fixed start like (1,1,1) misses axes whose channels sum to 0, red next to green say)
+  if ((cov[0] >= cov[3]) && (cov[0] >= cov[5])) {
+    axis[0] = cov[0];
+    axis[1] = cov[1];
+    axis[2] = cov[2];
+  }
+  else if (cov[3] >= cov[5]) {
+    axis[0] = cov[1];
+    axis[1] = cov[3];
+    axis[2] = cov[4];
+  }
+  else {
+    axis[0] = cov[2];
+    axis[1] = cov[4];
+    axis[2] = cov[5];
+  }
+  for (i=0; i<8; i++) {
+    v[0] = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    v[1] = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    v[2] = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    d = fabsf (v[0]);
+    if (fabsf (v[1]) > d)
+      d = fabsf (v[1]);
+    if (fabsf (v[2]) > d)
+      d = fabsf (v[2]);
+    if (d < 1e-6f)
+      break;
+    axis[0] = v[0] / d;
+    axis[1] = v[1] / d;
+    axis[2] = v[2] / d;
+  }
+  // Not 0, the start column has a diagonal entry > 0
+  d = 1 / sqrtf (axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  axis[0] *= d;
+  axis[1] *= d;
+  axis[2] *= d;
+
+  pmin = pmax = 0;
+  for (i=0; i<16; i++) {
+    p = (r[i] - mean[0]) * axis[0] + (g[i] - mean[1]) * axis[1] + (b[i] - mean[2]) * axis[2];
+    if (p < pmin)
+      pmin = p;
+    if (p > pmax)
+      pmax = p;
+  }
+  inset = (pmax - pmin) / 16;
+  pmin += inset;
+  pmax -= inset;
+
+  *c0 = To_565 (mean[0] + axis[0] * pmax, mean[1] + axis[1] * pmax, mean[2] + axis[2] * pmax);
+  *c1 = To_565 (mean[0] + axis[0] * pmin, mean[1] + axis[1] * pmin, mean[2] + axis[2] * pmin);
+}
+
+/*____________________________________________________________________
+|
+| Function: Refine_Colors
+|
+| Input: Called from Encode_Color()
+| Output: Gets the 2 colors that best fit (least squares) the pixels
+|   for the picks given.  Returns false if the picks don't set a line.
+|___________________________________________________________________*/
+
+static bool Refine_Colors (const float *r, const float *g, const float *b, const byte_t *indices, unsigned short *c0, unsigned short *c1)
+{
+  static const float weight[4] = { 1, 0, 2.0f/3, 1.0f/3 };  // of the first color
+  int i;
+  float w0, w1, aa, ab, bb, det, ax[3], bx[3], e0[3], e1[3];
+
+  aa = ab = bb = 0;
+  ax[0] = ax[1] = ax[2] = 0;
+  bx[0] = bx[1] = bx[2] = 0;
+  for (i=0; i<16; i++) {
+    w0 = weight[indices[i]];
+    w1 = 1 - w0;
+    aa += w0 * w0;
+    ab += w0 * w1;
+    bb += w1 * w1;
+    ax[0] += w0 * r[i];
+    ax[1] += w0 * g[i];
+    ax[2] += w0 * b[i];
+    bx[0] += w1 * r[i];
+    bx[1] += w1 * g[i];
+    bx[2] += w1 * b[i];
+  }
+  det = aa * bb - ab * ab;
+  if (fabsf (det) < 1e-6f)
+    return (false);
+
+  det = 1 / det;
+  for (i=0; i<3; i++) {
+    e0[i] = (ax[i] * bb - bx[i] * ab) * det;
+    e1[i] = (bx[i] * aa - ax[i] * ab) * det;
+  }
+  *c0 = To_565 (e0[0], e0[1], e0[2]);
+  *c1 = To_565 (e1[0], e1[1], e1[2]);
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pick_Indices
+|
+| Input: Called from Encode_Color()
+| Output: Picks the nearest of the 4 block colors for each pixel.
+|   Returns the total squared error.
+|___________________________________________________________________*/
+
+static float Pick_Indices (const float *r, const float *g, const float *b, unsigned short c0, unsigned short c1, byte_t *indices)
+{
+  int i, k;
+  float p[4][3], error;
+
+  From_565 (c0, p[0]);
+  From_565 (c1, p[1]);
+  for (i=0; i<3; i++) {
+    p[2][i] = (2 * p[0][i] + p[1][i]) / 3;
+    p[3][i] = (p[0][i] + 2 * p[1][i]) / 3;
+  }
+
+#ifdef BC_SSE2
+  __m128 vr, vg, vb, dr, dg, db, d, best, pick, less, total;
+  float picks[4], sum[4];
+
+  total = _mm_setzero_ps ();
+  for (i=0; i<16; i+=4) {
+    vr = _mm_loadu_ps (r + i);
+    vg = _mm_loadu_ps (g + i);
+    vb = _mm_loadu_ps (b + i);
+    best = _mm_set1_ps (3.4e38f);
+    pick = _mm_setzero_ps ();
+    for (k=0; k<4; k++) {
+      dr = _mm_sub_ps (vr, _mm_set1_ps (p[k][0]));
+      dg = _mm_sub_ps (vg, _mm_set1_ps (p[k][1]));
+      db = _mm_sub_ps (vb, _mm_set1_ps (p[k][2]));
+      d  = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dr, dr), _mm_mul_ps (dg, dg)), _mm_mul_ps (db, db));
+      less = _mm_cmplt_ps (d, best);
+      best = _mm_min_ps (d, best);
+      pick = _mm_or_ps (_mm_and_ps (less, _mm_set1_ps ((float)k)), _mm_andnot_ps (less, pick));
+    }
+    total = _mm_add_ps (total, best);
+    _mm_storeu_ps (picks, pick);
+    for (k=0; k<4; k++)
+      indices[i+k] = (byte_t) picks[k];
+  }
+  _mm_storeu_ps (sum, total);
+  error = sum[0] + sum[1] + sum[2] + sum[3];
+#else
+  int best_k;
+  float d, dr, dg, db, best;
+
+  error = 0;
+  for (i=0; i<16; i++) {
+    best   = 3.4e38f;
+    best_k = 0;
+    for (k=0; k<4; k++) {
+      dr = r[i] - p[k][0];
+      dg = g[i] - p[k][1];
+      db = b[i] - p[k][2];
+      d  = dr*dr + dg*dg + db*db;
+      if (d < best) {
+        best   = d;
+        best_k = k;
+      }
+    }
+    indices[i] = (byte_t) best_k;
+    error += best;
+  }
+#endif
+
+  return (error);
+}
+
+/*____________________________________________________________________
+|
+| Function: To_565
+|
+| Input: Called from Fit_Colors(), Refine_Colors()
+| Output: Returns a color rounded to 5:6:5 bits.
+|___________________________________________________________________*/
+
+static unsigned short To_565 (float r, float g, float b)
+{
+  int ri, gi, bi;
+
+  ri = (int)(r * 31 / 255 + 0.5f);
+  gi = (int)(g * 63 / 255 + 0.5f);
+  bi = (int)(b * 31 / 255 + 0.5f);
+  ri = (ri < 0) ? 0 : ((ri > 31) ? 31 : ri);
+  gi = (gi < 0) ? 0 : ((gi > 63) ? 63 : gi);
+  bi = (bi < 0) ? 0 : ((bi > 31) ? 31 : bi);
+
+  return ((unsigned short)((ri << 11) | (gi << 5) | bi));
+}
+
+/*____________________________________________________________________
+|
+| Function: From_565
+|
+| Input: Called from Pick_Indices(), Decode_Color()
+| Output: Expands a 5:6:5 color to 8 bits per channel, the way the
+|   decoder does.
+|___________________________________________________________________*/
+
+static void From_565 (unsigned short c, float *rgb)
+{
+  int r, g, b;
+
+  r = (c >> 11) & 31;
+  g = (c >> 5) & 63;
+  b = c & 31;
+  rgb[0] = (float)((r << 3) | (r >> 2));
+  rgb[1] = (float)((g << 2) | (g >> 4));
+  rgb[2] = (float)((b << 3) | (b >> 2));
+}
+
+/*____________________________________________________________________
+|
+| Function: Bc3_Encode_Block
+|
+| Input: Called from ____
+| Output: Encodes 4x4 RGBA pixels into a BC3 block, alpha then color.
+|___________________________________________________________________*/
+
+void Bc3_Encode_Block (const unsigned char *rgba, unsigned char *block)
+{
+  Encode_Alpha (rgba, block);
+  Encode_Color (rgba, block + 8);
+}
+
+/*____________________________________________________________________
+|
+| Function: Encode_Alpha
+|
+| Input: Called from Bc3_Encode_Block()
+| Output: Encodes the alpha of 4x4 pixels into an 8-byte alpha block,
+|   in 8 value mode between the lowest and highest alpha.
+|___________________________________________________________________*/
+
+static void Encode_Alpha (const byte_t *rgba, byte_t *block)
+{
+  int i, t, lo, hi, index;
+  unsigned long long bits;
+
+  lo = hi = rgba[3];
+  for (i=1; i<16; i++) {
+    if (rgba[i*4+3] < lo)
+      lo = rgba[i*4+3];
+    if (rgba[i*4+3] > hi)
+      hi = rgba[i*4+3];
+  }
+
+  // Values are hi, lo, then 6 steps from hi to lo
+  bits = 0;
+  if (hi > lo)
+    for (i=0; i<16; i++) {
+      t = ((rgba[i*4+3] - lo) * 7 + (hi - lo) / 2) / (hi - lo);
+      if (t == 7)
+        index = 0;
+      else if (t == 0)
+        index = 1;
+      else
+        index = 8 - t;
+      bits |= (unsigned long long)index << (i*3);
+    }
+
+  block[0] = (byte_t) hi;
+  block[1] = (byte_t) lo;
+  for (i=0; i<6; i++)
+    block[2+i] = (byte_t)(bits >> (i*8));
+}
+
+/*____________________________________________________________________
+|
+| Function: Bc1_Decode_Block
+|
+| Input: Called from ____
+| Output: Decodes a BC1 block into 4x4 RGBA pixels.
+|___________________________________________________________________*/
+
+void Bc1_Decode_Block (const unsigned char *block, unsigned char *rgba)
+{
+  Decode_Color (block, rgba, false);
+}
+
+/*____________________________________________________________________
+|
+| Function: Decode_Color
+|
+| Input: Called from Bc1_Decode_Block(), Bc3_Decode_Block()
+| Output: Decodes an 8-byte color block.  BC1 blocks with the first
+|   color not greater than the second have 3 colors and transparent
+|   black, BC3 color blocks always have 4 colors.
+|___________________________________________________________________*/
+
+static void Decode_Color (const byte_t *block, byte_t *rgba, bool four_colors)
+{
+  int i, j, index;
+  unsigned short c0, c1;
+  unsigned bits;
+  float f[2][3];
+  byte_t p[4][4];
+
+  c0 = (unsigned short)(block[0] | (block[1] << 8));
+  c1 = (unsigned short)(block[2] | (block[3] << 8));
+  bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned)block[7] << 24);
+
+  From_565 (c0, f[0]);
+  From_565 (c1, f[1]);
+  for (j=0; j<3; j++) {
+    p[0][j] = (byte_t) f[0][j];
+    p[1][j] = (byte_t) f[1][j];
+    if (four_colors || (c0 > c1)) {
+      p[2][j] = (byte_t)((2 * p[0][j] + p[1][j]) / 3);
+      p[3][j] = (byte_t)((p[0][j] + 2 * p[1][j]) / 3);
+    }
+    else {
+      p[2][j] = (byte_t)((p[0][j] + p[1][j]) / 2);
+      p[3][j] = 0;
+    }
+  }
+  p[0][3] = p[1][3] = p[2][3] = 255;
+  p[3][3] = (four_colors || (c0 > c1)) ? 255 : 0;
+
+  for (i=0; i<16; i++) {
+    index = (bits >> (i*2)) & 3;
+    for (j=0; j<4; j++)
+      rgba[i*4+j] = p[index][j];
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Bc3_Decode_Block
+|
+| Input: Called from ____
+| Output: Decodes a BC3 block into 4x4 RGBA pixels.
+|___________________________________________________________________*/
+
+void Bc3_Decode_Block (const unsigned char *block, unsigned char *rgba)
+{
+  int i, a0, a1;
+  unsigned long long bits;
+  byte_t a[8];
+
+  Decode_Color (block + 8, rgba, true);
+
+  a0 = block[0];
+  a1 = block[1];
+  a[0] = (byte_t) a0;
+  a[1] = (byte_t) a1;
+  if (a0 > a1)
+    for (i=1; i<7; i++)
+      a[i+1] = (byte_t)(((7 - i) * a0 + i * a1) / 7);
+  else {
+    for (i=1; i<5; i++)
+      a[i+1] = (byte_t)(((5 - i) * a0 + i * a1) / 5);
+    a[6] = 0;
+    a[7] = 255;
+  }
+
+  bits = 0;
+  for (i=0; i<6; i++)
+    bits |= (unsigned long long)block[2+i] << (i*8);
+  for (i=0; i<16; i++)
+    rgba[i*4+3] = a[(bits >> (i*3)) & 7];
+}
@@ -0,0 +1,22 @@
+/*____________________________________________________________________
+|
+| File: bc.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define BC1_BLOCK_SIZE 8    // bytes per 4x4 block, rgb
+#define BC3_BLOCK_SIZE 16   // bytes per 4x4 block, rgb + alpha
+
+// Encodes 4x4 RGBA pixels (rows top to bottom, 16 bytes each) into a BC1 block (alpha ignored)
+void Bc1_Encode_Block (const unsigned char *rgba, unsigned char *block);
+
+// Encodes 4x4 RGBA pixels into a BC3 block
+void Bc3_Encode_Block (const unsigned char *rgba, unsigned char *block);
+
+// Decodes a BC1 block into 4x4 RGBA pixels (alpha 255)
+void Bc1_Decode_Block (const unsigned char *block, unsigned char *rgba);
+
+// Decodes a BC3 block into 4x4 RGBA pixels
+void Bc3_Decode_Block (const unsigned char *block, unsigned char *rgba);
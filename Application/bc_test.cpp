@@ -0,0 +1,169 @@
+/*____________________________________________________________________
+|
+| File: bc_test.cpp
+|
+| Description: Encodes 4x4 blocks with bc.cpp, decodes them again and
+|   checks how far the colors moved, for BC1 and BC3.
+|
+|   The blocks include ones whose colors change in opposite directions
+|   across channels (red next to green, red rising as green falls), whose
+|   principal axis sums to 0 and is easy to miss, besides flat colors
+|   and plain gradients.  Each must come back within a set RMS error.
+|
+|   A standalone program, not part of the game build.  Build it in
+|   Application\:
+|     cl /EHsc bc_test.cpp bc.cpp
+|     g++ -O2 bc_test.cpp bc.cpp
+|   Returns 0 if every block came back close enough.
+|
+|   Only uses the C library and bc.cpp.
+|
+| Functions: main
+|             Make_Block
+|             Round_Trip
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "bc.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  const char   *name;
+  unsigned char from[4], to[4];     // rgba
+  bool          gradient;           // else the left half is from, the right half to
+  float         max_error;          // rms, per channel
+} TestBlock;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void  Make_Block (const TestBlock *test, unsigned char *rgba);
+static float Round_Trip (const unsigned char *rgba, bool bc3);
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+// Two colors come back nearly exact (565 rounding), a 16 step gradient as 4 levels
+static const TestBlock test_blocks[] = {
+  { "flat",                { 200, 100,  50, 255 }, { 200, 100,  50, 255 }, false,  4 },
+  { "black | white",       {   0,   0,   0, 255 }, { 255, 255, 255, 255 }, false,  4 },
+  { "red | green",         { 255,   0,   0, 255 }, {   0, 255,   0, 255 }, false,  4 },
+  { "red | blue",          { 255,   0,   0, 255 }, {   0,   0, 255, 255 }, false,  4 },
+  { "green | blue",        {   0, 255,   0, 255 }, {   0,   0, 255, 255 }, false,  4 },
+  { "yellow | blue",       { 255, 255,   0, 255 }, {   0,   0, 255, 255 }, false,  4 },
+  { "grey gradient",       {   0,   0,   0, 255 }, { 255, 255, 255, 255 }, true,  20 },
+  { "red up, green down",  {   0, 255,   0, 255 }, { 255,   0,   0, 255 }, true,  20 },
+  { "red up, blue down",   {   0,   0, 255, 255 }, { 255,   0,   0, 255 }, true,  20 },
+  { "green up, blue down", {   0,   0, 255,   0 }, {   0, 255,   0, 255 }, true,  20 },
+};
+
+/*____________________________________________________________________
+|
+| Function: main
+|
+| Input: Called from the OS
+| Output: Round trips every test block and prints the errors.  Returns
+|   0 if all were within their limit.
+|___________________________________________________________________*/
+
+int main ()
+{
+  int i, k, failed;
+  float error;
+  unsigned char rgba[64];
+  const TestBlock *test;
+
+  failed = 0;
+  for (i=0; i<(int)(sizeof(test_blocks)/sizeof(test_blocks[0])); i++) {
+    test = &test_blocks[i];
+    Make_Block (test, rgba);
+    for (k=0; k<2; k++) {
+      error = Round_Trip (rgba, k == 1);
+      printf ("%-20s %s  rms %5.1f%s\n", test->name, k ? "BC3" : "BC1", error, (error > test->max_error) ? "  FAILED" : "");
+      if (error > test->max_error)
+        failed++;
+    }
+  }
+
+  return (failed ? 1 : 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Make_Block
+|
+| Input: Called from main()
+| Output: Fills 4x4 RGBA pixels with a test block.
+|___________________________________________________________________*/
+
+static void Make_Block (const TestBlock *test, unsigned char *rgba)
+{
+  int i, c;
+  float t;
+
+  for (i=0; i<16; i++)
+    for (c=0; c<4; c++) {
+      if (test->gradient) {
+        // 16 steps, one per pixel
+        t = (float) i / 15;
+        rgba[i*4+c] = (unsigned char)(test->from[c] + (test->to[c] - test->from[c]) * t + 0.5f);
+      }
+      else
+        rgba[i*4+c] = ((i & 3) < 2) ? test->from[c] : test->to[c];
+    }
+}
+
+/*____________________________________________________________________
+|
+| Function: Round_Trip
+|
+| Input: Called from main()
+| Output: Encodes and decodes a block.  Returns the rms error of the
+|   colors (and alpha, for BC3) per channel.
+|___________________________________________________________________*/
+
+static float Round_Trip (const unsigned char *rgba, bool bc3)
+{
+  int i, c, channels;
+  float d, sum;
+  unsigned char block[BC3_BLOCK_SIZE], out[64];
+
+  if (bc3) {
+    Bc3_Encode_Block (rgba, block);
+    Bc3_Decode_Block (block, out);
+    channels = 4;
+  }
+  else {
+    Bc1_Encode_Block (rgba, block);
+    Bc1_Decode_Block (block, out);
+    channels = 3;
+  }
+
+  sum = 0;
+  for (i=0; i<16; i++)
+    for (c=0; c<channels; c++) {
+      d = (float) out[i*4+c] - (float) rgba[i*4+c];
+      sum += d * d;
+    }
+
+  return (sqrtf (sum / (16 * channels)));
+}
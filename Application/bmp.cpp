@@ -0,0 +1,548 @@
+/*____________________________________________________________________
+|
+| File: bmp.cpp
+|
+| Description: Functions to read and write uncompressed BMP files.
+|
+|   Bmp_Decode() is the fast way to read a texture: it maps a color
+|   file and its alpha (_fa) file and converts each row straight into
+|   the caller's RGBA image, writing the alpha from the _fa file in the
+|   same pass.  24 and 32-bit rows are converted 16 pixels at a time
+|   with SSSE3 byte shuffles where the processor has them.
+|
+| Functions: Bmp_Read_Info
+|             Read_Header
+|             Parse_Header
+|            Bmp_Read
+|            Bmp_Decode
+|             Map_Bmp
+|             Decode_Row
+|             Has_SSSE3
+|            Bmp_Write
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+
+#include "dp.h"
+
+#include "filemap.h"
+#include "bmp.h"
+
+#if defined(_MSC_VER) || defined(__SSSE3__)
+#define BMP_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  unsigned offset;     // to pixel data
+  int      dx, dy;
+  int      top_down;   // true if rows are stored top to bottom
+  int      bitdepth;
+  unsigned num_colors; // in palette
+} BmpHeader;
+
+// A BMP file mapped by Bmp_Decode()
+typedef struct {
+  const byte *data;
+  unsigned    size;
+  BmpHeader   header;
+  int         pitch;       // bytes per row in the file
+  unsigned    lut [256];   // 8-bit: palette as RGBA (alpha 0)
+} BmpMap;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int Read_Header (FILE *fp, BmpHeader *header, byte palette[256][4]);
+static int Parse_Header (const byte *buf, BmpHeader *header, unsigned *info_size);
+static int Map_Bmp (const char *filename, BmpMap *map);
+static void Decode_Row (byte *dst, int dx, BmpMap *color, const byte *color_row, BmpMap *alpha, const byte *alpha_row, int simd);
+static int Has_SSSE3 ();
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define GET_WORD(_p_)  ((unsigned)(_p_)[0] | ((unsigned)(_p_)[1] << 8))
+#define GET_DWORD(_p_) (GET_WORD(_p_) | (GET_WORD((_p_)+2) << 16))
+
+#define PUT_WORD(_p_,_v_)  { (_p_)[0] = (byte)(_v_); (_p_)[1] = (byte)((_v_) >> 8); }
+#define PUT_DWORD(_p_,_v_) { PUT_WORD(_p_,_v_); PUT_WORD((_p_)+2,(_v_) >> 16); }
+
+/*____________________________________________________________________
+|
+| Function: Bmp_Read_Info
+|
+| Input: Called from ____
+| Output: Reads size and bits per pixel of a BMP file.  Returns true on
+|   success, else false.
+|___________________________________________________________________*/
+
+int Bmp_Read_Info (const char *filename, int *dx, int *dy, int *bitdepth)
+{
+  FILE *fp;
+  BmpHeader header;
+  int ok = FALSE;
+
+  fp = fopen (filename, "rb");
+  if (fp) {
+    if (Read_Header (fp, &header, NULL)) {
+      *dx       = header.dx;
+      *dy       = header.dy;
+      *bitdepth = header.bitdepth;
+      ok = TRUE;
+    }
+    fclose (fp);
+  }
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_Header
+|
+| Input: Called from Bmp_Read_Info(), Bmp_Read()
+| Output: Reads file and info headers and the palette, if any.  Returns
+|   true if the file is a BMP this module can read.
+|___________________________________________________________________*/
+
+static int Read_Header (FILE *fp, BmpHeader *header, byte palette[256][4])
+{
+  byte buf[54];
+  unsigned info_size;
+
+  if (fread (buf, 1, sizeof(buf), fp) != sizeof(buf))
+    return (FALSE);
+  if (NOT Parse_Header (buf, header, &info_size))
+    return (FALSE);
+
+  if ((header->bitdepth == 8) AND palette) {
+    // Palette follows the info header
+    if (fseek (fp, 14 + info_size, SEEK_SET))
+      return (FALSE);
+    memset (palette, 0, 256 * 4);
+    if (fread (palette, 4, header->num_colors, fp) != header->num_colors)
+      return (FALSE);
+  }
+
+  return (TRUE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Parse_Header
+|
+| Input: Called from Read_Header(), Map_Bmp()
+| Output: Gets the header fields from the first 54 bytes of a file.
+|   Returns true if the file is a BMP this module can read.
+|___________________________________________________________________*/
+
+static int Parse_Header (const byte *buf, BmpHeader *header, unsigned *info_size)
+{
+  int height;
+  unsigned compression;
+
+  if ((buf[0] != 'B') OR (buf[1] != 'M'))
+    return (FALSE);
+
+  header->offset     = GET_DWORD (buf+10);
+  *info_size         = GET_DWORD (buf+14);
+  header->dx         = (int) GET_DWORD (buf+18);
+  height             = (int) GET_DWORD (buf+22);
+  header->bitdepth   = GET_WORD (buf+28);
+  compression        = GET_DWORD (buf+30);
+  header->num_colors = GET_DWORD (buf+46);
+
+  // Negative height means rows are stored top to bottom
+  header->top_down = (height < 0);
+  header->dy       = header->top_down ? -height : height;
+
+  // Only uncompressed (or BI_BITFIELDS 32-bit, read as BGRA)
+  if ((compression != 0) AND NOT ((compression == 3) AND (header->bitdepth == 32)))
+    return (FALSE);
+  if ((header->bitdepth != 8) AND (header->bitdepth != 24) AND (header->bitdepth != 32))
+    return (FALSE);
+  if ((header->dx <= 0) OR (header->dy <= 0))
+    return (FALSE);
+
+  if ((header->bitdepth == 8) AND ((header->num_colors == 0) OR (header->num_colors > 256)))
+    header->num_colors = 256;
+
+  return (TRUE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Bmp_Read
+|
+| Input: Called from ____
+| Output: Reads a BMP file into a new RGBA image with rows top to
+|   bottom and alpha set to 255.  Caller frees the image with free().
+|   Returns NULL on any error.
+|___________________________________________________________________*/
+
+byte *Bmp_Read (const char *filename, int *dx, int *dy)
+{
+  int x, y, row, pitch, bytes_per_pixel;
+  FILE *fp;
+  BmpHeader header;
+  byte palette[256][4];
+  byte *rgba = NULL, *line = NULL, *src, *dst;
+
+  fp = fopen (filename, "rb");
+  if (fp == NULL)
+    return (NULL);
+
+  if (Read_Header (fp, &header, palette) AND (fseek (fp, header.offset, SEEK_SET) == 0)) {
+    bytes_per_pixel = header.bitdepth / 8;
+    pitch = (header.dx * bytes_per_pixel + 3) & ~3;  // rows are padded to 4 bytes
+    rgba  = (byte *) malloc (header.dx * header.dy * 4);
+    line  = (byte *) malloc (pitch);
+    if (rgba AND line) {
+      for (row=0; row<header.dy; row++) {
+        if (fread (line, 1, pitch, fp) != (size_t)pitch) {
+          free (rgba);
+          rgba = NULL;
+          break;
+        }
+        y   = header.top_down ? row : header.dy - 1 - row;
+        dst = rgba + y * header.dx * 4;
+        src = line;
+        for (x=0; x<header.dx; x++, dst+=4) {
+          if (header.bitdepth == 8) {
+            dst[0] = palette[*src][2];
+            dst[1] = palette[*src][1];
+            dst[2] = palette[*src][0];
+          }
+          else {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+          }
+          dst[3] = 255;
+          src += bytes_per_pixel;
+        }
+      }
+    }
+    else if (rgba) {
+      free (rgba);
+      rgba = NULL;
+    }
+  }
+  if (line)
+    free (line);
+  fclose (fp);
+
+  if (rgba) {
+    *dx = header.dx;
+    *dy = header.dy;
+  }
+
+  return (rgba);
+}
+
+/*____________________________________________________________________
+|
+| Function: Bmp_Decode
+|
+| Input: Called from ____
+| Output: Decodes a BMP file into an RGBA image the caller allocated,
+|   dx by dy pixels with rows top to bottom, pitch bytes apart.  Alpha
+|   comes from the red channel of the alpha file (255 if NULL).  Both
+|   files must be dx by dy.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+int Bmp_Decode (const char *color_file, const char *alpha_file, byte *rgba, int dx, int dy, int pitch)
+{
+  int y, row, simd, ok;
+  BmpMap color, alpha;
+  const byte *alpha_row;
+
+  if (NOT Map_Bmp (color_file, &color))
+    return (FALSE);
+  ok = (color.header.dx == dx) AND (color.header.dy == dy);
+  if (ok AND alpha_file) {
+    ok = Map_Bmp (alpha_file, &alpha);
+    if (ok) {
+      ok = (alpha.header.dx == dx) AND (alpha.header.dy == dy);
+      if (NOT ok)
+        File_Unmap (alpha.data, alpha.size);
+    }
+  }
+  if (NOT ok) {
+    File_Unmap (color.data, color.size);
+    return (FALSE);
+  }
+
+  simd = Has_SSSE3 ();
+  for (row=0; row<dy; row++) {
+    y = color.header.top_down ? row : dy - 1 - row;
+    alpha_row = NULL;
+    if (alpha_file)
+      alpha_row = alpha.data + alpha.header.offset + (alpha.header.top_down ? y : dy - 1 - y) * alpha.pitch;
+    Decode_Row (rgba + y * pitch, dx, &color, color.data + color.header.offset + row * color.pitch, alpha_file ? &alpha : NULL, alpha_row, simd);
+  }
+
+  File_Unmap (color.data, color.size);
+  if (alpha_file)
+    File_Unmap (alpha.data, alpha.size);
+
+  return (TRUE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Map_Bmp
+|
+| Input: Called from Bmp_Decode()
+| Output: Maps a BMP file and checks it holds all its rows.  Returns
+|   true on success, else false.
+|___________________________________________________________________*/
+
+static int Map_Bmp (const char *filename, BmpMap *map)
+{
+  int i;
+  unsigned info_size;
+  const byte *palette;
+
+  map->data = (const byte *) File_Map (filename, &map->size);
+  if (map->data == NULL)
+    return (FALSE);
+
+  if ((map->size >= 54) AND Parse_Header (map->data, &map->header, &info_size)) {
+    map->pitch = (map->header.dx * (map->header.bitdepth / 8) + 3) & ~3;
+    if ((map->header.offset <= map->size) AND ((unsigned long long)map->pitch * map->header.dy <= map->size - map->header.offset)) {
+      if (map->header.bitdepth != 8)
+        return (TRUE);
+      if ((info_size <= map->size) AND (14 + (unsigned long long)info_size + map->header.num_colors * 4 <= map->size)) {
+        palette = map->data + 14 + info_size;
+        memset (map->lut, 0, sizeof(map->lut));
+        for (i=0; i<(int)map->header.num_colors; i++)
+          map->lut[i] = palette[i*4+2] | (palette[i*4+1] << 8) | (palette[i*4] << 16);
+        return (TRUE);
+      }
+    }
+  }
+
+  File_Unmap (map->data, map->size);
+  return (FALSE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Decode_Row
+|
+| Input: Called from Bmp_Decode()
+| Output: Converts a row of a color file and a row of an alpha file to
+|   RGBA.  With simd set, 24 and 32-bit pixels are done 16 at a time:
+|   one byte shuffle puts the blue, green and red of 4 pixels in RGBA
+|   order and another puts the red of 4 alpha pixels in the alpha byte.
+|___________________________________________________________________*/
+
+static void Decode_Row (byte *dst, int dx, BmpMap *color, const byte *color_row, BmpMap *alpha, const byte *alpha_row, int simd)
+{
+  int x, color_bytes, alpha_bytes;
+  unsigned *dst32 = (unsigned *) dst;
+  const byte *src;
+
+  color_bytes = color->header.bitdepth / 8;
+  alpha_bytes = alpha ? alpha->header.bitdepth / 8 : 0;
+  x = 0;
+
+#ifdef BMP_SSSE3
+  if (simd AND (color_bytes > 1)) {
+    int i, j;
+    __m128i in[4], a[4], color_mask, alpha_mask, opaque;
+
+    // Shuffle masks (-1 = zero the byte), one per pixel size
+    if (color_bytes == 3)
+      color_mask = _mm_setr_epi8 (2,1,0,-1, 5,4,3,-1, 8,7,6,-1, 11,10,9,-1);
+    else
+      color_mask = _mm_setr_epi8 (2,1,0,-1, 6,5,4,-1, 10,9,8,-1, 14,13,12,-1);
+    if (alpha_bytes == 3)
+      alpha_mask = _mm_setr_epi8 (-1,-1,-1,2, -1,-1,-1,5, -1,-1,-1,8, -1,-1,-1,11);
+    else
+      alpha_mask = _mm_setr_epi8 (-1,-1,-1,2, -1,-1,-1,6, -1,-1,-1,10, -1,-1,-1,14);
+    opaque = _mm_set1_epi32 ((int)0xFF000000);
+
+    for (; x+16<=dx; x+=16) {
+      // 4 groups of 4 pixels, each group starting at byte 0 of a register
+      src = color_row + x * color_bytes;
+      if (color_bytes == 3) {
+        in[0] = _mm_loadu_si128 ((const __m128i *)src);
+        in[1] = _mm_loadu_si128 ((const __m128i *)(src + 16));
+        in[2] = _mm_loadu_si128 ((const __m128i *)(src + 32));
+        in[3] = _mm_srli_si128 (in[2], 4);
+        in[2] = _mm_alignr_epi8 (in[2], in[1], 8);
+        in[1] = _mm_alignr_epi8 (in[1], in[0], 12);
+      }
+      else
+        for (i=0; i<4; i++)
+          in[i] = _mm_loadu_si128 ((const __m128i *)(src + i*16));
+      for (i=0; i<4; i++)
+        in[i] = _mm_shuffle_epi8 (in[i], color_mask);
+
+      // Alpha, in the same pass
+      if (alpha_bytes > 1) {
+        src = alpha_row + x * alpha_bytes;
+        if (alpha_bytes == 3) {
+          a[0] = _mm_loadu_si128 ((const __m128i *)src);
+          a[1] = _mm_loadu_si128 ((const __m128i *)(src + 16));
+          a[2] = _mm_loadu_si128 ((const __m128i *)(src + 32));
+          a[3] = _mm_srli_si128 (a[2], 4);
+          a[2] = _mm_alignr_epi8 (a[2], a[1], 8);
+          a[1] = _mm_alignr_epi8 (a[1], a[0], 12);
+        }
+        else
+          for (i=0; i<4; i++)
+            a[i] = _mm_loadu_si128 ((const __m128i *)(src + i*16));
+        for (i=0; i<4; i++)
+          in[i] = _mm_or_si128 (in[i], _mm_shuffle_epi8 (a[i], alpha_mask));
+      }
+      else if (alpha_bytes == 1) {
+        // 8-bit alpha goes through its palette
+        for (i=0; i<4; i++) {
+          j = x + i*4;
+          a[i] = _mm_setr_epi32 (alpha->lut[alpha_row[j]] << 24, alpha->lut[alpha_row[j+1]] << 24, alpha->lut[alpha_row[j+2]] << 24, alpha->lut[alpha_row[j+3]] << 24);
+          in[i] = _mm_or_si128 (in[i], a[i]);
+        }
+      }
+      else
+        for (i=0; i<4; i++)
+          in[i] = _mm_or_si128 (in[i], opaque);
+
+      for (i=0; i<4; i++)
+        _mm_storeu_si128 ((__m128i *)(dst32 + x + i*4), in[i]);
+    }
+  }
+#endif
+
+  // Rest of the row (or all of it), a pixel at a time
+  for (; x<dx; x++) {
+    if (color_bytes == 1)
+      dst32[x] = color->lut[color_row[x]];
+    else {
+      src = color_row + x * color_bytes;
+      dst32[x] = src[2] | (src[1] << 8) | (src[0] << 16);
+    }
+    if (alpha_bytes == 0)
+      dst32[x] |= 0xFF000000;
+    else if (alpha_bytes == 1)
+      dst32[x] |= alpha->lut[alpha_row[x]] << 24;
+    else
+      dst32[x] |= (unsigned)alpha_row[x * alpha_bytes + 2] << 24;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Has_SSSE3
+|
+| Input: Called from Bmp_Decode()
+| Output: Returns true if SSSE3 byte shuffles can be used.
+|___________________________________________________________________*/
+
+static int Has_SSSE3 ()
+{
+#if defined(BMP_SSSE3) && defined(_MSC_VER)
+  // Built without /arch:AVX, so ask the processor
+  static int has_ssse3 = -1;
+  int info[4];
+
+  if (has_ssse3 == -1) {
+    __cpuid (info, 1);
+    has_ssse3 = (info[2] >> 9) & 1;
+  }
+  return (has_ssse3);
+#elif defined(BMP_SSSE3)
+  return (TRUE);
+#else
+  return (FALSE);
+#endif
+}
+
+/*____________________________________________________________________
+|
+| Function: Bmp_Write
+|
+| Input: Called from ____
+| Output: Writes the color or the alpha channel of an RGBA image to a
+|   24-bit BMP file.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+int Bmp_Write (const char *filename, byte *rgba, int dx, int dy, int what)
+{
+  int x, y, pitch, ok;
+  unsigned size;
+  FILE *fp;
+  byte header[54], *line, *src, *dst;
+
+  fp = fopen (filename, "wb");
+  if (fp == NULL)
+    return (FALSE);
+
+  pitch = (dx * 3 + 3) & ~3;
+  size  = sizeof(header) + pitch * dy;
+
+  memset (header, 0, sizeof(header));
+  header[0] = 'B';
+  header[1] = 'M';
+  PUT_DWORD (header+2,  size);
+  PUT_DWORD (header+10, sizeof(header));
+  PUT_DWORD (header+14, 40);
+  PUT_DWORD (header+18, dx);
+  PUT_DWORD (header+22, dy);
+  PUT_WORD  (header+26, 1);
+  PUT_WORD  (header+28, 24);
+  PUT_DWORD (header+34, pitch * dy);
+  ok = (fwrite (header, 1, sizeof(header), fp) == sizeof(header));
+
+  line = (byte *) calloc (pitch, 1);
+  if (line == NULL)
+    ok = FALSE;
+
+  // Rows are written bottom to top
+  for (y=dy-1; ok AND (y>=0); y--) {
+    src = rgba + y * dx * 4;
+    dst = line;
+    for (x=0; x<dx; x++, src+=4, dst+=3) {
+      if (what == BMP_WRITE_ALPHA) {
+        dst[0] = src[3];
+        dst[1] = src[3];
+        dst[2] = src[3];
+      }
+      else {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+      }
+    }
+    ok = (fwrite (line, 1, pitch, fp) == (size_t)pitch);
+  }
+
+  if (line)
+    free (line);
+  fclose (fp);
+
+  return (ok);
+}
@@ -0,0 +1,23 @@
+/*____________________________________________________________________
+|
+| File: bmp.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// What Bmp_Write() writes from an RGBA image
+#define BMP_WRITE_COLOR 0   // rgb channels
+#define BMP_WRITE_ALPHA 1   // alpha channel as gray, for a _fa file
+
+// Reads size and bits per pixel of a BMP file, returns true on success
+int Bmp_Read_Info (const char *filename, int *dx, int *dy, int *bitdepth);
+
+// Reads an 8, 24 or 32-bit BMP file into a new RGBA image (rows top to bottom), returns NULL on any error
+byte *Bmp_Read (const char *filename, int *dx, int *dy);
+
+// Decodes a BMP file and its alpha (_fa) file (NULL = opaque) into an RGBA image the caller allocated, dx by dy with rows pitch bytes apart, returns true on success
+int Bmp_Decode (const char *color_file, const char *alpha_file, byte *rgba, int dx, int dy, int pitch);
+
+// Writes an RGBA image (rows top to bottom) to a 24-bit BMP file, returns true on success
+int Bmp_Write (const char *filename, byte *rgba, int dx, int dy, int what);
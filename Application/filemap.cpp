@@ -0,0 +1,152 @@
+/*____________________________________________________________________
+|
+| File: filemap.cpp
+|
+| Description: Read only file mapping and a few other file functions
+|   used by asset loaders.  Only uses the C library and the OS calls so
+|   it can be built into tools as well as the game.
+|
+| Functions: File_Map
+|            File_Unmap
+|            File_Get_Info
+|            File_Hash
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+
+#include "filemap.h"
+
+/*____________________________________________________________________
+|
+| Function: File_Map
+|
+| Input: Called from ____
+| Output: Maps a whole file read only.  Returns a pointer to the data,
+|   or NULL on any error or if the file is empty.
+|___________________________________________________________________*/
+
+const void *File_Map (const char *filename, unsigned *size)
+{
+  const void *data = NULL;
+
+#ifdef _WIN32
+  HANDLE file, mapping;
+
+  file = CreateFileA (filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file != INVALID_HANDLE_VALUE) {
+    *size = GetFileSize (file, NULL);
+    if ((*size != INVALID_FILE_SIZE) && (*size > 0)) {
+      mapping = CreateFileMapping (file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping) {
+        data = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+        // The view keeps the mapping open
+        CloseHandle (mapping);
+      }
+    }
+    CloseHandle (file);
+  }
+#else
+  int fd;
+  struct stat info;
+  void *p;
+
+  fd = open (filename, O_RDONLY);
+  if (fd != -1) {
+    if ((fstat (fd, &info) == 0) && (info.st_size > 0)) {
+      *size = (unsigned) info.st_size;
+      p = mmap (NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+        data = p;
+    }
+    close (fd);
+  }
+#endif
+
+  return (data);
+}
+
+/*____________________________________________________________________
+|
+| Function: File_Unmap
+|
+| Input: Called from ____
+| Output: Unmaps a file mapped by File_Map().
+|___________________________________________________________________*/
+
+void File_Unmap (const void *data, unsigned size)
+{
+#ifdef _WIN32
+  UnmapViewOfFile (data);
+#else
+  munmap ((void *) data, size);
+#endif
+}
+
+/*____________________________________________________________________
+|
+| Function: File_Get_Info
+|
+| Input: Called from ____
+| Output: Gets size and last write time of a file.  Times are only
+|   good for comparing with each other.  Returns true on success, else
+|   false.
+|___________________________________________________________________*/
+
+bool File_Get_Info (const char *filename, unsigned *size, unsigned long long *write_time)
+{
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA info;
+
+  if (!GetFileAttributesExA (filename, GetFileExInfoStandard, &info))
+    return (false);
+  *size       = info.nFileSizeLow;
+  *write_time = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+  struct stat info;
+
+  if (stat (filename, &info) != 0)
+    return (false);
+  *size       = (unsigned) info.st_size;
+  *write_time = (unsigned long long)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: File_Hash
+|
+| Input: Called from ____
+| Output: Returns a 64-bit FNV-1a hash of some data.
+|___________________________________________________________________*/
+
+unsigned long long File_Hash (const void *data, unsigned size)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  unsigned long long hash = 14695981039346656037ULL;
+  unsigned i;
+
+  for (i=0; i<size; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return (hash);
+}
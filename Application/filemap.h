@@ -0,0 +1,19 @@
+/*____________________________________________________________________
+|
+| File: filemap.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// Maps a whole file read only, returns NULL on any error (or an empty file)
+const void *File_Map (const char *filename, unsigned *size);
+
+// Unmaps a file mapped by File_Map()
+void File_Unmap (const void *data, unsigned size);
+
+// Gets size and last write time of a file, returns true on success
+bool File_Get_Info (const char *filename, unsigned *size, unsigned long long *write_time);
+
+// Returns a 64-bit hash (FNV-1a) of some data
+unsigned long long File_Hash (const void *data, unsigned size);
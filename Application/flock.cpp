@@ -0,0 +1,482 @@
+/*____________________________________________________________________
+|
+| File: flock.cpp
+|
+| Description: Boids style flocking (separation, alignment, cohesion)
+|   for a large number of ghosts moving on the xz plane.
+|
+|   Neighbor queries use a uniform grid (cell list) that is rebuilt every
+|   frame with a counting sort.  The sort copies positions and velocities
+|   into arrays ordered by cell, so the ghosts in a row of 3 neighboring
+|   cells are one contiguous span of memory.  Steering reads only the
+|   sorted copies and writes only the ghost's own slot, so the update runs
+|   in parallel and gives the same result for any number of threads.
+|
+|   Steering can be throttled per ghost (see lod.cpp): a ghost with an
+|   interval of n is steered every nth frame, staggered by ghost number
+|   so the work is spread evenly over frames.  Every ghost still moves
+|   along its current velocity every frame.
+|
+| Functions: Flock_Init
+|            Flock_Free
+|            Flock_Num_Ghosts
+|            Flock_Update
+|             Compute_Cells
+|             Sort_By_Cell
+|             Steer_Ghosts
+|             Move_Ghosts
+|            Flock_Get_Position
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <math.h>
+
+#include "dp.h"
+
+#include "jobs.h"
+#include "flock.h"
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Compute_Cells (int first, int last, void *params);
+static void Sort_By_Cell ();
+static void Steer_Ghosts (int first, int last, void *params);
+static void Move_Ghosts (int first, int last, void *params);
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MAX_ELAPSED_TIME 100  // milliseconds, larger steps are clamped to keep the flock stable
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static int         num_ghosts = 0;
+static FlockParams flock_params;
+static float       bound_xmin, bound_zmin, bound_xmax, bound_zmax;
+
+// Grid
+static float  cell_size_inv;
+static int    grid_dx, grid_dz;
+static int   *cell_start;   // [grid_dx*grid_dz+1], first sorted index of each cell
+static int   *cell_cursor;  // [grid_dx*grid_dz], scatter position while sorting
+
+// Ghost state, by ghost
+static float *pos_x, *pos_y, *pos_z;
+static float *vel_x, *vel_z;
+static int   *ghost_cell;
+
+// Ghost state, sorted by cell (rebuilt every frame)
+static int   *sorted_ghost;
+static float *sorted_pos_x, *sorted_pos_z;
+static float *sorted_vel_x, *sorted_vel_z;
+
+// Current step
+static unsigned    step_frame;
+static float       step_time;       // seconds
+static float       step_target_x, step_target_z;
+static const byte *step_interval;   // steering interval of each ghost (NULL = every frame)
+
+/*____________________________________________________________________
+|
+| Function: Flock_Init
+|
+| Input: Called from Program_Run()
+| Output: Allocates flock state and sets starting positions.  Ghosts
+|   start at rest.
+|___________________________________________________________________*/
+
+void Flock_Init (
+  int          n,
+  gx3dVector  *positions,
+  float        xmin,
+  float        zmin,
+  float        xmax,
+  float        zmax,
+  FlockParams *params )
+{
+  int i, num_cells;
+
+  num_ghosts   = n;
+  flock_params = *params;
+  bound_xmin   = xmin;
+  bound_zmin   = zmin;
+  bound_xmax   = xmax;
+  bound_zmax   = zmax;
+
+  // Make the grid, one cell per neighbor radius
+  cell_size_inv = 1 / flock_params.neighbor_radius;
+  grid_dx = (int) ceil ((xmax - xmin) * cell_size_inv);
+  grid_dz = (int) ceil ((zmax - zmin) * cell_size_inv);
+  if (grid_dx < 1)
+    grid_dx = 1;
+  if (grid_dz < 1)
+    grid_dz = 1;
+  num_cells = grid_dx * grid_dz;
+
+  cell_start   = (int *) malloc ((num_cells + 1) * sizeof(int));
+  cell_cursor  = (int *) malloc (num_cells * sizeof(int));
+
+  pos_x        = (float *) malloc (num_ghosts * sizeof(float));
+  pos_y        = (float *) malloc (num_ghosts * sizeof(float));
+  pos_z        = (float *) malloc (num_ghosts * sizeof(float));
+  vel_x        = (float *) malloc (num_ghosts * sizeof(float));
+  vel_z        = (float *) malloc (num_ghosts * sizeof(float));
+  ghost_cell   = (int *)   malloc (num_ghosts * sizeof(int));
+
+  sorted_ghost = (int *)   malloc (num_ghosts * sizeof(int));
+  sorted_pos_x = (float *) malloc (num_ghosts * sizeof(float));
+  sorted_pos_z = (float *) malloc (num_ghosts * sizeof(float));
+  sorted_vel_x = (float *) malloc (num_ghosts * sizeof(float));
+  sorted_vel_z = (float *) malloc (num_ghosts * sizeof(float));
+
+  for (i=0; i<num_ghosts; i++) {
+    pos_x[i] = positions[i].x;
+    pos_y[i] = positions[i].y;
+    pos_z[i] = positions[i].z;
+    vel_x[i] = 0;
+    vel_z[i] = 0;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Flock_Free
+|
+| Input: Called from Program_Run()
+| Output: Frees flock state.
+|___________________________________________________________________*/
+
+void Flock_Free ()
+{
+  if (num_ghosts) {
+    free (cell_start);
+    free (cell_cursor);
+    free (pos_x);
+    free (pos_y);
+    free (pos_z);
+    free (vel_x);
+    free (vel_z);
+    free (ghost_cell);
+    free (sorted_ghost);
+    free (sorted_pos_x);
+    free (sorted_pos_z);
+    free (sorted_vel_x);
+    free (sorted_vel_z);
+    num_ghosts = 0;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Flock_Num_Ghosts
+|
+| Input: Called from ____
+| Output: Returns # of ghosts in the flock.
+|___________________________________________________________________*/
+
+int Flock_Num_Ghosts ()
+{
+  return (num_ghosts);
+}
+
+/*____________________________________________________________________
+|
+| Function: Flock_Update
+|
+| Input: Called from Program_Run()
+| Output: Rebuilds the cell list, steers the ghosts that are due and
+|   moves every ghost one step.
+|___________________________________________________________________*/
+
+void Flock_Update (
+  unsigned    elapsed_time,   // milliseconds
+  gx3dVector *target,
+  const byte *steer_interval )
+{
+  if (num_ghosts == 0)
+    return;
+
+  if (elapsed_time > MAX_ELAPSED_TIME)
+    elapsed_time = MAX_ELAPSED_TIME;
+  step_frame++;
+  step_time     = (float)elapsed_time / 1000;
+  step_target_x = target->x;
+  step_target_z = target->z;
+  step_interval = steer_interval;
+
+  Jobs_Parallel_For (num_ghosts, 0, Compute_Cells, NULL);
+  Sort_By_Cell ();
+  Jobs_Parallel_For (num_ghosts, 0, Steer_Ghosts, NULL);
+  Jobs_Parallel_For (num_ghosts, 0, Move_Ghosts, NULL);
+}
+
+/*____________________________________________________________________
+|
+| Function: Compute_Cells
+|
+| Input: Called from Flock_Update() through Jobs_Parallel_For()
+| Output: Computes the grid cell each ghost is in.
+|___________________________________________________________________*/
+
+static void Compute_Cells (int first, int last, void *params)
+{
+  int i, cx, cz;
+
+  for (i=first; i<last; i++) {
+    cx = (int)((pos_x[i] - bound_xmin) * cell_size_inv);
+    cz = (int)((pos_z[i] - bound_zmin) * cell_size_inv);
+    if (cx < 0)
+      cx = 0;
+    else if (cx >= grid_dx)
+      cx = grid_dx - 1;
+    if (cz < 0)
+      cz = 0;
+    else if (cz >= grid_dz)
+      cz = grid_dz - 1;
+    ghost_cell[i] = cz * grid_dx + cx;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Sort_By_Cell
+|
+| Input: Called from Flock_Update()
+| Output: Counting sort of ghosts by cell.  Builds cell_start[] and
+|   copies ghost state into cell order.  The sort is stable so the
+|   order (and the flock) is the same every run.
+|___________________________________________________________________*/
+
+static void Sort_By_Cell ()
+{
+  int i, c, n, sum, num_cells;
+
+  num_cells = grid_dx * grid_dz;
+
+  // Count ghosts per cell
+  memset (cell_cursor, 0, num_cells * sizeof(int));
+  for (i=0; i<num_ghosts; i++)
+    cell_cursor[ghost_cell[i]]++;
+
+  // Prefix sum gives the first sorted index of each cell
+  sum = 0;
+  for (c=0; c<num_cells; c++) {
+    n = cell_cursor[c];
+    cell_start[c]  = sum;
+    cell_cursor[c] = sum;
+    sum += n;
+  }
+  cell_start[num_cells] = sum;
+
+  // Scatter into cell order
+  for (i=0; i<num_ghosts; i++) {
+    n = cell_cursor[ghost_cell[i]]++;
+    sorted_ghost[n] = i;
+    sorted_pos_x[n] = pos_x[i];
+    sorted_pos_z[n] = pos_z[i];
+    sorted_vel_x[n] = vel_x[i];
+    sorted_vel_z[n] = vel_z[i];
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Steer_Ghosts
+|
+| Input: Called from Flock_Update() through Jobs_Parallel_For()
+| Output: Computes steering for a range of sorted ghosts and updates
+|   their velocity.  Ghosts that are not due this frame are skipped.
+|___________________________________________________________________*/
+
+static void Steer_Ghosts (int first, int last, void *params)
+{
+  int s, j, g, cell, cx, cz, row, first_cell, last_cell, count, interval;
+  float x, z, vx, vz, dx, dz, d2, len, scale, dt;
+  float sep_x, sep_z, sum_vx, sum_vz, sum_x, sum_z;
+  float ax, az;
+  float neighbor_r2   = flock_params.neighbor_radius * flock_params.neighbor_radius;
+  float separation_r2 = flock_params.separation_radius * flock_params.separation_radius;
+
+  for (s=first; s<last; s++) {
+    g = sorted_ghost[s];
+
+    // Due this frame?
+    interval = step_interval ? step_interval[g] : 1;
+    if ((interval > 1) AND ((step_frame + g) % interval))
+      continue;
+    // Steering covers the whole interval since it was last done
+    dt = step_time * interval;
+
+    cell = ghost_cell[g];
+    cx   = cell % grid_dx;
+    cz   = cell / grid_dx;
+    x    = sorted_pos_x[s];
+    z    = sorted_pos_z[s];
+    vx   = sorted_vel_x[s];
+    vz   = sorted_vel_z[s];
+
+    sep_x = sep_z = 0;
+    sum_vx = sum_vz = 0;
+    sum_x = sum_z = 0;
+    count = 0;
+
+/*____________________________________________________________________
+|
+| Gather neighbors - each row of 3 cells is one contiguous span
+|___________________________________________________________________*/
+
+    first_cell = (cx > 0) ? cx - 1 : cx;
+    last_cell  = (cx < grid_dx - 1) ? cx + 1 : cx;
+    for (row = (cz > 0 ? cz - 1 : cz); (row <= cz + 1) AND (row < grid_dz) AND (count < flock_params.max_neighbors); row++) {
+      int span_first = cell_start[row * grid_dx + first_cell];
+      int span_last  = cell_start[row * grid_dx + last_cell + 1];
+      for (j=span_first; (j<span_last) AND (count < flock_params.max_neighbors); j++) {
+        if (j == s)
+          continue;
+        dx = x - sorted_pos_x[j];
+        dz = z - sorted_pos_z[j];
+        d2 = dx*dx + dz*dz;
+        if (d2 < neighbor_r2) {
+          if ((d2 < separation_r2) AND (d2 > 0)) {
+            sep_x += dx / d2;
+            sep_z += dz / d2;
+          }
+          sum_vx += sorted_vel_x[j];
+          sum_vz += sorted_vel_z[j];
+          sum_x  += sorted_pos_x[j];
+          sum_z  += sorted_pos_z[j];
+          count++;
+        }
+      }
+    }
+
+/*____________________________________________________________________
+|
+| Combine steering forces
+|___________________________________________________________________*/
+
+    ax = 0;
+    az = 0;
+    if (count) {
+      scale = 1 / (float)count;
+      // Separation
+      ax += sep_x * flock_params.separation_weight;
+      az += sep_z * flock_params.separation_weight;
+      // Alignment - match average velocity of neighbors
+      ax += (sum_vx * scale - vx) * flock_params.alignment_weight;
+      az += (sum_vz * scale - vz) * flock_params.alignment_weight;
+      // Cohesion - move towards center of neighbors
+      ax += (sum_x * scale - x) * flock_params.cohesion_weight;
+      az += (sum_z * scale - z) * flock_params.cohesion_weight;
+    }
+    // Seek the target
+    dx  = step_target_x - x;
+    dz  = step_target_z - z;
+    len = sqrtf (dx*dx + dz*dz);
+    if (len > 0) {
+      scale = flock_params.max_speed / len;
+      ax += (dx * scale - vx) * flock_params.seek_weight;
+      az += (dz * scale - vz) * flock_params.seek_weight;
+    }
+    // Limit force
+    len = sqrtf (ax*ax + az*az);
+    if (len > flock_params.max_force) {
+      scale = flock_params.max_force / len;
+      ax *= scale;
+      az *= scale;
+    }
+
+/*____________________________________________________________________
+|
+| Update velocity
+|___________________________________________________________________*/
+
+    vx += ax * dt;
+    vz += az * dt;
+    len = sqrtf (vx*vx + vz*vz);
+    if (len > flock_params.max_speed) {
+      scale = flock_params.max_speed / len;
+      vx *= scale;
+      vz *= scale;
+    }
+
+    // Write back to this ghost's own slot only
+    vel_x[g] = vx;
+    vel_z[g] = vz;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Move_Ghosts
+|
+| Input: Called from Flock_Update() through Jobs_Parallel_For()
+| Output: Moves a range of ghosts along their velocity.
+|___________________________________________________________________*/
+
+static void Move_Ghosts (int first, int last, void *params)
+{
+  int g;
+  float x, z, vx, vz;
+
+  for (g=first; g<last; g++) {
+    vx = vel_x[g];
+    vz = vel_z[g];
+    x  = pos_x[g] + vx * step_time;
+    z  = pos_z[g] + vz * step_time;
+
+    // Stay inside the bounds
+    if (x < bound_xmin) {
+      x  = bound_xmin;
+      vx = -vx;
+    }
+    else if (x > bound_xmax) {
+      x  = bound_xmax;
+      vx = -vx;
+    }
+    if (z < bound_zmin) {
+      z  = bound_zmin;
+      vz = -vz;
+    }
+    else if (z > bound_zmax) {
+      z  = bound_zmax;
+      vz = -vz;
+    }
+
+    pos_x[g] = x;
+    pos_z[g] = z;
+    vel_x[g] = vx;
+    vel_z[g] = vz;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Flock_Get_Position
+|
+| Input: Called from ____
+| Output: Returns the current position of a ghost.
+|___________________________________________________________________*/
+
+void Flock_Get_Position (int ghost, gx3dVector *position)
+{
+  position->x = pos_x[ghost];
+  position->y = pos_y[ghost];
+  position->z = pos_z[ghost];
+}
@@ -0,0 +1,44 @@
+/*____________________________________________________________________
+|
+| File: flock.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+typedef struct {
+  float neighbor_radius;    // feet, also the size of a grid cell
+  float separation_radius;  // feet
+  int   max_neighbors;      // max # of neighbors looked at per ghost
+  float separation_weight;
+  float alignment_weight;
+  float cohesion_weight;
+  float seek_weight;
+  float max_speed;          // feet per second
+  float max_force;          // feet per second per second
+} FlockParams;
+
+// Init flock with starting positions, ghosts are kept inside the rectangle on the xz plane
+void Flock_Init (
+  int          num_ghosts,
+  gx3dVector  *positions,
+  float        xmin,
+  float        zmin,
+  float        xmax,
+  float        zmax,
+  FlockParams *params );
+
+// Free any resources
+void Flock_Free ();
+
+// Returns # of ghosts in the flock
+int Flock_Num_Ghosts ();
+
+// Moves all ghosts one step, steering them towards target
+void Flock_Update (
+  unsigned    elapsed_time,     // milliseconds
+  gx3dVector *target,
+  const byte *steer_interval ); // # of frames between steering for each ghost, NULL = every frame
+
+// Returns the current position of a ghost
+void Flock_Get_Position (int ghost, gx3dVector *position);
@@ -0,0 +1,581 @@
+/*____________________________________________________________________
+|
+| File: forest.cpp
+|
+| Description: A forest of many tree instances.  Trees are scattered at
+|   startup from a density map.  Each frame every tree picks how it is
+|   drawn from its projected size on screen (full mesh, low poly mesh or
+|   billboard impostor), with hysteresis so trees don't flicker between
+|   ways.
+|
+|   Trees are then sorted into batches, one for the full mesh, one for
+|   each low poly texture and one for the impostor, so a batch is drawn
+|   with its textures set once.  Selection and batching are split into
+|   ranges of trees run on the worker threads: each range counts its
+|   trees per batch, the counts give each range a fixed spot in each
+|   batch, then each range writes its trees there.  The batches come out
+|   the same for any number of threads.
+|
+| Functions: Forest_Init
+|             Place_Trees
+|             Random
+|            Forest_Free
+|            Forest_Set_Textures
+|            Forest_Set_Models
+|            Forest_Update
+|             Select_Trees
+|             Fill_Batches
+|            Forest_Draw
+|            Forest_Get_Stats
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <math.h>
+
+#include "dp.h"
+
+#include "bmp.h"
+#include "jobs.h"
+#include "forest.h"
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int      Place_Trees (byte *density, int map_dx, int map_dy, bool store);
+static unsigned Random ();
+static void     Select_Trees (int first, int last, void *params);
+static void     Fill_Batches (int first, int last, void *params);
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define PI 3.14159265f
+
+// Batches: full mesh, one per low poly texture, impostor
+#define BATCH_FULL     0
+#define BATCH_LOW_POLY 1
+#define BATCH_IMPOSTOR (BATCH_LOW_POLY + FOREST_LOW_POLY_TEXTURES)
+#define NUM_BATCHES    (BATCH_IMPOSTOR + 1)
+#define NO_BATCH       0xFF
+
+#define NUM_RANGES     64     // trees are selected in this many ranges
+
+#define CLEARING_RADIUS 200   // feet, no trees this close to the origin without a density map
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static int           num_trees = 0;
+static ForestParams  forest_params;
+static ForestAssets  forest_assets;
+static float         bound_xmin, bound_zmin, bound_xmax, bound_zmax;
+static unsigned      random_seed;
+
+// Trees
+static float        *tree_x, *tree_z, *tree_scale;
+static gx3dMatrix   *tree_matrix;   // world transform, before the scale of each mesh
+static byte         *tree_rep;      // how tree was drawn last frame (for hysteresis)
+static byte         *tree_batch;
+
+// Batches
+static int          *batch_tree;    // trees of all batches, batch by batch
+static int           batch_start [NUM_BATCHES];
+static int           batch_count [NUM_BATCHES];
+static int           range_count [NUM_RANGES][NUM_BATCHES];
+static int           range_size;
+
+// Current update
+static gx3dMatrix    update_view;
+static float         update_tan_x, update_tan_y;
+static float         update_far;
+static float         update_pixels;  // projected size = radius * update_pixels / z
+static float         full_radius, impostor_lift;
+
+static ForestStats   forest_stats;
+
+/*____________________________________________________________________
+|
+| Function: Forest_Init
+|
+| Input: Called from Program_Run()
+| Output: Places trees and precomputes their mesh transforms.
+|___________________________________________________________________*/
+
+void Forest_Init (
+  const char   *density_map,
+  float         xmin,
+  float         zmin,
+  float         xmax,
+  float         zmax,
+  ForestParams *params,
+  ForestAssets *assets )
+{
+  int i, map_dx, map_dy;
+  byte *density = NULL;
+  gx3dMatrix ms, mr, mt, m;
+
+  forest_params = *params;
+  forest_assets = *assets;
+  bound_xmin    = xmin;
+  bound_zmin    = zmin;
+  bound_xmax    = xmax;
+  bound_zmax    = zmax;
+
+  if (density_map)
+    density = Bmp_Read (density_map, &map_dx, &map_dy);
+
+  // Count trees, then place them (same seed both times)
+  random_seed = forest_params.seed;
+  num_trees = Place_Trees (density, map_dx, map_dy, false);
+
+  tree_x      = (float *)      malloc (num_trees * sizeof(float));
+  tree_z      = (float *)      malloc (num_trees * sizeof(float));
+  tree_scale  = (float *)      malloc (num_trees * sizeof(float));
+  tree_matrix = (gx3dMatrix *) malloc (num_trees * sizeof(gx3dMatrix));
+  tree_rep    = (byte *)       malloc (num_trees);
+  tree_batch  = (byte *)       malloc (num_trees);
+  batch_tree  = (int *)        malloc (num_trees * sizeof(int));
+
+  random_seed = forest_params.seed;
+  Place_Trees (density, map_dx, map_dy, true);
+  if (density)
+    free (density);
+
+  for (i=0; i<num_trees; i++) {
+    gx3d_GetScaleMatrix (&ms, tree_scale[i], tree_scale[i], tree_scale[i]);
+    gx3d_GetRotateYMatrix (&mr, (float)(Random () % 360));
+    gx3d_GetTranslateMatrix (&mt, tree_x[i], 0, tree_z[i]);
+    gx3d_MultiplyMatrix (&ms, &mr, &m);
+    gx3d_MultiplyMatrix (&m, &mt, &tree_matrix[i]);
+    tree_rep[i] = FOREST_CULLED;
+  }
+
+  // Size of a tree, used to compute projected size
+  full_radius = forest_assets.full->bound_sphere.radius * forest_params.full_scale;
+  // Impostor is a square centered on its origin, raise it to stand on the ground
+  impostor_lift = forest_assets.impostor->bound_sphere.radius * forest_params.impostor_scale * 0.7071f;
+
+  range_size = (num_trees + NUM_RANGES - 1) / NUM_RANGES;
+  memset (&forest_stats, 0, sizeof(forest_stats));
+  forest_stats.num_trees = num_trees;
+}
+
+/*____________________________________________________________________
+|
+| Function: Place_Trees
+|
+| Input: Called from Forest_Init()
+| Output: Walks a grid of possible tree spots and keeps each one with a
+|   chance equal to the density there.  Kept spots are jittered inside
+|   their grid cell.  Stores trees only if store is true.  Returns # of
+|   trees.
+|___________________________________________________________________*/
+
+static int Place_Trees (byte *density, int map_dx, int map_dy, bool store)
+{
+  int n, mx, my;
+  float x, z, d, chance;
+
+  n = 0;
+  for (z=bound_zmin; z<bound_zmax; z+=forest_params.spacing) {
+    for (x=bound_xmin; x<bound_xmax; x+=forest_params.spacing) {
+      if (density) {
+        // Map covers the whole rectangle, top row of the map is zmax
+        mx = (int)((x - bound_xmin) / (bound_xmax - bound_xmin) * map_dx);
+        my = (int)((bound_zmax - z) / (bound_zmax - bound_zmin) * map_dy);
+        if (mx >= map_dx)
+          mx = map_dx - 1;
+        if (my >= map_dy)
+          my = map_dy - 1;
+        chance = density[(my * map_dx + mx) * 4] / 255.0f;
+      }
+      else {
+        // Clear area around the origin, then thicker farther out
+        d = sqrtf (x*x + z*z);
+        chance = (d - CLEARING_RADIUS) / CLEARING_RADIUS;
+        if (chance > 1)
+          chance = 1;
+      }
+      if ((Random () % 1000) < (unsigned)(chance * 1000)) {
+        if (store) {
+          tree_x[n]     = x + (Random () % 1000) / 1000.0f * forest_params.spacing;
+          tree_z[n]     = z + (Random () % 1000) / 1000.0f * forest_params.spacing;
+          tree_scale[n] = 0.8f + (Random () % 1000) / 1000.0f * 0.4f;
+        }
+        else {
+          // Use as many random numbers as when storing
+          Random ();
+          Random ();
+          Random ();
+        }
+        n++;
+      }
+    }
+  }
+
+  return (n);
+}
+
+/*____________________________________________________________________
+|
+| Function: Random
+|
+| Input: Called from Forest_Init(), Place_Trees()
+| Output: Returns a pseudo random number (LCG) so the same seed always
+|   gives the same forest.
+|___________________________________________________________________*/
+
+static unsigned Random ()
+{
+  random_seed = random_seed * 1664525 + 1013904223;
+  return (random_seed >> 8);
+}
+
+/*____________________________________________________________________
+|
+| Function: Forest_Free
+|
+| Input: Called from Program_Run()
+| Output: Frees tree and batch arrays.
+|___________________________________________________________________*/
+
+void Forest_Free ()
+{
+  if (num_trees) {
+    free (tree_x);
+    free (tree_z);
+    free (tree_scale);
+    free (tree_matrix);
+    free (tree_rep);
+    free (tree_batch);
+    free (batch_tree);
+    num_trees = 0;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Forest_Set_Textures
+|
+| Input: Called from Program_Run()
+| Output: Changes the textures trees are drawn with (models stay the
+|   same), used when streamed textures finish loading.
+|___________________________________________________________________*/
+
+void Forest_Set_Textures (ForestAssets *assets)
+{
+  int i;
+
+  forest_assets.trunk_texture    = assets->trunk_texture;
+  forest_assets.leaves_texture   = assets->leaves_texture;
+  forest_assets.impostor_texture = assets->impostor_texture;
+  for (i=0; i<FOREST_LOW_POLY_TEXTURES; i++)
+    forest_assets.low_poly_textures[i] = assets->low_poly_textures[i];
+}
+
+/*____________________________________________________________________
+|
+| Function: Forest_Set_Models
+|
+| Input: Called from Program_Run()
+| Output: Changes the models trees are drawn with (textures stay the
+|   same), used when changed models are loaded again.
+|___________________________________________________________________*/
+
+void Forest_Set_Models (ForestAssets *assets)
+{
+  forest_assets.full     = assets->full;
+  forest_assets.low_poly = assets->low_poly;
+  forest_assets.impostor = assets->impostor;
+
+  full_radius   = forest_assets.full->bound_sphere.radius * forest_params.full_scale;
+  impostor_lift = forest_assets.impostor->bound_sphere.radius * forest_params.impostor_scale * 0.7071f;
+}
+
+/*____________________________________________________________________
+|
+| Function: Forest_Update
+|
+| Input: Called from Program_Run()
+| Output: Picks how each tree is drawn and builds the batches.
+|___________________________________________________________________*/
+
+void Forest_Update (
+  gx3dMatrix *view_matrix,
+  float       fov,          // degrees
+  float       aspect,       // screen width / height
+  float       far_plane,
+  int         screen_dy )   // pixels
+{
+  int r, b, sum;
+  LARGE_INTEGER start, end, freq;
+
+  if (num_trees == 0)
+    return;
+
+  QueryPerformanceCounter (&start);
+
+  update_view   = *view_matrix;
+  update_tan_y  = tanf (fov * PI / 360);
+  update_tan_x  = update_tan_y * aspect;
+  update_far    = far_plane;
+  update_pixels = (float)screen_dy / update_tan_y;
+
+  // Pick a way to draw each tree, count trees per batch in each range
+  Jobs_Parallel_For (NUM_RANGES, 1, Select_Trees, NULL);
+
+  // Batch starts, and where each range writes in each batch
+  sum = 0;
+  for (b=0; b<NUM_BATCHES; b++) {
+    batch_start[b] = sum;
+    for (r=0; r<NUM_RANGES; r++) {
+      int n = range_count[r][b];
+      range_count[r][b] = sum;
+      sum += n;
+    }
+    batch_count[b] = sum - batch_start[b];
+  }
+
+  // Write trees into the batches
+  Jobs_Parallel_For (NUM_RANGES, 1, Fill_Batches, NULL);
+
+  forest_stats.count[FOREST_FULL]     = batch_count[BATCH_FULL];
+  forest_stats.count[FOREST_IMPOSTOR] = batch_count[BATCH_IMPOSTOR];
+  forest_stats.count[FOREST_LOW_POLY] = 0;
+  for (b=BATCH_LOW_POLY; b<BATCH_IMPOSTOR; b++)
+    forest_stats.count[FOREST_LOW_POLY] += batch_count[b];
+  forest_stats.count[FOREST_CULLED] = num_trees - sum;
+
+  QueryPerformanceCounter (&end);
+  QueryPerformanceFrequency (&freq);
+  forest_stats.update_time = (float)((double)(end.QuadPart - start.QuadPart) * 1000 / freq.QuadPart);
+}
+
+/*____________________________________________________________________
+|
+| Function: Select_Trees
+|
+| Input: Called from Forest_Update() through Jobs_Parallel_For()
+| Output: For a range of ranges, culls trees outside the view and picks
+|   how the rest are drawn.  Counts trees per batch in each range.
+|___________________________________________________________________*/
+
+static void Select_Trees (int first, int last, void *params)
+{
+  int r, i, end, rep, level, batch;
+  float radius, size, up, down, texture_size;
+  gx3dVector center, view;
+  float out_scale = 1 - forest_params.hysteresis;   // size must drop this far below a limit to get less detail
+  float in_scale  = 1 + forest_params.hysteresis;   // or rise this far above it to get more
+
+  for (r=first; r<last; r++) {
+    memset (range_count[r], 0, sizeof(range_count[r]));
+    end = (r + 1) * range_size;
+    if (end > num_trees)
+      end = num_trees;
+    for (i=r*range_size; i<end; i++) {
+      center.x = tree_x[i];
+      center.y = full_radius * tree_scale[i];  // trees stand on y = 0
+      center.z = tree_z[i];
+      gx3d_MultiplyVectorMatrix (&center, &update_view, &view);
+
+      // Outside the view? (radius is padded since the sides of the view aren't normalized)
+      radius = full_radius * tree_scale[i];
+      batch  = NO_BATCH;
+      rep    = FOREST_CULLED;
+      if ((view.z + radius > 0) AND (view.z - radius < update_far) AND
+          (fabsf (view.x) - radius * 1.5f <= view.z * update_tan_x) AND
+          (fabsf (view.y) - radius * 1.5f <= view.z * update_tan_y)) {
+
+        // Projected size (in pixels) of the tree
+        size = radius * update_pixels / ((view.z > 1) ? view.z : 1);
+
+        // Step down while size is below a limit, step up while above one (with hysteresis)
+        rep = tree_rep[i];
+        if (rep == FOREST_CULLED)
+          rep = FOREST_IMPOSTOR;
+        for (;;) {
+          down = (rep == FOREST_FULL) ? forest_params.full_size : (rep == FOREST_LOW_POLY) ? forest_params.low_poly_size : forest_params.min_size;
+          if ((rep < FOREST_CULLED) AND (size < down * out_scale)) {
+            rep++;
+            continue;
+          }
+          if (rep > FOREST_FULL) {
+            up = (rep == FOREST_CULLED) ? forest_params.min_size : (rep == FOREST_IMPOSTOR) ? forest_params.low_poly_size : forest_params.full_size;
+            if (size > up * in_scale) {
+              rep--;
+              continue;
+            }
+          }
+          break;
+        }
+
+        switch (rep) {
+          case FOREST_FULL:
+            batch = BATCH_FULL;
+            break;
+          case FOREST_LOW_POLY:
+            // Largest texture for a full screen tree, half the size for each halving of the tree
+            texture_size = 512;
+            for (level=0; (level < FOREST_LOW_POLY_TEXTURES-1) AND (size * 2 < texture_size); level++)
+              texture_size /= 2;
+            batch = BATCH_LOW_POLY + level;
+            break;
+          case FOREST_IMPOSTOR:
+            batch = BATCH_IMPOSTOR;
+            break;
+        }
+      }
+
+      tree_rep[i]   = (byte)rep;
+      tree_batch[i] = (byte)batch;
+      if (batch != NO_BATCH)
+        range_count[r][batch]++;
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Fill_Batches
+|
+| Input: Called from Forest_Update() through Jobs_Parallel_For()
+| Output: Writes the trees of a range of ranges into the batches.
+|___________________________________________________________________*/
+
+static void Fill_Batches (int first, int last, void *params)
+{
+  int r, i, end, b;
+
+  for (r=first; r<last; r++) {
+    end = (r + 1) * range_size;
+    if (end > num_trees)
+      end = num_trees;
+    for (i=r*range_size; i<end; i++) {
+      b = tree_batch[i];
+      if (b != NO_BATCH)
+        batch_tree[range_count[r][b]++] = i;
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Forest_Draw
+|
+| Input: Called from Program_Run()
+| Output: Draws each batch with its textures set once.
+|___________________________________________________________________*/
+
+void Forest_Draw (gx3dVector *heading)
+{
+  int b, i, n, *trees;
+  gx3dObjectLayer *trunk, *leaves;
+  gx3dMatrix ms, mr, mt, m, scale_rotate;
+  gx3dVector billboard_normal = { 0, 0, 1 };
+
+  forest_stats.draws         = 0;
+  forest_stats.state_changes = 0;
+  if (num_trees == 0)
+    return;
+
+/*____________________________________________________________________
+|
+| Full mesh - all trunks then all leaves
+|___________________________________________________________________*/
+
+  n     = batch_count[BATCH_FULL];
+  trees = batch_tree + batch_start[BATCH_FULL];
+  if (n) {
+    trunk  = gx3d_GetObjectLayer (forest_assets.full, "trunk");
+    leaves = gx3d_GetObjectLayer (forest_assets.full, "leaves");
+    gx3d_GetScaleMatrix (&ms, forest_params.full_scale, forest_params.full_scale, forest_params.full_scale);
+    gx3d_SetTexture (0, forest_assets.trunk_texture);
+    for (i=0; i<n; i++) {
+      gx3d_MultiplyMatrix (&ms, &tree_matrix[trees[i]], &m);
+      gx3d_SetObjectMatrix (forest_assets.full, &m);
+      gx3d_Object_UpdateTransforms (forest_assets.full);
+      gx3d_DrawObjectLayer (trunk, 0);
+    }
+    gx3d_SetTexture (0, forest_assets.leaves_texture);
+    for (i=0; i<n; i++) {
+      gx3d_MultiplyMatrix (&ms, &tree_matrix[trees[i]], &m);
+      gx3d_SetObjectMatrix (forest_assets.full, &m);
+      gx3d_Object_UpdateTransforms (forest_assets.full);
+      gx3d_DrawObjectLayer (leaves, 0);
+    }
+    forest_stats.draws         += 2 * n;
+    forest_stats.state_changes += 2;
+  }
+
+/*____________________________________________________________________
+|
+| Low poly mesh - one batch per texture
+|___________________________________________________________________*/
+
+  gx3d_GetScaleMatrix (&ms, forest_params.low_poly_scale, forest_params.low_poly_scale, forest_params.low_poly_scale);
+  for (b=BATCH_LOW_POLY; b<BATCH_IMPOSTOR; b++) {
+    n     = batch_count[b];
+    trees = batch_tree + batch_start[b];
+    if (n == 0)
+      continue;
+    gx3d_SetTexture (0, forest_assets.low_poly_textures[b - BATCH_LOW_POLY]);
+    for (i=0; i<n; i++) {
+      gx3d_MultiplyMatrix (&ms, &tree_matrix[trees[i]], &m);
+      gx3d_SetObjectMatrix (forest_assets.low_poly, &m);
+      gx3d_DrawObject (forest_assets.low_poly, 0);
+    }
+    forest_stats.draws += n;
+    forest_stats.state_changes++;
+  }
+
+/*____________________________________________________________________
+|
+| Impostors - billboards facing the camera
+|___________________________________________________________________*/
+
+  n     = batch_count[BATCH_IMPOSTOR];
+  trees = batch_tree + batch_start[BATCH_IMPOSTOR];
+  if (n) {
+    gx3d_GetBillboardRotateYMatrix (&mr, &billboard_normal, heading);
+    gx3d_SetTexture (0, forest_assets.impostor_texture);
+    for (i=0; i<n; i++) {
+      float s = forest_params.impostor_scale * tree_scale[trees[i]];
+      gx3d_GetScaleMatrix (&ms, s, s, 1);
+      gx3d_MultiplyMatrix (&ms, &mr, &scale_rotate);
+      gx3d_GetTranslateMatrix (&mt, tree_x[trees[i]], impostor_lift * tree_scale[trees[i]], tree_z[trees[i]]);
+      gx3d_MultiplyMatrix (&scale_rotate, &mt, &m);
+      gx3d_SetObjectMatrix (forest_assets.impostor, &m);
+      gx3d_DrawObject (forest_assets.impostor, 0);
+    }
+    forest_stats.draws += n;
+    forest_stats.state_changes++;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Forest_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets stats for the last update and draw.
+|___________________________________________________________________*/
+
+void Forest_Get_Stats (ForestStats *stats)
+{
+  *stats = forest_stats;
+}
@@ -0,0 +1,80 @@
+/*____________________________________________________________________
+|
+| File: forest.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// Ways a tree is drawn, most detailed first
+#define FOREST_FULL      0  // full mesh (trunk + leaves layers)
+#define FOREST_LOW_POLY  1  // low poly mesh, texture picked by size
+#define FOREST_IMPOSTOR  2  // billboard
+#define FOREST_CULLED    3  // too small or outside the view
+#define NUM_FOREST_REPS  4
+
+// # of textures (largest first) for the low poly mesh
+#define FOREST_LOW_POLY_TEXTURES 6
+
+typedef struct {
+  float spacing;          // feet between possible tree spots
+  float full_size;        // projected size (pixels) at or above which the full mesh is used
+  float low_poly_size;    // projected size at or above which the low poly mesh is used
+  float min_size;         // projected size below which a tree isn't drawn
+  float hysteresis;       // fraction a size must go back past to switch back (0.1 = 10%)
+  float full_scale;       // scale of each mesh to make them the same size
+  float low_poly_scale;
+  float impostor_scale;
+  unsigned seed;          // for placement
+} ForestParams;
+
+typedef struct {
+  gx3dObject  *full;                     // needs "trunk" and "leaves" layers
+  gx3dObject  *low_poly;
+  gx3dObject  *impostor;
+  gx3dTexture  trunk_texture;
+  gx3dTexture  leaves_texture;
+  gx3dTexture  low_poly_textures [FOREST_LOW_POLY_TEXTURES];
+  gx3dTexture  impostor_texture;
+} ForestAssets;
+
+typedef struct {
+  int   num_trees;
+  int   count [NUM_FOREST_REPS];  // # of trees drawn each way
+  int   draws;                    // # of draw calls
+  int   state_changes;            // # of texture changes
+  float update_time;              // milliseconds in Forest_Update()
+} ForestStats;
+
+// Scatters trees over a rectangle using a density map (8-bit BMP, white = dense), NULL = no trees near the origin
+void Forest_Init (
+  const char   *density_map,
+  float         xmin,
+  float         zmin,
+  float         xmax,
+  float         zmax,
+  ForestParams *params,
+  ForestAssets *assets );
+
+// Free any resources
+void Forest_Free ();
+
+// Changes the textures in assets (the models in assets are ignored)
+void Forest_Set_Textures (ForestAssets *assets);
+
+// Changes the models in assets (the textures in assets are ignored)
+void Forest_Set_Models (ForestAssets *assets);
+
+// Picks how to draw each tree and builds a batch for each way
+void Forest_Update (
+  gx3dMatrix *view_matrix,
+  float       fov,          // degrees
+  float       aspect,       // screen width / height
+  float       far_plane,
+  int         screen_dy );  // pixels
+
+// Draws all batches, alpha testing should be on
+void Forest_Draw (gx3dVector *heading);
+
+// Gets stats for the last update and draw
+void Forest_Get_Stats (ForestStats *stats);
@@ -0,0 +1,236 @@
+/*____________________________________________________________________
+|
+| File: jobs.cpp
+|
+| Description: A small pool of worker threads used to split a loop
+|   into ranges that are run in parallel.  The calling thread works on
+|   ranges too, and the call returns only when every range is done, so
+|   callers see the same results as a serial loop as long as each range
+|   only writes its own items.
+|
+| Functions: Jobs_Init
+|            Jobs_Free
+|            Jobs_Num_Threads
+|            Jobs_Parallel_For
+|             Run_Ranges
+|             Worker_Thread
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <process.h>
+
+#include "dp.h"
+
+#include "jobs.h"
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Run_Ranges ();
+static unsigned __stdcall Worker_Thread (void *params);
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MAX_WORKER_THREADS 63
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static HANDLE           worker_threads [MAX_WORKER_THREADS];
+static int              num_workers = 0;
+static HANDLE           start_semaphore;     // released once per worker for each loop
+static HANDLE           done_event;          // set when the last worker finishes a loop
+static CRITICAL_SECTION loop_critsection;    // one parallel loop at a time
+static volatile LONG    quit_workers;
+
+// Current loop
+static volatile LONG    next_range;
+static volatile LONG    workers_busy;
+static int              loop_count;
+static int              loop_grain;
+static JobsCallback     loop_callback;
+static void            *loop_params;
+
+/*____________________________________________________________________
+|
+| Function: Jobs_Init
+|
+| Input: Called from Program_Run()
+| Output: Starts the worker threads.  The calling thread takes part in
+|   every loop so num_threads-1 workers are created.
+|___________________________________________________________________*/
+
+void Jobs_Init (int num_threads)
+{
+  int i;
+  SYSTEM_INFO sysinfo;
+
+  if (num_threads <= 0) {
+    GetSystemInfo (&sysinfo);
+    num_threads = (int)sysinfo.dwNumberOfProcessors;
+  }
+  if (num_threads > MAX_WORKER_THREADS + 1)
+    num_threads = MAX_WORKER_THREADS + 1;
+
+  InitializeCriticalSection (&loop_critsection);
+  start_semaphore = CreateSemaphore (NULL, 0, MAX_WORKER_THREADS, NULL);
+  done_event      = CreateEvent (NULL, FALSE, FALSE, NULL);
+  quit_workers    = FALSE;
+
+  num_workers = 0;
+  for (i=0; i<num_threads-1; i++) {
+    worker_threads[i] = (HANDLE) _beginthreadex (NULL, 0, Worker_Thread, NULL, 0, NULL);
+    if (worker_threads[i] == 0)
+      break;
+    num_workers++;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Jobs_Free
+|
+| Input: Called from Program_Run()
+| Output: Stops the worker threads.
+|___________________________________________________________________*/
+
+void Jobs_Free ()
+{
+  int i;
+
+  InterlockedExchange (&quit_workers, TRUE);
+  if (num_workers) {
+    ReleaseSemaphore (start_semaphore, num_workers, NULL);
+    WaitForMultipleObjects (num_workers, worker_threads, TRUE, INFINITE);
+    for (i=0; i<num_workers; i++)
+      CloseHandle (worker_threads[i]);
+  }
+  num_workers = 0;
+
+  CloseHandle (start_semaphore);
+  CloseHandle (done_event);
+  DeleteCriticalSection (&loop_critsection);
+}
+
+/*____________________________________________________________________
+|
+| Function: Jobs_Num_Threads
+|
+| Input: Called from ____
+| Output: Returns # of threads that run a parallel loop.
+|___________________________________________________________________*/
+
+int Jobs_Num_Threads ()
+{
+  return (num_workers + 1);
+}
+
+/*____________________________________________________________________
+|
+| Function: Jobs_Parallel_For
+|
+| Input: Called from ____
+| Output: Runs callback over [0, count) split into ranges of grain
+|   items.  Returns when all ranges have been run.
+|___________________________________________________________________*/
+
+void Jobs_Parallel_For (
+  int           count,
+  int           grain,      // # of items per range (0 = pick automatically)
+  JobsCallback  callback,
+  void         *params )
+{
+  if (count <= 0)
+    return;
+
+  // Pick a grain that gives each thread a few ranges to balance the load
+  if (grain <= 0) {
+    grain = count / (Jobs_Num_Threads () * 4);
+    if (grain < 64)
+      grain = 64;
+  }
+
+  // Not worth waking up the workers?
+  if ((num_workers == 0) OR (count <= grain)) {
+    (*callback) (0, count, params);
+    return;
+  }
+
+  EnterCriticalSection (&loop_critsection);
+
+  loop_count    = count;
+  loop_grain    = grain;
+  loop_callback = callback;
+  loop_params   = params;
+  next_range    = 0;
+  workers_busy  = num_workers;
+
+  // Wake up the workers and help out
+  ReleaseSemaphore (start_semaphore, num_workers, NULL);
+  Run_Ranges ();
+  WaitForSingleObject (done_event, INFINITE);
+
+  LeaveCriticalSection (&loop_critsection);
+}
+
+/*____________________________________________________________________
+|
+| Function: Run_Ranges
+|
+| Input: Called from Jobs_Parallel_For(), Worker_Thread()
+| Output: Claims and runs ranges of the current loop until none are left.
+|___________________________________________________________________*/
+
+static void Run_Ranges ()
+{
+  int first, last;
+
+  for (;;) {
+    first = (int)(InterlockedIncrement (&next_range) - 1) * loop_grain;
+    if (first >= loop_count)
+      break;
+    last = first + loop_grain;
+    if (last > loop_count)
+      last = loop_count;
+    (*loop_callback) (first, last, loop_params);
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Worker_Thread
+|
+| Input: Started from Jobs_Init()
+| Output: Waits for a loop to start, runs ranges of it, repeats until
+|   Jobs_Free() is called.
+|___________________________________________________________________*/
+
+static unsigned __stdcall Worker_Thread (void *params)
+{
+  for (;;) {
+    WaitForSingleObject (start_semaphore, INFINITE);
+    if (quit_workers)
+      break;
+    Run_Ranges ();
+    // Last one done?
+    if (InterlockedDecrement (&workers_busy) == 0)
+      SetEvent (done_event);
+  }
+
+  return (0);
+}
@@ -0,0 +1,26 @@
+/*____________________________________________________________________
+|
+| File: jobs.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// Callback for one range of a parallel loop, [first, last)
+typedef void (*JobsCallback) (int first, int last, void *params);
+
+// Starts the worker threads (0 = one thread per processor)
+void Jobs_Init (int num_threads);
+
+// Stops the worker threads
+void Jobs_Free ();
+
+// Returns # of threads that run a parallel loop (including the caller)
+int Jobs_Num_Threads ();
+
+// Runs callback over [0, count) in ranges of grain items, returns when all ranges are done
+void Jobs_Parallel_For (
+  int           count,
+  int           grain,      // # of items per range (0 = pick automatically)
+  JobsCallback  callback,
+  void         *params );
@@ -0,0 +1,277 @@
+/*____________________________________________________________________
+|
+| File: lod.cpp
+|
+| Description: Distance based level of detail for ghosts.  Each ghost
+|   gets a level from its distance to the camera, with hysteresis so a
+|   ghost standing near a switch distance doesn't flip back and forth.
+|   Each level has a cost and a steering interval.  If the total cost is
+|   over budget, the farthest ghosts are culled until it fits.
+|
+|   The budget is applied with a histogram of cost by distance instead
+|   of sorting the ghosts, so an update is O(N).
+|
+| Functions: Lod_Init
+|            Lod_Free
+|            Lod_Update
+|             Compute_Distance_Levels
+|            Lod_Get_Level
+|            Lod_Get_Count
+|            Lod_Get_Intervals
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <math.h>
+
+#include "dp.h"
+
+#include "jobs.h"
+#include "flock.h"
+#include "lod.h"
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Compute_Distance_Levels (int first, int last, void *params);
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define NUM_BUCKETS 1024  // distance buckets used to apply the budget
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static int        num_ghosts = 0;
+static LODParams  lod_params;
+static float      bucket_scale;   // distance to bucket #
+
+static byte      *distance_level; // level from distance alone
+static byte      *budget_culled;  // true if culled to fit the budget
+static byte      *ghost_level;    // final level
+static byte      *ghost_interval;
+static word      *ghost_bucket;
+
+static int        bucket_cost [NUM_BUCKETS];
+static int        level_count [NUM_LODS];
+static int        last_cut;       // first bucket culled by the budget last update
+
+static gx3dVector update_camera;
+
+/*____________________________________________________________________
+|
+| Function: Lod_Init
+|
+| Input: Called from Program_Run()
+| Output: Allocates per ghost state.  All ghosts start at LOD_CULLED and
+|   move to their correct level on the first update.
+|___________________________________________________________________*/
+
+void Lod_Init (int n, LODParams *params)
+{
+  int i;
+
+  num_ghosts = n;
+  lod_params = *params;
+
+  // Buckets cover everything up to the far distance
+  bucket_scale = NUM_BUCKETS / (lod_params.distance[NUM_LODS-2] * (1 + lod_params.hysteresis));
+
+  distance_level = (byte *) malloc (num_ghosts);
+  budget_culled  = (byte *) malloc (num_ghosts);
+  ghost_level    = (byte *) malloc (num_ghosts);
+  ghost_interval = (byte *) malloc (num_ghosts);
+  ghost_bucket   = (word *) malloc (num_ghosts * sizeof(word));
+
+  for (i=0; i<num_ghosts; i++) {
+    distance_level[i] = LOD_CULLED;
+    budget_culled[i]  = FALSE;
+    ghost_level[i]    = LOD_CULLED;
+    ghost_interval[i] = lod_params.interval[LOD_CULLED];
+  }
+  for (i=0; i<NUM_LODS; i++)
+    level_count[i] = 0;
+  level_count[LOD_CULLED] = num_ghosts;
+  last_cut = NUM_BUCKETS;
+}
+
+/*____________________________________________________________________
+|
+| Function: Lod_Free
+|
+| Input: Called from Program_Run()
+| Output: Frees per ghost state.
+|___________________________________________________________________*/
+
+void Lod_Free ()
+{
+  if (num_ghosts) {
+    free (distance_level);
+    free (budget_culled);
+    free (ghost_level);
+    free (ghost_interval);
+    free (ghost_bucket);
+    num_ghosts = 0;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Lod_Update
+|
+| Input: Called from Program_Run()
+| Output: Assigns a level to each ghost.
+|___________________________________________________________________*/
+
+void Lod_Update (gx3dVector *camera_position)
+{
+  int i, b, cut, restore_below, total;
+
+  if (num_ghosts == 0)
+    return;
+
+  update_camera = *camera_position;
+
+  // Level from distance (in parallel)
+  Jobs_Parallel_For (num_ghosts, 0, Compute_Distance_Levels, NULL);
+
+/*____________________________________________________________________
+|
+| Find the first distance bucket that doesn't fit in the budget
+|___________________________________________________________________*/
+
+  // Every ghost costs at least as much as a culled one
+  total = num_ghosts * lod_params.cost[LOD_CULLED];
+
+  memset (bucket_cost, 0, sizeof(bucket_cost));
+  for (i=0; i<num_ghosts; i++)
+    bucket_cost[ghost_bucket[i]] += lod_params.cost[distance_level[i]] - lod_params.cost[LOD_CULLED];
+
+  cut = NUM_BUCKETS;
+  for (b=0; b<NUM_BUCKETS; b++) {
+    total += bucket_cost[b];
+    if (total > lod_params.budget) {
+      cut = b;
+      break;
+    }
+  }
+
+  // Ghosts culled by the budget come back only once they are well inside the cut
+  restore_below = cut - (int)(cut * lod_params.hysteresis);
+  if (restore_below > last_cut)
+    restore_below = last_cut;
+  last_cut = cut;
+
+/*____________________________________________________________________
+|
+| Set final levels
+|___________________________________________________________________*/
+
+  for (i=0; i<NUM_LODS; i++)
+    level_count[i] = 0;
+
+  for (i=0; i<num_ghosts; i++) {
+    b = ghost_bucket[i];
+    if ((b >= cut) OR (budget_culled[i] AND (b >= restore_below))) {
+      budget_culled[i] = (distance_level[i] != LOD_CULLED);
+      ghost_level[i]   = LOD_CULLED;
+    }
+    else {
+      budget_culled[i] = FALSE;
+      ghost_level[i]   = distance_level[i];
+    }
+    ghost_interval[i] = lod_params.interval[ghost_level[i]];
+    level_count[ghost_level[i]]++;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Compute_Distance_Levels
+|
+| Input: Called from Lod_Update() through Jobs_Parallel_For()
+| Output: Computes the level and distance bucket of a range of ghosts.
+|___________________________________________________________________*/
+
+static void Compute_Distance_Levels (int first, int last, void *params)
+{
+  int g, level, b;
+  float dx, dy, dz, d;
+  gx3dVector pos;
+  float out_scale = 1 + lod_params.hysteresis;
+  float in_scale  = 1 - lod_params.hysteresis;
+
+  for (g=first; g<last; g++) {
+    Flock_Get_Position (g, &pos);
+    dx = pos.x - update_camera.x;
+    dy = pos.y - update_camera.y;
+    dz = pos.z - update_camera.z;
+    d  = sqrtf (dx*dx + dy*dy + dz*dz);
+
+    // Move out past a switch distance + hysteresis, or in past a switch distance - hysteresis
+    level = distance_level[g];
+    while ((level < NUM_LODS-1) AND (d > lod_params.distance[level] * out_scale))
+      level++;
+    while ((level > 0) AND (d < lod_params.distance[level-1] * in_scale))
+      level--;
+    distance_level[g] = (byte)level;
+
+    b = (int)(d * bucket_scale);
+    if (b >= NUM_BUCKETS)
+      b = NUM_BUCKETS - 1;
+    ghost_bucket[g] = (word)b;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Lod_Get_Level
+|
+| Input: Called from ____
+| Output: Returns level of a ghost.
+|___________________________________________________________________*/
+
+int Lod_Get_Level (int ghost)
+{
+  return (ghost_level[ghost]);
+}
+
+/*____________________________________________________________________
+|
+| Function: Lod_Get_Count
+|
+| Input: Called from ____
+| Output: Returns # of ghosts at a level after the last update.
+|___________________________________________________________________*/
+
+int Lod_Get_Count (int level)
+{
+  return (level_count[level]);
+}
+
+/*____________________________________________________________________
+|
+| Function: Lod_Get_Intervals
+|
+| Input: Called from ____
+| Output: Returns steering interval of each ghost.
+|___________________________________________________________________*/
+
+const byte *Lod_Get_Intervals ()
+{
+  return (ghost_interval);
+}
@@ -0,0 +1,40 @@
+/*____________________________________________________________________
+|
+| File: lod.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// Ghost detail levels, nearest first
+#define LOD_NEAR    0 // depth sorted, alpha blended, steered every frame
+#define LOD_MIDDLE  1 // depth sorted, alpha blended, steered less often
+#define LOD_FAR     2 // unsorted, alpha tested, steered rarely
+#define LOD_CULLED  3 // not drawn, steered rarely
+#define NUM_LODS    4
+
+typedef struct {
+  float distance [NUM_LODS-1]; // feet, distance to switch to the next level
+  float hysteresis;            // fraction of the distance a ghost must go back past to switch back (0.1 = 10%)
+  byte  interval [NUM_LODS];   // # of frames between steering at each level
+  int   cost [NUM_LODS];       // cost of one ghost at each level
+  int   budget;                // max total cost of all ghosts per frame
+} LODParams;
+
+// Init levels for all ghosts, all start at LOD_CULLED
+void Lod_Init (int num_ghosts, LODParams *params);
+
+// Free any resources
+void Lod_Free ();
+
+// Assigns a level to each ghost based on distance from the camera and the budget
+void Lod_Update (gx3dVector *camera_position);
+
+// Returns level of a ghost
+int Lod_Get_Level (int ghost);
+
+// Returns # of ghosts at a level after the last update
+int Lod_Get_Count (int level);
+
+// Returns steering interval of each ghost, for Flock_Update()
+const byte *Lod_Get_Intervals ();
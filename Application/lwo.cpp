@@ -0,0 +1,599 @@
+/*____________________________________________________________________
+|
+| File: lwo.cpp
+|
+| Description: A standalone LWO2 (LightWave object) reader.  The file is
+|   memory mapped and its chunks (FORM, TAGS, LAYR, PNTS, POLS, PTAG and
+|   VMAP) are read in place, nothing is copied into a file buffer first.
+|
+|   The file is walked twice.  The first walk only counts points,
+|   polygons, triangles and names so the second walk can write every
+|   array into one allocation, no memory is allocated per chunk or per
+|   polygon.  Both walks check every index, so a file the first walk
+|   passes the second one reads whole.  Points are big-endian floats,
+|   they are byte swapped 4 at a time with SSE2 where it is available.
+|
+|   Only FACE polygons and the first TXUV vmap of each layer are used,
+|   other chunks are skipped.
+|
+|   Only uses the C library and filemap.cpp so it can be built into
+|   tools as well as the game.
+|
+| Functions: Lwo_Read
+|             Walk_Chunks
+|             Read_Layer
+|             Read_Points
+|             Read_Polygons
+|             Read_Polygon_Tags
+|             Read_Vertex_Map
+|             Read_String
+|             Read_VX
+|             Swap_Floats
+|            Lwo_Free
+|            Lwo_Get_Layer
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define LWO_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "filemap.h"
+#include "lwo.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef unsigned char byte_t;
+
+// State of a walk through the chunks
+typedef struct {
+  bool      store;            // false = count only
+  // Counts
+  int       num_layers, num_points, num_uvs, num_polygons, num_triangles, num_tags, string_bytes;
+  // Where the next item of each kind is written (store only)
+  LwoMesh  *mesh;
+  float    *points, *uvs;
+  int      *polygon_triangle;
+  unsigned *indices;
+  unsigned short *surfaces;
+  char     *strings;
+  // Current layer
+  LwoLayer *layer;
+  LwoLayer  count_layer;      // used as the current layer when counting
+  int       layer_points;     // # of PNTS chunks in current layer
+  bool      layer_has_uvs;
+  int       pols_first;       // first polygon (in layer) of the last POLS chunk
+  bool      pols_face;        // true if the last POLS chunk was FACE polygons
+} Walk;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static bool Walk_Chunks (Walk *w, const byte_t *data, unsigned size);
+static bool Read_Layer (Walk *w, const byte_t *p, const byte_t *end);
+static bool Read_Points (Walk *w, const byte_t *p, const byte_t *end);
+static bool Read_Polygons (Walk *w, const byte_t *p, const byte_t *end);
+static bool Read_Polygon_Tags (Walk *w, const byte_t *p, const byte_t *end);
+static bool Read_Vertex_Map (Walk *w, const byte_t *p, const byte_t *end);
+static const byte_t *Read_String (Walk *w, const byte_t *p, const byte_t *end, const char **str);
+static inline const byte_t *Read_VX (const byte_t *p, const byte_t *end, unsigned *vx);
+static void Swap_Floats (float *dst, const byte_t *src, int n);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define GET_U2(_p_) (((unsigned)(_p_)[0] << 8) | (unsigned)(_p_)[1])
+#define GET_U4(_p_) ((GET_U2(_p_) << 16) | GET_U2((_p_)+2))
+#define ID4(_a_,_b_,_c_,_d_) (((unsigned)(_a_) << 24) | ((unsigned)(_b_) << 16) | ((unsigned)(_c_) << 8) | (unsigned)(_d_))
+
+#define ALIGN_UP(_n_) (((_n_) + 15) & ~15)
+
+/*____________________________________________________________________
+|
+| Function: Lwo_Read
+|
+| Input: Called from ____
+| Output: Reads an LWO2 file.  Returns the mesh, or NULL on any error.
+|___________________________________________________________________*/
+
+LwoMesh *Lwo_Read (const char *filename)
+{
+  unsigned size, arena_size;
+  const byte_t *data;
+  byte_t *arena;
+  Walk count, w;
+  LwoMesh *mesh = NULL;
+
+  data = (const byte_t *) File_Map (filename, &size);
+  if (data == NULL)
+    return (NULL);
+
+  // Count everything
+  memset (&count, 0, sizeof(count));
+  if (Walk_Chunks (&count, data, size)) {
+
+    // Lay out one allocation for the mesh and all its arrays
+    arena_size = ALIGN_UP (sizeof(LwoMesh)) +
+                 ALIGN_UP (count.num_layers * sizeof(LwoLayer)) +
+                 ALIGN_UP (count.num_tags * sizeof(char *)) +
+                 ALIGN_UP (count.num_points * 3 * sizeof(float)) +
+                 ALIGN_UP (count.num_uvs * 2 * sizeof(float)) +
+                 ALIGN_UP (count.num_polygons * sizeof(int)) +
+                 ALIGN_UP (count.num_triangles * 3 * sizeof(unsigned)) +
+                 ALIGN_UP (count.num_triangles * sizeof(unsigned short)) +
+                 count.string_bytes;
+    arena = (byte_t *) calloc (arena_size, 1);
+    if (arena) {
+      memset (&w, 0, sizeof(w));
+      w.store = true;
+      w.mesh  = mesh = (LwoMesh *) arena;
+      arena += ALIGN_UP (sizeof(LwoMesh));
+      mesh->layers       = (LwoLayer *) arena;       arena += ALIGN_UP (count.num_layers * sizeof(LwoLayer));
+      mesh->tags         = (const char **) arena;    arena += ALIGN_UP (count.num_tags * sizeof(char *));
+      w.points           = (float *) arena;          arena += ALIGN_UP (count.num_points * 3 * sizeof(float));
+      w.uvs              = (float *) arena;          arena += ALIGN_UP (count.num_uvs * 2 * sizeof(float));
+      w.polygon_triangle = (int *) arena;            arena += ALIGN_UP (count.num_polygons * sizeof(int));
+      w.indices          = (unsigned *) arena;       arena += ALIGN_UP (count.num_triangles * 3 * sizeof(unsigned));
+      w.surfaces         = (unsigned short *) arena; arena += ALIGN_UP (count.num_triangles * sizeof(unsigned short));
+      w.strings          = (char *) arena;
+      mesh->num_tags     = count.num_tags;
+      mesh->file_size    = size;
+      mesh->arena_size   = arena_size;
+
+      // Walk again, writing everything
+      if (!Walk_Chunks (&w, data, size)) {
+        free (mesh);
+        mesh = NULL;
+      }
+    }
+  }
+
+  File_Unmap (data, size);
+
+  return (mesh);
+}
+
+/*____________________________________________________________________
+|
+| Function: Walk_Chunks
+|
+| Input: Called from Lwo_Read()
+| Output: Reads each chunk inside the FORM.  Returns true on success,
+|   else false.
+|___________________________________________________________________*/
+
+static bool Walk_Chunks (Walk *w, const byte_t *data, unsigned size)
+{
+  unsigned id, chunk_size;
+  const byte_t *p, *end, *chunk_end;
+  const char *str;
+  bool ok = true;
+
+  // FORM <size> LWO2
+  if ((size < 12) || (GET_U4 (data) != ID4('F','O','R','M')) || (GET_U4 (data+8) != ID4('L','W','O','2')))
+    return (false);
+  end = data + 8 + GET_U4 (data+4);
+  if (end > data + size)
+    end = data + size;
+
+  w->layer = &w->count_layer;
+
+  for (p=data+12; ok && (p + 8 <= end); p=chunk_end+(chunk_size & 1)) {
+    id         = GET_U4 (p);
+    chunk_size = GET_U4 (p+4);
+    p += 8;
+    chunk_end = p + chunk_size;
+    if ((chunk_end > end) || (chunk_end < p))
+      return (false);
+
+    switch (id) {
+      case ID4('T','A','G','S'):
+        while (ok && (p < chunk_end)) {
+          p = Read_String (w, p, chunk_end, &str);
+          if (p == NULL)
+            ok = false;
+          else {
+            if (w->store)
+              w->mesh->tags[w->num_tags] = str;
+            w->num_tags++;
+          }
+        }
+        break;
+      case ID4('L','A','Y','R'):
+        ok = Read_Layer (w, p, chunk_end);
+        break;
+      case ID4('P','N','T','S'):
+        ok = Read_Points (w, p, chunk_end);
+        break;
+      case ID4('P','O','L','S'):
+        ok = Read_Polygons (w, p, chunk_end);
+        break;
+      case ID4('P','T','A','G'):
+        ok = Read_Polygon_Tags (w, p, chunk_end);
+        break;
+      case ID4('V','M','A','P'):
+        ok = Read_Vertex_Map (w, p, chunk_end);
+        break;
+    }
+  }
+
+  if (ok && w->store)
+    w->mesh->num_layers = w->num_layers;
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_Layer
+|
+| Input: Called from Walk_Chunks()
+| Output: Starts a new layer.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+static bool Read_Layer (Walk *w, const byte_t *p, const byte_t *end)
+{
+  LwoLayer *layer;
+  const char *name;
+
+  // number, flags, pivot
+  if (p + 16 > end)
+    return (false);
+  if (w->store)
+    layer = &w->mesh->layers[w->num_layers];
+  else {
+    layer = &w->count_layer;
+    memset (layer, 0, sizeof(LwoLayer));
+  }
+  layer->number = GET_U2 (p);
+  Swap_Floats (layer->pivot, p+4, 3);
+  p = Read_String (w, p+16, end, &name);
+  if (p == NULL)
+    return (false);
+  layer->name   = name;
+  layer->parent = (p + 2 <= end) ? GET_U2 (p) : -1;
+  if (layer->parent == 0xFFFF)
+    layer->parent = -1;
+
+  w->layer         = layer;
+  w->layer_points  = 0;
+  w->layer_has_uvs = false;
+  w->pols_face     = false;
+  w->num_layers++;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_Points
+|
+| Input: Called from Walk_Chunks()
+| Output: Reads the points of the current layer.  A file with points
+|   before any LAYR chunk gets an unnamed layer 0.  Returns true on
+|   success, else false.
+|___________________________________________________________________*/
+
+static bool Read_Points (Walk *w, const byte_t *p, const byte_t *end)
+{
+  int n;
+  LwoLayer *layer;
+
+  if (w->num_layers == 0) {
+    layer = w->store ? &w->mesh->layers[0] : &w->count_layer;
+    memset (layer, 0, sizeof(LwoLayer));
+    layer->name   = w->store ? w->strings : "";
+    layer->parent = -1;
+    if (w->store)
+      *w->strings++ = 0;
+    w->string_bytes++;
+    w->layer = layer;
+    w->num_layers++;
+  }
+  // Only one set of points per layer
+  if (w->layer_points++)
+    return (false);
+
+  n = (int)(end - p) / 12;
+  layer = w->layer;
+  layer->num_points = n;
+  if (w->store) {
+    layer->points = w->points;
+    Swap_Floats (w->points, p, n * 3);
+    w->points += n * 3;
+  }
+  w->num_points += n;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_Polygons
+|
+| Input: Called from Walk_Chunks()
+| Output: Reads FACE polygons of the current layer and splits them into
+|   triangle fans, other polygon types are skipped.  Returns true on
+|   success, else false.
+|___________________________________________________________________*/
+
+static bool Read_Polygons (Walk *w, const byte_t *p, const byte_t *end)
+{
+  int i, n, num_points;
+  unsigned first, prev, vx;
+  LwoLayer *layer = w->layer;
+
+  if (p + 4 > end)
+    return (false);
+  w->pols_face = (GET_U4 (p) == ID4('F','A','C','E'));
+  if (!w->pols_face)
+    return (true);
+  p += 4;
+
+  if (w->store && (layer->num_polygons == 0)) {
+    layer->polygon_triangle = w->polygon_triangle;
+    layer->indices          = w->indices;
+    layer->triangle_surface = w->surfaces;
+  }
+  w->pols_first = layer->num_polygons;
+  num_points    = layer->num_points;
+
+  while (p < end) {
+    if (p + 2 > end)
+      return (false);
+    n = GET_U2 (p) & 0x3FF;   // high 6 bits are flags
+    p += 2;
+    if (w->store)
+      *w->polygon_triangle++ = layer->num_triangles;
+    // Fan from the first point
+    first = prev = 0;
+    for (i=0; i<n; i++) {
+      p = Read_VX (p, end, &vx);
+      if ((p == NULL) || ((int)vx >= num_points))
+        return (false);
+      if (i == 0)
+        first = vx;
+      else if (i >= 2) {
+        if (w->store) {
+          w->indices[0] = first;
+          w->indices[1] = prev;
+          w->indices[2] = vx;
+          w->indices   += 3;
+          *w->surfaces++ = 0;
+        }
+        layer->num_triangles++;
+        w->num_triangles++;
+      }
+      prev = vx;
+    }
+    layer->num_polygons++;
+    w->num_polygons++;
+  }
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_Polygon_Tags
+|
+| Input: Called from Walk_Chunks()
+| Output: Sets the surface of each triangle from a SURF polygon tag
+|   chunk for the last FACE polygons.  Returns true on success, else
+|   false if a polygon or tag index is out of range.
+|___________________________________________________________________*/
+
+static bool Read_Polygon_Tags (Walk *w, const byte_t *p, const byte_t *end)
+{
+  int t, last;
+  unsigned polygon, tag;
+  LwoLayer *layer = w->layer;
+
+  if (p + 4 > end)
+    return (false);
+  if ((GET_U4 (p) != ID4('S','U','R','F')) || (!w->pols_face))
+    return (true);
+  p += 4;
+
+  while (p < end) {
+    p = Read_VX (p, end, &polygon);
+    if ((p == NULL) || (p + 2 > end))
+      return (false);
+    tag = GET_U2 (p);
+    p += 2;
+    polygon += w->pols_first;
+    if ((polygon >= (unsigned)layer->num_polygons) || (tag >= (unsigned)w->num_tags))
+      return (false);
+    if (!w->store)
+      continue;
+    last = (polygon + 1 < (unsigned)layer->num_polygons) ? layer->polygon_triangle[polygon+1] : layer->num_triangles;
+    for (t=layer->polygon_triangle[polygon]; t<last; t++)
+      layer->triangle_surface[t] = (unsigned short)tag;
+  }
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_Vertex_Map
+|
+| Input: Called from Walk_Chunks()
+| Output: Reads the first TXUV vertex map of the current layer, other
+|   vertex maps are skipped.  Returns true on success, else false if a
+|   point index is out of range.
+|___________________________________________________________________*/
+
+static bool Read_Vertex_Map (Walk *w, const byte_t *p, const byte_t *end)
+{
+  unsigned vx;
+  LwoLayer *layer = w->layer;
+
+  if (p + 6 > end)
+    return (false);
+  if ((GET_U4 (p) != ID4('T','X','U','V')) || (GET_U2 (p+4) != 2) || w->layer_has_uvs || (layer->num_points == 0))
+    return (true);
+  w->layer_has_uvs = true;
+  w->num_uvs += layer->num_points;
+  if (w->store) {
+    layer->uvs = w->uvs;
+    w->uvs += layer->num_points * 2;
+  }
+
+  p = Read_String (w, p+6, end, NULL);
+  if (p == NULL)
+    return (false);
+  while (p < end) {
+    p = Read_VX (p, end, &vx);
+    if ((p == NULL) || (p + 8 > end) || (vx >= (unsigned)layer->num_points))
+      return (false);
+    if (w->store)
+      Swap_Floats (&layer->uvs[vx*2], p, 2);
+    p += 8;
+  }
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_String
+|
+| Input: Called from Walk_Chunks(), Read_Layer(), Read_Vertex_Map()
+| Output: Reads a null terminated string padded to an even length.  If
+|   str isn't NULL the string is counted and, when storing, copied into
+|   the string pool.  Returns a pointer past the string, or NULL if it
+|   runs past the end of the chunk.
+|___________________________________________________________________*/
+
+static const byte_t *Read_String (Walk *w, const byte_t *p, const byte_t *end, const char **str)
+{
+  const byte_t *s;
+  int n;
+
+  for (s=p; (s < end) && *s; s++);
+  if (s == end)
+    return (NULL);
+  n = (int)(s - p) + 1;
+
+  if (str) {
+    if (w->store) {
+      memcpy (w->strings, p, n);
+      *str = w->strings;
+      w->strings += n;
+    }
+    else
+      *str = "";
+    w->string_bytes += n;
+  }
+
+  return (p + n + (n & 1));
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_VX
+|
+| Input: Called from Read_Polygons(), Read_Polygon_Tags(),
+|   Read_Vertex_Map()
+| Output: Reads a variable length index, 2 bytes or 4 bytes if the
+|   first byte is 0xFF.  Returns a pointer past the index, or NULL if it
+|   runs past the end of the chunk.
+|___________________________________________________________________*/
+
+static inline const byte_t *Read_VX (const byte_t *p, const byte_t *end, unsigned *vx)
+{
+  if (p + 2 > end)
+    return (NULL);
+  if (p[0] != 0xFF) {
+    *vx = GET_U2 (p);
+    return (p + 2);
+  }
+  if (p + 4 > end)
+    return (NULL);
+  *vx = GET_U4 (p) & 0x00FFFFFF;
+  return (p + 4);
+}
+
+/*____________________________________________________________________
+|
+| Function: Swap_Floats
+|
+| Input: Called from Read_Layer(), Read_Points(), Read_Vertex_Map()
+| Output: Converts n big-endian floats to native floats.  Swaps 4 at a
+|   time with SSE2: bytes within each 16-bit word, then the 2 words of
+|   each 32-bit value.
+|___________________________________________________________________*/
+
+static void Swap_Floats (float *dst, const byte_t *src, int n)
+{
+  int i = 0;
+  unsigned u;
+
+#ifdef LWO_SSE2
+  __m128i v;
+
+  for (; i+4<=n; i+=4) {
+    v = _mm_loadu_si128 ((const __m128i *)(src + i*4));
+    v = _mm_or_si128 (_mm_srli_epi16 (v, 8), _mm_slli_epi16 (v, 8));
+    v = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (2,3,0,1));
+    v = _mm_shufflehi_epi16 (v, _MM_SHUFFLE (2,3,0,1));
+    _mm_storeu_si128 ((__m128i *)(dst + i), v);
+  }
+#endif
+  for (; i<n; i++) {
+    u = GET_U4 (src + i*4);
+    memcpy (&dst[i], &u, 4);
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Lwo_Free
+|
+| Input: Called from ____
+| Output: Frees a mesh returned by Lwo_Read().
+|___________________________________________________________________*/
+
+void Lwo_Free (LwoMesh *mesh)
+{
+  if (mesh)
+    free (mesh);
+}
+
+/*____________________________________________________________________
+|
+| Function: Lwo_Get_Layer
+|
+| Input: Called from ____
+| Output: Returns a layer by name, or NULL if not found.
+|___________________________________________________________________*/
+
+LwoLayer *Lwo_Get_Layer (LwoMesh *mesh, const char *name)
+{
+  int i;
+
+  for (i=0; i<mesh->num_layers; i++)
+    if (strcmp (mesh->layers[i].name, name) == 0)
+      return (&mesh->layers[i]);
+
+  return (NULL);
+}
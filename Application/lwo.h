@@ -0,0 +1,41 @@
+/*____________________________________________________________________
+|
+| File: lwo.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// One layer of an LWO2 file, polygons are split into triangles
+typedef struct {
+  const char *name;
+  int         number;               // layer number in the file
+  int         parent;               // -1 = none
+  float       pivot [3];
+  int         num_points;
+  float      *points;               // x,y,z per point
+  float      *uvs;                  // u,v per point from the first TXUV vmap (NULL = none)
+  int         num_polygons;
+  int        *polygon_triangle;     // first triangle of each polygon
+  int         num_triangles;
+  unsigned   *indices;              // 3 point indices per triangle
+  unsigned short *triangle_surface; // index into tags per triangle
+} LwoLayer;
+
+typedef struct {
+  int          num_layers;
+  LwoLayer    *layers;
+  int          num_tags;
+  const char **tags;                // surface names
+  unsigned     file_size;           // bytes
+  unsigned     arena_size;          // bytes, everything above is in one allocation
+} LwoMesh;
+
+// Reads an LWO2 file, returns NULL on any error
+LwoMesh *Lwo_Read (const char *filename);
+
+// Frees a mesh returned by Lwo_Read()
+void Lwo_Free (LwoMesh *mesh);
+
+// Returns a layer by name, or NULL if not found
+LwoLayer *Lwo_Get_Layer (LwoMesh *mesh, const char *name);
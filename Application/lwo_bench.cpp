@@ -0,0 +1,237 @@
+/*____________________________________________________________________
+|
+| File: lwo_bench.cpp
+|
+| Description: Times lwo.cpp on every .lwo file in a directory.  Each
+|   file is read with Lwo_Read() (map, parse, unmap) and freed again,
+|   over and over for at least READ_TIME_MS, and the time of one read
+|   and the rate in MB of file per second are printed, per file and in
+|   total.  The first read of each file is timed on its own, it is the
+|   one that may have to fault the file in.
+|
+|   A standalone program, not part of the game build.  Build it in
+|   Application\:
+|     cl /O2 /EHsc lwo_bench.cpp lwo.cpp filemap.cpp
+|     g++ -O2 lwo_bench.cpp lwo.cpp filemap.cpp
+|   Run from the project directory (it reads Objects\*.lwo), or give
+|   the objects directory as the argument.  Returns 0 if every file
+|   was read.
+|
+|   Only uses the C library, the OS, lwo.cpp and filemap.cpp.
+|
+| Functions: main
+|             Find_Files
+|             Read_File
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwo.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MAX_FILES     256
+#define MAX_PATH_LEN  260
+#define READ_TIME_MS  250        // to keep reading each file
+#define MIN_READS     10
+
+#ifdef _WIN32
+#define SEP "\\"
+#else
+#define SEP "/"
+#endif
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int    Find_Files (const char *dir, char (*files)[MAX_PATH_LEN], int max_files);
+static bool   Read_File (const char *filename, int *triangles, unsigned *size);
+static double Get_Time ();
+
+/*____________________________________________________________________
+|
+| Function: main
+|
+| Input: Called from the OS
+| Output: Reads every file repeatedly and prints the rates.  Returns 0
+|   if all were read.
+|___________________________________________________________________*/
+
+int main (int argc, char **argv)
+{
+  static char files[MAX_FILES][MAX_PATH_LEN];
+  int i, n, reads, triangles, failed;
+  unsigned size;
+  double start, first, t, total_bytes, total_time;
+  const char *objects;
+
+  objects = (argc > 1) ? argv[1] : "Objects";
+  n = Find_Files (objects, files, MAX_FILES);
+  if (n == 0) {
+    printf ("no .lwo files in %s\n", objects);
+    return (1);
+  }
+
+  printf ("%-24s %9s %9s %10s %10s %9s\n", "file", "KB", "triangles", "first ms", "ms/read", "MB/s");
+  failed = 0;
+  total_bytes = 0;
+  total_time = 0;
+  for (i=0; i<n; i++) {
+    start = Get_Time ();
+    if (!Read_File (files[i], &triangles, &size)) {
+      printf ("%-24s can't read\n", files[i] + strlen (objects) + 1);
+      failed++;
+      continue;
+    }
+    first = Get_Time () - start;
+
+    // Warm reads until long enough to time
+    reads = 0;
+    start = Get_Time ();
+    do {
+      Read_File (files[i], &triangles, &size);
+      reads++;
+      t = Get_Time () - start;
+    } while ((t < READ_TIME_MS) || (reads < MIN_READS));
+
+    printf ("%-24s %9.1f %9d %10.3f %10.4f %9.1f\n", files[i] + strlen (objects) + 1, size / 1024.0, triangles, first, t / reads,
+            (double)size * reads / (1024 * 1024) / (t / 1000));
+    // One read of each file
+    total_bytes += size;
+    total_time  += t / reads;
+  }
+  if (total_time > 0)
+    printf ("%d files, %.3f ms to read each once, %.1f MB/s\n", n - failed, total_time, total_bytes / (1024 * 1024) / (total_time / 1000));
+
+  return (failed ? 1 : 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Find_Files
+|
+| Input: Called from main()
+| Output: Gets the paths of the .lwo files in a directory.  Returns #
+|   of files found.
+|___________________________________________________________________*/
+
+static int Find_Files (const char *dir, char (*files)[MAX_PATH_LEN], int max_files)
+{
+  int n, len;
+  const char *name;
+#ifdef _WIN32
+  char path[MAX_PATH_LEN];
+  HANDLE find;
+  WIN32_FIND_DATAA data;
+
+  n = 0;
+  snprintf (path, sizeof(path), "%s" SEP "*.lwo", dir);
+  find = FindFirstFileA (path, &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return (0);
+  do {
+    name = data.cFileName;
+#else
+  DIR *d;
+  struct dirent *e;
+
+  n = 0;
+  d = opendir (dir);
+  if (d == NULL)
+    return (0);
+  while ((e = readdir (d)) != NULL) {
+    name = e->d_name;
+    // FindFirstFileA() only finds *.lwo, readdir() finds everything
+    len = (int)strlen (name);
+    if ((len <= 4) || (strcmp (name + len - 4, ".lwo") != 0))
+      continue;
+#endif
+    if (n < max_files) {
+      len = snprintf (files[n], MAX_PATH_LEN, "%s" SEP "%s", dir, name);
+      if ((len > 0) && (len < MAX_PATH_LEN))
+        n++;
+    }
+#ifdef _WIN32
+  } while (FindNextFileA (find, &data));
+  FindClose (find);
+#else
+  }
+  closedir (d);
+#endif
+
+  return (n);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_File
+|
+| Input: Called from main()
+| Output: Reads a file with Lwo_Read() and frees it.  Returns true on
+|   success, else false.
+|___________________________________________________________________*/
+
+static bool Read_File (const char *filename, int *triangles, unsigned *size)
+{
+  int i;
+  LwoMesh *mesh;
+
+  mesh = Lwo_Read (filename);
+  if (mesh == NULL)
+    return (false);
+  *triangles = 0;
+  for (i=0; i<mesh->num_layers; i++)
+    *triangles += mesh->layers[i].num_triangles;
+  *size = mesh->file_size;
+  Lwo_Free (mesh);
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from main()
+| Output: Returns the time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
@@ -10,6 +10,8 @@
 |								Set_Mouse_Cursor
 |             Program_Run
 |							 Init_Render_State
+|               Draw_Billboard
+|               Simulate_Frame
 |             Program_Free
 |             Program_Immediate_Key_Handler               
 |
@@ -31,25 +33,22 @@
 
 #include "main.h"
 #include "position.h"
-
-/*___________________
-|
-| Type definitions
-|__________________*/
-
-typedef struct {
-  unsigned resolution;
-  unsigned bitdepth;
-} UserPreferences;
-
-/*___________________
-|
-| Function Prototypes
-|__________________*/
-
-static int Init_Graphics (unsigned resolution, unsigned bitdepth, unsigned stencildepth, int *generate_keypress_events);
-static void Set_Mouse_Cursor ();
-static void Init_Render_State ();
+#include "jobs.h"
+#include "flock.h"
+#include "lod.h"
+#include "atlas.h"
+#include "transparent.h"
+#include "forest.h"
+#include "asset.h"
+#include "stream.h"
+#include "bmp.h"
+#include "reload.h"
+#include "wavstream.h"
+#include "music.h"
+#include "mixer.h"
+#include "audio.h"
+#include "pipeline.h"
+#include "arena.h"
 
 /*___________________
 |
@@ -83,6 +82,91 @@ static void Init_Render_State ();
 #define AUTO_TRACKING    1
 #define NO_AUTO_TRACKING 0
 
+#define ASSET_BUDGET (64 * 1024 * 1024)  // bytes of unused assets kept loaded
+#define STREAM_THREADS         4          // background loading threads
+#define STREAM_LOADS_PER_FRAME 2          // streamed loads finished each frame
+#define PLACEHOLDER_SIZE       8          // pixels, shown until a streamed texture is loaded
+
+#define NUM_GHOST_FRAMES     3
+#define GHOST_ATLAS_PADDING  8    // gutter around each frame, keeps the first mip levels from blending frames (the 512 frames are drawn at 504)
+#define GHOST_FRAME_TIME     150  // milliseconds per animation frame
+#define GHOST_ANIMATION_SIZE 4    // frames in the animation sequence
+
+#define MAX_RELOAD_CHANGES   16   // changed files loaded again each frame
+
+#define GHOST_SOUND_VOLUME   0.5f // each ghost's sound, only the most audible ones are mixed
+#define GHOST_SOUND_PRIORITY 0.5f
+#define GHOST_SOUND_MIN      5    // feet, heard at full volume this close
+#define GHOST_SOUND_MAX      50
+
+#define NUM_GHOSTS 200        // the C style way of making constant
+//const int NUM_GHOSTS = 200; // the C++ style way of making a constant
+
+#define PIPELINE_THREADED    TRUE // simulate on a thread of its own, a frame ahead of drawing
+
+#define FRAME_ARENA_SIZE (256 * 1024)  // bytes of memory for each thread's temporaries in a frame
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  unsigned resolution;
+  unsigned bitdepth;
+} UserPreferences;
+
+// Copies of one billboard object drawn at different positions
+typedef struct {
+  gx3dObject *object;
+  gx3dMatrix  scale_rotate;  // same for every copy
+  gx3dVector *positions;
+} BillboardBatch;
+
+// Input from the render thread, mouse movement as totals so none is lost if the sim misses a frame
+typedef struct {
+  unsigned cmd_move;
+  int      move_x, move_y;
+} FrameInput;
+
+// Everything drawn in a frame that the sim changes, not changed once handed to the render thread
+typedef struct {
+  gx3dVector position, heading;      // camera
+  gx3dMatrix view_matrix;
+  gx3dVector light_src;              // point light
+  gx3dVector ghost_world [NUM_GHOSTS];
+  int        ghost_frame [NUM_GHOSTS];
+  int        num_near_ghosts;        // near and middle ghosts, blended
+  short      near_ghosts [NUM_GHOSTS];
+  int        num_far_ghosts;         // far ghosts, alpha tested, in order of animation frame
+  short      far_ghosts [NUM_GHOSTS];
+} FramePacket;
+
+// Game state only the sim thread uses once the pipeline is started
+typedef struct {
+  AudioVoice v_chimes;
+  MixerSound s_ghost;
+  AudioVoice v_ghosts [NUM_GHOSTS];
+  int        num_ghost_voices;       // ghosts whose sound has been started
+  int        num_ghost_frames;
+  unsigned   last_time;
+  int        move_x, move_y;         // mouse movement already used
+  float      angle;                  // of the point light and the chimes
+  float      target_x, target_x_incr;
+  unsigned   animation_time;
+} SimState;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int Init_Graphics (unsigned resolution, unsigned bitdepth, unsigned stencildepth, int *generate_keypress_events);
+static void Set_Mouse_Cursor ();
+static void Init_Render_State ();
+static void Draw_Billboard (void *params, int item);
+static void Simulate_Frame (const void *input, void *packet, void *data);
+
 /*____________________________________________________________________
 |
 | Function: Program_Get_User_Preferences
@@ -216,32 +300,15 @@ static void Set_Mouse_Cursor ()
 |   hidden.
 |___________________________________________________________________*/
 
-struct GhostPos {
-	gx3dVector world, view;
-};
-
-int compare_ghosts (const void *elem1, const void *elem2) 
-{
-	GhostPos *e1 = (GhostPos *)elem1;
-	GhostPos *e2 = (GhostPos *)elem2;
-
-	if (e1->view.z == e2->view.z)		 
-		return 0;
-	else if (e1->view.z < e2->view.z)
-		return 1;
-	else
-		return -1; // e2 > e1
-}
-
 void Program_Run ()
 {
-  int i, quit;
+  int i, j, quit;
   evEvent event;
   gx3dDriverInfo dinfo;
   gxColor color;
   char str[256];
 
-	gx3dObject *obj_tree, *obj_tree2, *obj_skydome, *obj_clouddome, *obj_ghost, *obj_billboard_tree, *obj_ground;
+	gx3dObject *obj_tree, *obj_tree2, *obj_skydome, *obj_clouddome, *obj_ghost, *obj_billboard_tree, *obj_ground, *obj_ptree;
 	gx3dMatrix m, m1, m2, m3, m4, m5, m6;
   gx3dColor color3d_white    = { 1, 1, 1, 0 };
   gx3dColor color3d_dim      = { 0.1f, 0.1f, 0.1f };
@@ -264,15 +331,12 @@ void Program_Run ()
 	//strcpy (ss, mystr.c_str());
 	//debug_WriteFile (ss);
 
-#define NUM_GHOSTS 20         // the C style way of making constant
-//const int NUM_GHOSTS = 20;  // the C++ style way of making a constant
-
-	GhostPos ghost_pos[NUM_GHOSTS];
+	gx3dVector ghost_world[NUM_GHOSTS];
  
   for (i=0; i<NUM_GHOSTS; i++) {
-		ghost_pos[i].world.x = random_GetFloat () * 100 - 50;
-		ghost_pos[i].world.y = 1;
-		ghost_pos[i].world.z = random_GetFloat () * -100;
+		ghost_world[i].x = random_GetFloat () * 100 - 50;
+		ghost_world[i].y = 1;
+		ghost_world[i].z = random_GetFloat () * -100;
 	}
 
 /*____________________________________________________________________
@@ -301,13 +365,20 @@ void Program_Run ()
 | Initialize the sound library
 |___________________________________________________________________*/
 
-  snd_Init (22, 16, 2, 1, 1);
-	snd_SetListenerDistanceFactorToFeet (snd_3D_APPLY_NOW);
+  // Sounds are mixed on their own thread, positions are in feet
+  if (NOT Audio_Init (44100))
+    debug_WriteFile ("Can't start audio");
 
-	Sound s_chimes, s_song;
+	MixerSound s_chimes, s_ghost;
 
-	s_song = snd_LoadSound ("wav\\eyes_without_a_face.wav", snd_CONTROL_VOLUME, 0);
-	s_chimes = snd_LoadSound ("wav\\ducks.wav", snd_CONTROL_3D, 0);
+  // Music is streamed from its file instead of loaded whole
+  if (NOT Wav_Stream_Init ())
+    debug_WriteFile ("Can't start streaming music");
+	// Both always play, kept as ADPCM they would also hold a decoded copy the whole time
+	s_chimes = Audio_Load_Sound ("wav\\ducks.wav", TRUE, FALSE);
+	s_ghost  = Audio_Load_Sound ("wav\\chimes.wav", TRUE, FALSE);
+  if (NOT Audio_Start ())
+    debug_WriteFile ("Can't open the sound device");
 	
 /*____________________________________________________________________
 |
@@ -345,6 +416,47 @@ void Program_Run ()
   heading.z = 1;
   Position_Init (&position, &heading, RUN_SPEED);
 
+	// Temporaries live until the end of the frame, in each thread's arena
+	Arena_Init (FRAME_ARENA_SIZE);
+	// Start worker threads, one per processor
+	Jobs_Init (0);
+	// Start background loading threads
+	Stream_Init (STREAM_THREADS);
+
+	// Init ghost flock
+	FlockParams flock_params;
+	flock_params.neighbor_radius   = 8;
+	flock_params.separation_radius = 3;
+	flock_params.max_neighbors     = 16;
+	flock_params.separation_weight = 20;
+	flock_params.alignment_weight  = 1;
+	flock_params.cohesion_weight   = 0.5f;
+	flock_params.seek_weight       = 0.5f;
+	flock_params.max_speed         = 10;
+	flock_params.max_force         = 20;
+
+	Flock_Init (NUM_GHOSTS, ghost_world, -150, -200, 150, 100, &flock_params);
+
+	// Init ghost level of detail
+	LODParams lod_params;
+	lod_params.distance[LOD_NEAR]   = 100;
+	lod_params.distance[LOD_MIDDLE] = 250;
+	lod_params.distance[LOD_FAR]    = 600;
+	lod_params.hysteresis           = 0.1f;
+	lod_params.interval[LOD_NEAR]   = 1;
+	lod_params.interval[LOD_MIDDLE] = 4;
+	lod_params.interval[LOD_FAR]    = 16;
+	lod_params.interval[LOD_CULLED] = 32;
+	lod_params.cost[LOD_NEAR]       = 4;
+	lod_params.cost[LOD_MIDDLE]     = 3;
+	lod_params.cost[LOD_FAR]        = 1;
+	lod_params.cost[LOD_CULLED]     = 0;
+	lod_params.budget               = 3 * NUM_GHOSTS;
+	Lod_Init (NUM_GHOSTS, &lod_params);
+
+	// Room for every ghost plus some billboard trees
+	Transparent_Init (NUM_GHOSTS + 16);
+
 /*____________________________________________________________________
 |
 | Init 3D graphics
@@ -369,25 +481,150 @@ void Program_Run ()
 | Load 3D models
 |___________________________________________________________________*/
 
-  // Load a 3D model																								
-  gx3d_ReadLWO2File("Objects\\tree2.lwo",&obj_tree,gx3d_VERTEXFORMAT_DEFAULT,gx3d_DONT_LOAD_TEXTURES);
-  // Load the same model but make sure mipmapping of the texture is turned off
-  gx3d_ReadLWO2File("Objects\\tree2.lwo",&obj_tree2,gx3d_VERTEXFORMAT_DEFAULT,gx3d_DONT_LOAD_TEXTURES | gx3d_DONT_GENERATE_MIPMAPS);
-  gx3d_ReadLWO2File("Objects\\ground.lwo", &obj_ground, gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
-
-  gx3d_ReadLWO2File("Objects\\skydome.lwo",&obj_skydome,gx3d_VERTEXFORMAT_DEFAULT,gx3d_DONT_LOAD_TEXTURES);
-  gx3d_ReadLWO2File("Objects\\clouddome.lwo",&obj_clouddome,gx3d_VERTEXFORMAT_DEFAULT,gx3d_DONT_LOAD_TEXTURES);
+  // Start the asset cache, it loads each file once
+  Asset_Init (ASSET_BUDGET);
+
+  // Load a 3D model, keep the handles so models loaded again when their files change are picked up
+  AssetHandle asset_tree = Asset_Load_Object ("Objects\\tree2.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
+  // Load the same model but make sure mipmapping of the texture is turned off (shares the object above since textures aren't loaded)
+  AssetHandle asset_tree2 = Asset_Load_Object ("Objects\\tree2.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES | gx3d_DONT_GENERATE_MIPMAPS);
+  AssetHandle asset_ground = Asset_Load_Object ("Objects\\ground.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
+
+  AssetHandle asset_skydome = Asset_Load_Object ("Objects\\skydome.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
+  AssetHandle asset_clouddome = Asset_Load_Object ("Objects\\clouddome.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
+
+  AssetHandle asset_ghost = Asset_Load_Object ("Objects\\billboard_ghost.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
+  AssetHandle asset_billboard_tree = Asset_Load_Object ("Objects\\billboard_tree.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
+  AssetHandle asset_ptree = Asset_Load_Object ("Objects\\ptree6.lwo", gx3d_VERTEXFORMAT_DEFAULT, gx3d_DONT_LOAD_TEXTURES);
+
+  obj_tree           = Asset_Get_Object (asset_tree);
+  obj_tree2          = Asset_Get_Object (asset_tree2);
+  obj_ground         = Asset_Get_Object (asset_ground);
+  obj_skydome        = Asset_Get_Object (asset_skydome);
+  obj_clouddome      = Asset_Get_Object (asset_clouddome);
+  obj_ghost          = Asset_Get_Object (asset_ghost);
+  obj_billboard_tree = Asset_Get_Object (asset_billboard_tree);
+  obj_ptree          = Asset_Get_Object (asset_ptree);
+
+  // Make the placeholder textures, gray and clear gray
+  byte placeholder[PLACEHOLDER_SIZE * PLACEHOLDER_SIZE * 4];
+  int placeholder_dx, placeholder_dy, placeholder_bitdepth;
+  if (NOT Bmp_Read_Info ("Objects\\Images\\placeholder_fa.bmp", &placeholder_dx, &placeholder_dy, &placeholder_bitdepth)) {
+    for (i=0; i<PLACEHOLDER_SIZE * PLACEHOLDER_SIZE * 4; i++)
+      placeholder[i] = ((i & 3) == 3) ? 0 : 128;
+    Bmp_Write ("Objects\\Images\\placeholder.bmp", placeholder, PLACEHOLDER_SIZE, PLACEHOLDER_SIZE, BMP_WRITE_COLOR);
+    Bmp_Write ("Objects\\Images\\placeholder_fa.bmp", placeholder, PLACEHOLDER_SIZE, PLACEHOLDER_SIZE, BMP_WRITE_ALPHA);
+  }
+  gx3dTexture tex_placeholder = Asset_Get_Texture (Asset_Load_Texture ("Objects\\Images\\placeholder.bmp", 0, 0));
+  gx3dTexture tex_placeholder_clear = Asset_Get_Texture (Asset_Load_Texture ("Objects\\Images\\placeholder.bmp", "Objects\\Images\\placeholder_fa.bmp", 0));
+
+  // Stream the large textures, the ones that fill the screen first, then nearest the camera first
+  gx3dVector tree_position = { 0, 0, 0 };
+  gx3dVector billboard_tree_position = { 10, 0, 50 };
+  unsigned load_start_time = timeGetTime ();
+  StreamHandle stream_ground = Stream_Load_Texture ("Objects\\Images\\sand_d512.bmp", 0, 0, NULL, tex_placeholder);
+  StreamHandle stream_skydome = Stream_Load_Texture ("Objects\\Images\\bright_sky_d128.bmp", 0, 0, NULL, tex_placeholder);
+  StreamHandle stream_clouddome = Stream_Load_Texture ("Objects\\Images\\newclouds.bmp", "Objects\\Images\\newclouds_fa.bmp", 0, NULL, tex_placeholder_clear);
+  StreamHandle stream_tree = Stream_Load_Texture ("Objects\\Images\\shrub_texture.bmp", 0, 0, &tree_position, tex_placeholder);
+  StreamHandle stream_bark = Stream_Load_Texture ("Objects\\Images\\bark_texture.bmp", 0, 0, &tree_position, tex_placeholder);
+  StreamHandle stream_billboardtree = Stream_Load_Texture ("Objects\\Images\\tree.bmp", "Objects\\Images\\tree_fa.bmp", 0, &billboard_tree_position, tex_placeholder_clear);
+
+  gx3dTexture tex_tree = Stream_Get_Texture (stream_tree);
+  gx3dTexture tex_bark = Stream_Get_Texture (stream_bark);
+  gx3dTexture tex_billboardtree = Stream_Get_Texture (stream_billboardtree);
+  gx3dTexture tex_skydome = Stream_Get_Texture (stream_skydome);
+  gx3dTexture tex_clouddome = Stream_Get_Texture (stream_clouddome);
+  gx3dTexture tex_ghost;
+  AssetHandle asset_tex_ghost;
+  gx3dTexture tex_ground = Stream_Get_Texture (stream_ground);
+
+  // Pack the ghost animation frames into one texture
+  const char *ghost_color_files[NUM_GHOST_FRAMES] = { "Objects\\Images\\ghost.bmp", "Objects\\Images\\ghost1.bmp", "Objects\\Images\\ghost2.bmp" };
+  const char *ghost_alpha_files[NUM_GHOST_FRAMES] = { "Objects\\Images\\ghost_fa.bmp", "Objects\\Images\\ghost_fa1.bmp", "Objects\\Images\\ghost_fa2.bmp" };
+  AtlasRect ghost_frames[NUM_GHOST_FRAMES];
+  AtlasReport atlas_report;
+  gx3dMatrix ghost_frame_matrix[NUM_GHOST_FRAMES];
+  int num_ghost_frames;
+
+  if (Atlas_Build (NUM_GHOST_FRAMES, ghost_color_files, ghost_alpha_files, GHOST_ATLAS_PADDING, "Objects\\Images\\ghost_atlas.bmp", "Objects\\Images\\ghost_atlas_fa.bmp", ghost_frames, &atlas_report)) {
+    debug_WriteFile ("_______________ Ghost Atlas ______________");
+    sprintf (str, "atlas size: %dx%d (%s)", atlas_report.dx, atlas_report.dy, atlas_report.rebuilt ? "rebuilt" : "up to date");
+    debug_WriteFile (str);
+    sprintf (str, "packing efficiency: %d of %d pixels used (%.1f%%), %d frames scaled to fit", atlas_report.used_pixels, atlas_report.dx * atlas_report.dy, atlas_report.efficiency * 100, atlas_report.scaled);
+    debug_WriteFile (str);
+    debug_WriteFile ("__________________________________________");
+    asset_tex_ghost = Asset_Load_Texture ("Objects\\Images\\ghost_atlas.bmp", "Objects\\Images\\ghost_atlas_fa.bmp", 0);
+    num_ghost_frames = NUM_GHOST_FRAMES;
+  }
+  else {
+    // No atlas, use the first frame only
+    asset_tex_ghost = Asset_Load_Texture ("Objects\\Images\\ghost.bmp", "Objects\\Images\\ghost_fa.bmp", 0);
+    ghost_frames[0].u  = 0;
+    ghost_frames[0].v  = 0;
+    ghost_frames[0].du = 1;
+    ghost_frames[0].dv = 1;
+    num_ghost_frames = 1;
+  }
+  tex_ghost = Asset_Get_Texture (asset_tex_ghost);
+  for (i=0; i<num_ghost_frames; i++)
+    Atlas_Get_Texture_Matrix (&ghost_frames[i], &ghost_frame_matrix[i]);
+
+  // Scatter a forest over the ground, keeping the play area clear
+  ForestAssets forest_assets;
+  forest_assets.full             = obj_tree;
+  forest_assets.low_poly         = obj_ptree;
+  forest_assets.impostor         = obj_billboard_tree;
+  forest_assets.trunk_texture    = tex_bark;
+  forest_assets.leaves_texture   = tex_tree;
+  forest_assets.impostor_texture = tex_billboardtree;
+  const char *ptree_files[FOREST_LOW_POLY_TEXTURES][2] = {
+    { "Objects\\Images\\ptree_d512.bmp", "Objects\\Images\\ptree_d512_fa.bmp" },
+    { "Objects\\Images\\ptree_d256.bmp", "Objects\\Images\\ptree_d256_fa.bmp" },
+    { "Objects\\Images\\ptree_d128.bmp", "Objects\\Images\\ptree_d128_fa.bmp" },
+    { "Objects\\Images\\ptree_d64.bmp",  "Objects\\Images\\ptree_d64_fa.bmp"  },
+    { "Objects\\Images\\ptree_d32.bmp",  "Objects\\Images\\ptree_d32_fa.bmp"  },
+    { "Objects\\Images\\ptree_d16.bmp",  "Objects\\Images\\ptree_d16_fa.bmp"  }
+  };
+  StreamHandle stream_ptree[FOREST_LOW_POLY_TEXTURES];
+  for (i=0; i<FOREST_LOW_POLY_TEXTURES; i++) {
+    stream_ptree[i] = Stream_Load_Texture (ptree_files[i][0], ptree_files[i][1], 0, NULL, tex_placeholder_clear);
+    forest_assets.low_poly_textures[i] = Stream_Get_Texture (stream_ptree[i]);
+  }
 
-  gx3d_ReadLWO2File("Objects\\billboard_ghost.lwo",&obj_ghost,gx3d_VERTEXFORMAT_DEFAULT,gx3d_DONT_LOAD_TEXTURES);
-  gx3d_ReadLWO2File("Objects\\billboard_tree.lwo",&obj_billboard_tree,gx3d_VERTEXFORMAT_DEFAULT,gx3d_DONT_LOAD_TEXTURES);
+  AssetStats asset_stats;
+  Asset_Get_Stats (&asset_stats);
+  debug_WriteFile ("_______________ Assets ___________________");
+  sprintf (str, "assets loaded: %d (%u KB)", asset_stats.num_assets, asset_stats.bytes / 1024);
+  debug_WriteFile (str);
+  sprintf (str, "hits: %d, misses: %d, evictions: %d", asset_stats.hits, asset_stats.misses, asset_stats.evictions);
+  debug_WriteFile (str);
+  debug_WriteFile ("__________________________________________");
 
-  gx3dTexture tex_tree = gx3d_InitTexture_File("Objects\\Images\\shrub_texture.bmp",0,0);
-  gx3dTexture tex_bark = gx3d_InitTexture_File("Objects\\Images\\bark_texture.bmp",0,0);
-  gx3dTexture tex_billboardtree = gx3d_InitTexture_File("Objects\\Images\\tree.bmp","Objects\\Images\\tree_fa.bmp",0);
-  gx3dTexture tex_skydome = gx3d_InitTexture_File("Objects\\Images\\bright_sky_d128.bmp",0,0);
-  gx3dTexture tex_clouddome = gx3d_InitTexture_File("Objects\\Images\\newclouds.bmp","Objects\\Images\\newclouds_fa.bmp",0);
-  gx3dTexture tex_ghost = gx3d_InitTexture_File("Objects\\Images\\ghost.bmp","Objects\\Images\\ghost_fa.bmp",0);
-  gx3dTexture tex_ground = gx3d_InitTexture_File("Objects\\Images\\sand_d512.bmp", 0, 0);
+  ForestParams forest_params;
+  forest_params.spacing        = 6;
+  forest_params.full_size      = 200;
+  forest_params.low_poly_size  = 60;
+  forest_params.min_size       = 2;
+  forest_params.hysteresis     = 0.1f;
+  forest_params.full_scale     = 1;
+  forest_params.low_poly_scale = 0.8f;       // ptree6 is 18 feet tall, tree2 is 14
+  forest_params.impostor_scale = 47.0f / 2;
+  forest_params.seed           = 1;
+  Forest_Init (NULL, -300, -300, 300, 300, &forest_params, &forest_assets);
+
+  ForestStats forest_stats;
+  double forest_time = 0;
+  int forest_draws = 0, forest_frames = 0;
+
+  StreamStats stream_stats;
+  bool streaming = true, first_frame = true;
+
+  // Watch the asset files, changed ones are loaded again while running
+  ReloadChange *reload_changes;
+  int num_reload_changes;
+  bool ghost_changed;
+  if (NOT Reload_Init ("Objects"))
+    debug_WriteFile ("Can't watch Objects for changed files");
 /*____________________________________________________________________
 |
 | create lights
@@ -436,15 +673,13 @@ void Program_Run ()
 	light_data.point.quadratic_attenuation = 0;
 	point_light1 = gx3d_InitLight (&light_data);
 
-	gx3dVector light_position = { 10, 20, 0 }, xlight_position;
-	float angle = 0;
-
 /*____________________________________________________________________
 |
 | Flush input queue
 |___________________________________________________________________*/
     
 	int move_x, move_y;	// mouse movement counters
+	FrameInput frame_input;
 
 	// Flush input queue
   evFlushEvents ();
@@ -458,57 +693,53 @@ void Program_Run ()
 | Main game loop
 |___________________________________________________________________*/
 	
-  snd_PlaySound (s_song, 1);
-	snd_SetSoundVolume (s_song, 90);
+  unsigned music_start_time = timeGetTime ();
+  if (Music_Play ("wav\\eyes_without_a_face.wav", TRUE, 90))
+    sprintf (str, "music started: %u ms", (unsigned)(timeGetTime () - music_start_time));
+  else
+    sprintf (str, "Can't play music");
+  debug_WriteFile (str);
 
-	snd_SetSoundMode (s_chimes, snd_3D_MODE_ORIGIN_RELATIVE, snd_3D_APPLY_NOW);
-	snd_SetSoundPosition (s_chimes, 30, 0, 0, snd_3D_APPLY_NOW);
-  snd_SetSoundMinDistance (s_chimes, 10, snd_3D_APPLY_NOW);
-  snd_SetSoundMaxDistance (s_chimes, 100, snd_3D_APPLY_NOW);
-	snd_PlaySound (s_chimes, 1);
+	// Init the sim, from here on only the sim thread moves the camera, ghosts and sounds
+	SimState sim;
+	sim.v_chimes         = Audio_Play_3D (s_chimes, 1, 1, 30, 0, 0, 10, 100);
+	sim.s_ghost          = s_ghost;
+	sim.num_ghost_voices = 0;
+	for (i=0; i<NUM_GHOSTS; i++)
+		sim.v_ghosts[i] = 0;
+	sim.num_ghost_frames = num_ghost_frames;
+	sim.last_time        = 0;
+	sim.move_x           = 0;
+	sim.move_y           = 0;
+	sim.angle            = 0;
+	sim.target_x         = -10;
+	sim.target_x_incr    = 0.1f;
+	sim.animation_time   = 0;
+
+	frame_input.cmd_move = 0;
+	frame_input.move_x   = 0;
+	frame_input.move_y   = 0;
+
+	// Simulate frames while the last one is drawn, the first one starts now
+	if (NOT Pipeline_Init (sizeof(FramePacket), sizeof(FrameInput), PIPELINE_THREADED, Simulate_Frame, &sim)) {
+		debug_WriteFile ("Can't start the sim thread, simulating each frame before drawing it");
+		Pipeline_Init (sizeof(FramePacket), sizeof(FrameInput), FALSE, Simulate_Frame, &sim);
+	}
 
 	// Variables
-  unsigned elapsed_time, last_time, new_time;
-	bool force_update;
+	const FramePacket *frame;
+	gx3dMatrix view_matrix;
 	unsigned cmd_move;
+	ArenaStats arena_stats;
+	int arena_overflows;
 
 	// Init loop variables
 	cmd_move = 0;
-	last_time = 0;
-	force_update = false;
+	arena_overflows = 0;
 
 	// Game loop
 	for (quit=FALSE; NOT quit; ) {
 
-		angle += 0.5;
-		if (angle >= 360)
-			angle = 0;
-		gx3d_GetRotateYMatrix (&m, angle);
-		gx3d_MultiplyVectorMatrix (&light_position, &m, &(light_data.point.src));
-    gx3d_UpdateLight (point_light1, &light_data);
-
-		gx3dVector sound1_position = { 50, 10, 0 };
-		gx3dVector Xsound1_position;
-
-		// build a matrix 
-		gx3d_MultiplyVectorMatrix (&sound1_position, &m, &Xsound1_position);
-
-	  snd_SetSoundPosition (s_chimes, Xsound1_position.x, Xsound1_position.y, Xsound1_position.z, snd_3D_APPLY_NOW);
-
-/*____________________________________________________________________
-|
-| Update clock
-|___________________________________________________________________*/
-
-		// Get the current time (# milliseconds since the program started)
-    new_time = timeGetTime ();
-		// Compute the elapsed time (in milliseconds) since the last time through this loop
-    if (last_time == 0) 
-      elapsed_time = 0;
-    else 
-      elapsed_time = new_time - last_time;
-    last_time = new_time;
-
 /*____________________________________________________________________
 |
 | Process user input
@@ -547,16 +778,128 @@ void Program_Run ()
 		// Check for camera movement (via mouse)
 		msGetMouseMovement (&move_x, &move_y);
 
+		// Seen by the next frame the sim starts
+		frame_input.cmd_move  = cmd_move;
+		frame_input.move_x   += move_x;
+		frame_input.move_y   += move_y;
+		Pipeline_Set_Input (&frame_input);
+
 /*____________________________________________________________________
 |
-| Update camera view
+| Get the newest frame from the sim
+|___________________________________________________________________*/
+
+		// Read only until Pipeline_End_Render()
+		frame = (const FramePacket *) Pipeline_Begin_Render ();
+		if (frame == NULL)
+			break;
+
+		position    = frame->position;
+		heading     = frame->heading;
+		view_matrix = frame->view_matrix;
+		gx3d_SetViewMatrix (&view_matrix);
+
+		light_data.point.src = frame->light_src;
+    gx3d_UpdateLight (point_light1, &light_data);
+
+/*____________________________________________________________________
+|
+| Update streaming
+|___________________________________________________________________*/
+
+    if (streaming) {
+      // Log how long until the first frame is drawn
+      if (first_frame) {
+        first_frame = false;
+        sprintf (str, "time to first frame: %u ms", (unsigned)(timeGetTime () - load_start_time));
+        debug_WriteFile (str);
+      }
+      // Switch to any textures that finished loading
+      if (Stream_Update (&position, STREAM_LOADS_PER_FRAME)) {
+        tex_tree          = Stream_Get_Texture (stream_tree);
+        tex_bark          = Stream_Get_Texture (stream_bark);
+        tex_billboardtree = Stream_Get_Texture (stream_billboardtree);
+        tex_skydome       = Stream_Get_Texture (stream_skydome);
+        tex_clouddome     = Stream_Get_Texture (stream_clouddome);
+        tex_ground        = Stream_Get_Texture (stream_ground);
+        forest_assets.trunk_texture    = tex_bark;
+        forest_assets.leaves_texture   = tex_tree;
+        forest_assets.impostor_texture = tex_billboardtree;
+        for (i=0; i<FOREST_LOW_POLY_TEXTURES; i++)
+          forest_assets.low_poly_textures[i] = Stream_Get_Texture (stream_ptree[i]);
+        Forest_Set_Textures (&forest_assets);
+      }
+      Stream_Get_Stats (&stream_stats);
+      if (stream_stats.pending + stream_stats.ready == 0) {
+        streaming = false;
+        debug_WriteFile ("_______________ Streaming ________________");
+        sprintf (str, "all loaded: %u ms (%d loaded, %d failed)", (unsigned)(timeGetTime () - load_start_time), stream_stats.loaded, stream_stats.failed);
+        debug_WriteFile (str);
+        sprintf (str, "read time: %.1f ms, finish time: %.1f ms", stream_stats.read_time, stream_stats.finish_time);
+        debug_WriteFile (str);
+        debug_WriteFile ("__________________________________________");
+      }
+    }
+
+/*____________________________________________________________________
+|
+| Load changed assets
+|___________________________________________________________________*/
+
+    // Files were read on the watching thread, swap in the new versions here between frames
+    reload_changes = ARENA_ARRAY (ReloadChange, MAX_RELOAD_CHANGES);
+    // Out of memory, the changes wait for the next frame
+    num_reload_changes = reload_changes ? Reload_Get_Changes (reload_changes, MAX_RELOAD_CHANGES) : 0;
+    if (num_reload_changes) {
+      ghost_changed = false;
+      for (i=0; i<num_reload_changes; i++) {
+        ReloadChange *c = &reload_changes[i];
+        int reloaded = Asset_Reload (c->filename, c->size, c->write_time, c->hash);
+        for (j=0; j<NUM_GHOST_FRAMES; j++)
+          if ((strcmp (c->filename, ghost_color_files[j]) == 0) OR (strcmp (c->filename, ghost_alpha_files[j]) == 0))
+            ghost_changed = true;
+        sprintf (str, "reloaded %s: %d assets, %.1f ms after the change", c->filename, reloaded, Reload_Get_Time () - c->change_time);
+        debug_WriteFile (str);
+      }
+      // A ghost frame changed, pack the atlas again (the atlas files are then seen changing and loaded)
+      if (ghost_changed AND (num_ghost_frames == NUM_GHOST_FRAMES))
+        if (Atlas_Build (NUM_GHOST_FRAMES, ghost_color_files, ghost_alpha_files, GHOST_ATLAS_PADDING, "Objects\\Images\\ghost_atlas.bmp", "Objects\\Images\\ghost_atlas_fa.bmp", ghost_frames, &atlas_report))
+          for (i=0; i<num_ghost_frames; i++)
+            Atlas_Get_Texture_Matrix (&ghost_frames[i], &ghost_frame_matrix[i]);
+      // Handles stay the same, get what they now point to
+      obj_tree           = Asset_Get_Object (asset_tree);
+      obj_tree2          = Asset_Get_Object (asset_tree2);
+      obj_ground         = Asset_Get_Object (asset_ground);
+      obj_skydome        = Asset_Get_Object (asset_skydome);
+      obj_clouddome      = Asset_Get_Object (asset_clouddome);
+      obj_ghost          = Asset_Get_Object (asset_ghost);
+      obj_billboard_tree = Asset_Get_Object (asset_billboard_tree);
+      obj_ptree          = Asset_Get_Object (asset_ptree);
+      tex_ghost          = Asset_Get_Texture (asset_tex_ghost);
+      tex_tree           = Stream_Get_Texture (stream_tree);
+      tex_bark           = Stream_Get_Texture (stream_bark);
+      tex_billboardtree  = Stream_Get_Texture (stream_billboardtree);
+      tex_skydome        = Stream_Get_Texture (stream_skydome);
+      tex_clouddome      = Stream_Get_Texture (stream_clouddome);
+      tex_ground         = Stream_Get_Texture (stream_ground);
+      forest_assets.full             = obj_tree;
+      forest_assets.low_poly         = obj_ptree;
+      forest_assets.impostor         = obj_billboard_tree;
+      forest_assets.trunk_texture    = tex_bark;
+      forest_assets.leaves_texture   = tex_tree;
+      forest_assets.impostor_texture = tex_billboardtree;
+      for (i=0; i<FOREST_LOW_POLY_TEXTURES; i++)
+        forest_assets.low_poly_textures[i] = Stream_Get_Texture (stream_ptree[i]);
+      Forest_Set_Models (&forest_assets);
+      Forest_Set_Textures (&forest_assets);
+    }
+
+/*____________________________________________________________________
+|
+| Update forest
 |___________________________________________________________________*/
 
-    bool position_changed, camera_changed;
-    Position_Update (elapsed_time, cmd_move, -move_y, move_x, force_update, 
-                     &position_changed, &camera_changed, &position, &heading);
-    snd_SetListenerPosition (position.x, position.y, position.z, snd_3D_APPLY_NOW);
-    snd_SetListenerOrientation (heading.x, heading.y, heading.z, 0, 1, 0, snd_3D_APPLY_NOW);
+		Forest_Update (&view_matrix, fov, (float)gxGetScreenWidth () / gxGetScreenHeight (), far_plane, gxGetScreenHeight ());
 
 /*____________________________________________________________________
 |
@@ -620,24 +963,12 @@ void Program_Run ()
         gx3d_DrawObjectLayer(layer,0);
       }
 
-      // Draw some billboard trees
-      gx3dVector billboard_normal = {0,0,1};
-      gx3d_GetScaleMatrix(&m1,47 / 2,47 / 2,1);
-      gx3d_GetBillboardRotateYMatrix(&m2,&billboard_normal,&heading);
-
-      gx3d_GetTranslateMatrix(&m3,10,0,50);
-      gx3d_MultiplyMatrix(&m1,&m2,&m);
-      gx3d_MultiplyMatrix(&m,&m3,&m);
-      gx3d_SetObjectMatrix(obj_billboard_tree,&m);
-      gx3d_SetTexture(0,tex_billboardtree);
-      gx3d_DrawObject(obj_billboard_tree,0);
-
-      gx3d_GetTranslateMatrix(&m3,-30,0,0);
-      gx3d_MultiplyMatrix(&m1,&m2,&m);
-      gx3d_MultiplyMatrix(&m,&m3,&m);
-      gx3d_SetObjectMatrix(obj_billboard_tree,&m);
-      gx3d_SetTexture(0,tex_billboardtree);
-      gx3d_DrawObject(obj_billboard_tree,0);
+      // Draw forest
+      Forest_Draw (&heading);
+      Forest_Get_Stats (&forest_stats);
+      forest_time  += forest_stats.update_time;
+      forest_draws += forest_stats.draws;
+      forest_frames++;
 
       gx3d_DisableAlphaTesting();
 
@@ -678,34 +1009,47 @@ void Program_Run ()
       // Turn off fog
       gx3d_DisableFog();
 
-		  // Transform ghosts positions into camera space
-			gx3dMatrix viewmatrix;
-			gx3d_GetViewMatrix (&viewmatrix);
-			for (i=0; i<NUM_GHOSTS; i++)
-				gx3d_MultiplyVectorMatrix (&ghost_pos[i].world, &viewmatrix, &ghost_pos[i].view);
-			qsort ((void*)ghost_pos, NUM_GHOSTS, sizeof(GhostPos), compare_ghosts);  
-			
-			static float targetX = -10;
-			static float targetX_incr = 0.1f;
-			targetX += targetX_incr;
-			if (targetX > 10)
-				targetX_incr = -0.1f;
-			else if (targetX < -10)
-				targetX_incr = 0.1f;
-
-
-			// Draw ghosts
-			for (i=0; i<NUM_GHOSTS; i++) {
-				gx3d_GetScaleMatrix (&m1, 10, 10, 10);
-				gx3d_GetBillboardRotateYMatrix (&m2, &billboard_normal, &heading);
-				gx3d_GetTranslateMatrix (&m3, targetX, ghost_pos[i].world.y, ghost_pos[i].world.z);
-				gx3d_MultiplyMatrix (&m1, &m2, &m);
-				gx3d_MultiplyMatrix (&m, &m3, &m);
-        gx3d_SetObjectMatrix (obj_ghost, &m);
-        gx3d_SetTexture (0, tex_ghost);
-				gx3d_DrawObject (obj_ghost, 0);
+/*____________________________________________________________________
+|
+| Draw transparent objects (billboard trees and ghosts) in one pass
+|___________________________________________________________________*/
+
+			gx3dVector view;
+			gx3dVector billboard_normal = {0,0,1};
+			Transparent_Begin (near_plane, far_plane);
+
+			// Billboard trees
+			static gx3dVector billboard_tree_pos[2] = { { 10, 0, 50 }, { -30, 0, 0 } };
+			BillboardBatch billboard_trees;
+			billboard_trees.object    = obj_billboard_tree;
+			billboard_trees.positions = billboard_tree_pos;
+			gx3d_GetScaleMatrix (&m1, 47 / 2, 47 / 2, 1);
+			gx3d_GetBillboardRotateYMatrix (&m2, &billboard_normal, &heading);
+			gx3d_MultiplyMatrix (&m1, &m2, &billboard_trees.scale_rotate);
+			for (i=0; i<2; i++) {
+				gx3d_MultiplyVectorMatrix (&billboard_tree_pos[i], &view_matrix, &view);
+				Transparent_Add (TRANSPARENT_BLENDED, view.z, tex_billboardtree, NULL, Draw_Billboard, &billboard_trees, i);
 			}
 
+			// Ghosts - near ones are blended, far ones only alpha tested
+			BillboardBatch ghosts;
+			ghosts.object    = obj_ghost;
+			ghosts.positions = (gx3dVector *) frame->ghost_world;
+			gx3d_GetScaleMatrix (&m1, 10, 10, 10);
+			gx3d_MultiplyMatrix (&m1, &m2, &ghosts.scale_rotate);
+			for (j=0; j<frame->num_near_ghosts; j++) {
+				i = frame->near_ghosts[j];
+				gx3d_MultiplyVectorMatrix (&ghosts.positions[i], &view_matrix, &view);
+				Transparent_Add (TRANSPARENT_BLENDED, view.z, tex_ghost, &ghost_frame_matrix[frame->ghost_frame[i]], Draw_Billboard, &ghosts, i);
+			}
+			// Far ghosts are in order of frame so the texture matrix changes once per frame
+			for (j=0; j<frame->num_far_ghosts; j++) {
+				i = frame->far_ghosts[j];
+				Transparent_Add (TRANSPARENT_TESTED, 0, tex_ghost, &ghost_frame_matrix[frame->ghost_frame[i]], Draw_Billboard, &ghosts, i);
+			}
+
+			Transparent_Draw ();
+
 		  gx3d_SetAmbientLight (color3d_white);
 
 		  // Disable alpha blending
@@ -717,6 +1061,18 @@ void Program_Run ()
 		  // Page flip (so user can see it)
 		  gxFlipVisualActivePages (FALSE);
 	  }   
+
+		// Done with the frame, the sim can fill it again
+		Pipeline_End_Render ();
+
+		// Free this frame's temporaries, warn when a frame didn't fit (the arena is made bigger)
+		Arena_Reset ();
+		Arena_Get_Total_Stats (&arena_stats);
+		if (arena_stats.overflows > arena_overflows) {
+			arena_overflows = arena_stats.overflows;
+			sprintf (str, "frame arena overflowed: %u bytes used in a frame, arenas now %u KB in all", arena_stats.max_peak, arena_stats.size / 1024);
+			debug_WriteFile (str);
+		}
   }
 
 /*____________________________________________________________________
@@ -724,11 +1080,54 @@ void Program_Run ()
 | Free stuff and exit
 |___________________________________________________________________*/
 
-  gx3d_FreeObject (obj_tree);  
-  gx3d_FreeObject (obj_tree2);  
+  // Stop the sim before what it uses is freed
+  PipelineStats pipeline_stats;
+  Pipeline_Get_Stats (&pipeline_stats);
+  Pipeline_Free ();
+  if (pipeline_stats.drawn) {
+    debug_WriteFile ("_______________ Pipeline _________________");
+    sprintf (str, "frames: %d simulated, %d drawn", pipeline_stats.frames, pipeline_stats.drawn);
+    debug_WriteFile (str);
+    sprintf (str, "average sim time: %.3f ms", pipeline_stats.sim_time / pipeline_stats.frames);
+    debug_WriteFile (str);
+    sprintf (str, "average wait: %.3f ms for a frame, %.3f ms for the render", pipeline_stats.render_wait / pipeline_stats.drawn, pipeline_stats.sim_wait / pipeline_stats.frames);
+    debug_WriteFile (str);
+    debug_WriteFile ("__________________________________________");
+  }
+
+  if (Arena_Get_Total_Stats (&arena_stats)) {
+    debug_WriteFile ("_______________ Frame Arenas _____________");
+    sprintf (str, "arena size: %u KB in all (%s)", arena_stats.size / 1024, arena_stats.large_pages ? "large pages" : "small pages");
+    debug_WriteFile (str);
+    sprintf (str, "peak per frame: %u bytes, %d frames overflowed", arena_stats.max_peak, arena_stats.overflows);
+    debug_WriteFile (str);
+    debug_WriteFile ("__________________________________________");
+  }
+
+  if (forest_frames) {
+    debug_WriteFile ("_______________ Forest ___________________");
+    sprintf (str, "trees: %d", forest_stats.num_trees);
+    debug_WriteFile (str);
+    sprintf (str, "average update time: %.3f ms", forest_time / forest_frames);
+    debug_WriteFile (str);
+    sprintf (str, "average draws per frame: %d", forest_draws / forest_frames);
+    debug_WriteFile (str);
+    debug_WriteFile ("__________________________________________");
+  }
 
-	snd_StopSound (s_song);
-	snd_Free ();
+  Reload_Free ();
+  Forest_Free ();
+  Stream_Free ();
+  Asset_Free ();
+  Transparent_Free ();
+  Lod_Free ();
+  Flock_Free ();
+  Jobs_Free ();
+  Arena_Free ();
+
+  Music_Stop ();
+  Wav_Stream_Free ();
+  Audio_Free ();
 }
 
 /*____________________________________________________________________
@@ -769,6 +1168,151 @@ static void Init_Render_State ()
   gx3d_SetTextureFiltering (1, gx3d_TEXTURE_FILTERTYPE_TRILINEAR, 0);
 }
 
+/*____________________________________________________________________
+|
+| Function: Draw_Billboard
+|
+| Input: Called from Transparent_Draw()
+| Output: Draws one copy of a billboard object.
+|___________________________________________________________________*/
+
+static void Draw_Billboard (void *params, int item)
+{
+  BillboardBatch *batch = (BillboardBatch *) params;
+  gx3dMatrix m, mt;
+
+  gx3d_GetTranslateMatrix (&mt, batch->positions[item].x, batch->positions[item].y, batch->positions[item].z);
+  gx3d_MultiplyMatrix (&batch->scale_rotate, &mt, &m);
+  gx3d_SetObjectMatrix (batch->object, &m);
+  gx3d_DrawObject (batch->object, 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Simulate_Frame
+|
+| Input: Called from Pipeline_Begin_Render() or the sim thread
+| Output: Moves the camera, light, sounds and ghosts on by the time
+|   since the last frame and fills a frame packet with what to draw.
+|   Only does math and calls sim modules, never the graphics device.
+|___________________________________________________________________*/
+
+static void Simulate_Frame (const void *input, void *packet, void *data)
+{
+  int i, frame, level, animation_step;
+  unsigned new_time, elapsed_time;
+  bool position_changed, camera_changed;
+  gx3dMatrix m;
+  gx3dVector light_position = { 10, 20, 0 };
+  gx3dVector sound1_position = { 50, 10, 0 }, xsound1_position;
+  gx3dVector flock_target;
+  static const int ghost_animation[GHOST_ANIMATION_SIZE] = { 0, 1, 2, 1 };
+  const FrameInput *frame_input = (const FrameInput *) input;
+  FramePacket *p = (FramePacket *) packet;
+  SimState *sim = (SimState *) data;
+  ArenaMarker marker;
+  byte *ghost_level;
+
+  // Not threaded this is the render thread's arena, free only what's used here
+  marker = Arena_Get_Marker ();
+
+/*____________________________________________________________________
+|
+| Update clock
+|___________________________________________________________________*/
+
+  // Get the current time (# milliseconds since the program started)
+  new_time = timeGetTime ();
+  // Compute the elapsed time (in milliseconds) since the last frame
+  if (sim->last_time == 0)
+    elapsed_time = 0;
+  else
+    elapsed_time = new_time - sim->last_time;
+  sim->last_time = new_time;
+
+/*____________________________________________________________________
+|
+| Move the point light and the chimes around
+|___________________________________________________________________*/
+
+  sim->angle += 0.5;
+  if (sim->angle >= 360)
+    sim->angle = 0;
+  gx3d_GetRotateYMatrix (&m, sim->angle);
+  gx3d_MultiplyVectorMatrix (&light_position, &m, &p->light_src);
+  gx3d_MultiplyVectorMatrix (&sound1_position, &m, &xsound1_position);
+  Audio_Set_Position (sim->v_chimes, xsound1_position.x, xsound1_position.y, xsound1_position.z);
+
+/*____________________________________________________________________
+|
+| Update camera view
+|___________________________________________________________________*/
+
+  Position_Update (elapsed_time, frame_input->cmd_move, -(frame_input->move_y - sim->move_y), frame_input->move_x - sim->move_x, false,
+                   &position_changed, &camera_changed, &p->position, &p->heading);
+  Position_Get_View_Matrix (&p->view_matrix);
+  sim->move_x = frame_input->move_x;
+  sim->move_y = frame_input->move_y;
+  // Queued for the audio thread, applied before it mixes the next buffer
+  Audio_Set_Listener (p->position.x, p->position.y, p->position.z, p->heading.x, p->heading.y, p->heading.z, 0, 1, 0);
+
+/*____________________________________________________________________
+|
+| Update ghosts
+|___________________________________________________________________*/
+
+  // Flock swarms around a target that sweeps back and forth
+  sim->target_x += sim->target_x_incr;
+  if (sim->target_x > 10)
+    sim->target_x_incr = -0.1f;
+  else if (sim->target_x < -10)
+    sim->target_x_incr = 0.1f;
+
+  flock_target.x = sim->target_x * 5;
+  flock_target.y = 1;
+  flock_target.z = -50;
+  Flock_Update (elapsed_time, &flock_target, Lod_Get_Intervals ());
+  Lod_Update (&p->position);
+
+  // Get position and animation frame of each visible ghost
+  sim->animation_time += elapsed_time;
+  animation_step = sim->animation_time / GHOST_FRAME_TIME;
+  ghost_level = ARENA_ARRAY (byte, NUM_GHOSTS);
+  p->num_near_ghosts = 0;
+  for (i=0; i<NUM_GHOSTS; i++) {
+    level = Lod_Get_Level (i);
+    if (ghost_level)
+      ghost_level[i] = (byte) level;
+    // Culled ghosts are still heard
+    Flock_Get_Position (i, &p->ghost_world[i]);
+    Audio_Set_Position (sim->v_ghosts[i], p->ghost_world[i].x, p->ghost_world[i].y, p->ghost_world[i].z);
+    if (level == LOD_CULLED)
+      continue;
+    // Each ghost starts the animation at a different point
+    p->ghost_frame[i] = ghost_animation[(animation_step + i) % GHOST_ANIMATION_SIZE] % sim->num_ghost_frames;
+    if ((level == LOD_NEAR) OR (level == LOD_MIDDLE))
+      p->near_ghosts[p->num_near_ghosts++] = (short) i;
+  }
+  // Far ghosts grouped by animation frame (none this frame if out of memory)
+  p->num_far_ghosts = 0;
+  for (frame=0; ghost_level AND (frame<sim->num_ghost_frames); frame++)
+    for (i=0; i<NUM_GHOSTS; i++)
+      if ((ghost_level[i] == LOD_FAR) AND (p->ghost_frame[i] == frame))
+        p->far_ghosts[p->num_far_ghosts++] = (short) i;
+
+  // Start one ghost's sound a frame, so they don't all play in step
+  if (sim->s_ghost AND (sim->num_ghost_voices < NUM_GHOSTS)) {
+    i = sim->num_ghost_voices;
+    sim->v_ghosts[i] = Audio_Play_3D (sim->s_ghost, GHOST_SOUND_VOLUME, GHOST_SOUND_PRIORITY, p->ghost_world[i].x, p->ghost_world[i].y, p->ghost_world[i].z,
+                                      GHOST_SOUND_MIN, GHOST_SOUND_MAX);
+    // Else try again next frame
+    if (sim->v_ghosts[i])
+      sim->num_ghost_voices++;
+  }
+
+  Arena_Free_To_Marker (marker);
+}
+
 /*____________________________________________________________________
 |
 | Function: Program_Free
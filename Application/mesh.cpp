@@ -0,0 +1,917 @@
+/*____________________________________________________________________
+|
+| File: mesh.cpp
+|
+| Description: Cooked mesh files.  An LWO2 file is cooked once into a
+|   file that is ready to use as is: an interleaved vertex buffer
+|   (position, normal, uv), a 16 or 32-bit index buffer, a table of
+|   named layers, a table of surfaces (the triangles of a layer with
+|   one surface, one draw each) and a bound sphere.  Everything is
+|   found by offsets from the start of the file, so loading is just
+|   mapping the file.
+|
+|   The header records the size, write time and content hash of the
+|   .lwo file.  If size or time changed the source is hashed, and the
+|   mesh is cooked again only if the hash changed too.  If not, the new
+|   size and time are written into the header so the next load doesn't
+|   hash it again.
+|
+|   Triangles are grouped by surface, reordered within each surface for
+|   the vertex cache and then for overdraw, and vertices for fetch order
+|   (see meshopt.cpp).  A surface whose reordered triangles miss the
+|   modeled cache as often as before (small or already well ordered
+|   ones) keeps the order of the file.
+|
+|   Vertices are 32-byte floats, or packed in 16 bytes: positions and
+|   uvs as 16-bit steps across the bounds of the mesh and normals
+|   octahedral, the unit sphere folded onto a square, as two 16-bit
+|   values.  Packed vertices are decoded 4 at a time with SSE2.
+|
+| Functions: Mesh_Cook
+|             Build_Layer
+|             Pack_Vertices
+|             Encode_Normal
+|            Mesh_Load
+|             Update_Source_Info
+|             Map_Mesh
+|             Get_Mesh_Filename
+|            Mesh_Free
+|            Mesh_Get_Layer
+|            Mesh_Decode_Vertices
+|             Decode_Vertices
+|             Decode_Normal
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "filemap.h"
+#include "lwo.h"
+#include "mesh.h"
+#include "meshopt.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define MESH_SSE2
+#include <emmintrin.h>
+#endif
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static bool Build_Layer (LwoMesh *lwo, LwoLayer *lwo_layer, MeshLayer *layer, MeshSurface *surfaces, MeshVertex *vertices, unsigned *indices);
+static void Pack_Vertices (const MeshVertex *vertices, unsigned num_vertices, const float *min, const float *max, MeshHeader *header, MeshPackedVertex *packed, MeshReport *report);
+static void Encode_Normal (const float *n, short *packed);
+static bool Update_Source_Info (const char *mesh_file, unsigned source_size, unsigned long long source_time);
+static bool Map_Mesh (const char *mesh_file, Mesh *mesh, unsigned *size);
+static void Get_Mesh_Filename (const char *lwo_file, char *mesh_file);
+static void Decode_Vertices (const MeshHeader *header, const MeshPackedVertex *packed, unsigned count, MeshVertex *vertices);
+static void Decode_Normal (short nx, short ny, float *n);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define ALIGN_UP(_n_) (((_n_) + 15) & ~15)
+
+#define MESH_MAX_PATH 260
+
+#define MESH_PACK_STEPS   65535.0f   // unsigned 16-bit steps across the bounds
+#define MESH_NORMAL_STEPS 32767.0f   // signed 16-bit steps of an octahedral coordinate
+
+#define OVERDRAW_THRESHOLD 1.05f   // vertex cache misses allowed for overdraw ordering
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Cook
+|
+| Input: Called from Mesh_Load()
+| Output: Cooks an LWO2 file into a mesh file with vertices in a format.
+|   Gets vertex cache stats before and after optimizing, and the error
+|   of packed vertices, if report is not NULL.  Returns true on success,
+|   else false.
+|___________________________________________________________________*/
+
+int Mesh_Cook (const char *lwo_file, const char *mesh_file, int vertex_format, MeshReport *report)
+{
+  int i, ok;
+  unsigned size, num_vertices, num_indices, max_vertices, index_size, vertex_size, num_triangles, num_surfaces;
+  unsigned first_vertex, first_index, first_surface, build_vertex, j, k;
+  const void *source;
+  float d, dx, dy, dz, min[3], max[3], acmr, atvr, optimized_acmr;
+  unsigned char *file;
+  unsigned *build_indices, *original_indices, *tri;
+  MeshHeader *header;
+  MeshLayer *layers, *build_layers;
+  MeshSurface *surfaces, *surface, *build_surfaces;
+  MeshVertex *vertices, *v, *build_vertices;
+  LwoMesh *lwo;
+  FILE *fp;
+
+  if (report)
+    memset (report, 0, sizeof(MeshReport));
+
+  lwo = Lwo_Read (lwo_file);
+  if (lwo == NULL)
+    return (false);
+
+  // Count vertices, indices and surfaces (at most one per tag in each layer) before optimizing
+  num_vertices = 0;
+  num_indices  = 0;
+  num_surfaces = 0;
+  for (i=0; i<lwo->num_layers; i++) {
+    num_vertices += lwo->layers[i].num_points;
+    num_indices  += lwo->layers[i].num_triangles * 3;
+    num_surfaces += (lwo->num_tags > 0) ? lwo->num_tags : 1;
+  }
+  build_layers   = (MeshLayer *) calloc (lwo->num_layers + 1, sizeof(MeshLayer));
+  build_surfaces = (MeshSurface *) calloc (num_surfaces + 1, sizeof(MeshSurface));
+  build_vertices = (MeshVertex *) calloc (num_vertices + 1, sizeof(MeshVertex));
+  build_indices  = (unsigned *) malloc (num_indices * sizeof(unsigned) + 1);
+  original_indices = (unsigned *) malloc (num_indices * sizeof(unsigned) + 1);
+  if ((build_layers == NULL) || (build_surfaces == NULL) || (build_vertices == NULL) || (build_indices == NULL) || (original_indices == NULL)) {
+    if (build_layers)   free (build_layers);
+    if (build_surfaces) free (build_surfaces);
+    if (build_vertices) free (build_vertices);
+    if (build_indices)  free (build_indices);
+    if (original_indices) free (original_indices);
+    Lwo_Free (lwo);
+    return (false);
+  }
+
+  // Build each layer and optimize it: triangles of each surface for the vertex cache then overdraw, vertices for fetch
+  build_vertex  = 0;
+  first_index   = 0;
+  first_surface = 0;
+  ok = true;
+  for (i=0; ok && (i<lwo->num_layers); i++) {
+    ok = Build_Layer (lwo, &lwo->layers[i], &build_layers[i], build_surfaces + first_surface, build_vertices + build_vertex, build_indices + first_index);
+    if (!ok)
+      break;
+    num_triangles = build_layers[i].num_indices / 3;
+    if (report) {
+      Mesh_Get_Cache_Stats (build_indices + first_index, build_layers[i].num_indices, build_layers[i].num_vertices, MESH_CACHE_SIZE, &acmr, &atvr);
+      report->acmr_before += acmr * num_triangles;
+      report->atvr_before += atvr * build_layers[i].num_vertices;
+      report->vertices_before += build_layers[i].num_vertices;
+    }
+    for (k=0; k<build_layers[i].num_surfaces; k++) {
+      surface = &build_surfaces[first_surface + k];
+      tri = build_indices + first_index + surface->first_index;
+      // Keep the file's order unless the reordering takes fewer cache misses
+      Mesh_Get_Cache_Stats (tri, surface->num_indices, build_layers[i].num_vertices, MESH_CACHE_SIZE, &acmr, &atvr);
+      memcpy (original_indices, tri, surface->num_indices * sizeof(unsigned));
+      Mesh_Optimize_Cache (tri, surface->num_indices, build_layers[i].num_vertices);
+      Mesh_Optimize_Overdraw (tri, surface->num_indices, build_vertices + build_vertex, build_layers[i].num_vertices, OVERDRAW_THRESHOLD);
+      Mesh_Get_Cache_Stats (tri, surface->num_indices, build_layers[i].num_vertices, MESH_CACHE_SIZE, &optimized_acmr, &atvr);
+      if (optimized_acmr >= acmr)
+        memcpy (tri, original_indices, surface->num_indices * sizeof(unsigned));
+      surface->first_index += first_index;
+    }
+    build_layers[i].first_surface = first_surface;
+    first_surface += build_layers[i].num_surfaces;
+    build_layers[i].num_vertices = Mesh_Optimize_Fetch (build_indices + first_index, build_layers[i].num_indices, build_vertices + build_vertex, build_layers[i].num_vertices);
+    if (report) {
+      Mesh_Get_Cache_Stats (build_indices + first_index, build_layers[i].num_indices, build_layers[i].num_vertices, MESH_CACHE_SIZE, &acmr, &atvr);
+      report->acmr_after += acmr * num_triangles;
+      report->atvr_after += atvr * build_layers[i].num_vertices;
+      report->vertices_after += build_layers[i].num_vertices;
+    }
+    build_vertex += lwo->layers[i].num_points;
+    first_index  += build_layers[i].num_indices;
+  }
+  num_surfaces = first_surface;
+  free (original_indices);
+  if (!ok) {
+    free (build_layers);
+    free (build_surfaces);
+    free (build_vertices);
+    free (build_indices);
+    Lwo_Free (lwo);
+    return (false);
+  }
+  if (report) {
+    if (num_indices) {
+      report->acmr_before /= num_indices / 3;
+      report->acmr_after  /= num_indices / 3;
+    }
+    if (report->vertices_before)
+      report->atvr_before /= report->vertices_before;
+    if (report->vertices_after)
+      report->atvr_after /= report->vertices_after;
+  }
+
+  // Indices are 16-bit if every layer fits
+  num_vertices = 0;
+  max_vertices = 0;
+  for (i=0; i<lwo->num_layers; i++) {
+    num_vertices += build_layers[i].num_vertices;
+    if (build_layers[i].num_vertices > max_vertices)
+      max_vertices = build_layers[i].num_vertices;
+  }
+  index_size  = (max_vertices <= 0x10000) ? 2 : 4;
+  vertex_size = (vertex_format == MESH_VERTEX_PACKED) ? sizeof(MeshPackedVertex) : sizeof(MeshVertex);
+
+  // Lay out the file
+  size = ALIGN_UP (sizeof(MeshHeader)) +
+         ALIGN_UP (lwo->num_layers * sizeof(MeshLayer)) +
+         ALIGN_UP (num_surfaces * sizeof(MeshSurface)) +
+         ALIGN_UP (num_vertices * vertex_size) +
+         ALIGN_UP (num_indices * index_size);
+  file = (unsigned char *) calloc (size, 1);
+  if (file == NULL) {
+    free (build_layers);
+    free (build_surfaces);
+    free (build_vertices);
+    free (build_indices);
+    Lwo_Free (lwo);
+    return (false);
+  }
+  header = (MeshHeader *) file;
+  header->magic         = MESH_MAGIC;
+  header->version       = MESH_VERSION;
+  header->file_size     = size;
+  header->index_size    = index_size;
+  header->vertex_format = (vertex_format == MESH_VERTEX_PACKED) ? MESH_VERTEX_PACKED : MESH_VERTEX_FLOAT;
+  header->vertex_size   = vertex_size;
+  header->num_vertices  = num_vertices;
+  header->num_indices   = num_indices;
+  header->num_layers    = lwo->num_layers;
+  header->num_surfaces  = num_surfaces;
+  header->layer_offset  = ALIGN_UP (sizeof(MeshHeader));
+  header->surface_offset = header->layer_offset + ALIGN_UP (lwo->num_layers * sizeof(MeshLayer));
+  header->vertex_offset = header->surface_offset + ALIGN_UP (num_surfaces * sizeof(MeshSurface));
+  header->index_offset  = header->vertex_offset + ALIGN_UP (num_vertices * vertex_size);
+  layers   = (MeshLayer *)  (file + header->layer_offset);
+  surfaces = (MeshSurface *) (file + header->surface_offset);
+  vertices = build_vertices;
+  memcpy (surfaces, build_surfaces, num_surfaces * sizeof(MeshSurface));
+
+  // Record the source so a stale mesh can be found
+  File_Get_Info (lwo_file, &header->source_size, &header->source_time);
+  source = File_Map (lwo_file, &header->source_size);
+  if (source) {
+    header->source_hash = File_Hash (source, header->source_size);
+    File_Unmap (source, header->source_size);
+  }
+
+  // Copy each layer, vertices moved together
+  first_vertex = 0;
+  build_vertex = 0;
+  first_index  = 0;
+  for (i=0; i<lwo->num_layers; i++) {
+    layers[i] = build_layers[i];
+    layers[i].first_vertex = first_vertex;
+    layers[i].first_index  = first_index;
+    memmove (vertices + first_vertex, build_vertices + build_vertex, layers[i].num_vertices * sizeof(MeshVertex));
+    for (j=0; j<layers[i].num_indices; j++) {
+      if (index_size == 2)
+        ((unsigned short *)(file + header->index_offset))[first_index+j] = (unsigned short) build_indices[first_index+j];
+      else
+        ((unsigned *)(file + header->index_offset))[first_index+j] = build_indices[first_index+j];
+    }
+    first_vertex += layers[i].num_vertices;
+    build_vertex += lwo->layers[i].num_points;
+    first_index  += layers[i].num_indices;
+  }
+  free (build_layers);
+  free (build_surfaces);
+  free (build_indices);
+
+  // Bound sphere of the whole mesh, centered on the bound box
+  for (i=0; i<3; i++) {
+    min[i] = 0;
+    max[i] = 0;
+  }
+  for (v=vertices; v<vertices+num_vertices; v++) {
+    if ((v == vertices) || (v->x < min[0])) min[0] = v->x;
+    if ((v == vertices) || (v->y < min[1])) min[1] = v->y;
+    if ((v == vertices) || (v->z < min[2])) min[2] = v->z;
+    if ((v == vertices) || (v->x > max[0])) max[0] = v->x;
+    if ((v == vertices) || (v->y > max[1])) max[1] = v->y;
+    if ((v == vertices) || (v->z > max[2])) max[2] = v->z;
+  }
+  for (i=0; i<3; i++)
+    header->center[i] = (min[i] + max[i]) / 2;
+  header->radius = 0;
+  for (v=vertices; v<vertices+num_vertices; v++) {
+    dx = v->x - header->center[0];
+    dy = v->y - header->center[1];
+    dz = v->z - header->center[2];
+    d = dx*dx + dy*dy + dz*dz;
+    if (d > header->radius)
+      header->radius = d;
+  }
+  header->radius = sqrtf (header->radius);
+
+  // Vertices
+  if (header->vertex_format == MESH_VERTEX_PACKED)
+    Pack_Vertices (vertices, num_vertices, min, max, header, (MeshPackedVertex *) (file + header->vertex_offset), report);
+  else
+    memcpy (file + header->vertex_offset, vertices, num_vertices * sizeof(MeshVertex));
+  if (report)
+    report->vertex_bytes = vertex_size;
+  free (build_vertices);
+
+  Lwo_Free (lwo);
+
+  // Write it
+  ok = false;
+  fp = fopen (mesh_file, "wb");
+  if (fp) {
+    ok = (fwrite (file, size, 1, fp) == 1);
+    if (fclose (fp) != 0)
+      ok = false;
+    if (!ok)
+      remove (mesh_file);
+  }
+  free (file);
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Build_Layer
+|
+| Input: Called from Mesh_Cook()
+| Output: Fills in vertices and indices for one layer, triangles
+|   grouped by surface (in tag order) and otherwise in the order of the
+|   LWO2 file, and a surface for each group.  Each point is one vertex.
+|   Normals are smooth, the sum of the normals of the triangles using a
+|   point weighted by their area.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+static bool Build_Layer (LwoMesh *lwo, LwoLayer *lwo_layer, MeshLayer *layer, MeshSurface *surfaces, MeshVertex *vertices, unsigned *indices)
+{
+  int i, j, t, num_tags, *first;
+  unsigned *tri;
+  float *p, e1[3], e2[3], n[3], d, min[3], max[3];
+  MeshVertex *v;
+
+  strncpy (layer->name, lwo_layer->name, MESH_NAME_SIZE-1);
+  layer->num_vertices = lwo_layer->num_points;
+  layer->num_indices  = lwo_layer->num_triangles * 3;
+
+  // Positions and uvs (LightWave v runs up, texture v runs down)
+  for (i=0; i<lwo_layer->num_points; i++) {
+    p = &lwo_layer->points[i*3];
+    v = &vertices[i];
+    v->x = p[0];
+    v->y = p[1];
+    v->z = p[2];
+    if (lwo_layer->uvs) {
+      v->u = lwo_layer->uvs[i*2];
+      v->v = 1 - lwo_layer->uvs[i*2+1];
+    }
+  }
+
+  // First triangle of each surface, a tag with no triangles gets no surface
+  num_tags = (lwo->num_tags > 0) ? lwo->num_tags : 1;
+  first = (int *) calloc (num_tags + 1, sizeof(int));
+  if (first == NULL)
+    return (false);
+  for (i=0; i<lwo_layer->num_triangles; i++)
+    first[lwo_layer->triangle_surface[i] + 1]++;
+  layer->num_surfaces = 0;
+  for (t=0; t<num_tags; t++) {
+    if (first[t+1]) {
+      MeshSurface *s = &surfaces[layer->num_surfaces++];
+      strncpy (s->name, (t < lwo->num_tags) ? lwo->tags[t] : "", MESH_NAME_SIZE-1);
+      s->first_index = first[t] * 3;
+      s->num_indices = first[t+1] * 3;
+    }
+    first[t+1] += first[t];
+  }
+
+  // Indices and normals
+  for (i=0; i<lwo_layer->num_triangles; i++) {
+    tri = &lwo_layer->indices[i*3];
+    t = first[lwo_layer->triangle_surface[i]]++;
+    for (j=0; j<3; j++)
+      indices[t*3+j] = tri[j];
+    // Cross product length is twice the area, so bigger triangles count more
+    for (j=0; j<3; j++) {
+      e1[j] = lwo_layer->points[tri[1]*3+j] - lwo_layer->points[tri[0]*3+j];
+      e2[j] = lwo_layer->points[tri[2]*3+j] - lwo_layer->points[tri[0]*3+j];
+    }
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    for (j=0; j<3; j++) {
+      vertices[tri[j]].nx += n[0];
+      vertices[tri[j]].ny += n[1];
+      vertices[tri[j]].nz += n[2];
+    }
+  }
+  for (i=0; i<lwo_layer->num_points; i++) {
+    v = &vertices[i];
+    d = sqrtf (v->nx*v->nx + v->ny*v->ny + v->nz*v->nz);
+    if (d > 0) {
+      v->nx /= d;
+      v->ny /= d;
+      v->nz /= d;
+    }
+  }
+
+  // Bound sphere of the layer
+  for (j=0; j<3; j++) {
+    min[j] = 0;
+    max[j] = 0;
+  }
+  for (i=0; i<lwo_layer->num_points; i++) {
+    p = &lwo_layer->points[i*3];
+    for (j=0; j<3; j++) {
+      if ((i == 0) || (p[j] < min[j]))
+        min[j] = p[j];
+      if ((i == 0) || (p[j] > max[j]))
+        max[j] = p[j];
+    }
+  }
+  for (j=0; j<3; j++)
+    layer->center[j] = (min[j] + max[j]) / 2;
+  layer->radius = 0;
+  for (i=0; i<lwo_layer->num_points; i++) {
+    p = &lwo_layer->points[i*3];
+    d = (p[0] - layer->center[0]) * (p[0] - layer->center[0]) +
+        (p[1] - layer->center[1]) * (p[1] - layer->center[1]) +
+        (p[2] - layer->center[2]) * (p[2] - layer->center[2]);
+    if (d > layer->radius)
+      layer->radius = d;
+  }
+  layer->radius = sqrtf (layer->radius);
+
+  free (first);
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pack_Vertices
+|
+| Input: Called from Mesh_Cook()
+| Output: Packs vertices, positions across the bound box of the mesh
+|   and uvs across their own bounds.  Gets the largest errors after
+|   decoding if report is not NULL.
+|___________________________________________________________________*/
+
+static void Pack_Vertices (const MeshVertex *vertices, unsigned num_vertices, const float *min, const float *max, MeshHeader *header, MeshPackedVertex *packed, MeshReport *report)
+{
+  unsigned i, j;
+  float uv_min[2], uv_max[2], scale[5], value[5], offset[5], d, n[3];
+  const MeshVertex *v;
+  MeshPackedVertex *p;
+  MeshVertex decoded;
+  unsigned short *q[5];
+
+  for (j=0; j<2; j++) {
+    uv_min[j] = 0;
+    uv_max[j] = 0;
+  }
+  for (v=vertices; v<vertices+num_vertices; v++) {
+    if ((v == vertices) || (v->u < uv_min[0])) uv_min[0] = v->u;
+    if ((v == vertices) || (v->v < uv_min[1])) uv_min[1] = v->v;
+    if ((v == vertices) || (v->u > uv_max[0])) uv_max[0] = v->u;
+    if ((v == vertices) || (v->v > uv_max[1])) uv_max[1] = v->v;
+  }
+  for (j=0; j<3; j++) {
+    header->position_offset[j] = min[j];
+    header->position_scale[j]  = (max[j] - min[j]) / MESH_PACK_STEPS;
+  }
+  for (j=0; j<2; j++) {
+    header->uv_offset[j] = uv_min[j];
+    header->uv_scale[j]  = (uv_max[j] - uv_min[j]) / MESH_PACK_STEPS;
+  }
+
+  // x, y, z, u, v to the nearest step
+  for (j=0; j<3; j++) {
+    offset[j] = header->position_offset[j];
+    scale[j]  = (header->position_scale[j] > 0) ? 1 / header->position_scale[j] : 0;
+  }
+  for (j=0; j<2; j++) {
+    offset[3+j] = header->uv_offset[j];
+    scale[3+j]  = (header->uv_scale[j] > 0) ? 1 / header->uv_scale[j] : 0;
+  }
+  for (i=0; i<num_vertices; i++) {
+    v = &vertices[i];
+    p = &packed[i];
+    value[0] = v->x;  value[1] = v->y;  value[2] = v->z;
+    value[3] = v->u;  value[4] = v->v;
+    q[0] = &p->x;  q[1] = &p->y;  q[2] = &p->z;
+    q[3] = &p->u;  q[4] = &p->v;
+    for (j=0; j<5; j++) {
+      d = (value[j] - offset[j]) * scale[j] + 0.5f;
+      *q[j] = (unsigned short) ((d < 0) ? 0 : (d > MESH_PACK_STEPS) ? MESH_PACK_STEPS : d);
+    }
+    p->w = 0;
+    n[0] = v->nx;
+    n[1] = v->ny;
+    n[2] = v->nz;
+    Encode_Normal (n, &p->nx);
+  }
+
+  // Largest errors
+  if (report)
+    for (i=0; i<num_vertices; i++) {
+      v = &vertices[i];
+      Decode_Vertices (header, &packed[i], 1, &decoded);
+      d = sqrtf ((decoded.x - v->x) * (decoded.x - v->x) + (decoded.y - v->y) * (decoded.y - v->y) + (decoded.z - v->z) * (decoded.z - v->z));
+      if (d > report->position_error)
+        report->position_error = d;
+      d = decoded.nx * v->nx + decoded.ny * v->ny + decoded.nz * v->nz;
+      d = acosf ((d > 1) ? 1 : (d < -1) ? -1 : d) * 57.29578f;
+      if ((v->nx*v->nx + v->ny*v->ny + v->nz*v->nz > 0) && (d > report->normal_error))
+        report->normal_error = d;
+      d = (float) fabs (decoded.u - v->u);
+      if (d > report->uv_error)
+        report->uv_error = d;
+      d = (float) fabs (decoded.v - v->v);
+      if (d > report->uv_error)
+        report->uv_error = d;
+    }
+}
+
+/*____________________________________________________________________
+|
+| Function: Encode_Normal
+|
+| Input: Called from Pack_Vertices()
+| Output: Encodes a unit normal as octahedral x,y.  The normal is put
+|   on the octahedron |x|+|y|+|z| = 1, and the half below z = 0 is
+|   folded out over the corners.  Of the 4 nearest steps the one that
+|   decodes closest to the normal is used.
+|___________________________________________________________________*/
+
+static void Encode_Normal (const float *n, short *packed)
+{
+  int i, x, y;
+  float l, ox, oy, t, d, best, decoded[3];
+
+  l = (float) (fabs (n[0]) + fabs (n[1]) + fabs (n[2]));
+  packed[0] = 0;
+  packed[1] = 0;
+  if (l == 0)
+    return;
+  ox = n[0] / l;
+  oy = n[1] / l;
+  if (n[2] < 0) {
+    t  = ox;
+    ox = (1 - (float) fabs (oy)) * ((t >= 0) ? 1 : -1);
+    oy = (1 - (float) fabs (t)) * ((oy >= 0) ? 1 : -1);
+  }
+  ox *= MESH_NORMAL_STEPS;
+  oy *= MESH_NORMAL_STEPS;
+
+  best = -2;
+  for (i=0; i<4; i++) {
+    x = (int) floorf (ox) + (i & 1);
+    y = (int) floorf (oy) + (i >> 1);
+    if ((x < -32767) || (x > 32767) || (y < -32767) || (y > 32767))
+      continue;
+    Decode_Normal ((short) x, (short) y, decoded);
+    d = decoded[0] * n[0] + decoded[1] * n[1] + decoded[2] * n[2];
+    if (d > best) {
+      best = d;
+      packed[0] = (short) x;
+      packed[1] = (short) y;
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Load
+|
+| Input: Called from ____
+| Output: Loads the cooked version of an LWO2 file.  Cooks it first if
+|   it is missing, from an older version, in another vertex format or
+|   the LWO2 file changed.  If the LWO2 file was only touched, its new
+|   size and time are written into the mesh file.
+|   Returns true on success, else false.
+|___________________________________________________________________*/
+
+int Mesh_Load (const char *lwo_file, int vertex_format, Mesh *mesh)
+{
+  char mesh_file[MESH_MAX_PATH];
+  unsigned size, source_size;
+  unsigned long long source_time;
+  const void *source;
+  bool ok;
+
+  Get_Mesh_Filename (lwo_file, mesh_file);
+
+  if (Map_Mesh (mesh_file, mesh, &size)) {
+    ok = false;
+    // In another vertex format, cook it again
+    if (mesh->header->vertex_format == (unsigned) vertex_format) {
+      // No source (a shipped build), use the mesh as is
+      if (!File_Get_Info (lwo_file, &source_size, &source_time))
+        return (true);
+      if ((source_size == mesh->header->source_size) && (source_time == mesh->header->source_time))
+        return (true);
+      // Source was touched, is the content the same?
+      source = File_Map (lwo_file, &size);
+      if (source) {
+        ok = (size == mesh->header->source_size) && (File_Hash (source, size) == mesh->header->source_hash);
+        File_Unmap (source, size);
+      }
+      // So it isn't hashed again next time (can't write to the mapped file, so unmap it first)
+      if (ok) {
+        Mesh_Free (mesh);
+        Update_Source_Info (mesh_file, source_size, source_time);
+        return (Map_Mesh (mesh_file, mesh, &size));
+      }
+    }
+    Mesh_Free (mesh);
+  }
+
+  // Cook it and map it again
+  if (!Mesh_Cook (lwo_file, mesh_file, vertex_format, NULL))
+    return (false);
+
+  return (Map_Mesh (mesh_file, mesh, &size));
+}
+
+/*____________________________________________________________________
+|
+| Function: Update_Source_Info
+|
+| Input: Called from Mesh_Load()
+| Output: Writes the size and write time of the source into the header
+|   of a mesh file.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+static bool Update_Source_Info (const char *mesh_file, unsigned source_size, unsigned long long source_time)
+{
+  bool ok;
+  MeshHeader header;
+  FILE *fp;
+
+  fp = fopen (mesh_file, "r+b");
+  if (fp == NULL)
+    return (false);
+  ok = (fread (&header, sizeof(MeshHeader), 1, fp) == 1);
+  if (ok) {
+    header.source_size = source_size;
+    header.source_time = source_time;
+    ok = (fseek (fp, 0, SEEK_SET) == 0) && (fwrite (&header, sizeof(MeshHeader), 1, fp) == 1);
+  }
+  if (fclose (fp) != 0)
+    ok = false;
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Map_Mesh
+|
+| Input: Called from Mesh_Load()
+| Output: Maps a mesh file and sets pointers to its parts.  Returns true
+|   if the file is a mesh of the current version, else false.
+|___________________________________________________________________*/
+
+static bool Map_Mesh (const char *mesh_file, Mesh *mesh, unsigned *size)
+{
+  const unsigned char *data;
+  const MeshHeader *header;
+
+  data = (const unsigned char *) File_Map (mesh_file, size);
+  if (data == NULL)
+    return (false);
+  header = (const MeshHeader *) data;
+  if ((*size < sizeof(MeshHeader)) ||
+      (header->magic != MESH_MAGIC) ||
+      (header->version != MESH_VERSION) ||
+      (header->file_size != *size) ||
+      ((header->vertex_format != MESH_VERTEX_FLOAT) && (header->vertex_format != MESH_VERTEX_PACKED)) ||
+      (header->vertex_size != ((header->vertex_format == MESH_VERTEX_PACKED) ? sizeof(MeshPackedVertex) : sizeof(MeshVertex))) ||
+      (header->layer_offset + header->num_layers * sizeof(MeshLayer) > *size) ||
+      (header->surface_offset + header->num_surfaces * sizeof(MeshSurface) > *size) ||
+      (header->vertex_offset + header->num_vertices * header->vertex_size > *size) ||
+      (header->index_offset + header->num_indices * header->index_size > *size)) {
+    File_Unmap (data, *size);
+    return (false);
+  }
+
+  mesh->header   = header;
+  mesh->layers   = (const MeshLayer *)  (data + header->layer_offset);
+  mesh->surfaces = (const MeshSurface *) (data + header->surface_offset);
+  mesh->vertices = NULL;
+  mesh->packed_vertices = NULL;
+  if (header->vertex_format == MESH_VERTEX_PACKED)
+    mesh->packed_vertices = (const MeshPackedVertex *) (data + header->vertex_offset);
+  else
+    mesh->vertices = (const MeshVertex *) (data + header->vertex_offset);
+  mesh->indices  = data + header->index_offset;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Mesh_Filename
+|
+| Input: Called from Mesh_Load()
+| Output: Gets the mesh filename for an LWO2 file, the same name with a
+|   .mesh extension.
+|___________________________________________________________________*/
+
+static void Get_Mesh_Filename (const char *lwo_file, char *mesh_file)
+{
+  char *dot;
+
+  strncpy (mesh_file, lwo_file, MESH_MAX_PATH-6);
+  mesh_file[MESH_MAX_PATH-6] = 0;
+  dot = strrchr (mesh_file, '.');
+  if (dot && (strpbrk (dot, "\\/") == NULL))
+    *dot = 0;
+  strcat (mesh_file, ".mesh");
+}
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Free
+|
+| Input: Called from ____
+| Output: Frees a mesh loaded by Mesh_Load().
+|___________________________________________________________________*/
+
+void Mesh_Free (Mesh *mesh)
+{
+  if (mesh->header) {
+    File_Unmap (mesh->header, mesh->header->file_size);
+    mesh->header = NULL;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Get_Layer
+|
+| Input: Called from ____
+| Output: Returns a layer by name, or NULL if not found.
+|___________________________________________________________________*/
+
+const MeshLayer *Mesh_Get_Layer (Mesh *mesh, const char *name)
+{
+  unsigned i;
+
+  for (i=0; i<mesh->header->num_layers; i++)
+    if (strcmp (mesh->layers[i].name, name) == 0)
+      return (&mesh->layers[i]);
+
+  return (NULL);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Decode_Vertices
+|
+| Input: Called from ____
+| Output: Decodes vertices of a mesh into floats, copying them if the
+|   mesh is not packed.
+|___________________________________________________________________*/
+
+void Mesh_Decode_Vertices (const Mesh *mesh, unsigned first, unsigned count, MeshVertex *vertices)
+{
+  if (mesh->packed_vertices)
+    Decode_Vertices (mesh->header, mesh->packed_vertices + first, count, vertices);
+  else
+    memcpy (vertices, mesh->vertices + first, count * sizeof(MeshVertex));
+}
+
+/*____________________________________________________________________
+|
+| Function: Decode_Vertices
+|
+| Input: Called from Pack_Vertices(), Mesh_Decode_Vertices()
+| Output: Decodes packed vertices.  With SSE2, 4 vertices are turned
+|   into one register per value, decoded, and turned back.
+|___________________________________________________________________*/
+
+static void Decode_Vertices (const MeshHeader *header, const MeshPackedVertex *packed, unsigned count, MeshVertex *vertices)
+{
+  unsigned i, j;
+  float n[3];
+  const MeshPackedVertex *p;
+  MeshVertex *v;
+
+  i = 0;
+#ifdef MESH_SSE2
+  __m128i a0, a1, a2, a3, lo01, lo23, hi01, hi23, xy, zw, nxy, uv, zero;
+  __m128 x, y, z, nx, ny, nz, u, vv, t, l, sign, one, steps;
+  __m128 scale[5], offset[5];
+
+  for (j=0; j<3; j++) {
+    scale[j]  = _mm_set1_ps (header->position_scale[j]);
+    offset[j] = _mm_set1_ps (header->position_offset[j]);
+  }
+  for (j=0; j<2; j++) {
+    scale[3+j]  = _mm_set1_ps (header->uv_scale[j]);
+    offset[3+j] = _mm_set1_ps (header->uv_offset[j]);
+  }
+  zero  = _mm_setzero_si128 ();
+  one   = _mm_set1_ps (1.0f);
+  steps = _mm_set1_ps (1.0f / MESH_NORMAL_STEPS);
+  sign  = _mm_set1_ps (-0.0f);
+  for (; i+4<=count; i+=4) {
+    // 4 vertices to x0-3 y0-3 z0-3 w0-3 nx0-3 ny0-3 u0-3 v0-3
+    a0 = _mm_loadu_si128 ((const __m128i *) &packed[i]);
+    a1 = _mm_loadu_si128 ((const __m128i *) &packed[i+1]);
+    a2 = _mm_loadu_si128 ((const __m128i *) &packed[i+2]);
+    a3 = _mm_loadu_si128 ((const __m128i *) &packed[i+3]);
+    lo01 = _mm_unpacklo_epi16 (a0, a1);
+    lo23 = _mm_unpacklo_epi16 (a2, a3);
+    hi01 = _mm_unpackhi_epi16 (a0, a1);
+    hi23 = _mm_unpackhi_epi16 (a2, a3);
+    xy  = _mm_unpacklo_epi32 (lo01, lo23);
+    zw  = _mm_unpackhi_epi32 (lo01, lo23);
+    nxy = _mm_unpacklo_epi32 (hi01, hi23);
+    uv  = _mm_unpackhi_epi32 (hi01, hi23);
+
+    // Positions and uvs, unsigned
+    x  = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (xy, zero)), scale[0]), offset[0]);
+    y  = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (xy, zero)), scale[1]), offset[1]);
+    z  = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (zw, zero)), scale[2]), offset[2]);
+    u  = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (uv, zero)), scale[3]), offset[3]);
+    vv = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (uv, zero)), scale[4]), offset[4]);
+
+    // Normals, signed: z = 1 - |x| - |y|, below 0 x and y move back by -z toward 0
+    nx = _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (zero, nxy), 16)), steps);
+    ny = _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (zero, nxy), 16)), steps);
+    nz = _mm_sub_ps (_mm_sub_ps (one, _mm_andnot_ps (sign, nx)), _mm_andnot_ps (sign, ny));
+    t  = _mm_max_ps (_mm_sub_ps (_mm_setzero_ps (), nz), _mm_setzero_ps ());
+    nx = _mm_sub_ps (nx, _mm_or_ps (t, _mm_and_ps (sign, nx)));
+    ny = _mm_sub_ps (ny, _mm_or_ps (t, _mm_and_ps (sign, ny)));
+    l  = _mm_div_ps (one, _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (nx, nx), _mm_mul_ps (ny, ny)), _mm_mul_ps (nz, nz))));
+    nx = _mm_mul_ps (nx, l);
+    ny = _mm_mul_ps (ny, l);
+    nz = _mm_mul_ps (nz, l);
+
+    // Back to x y z nx, ny nz u v per vertex
+    _MM_TRANSPOSE4_PS (x, y, z, nx);
+    _MM_TRANSPOSE4_PS (ny, nz, u, vv);
+    v = &vertices[i];
+    _mm_storeu_ps (&v[0].x, x);   _mm_storeu_ps (&v[0].ny, ny);
+    _mm_storeu_ps (&v[1].x, y);   _mm_storeu_ps (&v[1].ny, nz);
+    _mm_storeu_ps (&v[2].x, z);   _mm_storeu_ps (&v[2].ny, u);
+    _mm_storeu_ps (&v[3].x, nx);  _mm_storeu_ps (&v[3].ny, vv);
+  }
+#endif
+
+  // The rest one at a time
+  for (; i<count; i++) {
+    p = &packed[i];
+    v = &vertices[i];
+    v->x = header->position_offset[0] + p->x * header->position_scale[0];
+    v->y = header->position_offset[1] + p->y * header->position_scale[1];
+    v->z = header->position_offset[2] + p->z * header->position_scale[2];
+    Decode_Normal (p->nx, p->ny, n);
+    v->nx = n[0];
+    v->ny = n[1];
+    v->nz = n[2];
+    v->u = header->uv_offset[0] + p->u * header->uv_scale[0];
+    v->v = header->uv_offset[1] + p->v * header->uv_scale[1];
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Decode_Normal
+|
+| Input: Called from Encode_Normal(), Decode_Vertices()
+| Output: Decodes an octahedral normal to a unit vector.
+|___________________________________________________________________*/
+
+static void Decode_Normal (short nx, short ny, float *n)
+{
+  float x, y, z, t, l;
+
+  x = nx / MESH_NORMAL_STEPS;
+  y = ny / MESH_NORMAL_STEPS;
+  z = 1 - (float) fabs (x) - (float) fabs (y);
+  // Unfold the lower half
+  if (z < 0) {
+    t = x;
+    x = (1 - (float) fabs (y)) * ((t >= 0) ? 1 : -1);
+    y = (1 - (float) fabs (t)) * ((y >= 0) ? 1 : -1);
+  }
+  l = 1 / sqrtf (x*x + y*y + z*z);
+  n[0] = x * l;
+  n[1] = y * l;
+  n[2] = z * l;
+}
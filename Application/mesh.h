@@ -0,0 +1,107 @@
+/*____________________________________________________________________
+|
+| File: mesh.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define MESH_MAGIC      0x4853454D  // "MESH"
+#define MESH_VERSION    4
+#define MESH_NAME_SIZE  32
+
+// Vertex formats
+#define MESH_VERTEX_FLOAT   0   // MeshVertex, 32 bytes
+#define MESH_VERTEX_PACKED  1   // MeshPackedVertex, 16 bytes
+
+// Cooked mesh file: header, layer table, surface table, vertices, indices, each part 16-byte aligned
+typedef struct {
+  unsigned           magic;
+  unsigned           version;
+  unsigned           source_size;     // .lwo file the mesh was cooked from
+  unsigned           file_size;       // this file
+  unsigned long long source_time;
+  unsigned long long source_hash;
+  unsigned           index_size;      // 2 or 4 bytes
+  unsigned           vertex_format;   // MESH_VERTEX_FLOAT or MESH_VERTEX_PACKED
+  unsigned           vertex_size;     // sizeof(MeshVertex) or sizeof(MeshPackedVertex)
+  unsigned           num_vertices;
+  unsigned           num_indices;
+  unsigned           num_layers;
+  unsigned           num_surfaces;
+  unsigned           layer_offset;    // bytes from the start of the file
+  unsigned           surface_offset;
+  unsigned           vertex_offset;
+  unsigned           index_offset;
+  float              center [3];      // bound sphere
+  float              radius;
+  float              position_offset [3];  // packed vertices: value = offset + quantized * scale
+  float              position_scale [3];
+  float              uv_offset [2];
+  float              uv_scale [2];
+  unsigned           reserved;
+} MeshHeader;
+
+typedef struct {
+  char     name [MESH_NAME_SIZE];
+  unsigned first_vertex, num_vertices;
+  unsigned first_index, num_indices;  // indices are relative to first_vertex
+  unsigned first_surface, num_surfaces;
+  float    center [3];
+  float    radius;
+} MeshLayer;
+
+// Triangles of a layer with one surface, drawn together
+typedef struct {
+  char     name [MESH_NAME_SIZE];     // LWO2 surface name
+  unsigned first_index, num_indices;  // within the mesh's indices
+} MeshSurface;
+
+typedef struct {
+  float x, y, z;
+  float nx, ny, nz;
+  float u, v;
+} MeshVertex;
+
+// Position and uv are 16-bit steps across the bounds of the mesh, normal is octahedral (snorm16 x,y)
+typedef struct {
+  unsigned short x, y, z, w;          // w is 0
+  short          nx, ny;
+  unsigned short u, v;
+} MeshPackedVertex;
+
+// A loaded mesh, all pointers are into the mapped file
+typedef struct {
+  const MeshHeader *header;
+  const MeshLayer  *layers;
+  const MeshSurface *surfaces;
+  const MeshVertex *vertices;         // NULL if packed
+  const MeshPackedVertex *packed_vertices;  // NULL if float
+  const void       *indices;          // unsigned short or unsigned per header->index_size
+} Mesh;
+
+// Vertex cache stats of a cook, over all layers
+typedef struct {
+  float    acmr_before, acmr_after;          // cache misses per triangle
+  float    atvr_before, atvr_after;          // cache misses per vertex, 1 is best
+  unsigned vertices_before, vertices_after;
+  unsigned vertex_bytes;               // per vertex
+  float    position_error;             // max distance from the float vertex, packed only
+  float    normal_error;               // max angle in degrees, packed only
+  float    uv_error;                   // max difference of u or v, packed only
+} MeshReport;
+
+// Cooks an LWO2 file into a mesh file, optimized for the vertex cache, overdraw and vertex fetch, report can be NULL, returns true on success
+int Mesh_Cook (const char *lwo_file, const char *mesh_file, int vertex_format, MeshReport *report);
+
+// Loads the cooked version of an LWO2 file (same name, .mesh), cooking it first if it is missing, stale or in another vertex format, returns true on success
+int Mesh_Load (const char *lwo_file, int vertex_format, Mesh *mesh);
+
+// Decodes vertices of a mesh (either format) into floats
+void Mesh_Decode_Vertices (const Mesh *mesh, unsigned first, unsigned count, MeshVertex *vertices);
+
+// Frees a mesh loaded by Mesh_Load()
+void Mesh_Free (Mesh *mesh);
+
+// Returns a layer by name, or NULL if not found
+const MeshLayer *Mesh_Get_Layer (Mesh *mesh, const char *name);
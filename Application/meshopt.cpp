@@ -0,0 +1,491 @@
+/*____________________________________________________________________
+|
+| File: meshopt.cpp
+|
+| Description: Mesh optimizations run when a mesh is cooked.
+|
+|   Vertex cache: triangles are reordered with Forsyth's linear speed
+|   method.  Each vertex has a score from its place in a modeled LRU
+|   cache and how many triangles still use it, and the next triangle is
+|   the best scoring one using a vertex in the cache.
+|
+|   Overdraw: the cache ordered list is cut into clusters, at points
+|   where the cache starts over anyway and where the misses of starting
+|   cold stay within a threshold of the misses in order.  Clusters are
+|   then drawn facing out first (Sander, Nehab and Barczak, "Fast
+|   Triangle Reordering for Vertex Locality and Reduced Overdraw"), so
+|   outer leaves hide inner ones from most views.
+|
+|   Vertex fetch: vertices are put in the order triangles first use
+|   them, equal vertices are merged and unused ones dropped, so the
+|   vertex buffer is read front to back.
+|
+|   The stats simulate a FIFO cache and give average misses per
+|   triangle (ACMR) and per vertex used (ATVR).
+|
+| Functions: Mesh_Optimize_Cache
+|             Vertex_Score
+|            Mesh_Optimize_Overdraw
+|             Compare_Clusters
+|            Mesh_Optimize_Fetch
+|             Hash_Vertex
+|            Mesh_Get_Cache_Stats
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh.h"
+#include "meshopt.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+// Forsyth's scoring, for a 32 entry LRU cache
+#define SCORE_CACHE_SIZE     32
+#define SCORE_LAST_TRIANGLE  0.75f
+#define SCORE_CACHE_DECAY    1.5f
+#define SCORE_VALENCE_SCALE  2.0f
+#define SCORE_VALENCE_POWER  0.5f
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  float key;      // how far the cluster faces out from the middle of the mesh
+  int   cluster;
+} ClusterKey;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static float Vertex_Score (int cache_position, int remaining);
+static int Compare_Clusters (const void *a, const void *b);
+static unsigned Hash_Vertex (const MeshVertex *vertex);
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Optimize_Cache
+|
+| Input: Called from Mesh_Cook()
+| Output: Reorders triangles for post-transform vertex cache hits.  The
+|   list is left as is if there is not enough memory.
+|___________________________________________________________________*/
+
+void Mesh_Optimize_Cache (unsigned *indices, int num_indices, int num_vertices)
+{
+  int i, j, k, t, v, n, num_triangles, best, cursor, cache_count;
+  int *offsets, *remaining, *triangles, *cache_position, cache[SCORE_CACHE_SIZE+3], new_cache[SCORE_CACHE_SIZE+3];
+  float best_score, *vertex_score, *triangle_score;
+  unsigned *tri, *output;
+  bool *emitted;
+
+  num_triangles = num_indices / 3;
+  if (num_triangles == 0)
+    return;
+
+  offsets        = (int *) calloc (num_vertices + 1, sizeof(int));
+  remaining      = (int *) calloc (num_vertices, sizeof(int));
+  cache_position = (int *) malloc (num_vertices * sizeof(int));
+  vertex_score   = (float *) malloc (num_vertices * sizeof(float));
+  triangles      = (int *) malloc (num_triangles * 3 * sizeof(int));
+  triangle_score = (float *) malloc (num_triangles * sizeof(float));
+  emitted        = (bool *) calloc (num_triangles, sizeof(bool));
+  output         = (unsigned *) malloc (num_triangles * 3 * sizeof(unsigned));
+  if (offsets && remaining && cache_position && vertex_score && triangles && triangle_score && emitted && output) {
+
+    // Triangles using each vertex, a list per vertex with the unused ones first
+    for (i=0; i<num_triangles*3; i++)
+      offsets[indices[i]+1]++;
+    for (v=0; v<num_vertices; v++)
+      offsets[v+1] += offsets[v];
+    for (i=0; i<num_triangles*3; i++) {
+      v = indices[i];
+      triangles[offsets[v] + remaining[v]++] = i / 3;
+    }
+    for (v=0; v<num_vertices; v++) {
+      cache_position[v] = -1;
+      vertex_score[v] = Vertex_Score (-1, remaining[v]);
+    }
+    best = 0;
+    for (t=0; t<num_triangles; t++) {
+      tri = &indices[t*3];
+      triangle_score[t] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+      if (triangle_score[t] > triangle_score[best])
+        best = t;
+    }
+
+    cache_count = 0;
+    cursor = 0;
+    for (i=0; i<num_triangles; i++) {
+      // Nothing in the cache is used again, take the next triangle not drawn
+      if (best < 0) {
+        while (emitted[cursor])
+          cursor++;
+        best = cursor;
+      }
+      tri = &indices[best*3];
+      output[i*3]   = tri[0];
+      output[i*3+1] = tri[1];
+      output[i*3+2] = tri[2];
+      emitted[best] = true;
+
+      // Take it out of the lists of its vertices
+      for (j=0; j<3; j++) {
+        v = tri[j];
+        for (k=offsets[v]; k<offsets[v]+remaining[v]; k++)
+          if (triangles[k] == best) {
+            triangles[k] = triangles[offsets[v] + --remaining[v]];
+            break;
+          }
+      }
+
+      // Its vertices go to the front of the cache
+      n = 0;
+      for (j=0; j<3; j++)
+        if ((j == 0) || ((tri[j] != tri[0]) && ((j == 1) || (tri[j] != tri[1]))))
+          new_cache[n++] = tri[j];
+      for (j=0; j<cache_count; j++)
+        if ((cache[j] != (int)tri[0]) && (cache[j] != (int)tri[1]) && (cache[j] != (int)tri[2]))
+          new_cache[n++] = cache[j];
+
+      // New scores for vertices in the cache and any pushed out, and for their triangles
+      for (j=0; j<n; j++) {
+        v = new_cache[j];
+        cache_position[v] = (j < SCORE_CACHE_SIZE) ? j : -1;
+        vertex_score[v] = Vertex_Score (cache_position[v], remaining[v]);
+      }
+      best = -1;
+      best_score = -1;
+      for (j=0; j<n; j++) {
+        v = new_cache[j];
+        for (k=offsets[v]; k<offsets[v]+remaining[v]; k++) {
+          t = triangles[k];
+          triangle_score[t] = vertex_score[indices[t*3]] + vertex_score[indices[t*3+1]] + vertex_score[indices[t*3+2]];
+          if (triangle_score[t] > best_score) {
+            best = t;
+            best_score = triangle_score[t];
+          }
+        }
+      }
+      cache_count = (n < SCORE_CACHE_SIZE) ? n : SCORE_CACHE_SIZE;
+      memcpy (cache, new_cache, cache_count * sizeof(int));
+    }
+
+    memcpy (indices, output, num_triangles * 3 * sizeof(unsigned));
+  }
+
+  if (offsets)        free (offsets);
+  if (remaining)      free (remaining);
+  if (cache_position) free (cache_position);
+  if (vertex_score)   free (vertex_score);
+  if (triangles)      free (triangles);
+  if (triangle_score) free (triangle_score);
+  if (emitted)        free (emitted);
+  if (output)         free (output);
+}
+
+/*____________________________________________________________________
+|
+| Function: Vertex_Score
+|
+| Input: Called from Mesh_Optimize_Cache()
+| Output: Returns the score of a vertex from its position in the cache
+|   (-1 = not in it) and # of triangles still to draw using it.  The
+|   last triangle's vertices score a little lower so the next triangle
+|   doesn't just go back and forth over the same edge.
+|___________________________________________________________________*/
+
+static float Vertex_Score (int cache_position, int remaining)
+{
+  float score;
+
+  if (remaining == 0)
+    return (-1);
+
+  score = 0;
+  if (cache_position >= 0) {
+    if (cache_position < 3)
+      score = SCORE_LAST_TRIANGLE;
+    else
+      score = powf (1.0f - (float)(cache_position - 3) / (SCORE_CACHE_SIZE - 3), SCORE_CACHE_DECAY);
+  }
+  // Vertices with few triangles left get them done first
+  score += SCORE_VALENCE_SCALE * powf ((float)remaining, -SCORE_VALENCE_POWER);
+
+  return (score);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Optimize_Overdraw
+|
+| Input: Called from Mesh_Cook()
+| Output: Reorders clusters of triangles to reduce overdraw.  The list
+|   is left as is if there is not enough memory.
+|___________________________________________________________________*/
+
+void Mesh_Optimize_Overdraw (unsigned *indices, int num_indices, const MeshVertex *vertices, int num_vertices, float threshold)
+{
+  int i, j, t, num_triangles, num_clusters, out, warm_misses, cold_misses, misses;
+  int *cluster_start;
+  unsigned warm_time, cold_time, *warm_stamp, *cold_stamp, *tri, *output;
+  float e1[3], e2[3], n[3], c[3], area, cluster_area, center[3], total_area;
+  float (*cluster_center)[3], (*cluster_normal)[3];
+  const MeshVertex *p[3];
+  ClusterKey *keys;
+
+  num_triangles = num_indices / 3;
+  if (num_triangles < 2)
+    return;
+
+  cluster_start  = (int *) malloc ((num_triangles + 1) * sizeof(int));
+  warm_stamp     = (unsigned *) calloc (num_vertices, sizeof(unsigned));
+  cold_stamp     = (unsigned *) calloc (num_vertices, sizeof(unsigned));
+  cluster_center = (float (*)[3]) calloc (num_triangles, sizeof(float[3]));
+  cluster_normal = (float (*)[3]) calloc (num_triangles, sizeof(float[3]));
+  keys           = (ClusterKey *) malloc (num_triangles * sizeof(ClusterKey));
+  output         = (unsigned *) malloc (num_triangles * 3 * sizeof(unsigned));
+  if (cluster_start && warm_stamp && cold_stamp && cluster_center && cluster_normal && keys && output) {
+
+    // Cut into clusters, simulating the cache in order (warm) and starting empty at each cluster (cold)
+    warm_time = MESH_CACHE_SIZE + 1;
+    cold_time = MESH_CACHE_SIZE + 1;
+    warm_misses = 0;
+    cold_misses = 0;
+    num_clusters = 0;
+    for (t=0; t<num_triangles; t++) {
+      tri = &indices[t*3];
+      misses = 0;
+      for (j=0; j<3; j++)
+        if (warm_time - warm_stamp[tri[j]] > MESH_CACHE_SIZE)
+          misses++;
+      if ((misses == 3) || (cold_misses <= threshold * warm_misses)) {
+        cluster_start[num_clusters++] = t;
+        cold_time += MESH_CACHE_SIZE + 1;
+      }
+      for (j=0; j<3; j++) {
+        if (warm_time - warm_stamp[tri[j]] > MESH_CACHE_SIZE) {
+          warm_stamp[tri[j]] = warm_time++;
+          warm_misses++;
+        }
+        if (cold_time - cold_stamp[tri[j]] > MESH_CACHE_SIZE) {
+          cold_stamp[tri[j]] = cold_time++;
+          cold_misses++;
+        }
+      }
+    }
+    cluster_start[num_clusters] = num_triangles;
+
+    // Center and normal of each cluster, weighted by triangle area
+    for (j=0; j<3; j++)
+      center[j] = 0;
+    total_area = 0;
+    for (i=0; i<num_clusters; i++) {
+      cluster_area = 0;
+      for (t=cluster_start[i]; t<cluster_start[i+1]; t++) {
+        for (j=0; j<3; j++)
+          p[j] = &vertices[indices[t*3+j]];
+        e1[0] = p[1]->x - p[0]->x;  e1[1] = p[1]->y - p[0]->y;  e1[2] = p[1]->z - p[0]->z;
+        e2[0] = p[2]->x - p[0]->x;  e2[1] = p[2]->y - p[0]->y;  e2[2] = p[2]->z - p[0]->z;
+        // Cross product length is twice the area
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        area = sqrtf (n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        c[0] = (p[0]->x + p[1]->x + p[2]->x) / 3;
+        c[1] = (p[0]->y + p[1]->y + p[2]->y) / 3;
+        c[2] = (p[0]->z + p[1]->z + p[2]->z) / 3;
+        for (j=0; j<3; j++) {
+          cluster_normal[i][j] += n[j];
+          cluster_center[i][j] += c[j] * area;
+        }
+        cluster_area += area;
+      }
+      for (j=0; j<3; j++) {
+        center[j] += cluster_center[i][j];
+        if (cluster_area > 0)
+          cluster_center[i][j] /= cluster_area;
+      }
+      total_area += cluster_area;
+    }
+    if (total_area > 0)
+      for (j=0; j<3; j++)
+        center[j] /= total_area;
+
+    // Clusters facing out from the middle draw first
+    for (i=0; i<num_clusters; i++) {
+      keys[i].cluster = i;
+      keys[i].key = 0;
+      area = sqrtf (cluster_normal[i][0] * cluster_normal[i][0] +
+                    cluster_normal[i][1] * cluster_normal[i][1] +
+                    cluster_normal[i][2] * cluster_normal[i][2]);
+      if (area > 0)
+        for (j=0; j<3; j++)
+          keys[i].key += (cluster_center[i][j] - center[j]) * cluster_normal[i][j] / area;
+    }
+    qsort (keys, num_clusters, sizeof(ClusterKey), Compare_Clusters);
+
+    out = 0;
+    for (i=0; i<num_clusters; i++) {
+      t = keys[i].cluster;
+      memcpy (output + out, indices + cluster_start[t] * 3, (cluster_start[t+1] - cluster_start[t]) * 3 * sizeof(unsigned));
+      out += (cluster_start[t+1] - cluster_start[t]) * 3;
+    }
+    memcpy (indices, output, num_triangles * 3 * sizeof(unsigned));
+  }
+
+  if (cluster_start)  free (cluster_start);
+  if (warm_stamp)     free (warm_stamp);
+  if (cold_stamp)     free (cold_stamp);
+  if (cluster_center) free (cluster_center);
+  if (cluster_normal) free (cluster_normal);
+  if (keys)           free (keys);
+  if (output)         free (output);
+}
+
+/*____________________________________________________________________
+|
+| Function: Compare_Clusters
+|
+| Input: Called from Mesh_Optimize_Overdraw() through qsort()
+| Output: Orders clusters facing out the most first, keeping the cache
+|   order of equal ones.
+|___________________________________________________________________*/
+
+static int Compare_Clusters (const void *a, const void *b)
+{
+  const ClusterKey *ka = (const ClusterKey *) a;
+  const ClusterKey *kb = (const ClusterKey *) b;
+
+  if (ka->key != kb->key)
+    return ((ka->key > kb->key) ? -1 : 1);
+
+  return (ka->cluster - kb->cluster);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Optimize_Fetch
+|
+| Input: Called from Mesh_Cook()
+| Output: Reorders vertices in the order the indices first use them,
+|   merging vertices with equal position, normal and uv and dropping
+|   unused ones.  Returns the new # of vertices.  Vertices are left as
+|   is if there is not enough memory.
+|___________________________________________________________________*/
+
+int Mesh_Optimize_Fetch (unsigned *indices, int num_indices, MeshVertex *vertices, int num_vertices)
+{
+  int i, v, h, count, table_size, *remap, *table;
+  MeshVertex *output;
+
+  for (table_size=1; table_size < num_vertices * 2; table_size *= 2);
+
+  remap  = (int *) malloc (num_vertices * sizeof(int));
+  table  = (int *) malloc (table_size * sizeof(int));
+  output = (MeshVertex *) malloc (num_vertices * sizeof(MeshVertex) + 1);
+  count  = num_vertices;
+  if (remap && table && output) {
+    memset (remap, -1, num_vertices * sizeof(int));
+    memset (table, -1, table_size * sizeof(int));
+    count = 0;
+    for (i=0; i<num_indices; i++) {
+      v = indices[i];
+      if (remap[v] < 0) {
+        // Open addressing, the table is at least half empty
+        for (h=Hash_Vertex (&vertices[v]) & (table_size-1); table[h] >= 0; h=(h+1) & (table_size-1))
+          if (memcmp (&output[table[h]], &vertices[v], sizeof(MeshVertex)) == 0)
+            break;
+        if (table[h] < 0) {
+          output[count] = vertices[v];
+          table[h] = count++;
+        }
+        remap[v] = table[h];
+      }
+      indices[i] = remap[v];
+    }
+    memcpy (vertices, output, count * sizeof(MeshVertex));
+  }
+
+  if (remap)  free (remap);
+  if (table)  free (table);
+  if (output) free (output);
+
+  return (count);
+}
+
+/*____________________________________________________________________
+|
+| Function: Hash_Vertex
+|
+| Input: Called from Mesh_Optimize_Fetch()
+| Output: Returns a hash (FNV-1a) of the bytes of a vertex.
+|___________________________________________________________________*/
+
+static unsigned Hash_Vertex (const MeshVertex *vertex)
+{
+  int i;
+  unsigned hash;
+  const unsigned char *p = (const unsigned char *) vertex;
+
+  hash = 2166136261u;
+  for (i=0; i<(int)sizeof(MeshVertex); i++)
+    hash = (hash ^ p[i]) * 16777619u;
+
+  return (hash);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mesh_Get_Cache_Stats
+|
+| Input: Called from Mesh_Cook(), ____
+| Output: Simulates a FIFO vertex cache of cache_size entries and gets
+|   average misses per triangle and per vertex used.
+|___________________________________________________________________*/
+
+void Mesh_Get_Cache_Stats (const unsigned *indices, int num_indices, int num_vertices, int cache_size, float *acmr, float *atvr)
+{
+  int i, misses, used;
+  unsigned time, *stamp;
+
+  *acmr = 0;
+  *atvr = 0;
+  stamp = (unsigned *) calloc (num_vertices, sizeof(unsigned));
+  if (stamp == NULL)
+    return;
+
+  // A vertex is in the cache if fewer than cache_size vertices were added since it was
+  time = cache_size + 1;
+  misses = 0;
+  used = 0;
+  for (i=0; i<num_indices; i++)
+    if (time - stamp[indices[i]] > (unsigned)cache_size) {
+      if (stamp[indices[i]] == 0)
+        used++;
+      stamp[indices[i]] = time++;
+      misses++;
+    }
+  if (num_indices >= 3)
+    *acmr = (float) misses / (num_indices / 3);
+  if (used)
+    *atvr = (float) misses / used;
+
+  free (stamp);
+}
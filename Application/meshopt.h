@@ -0,0 +1,23 @@
+/*____________________________________________________________________
+|
+| File: meshopt.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define MESH_CACHE_SIZE  16   // entries of the FIFO vertex cache Mesh_Get_Cache_Stats() simulates
+
+// Reorders triangles so vertices are reused while still in the post-transform cache
+void Mesh_Optimize_Cache (unsigned *indices, int num_indices, int num_vertices);
+
+// Reorders clusters of triangles of a cache optimized list so outside surfaces draw first from any view,
+//   threshold is how much worse (1.05 = 5%) the cache may get
+void Mesh_Optimize_Overdraw (unsigned *indices, int num_indices, const MeshVertex *vertices, int num_vertices, float threshold);
+
+// Reorders vertices in the order the indices first use them, merging equal vertices and dropping unused ones,
+//   returns the new # of vertices
+int Mesh_Optimize_Fetch (unsigned *indices, int num_indices, MeshVertex *vertices, int num_vertices);
+
+// Simulates a FIFO vertex cache, gets misses per triangle (ACMR) and per vertex used (ATVR, 1 is best)
+void Mesh_Get_Cache_Stats (const unsigned *indices, int num_indices, int num_vertices, int cache_size, float *acmr, float *atvr);
@@ -0,0 +1,500 @@
+/*____________________________________________________________________
+|
+| File: mip.cpp
+|
+| Description: Builds mip chains.  Colors are stored as sRGB, so the
+|   image is changed to linear floats first, each level is filtered
+|   from the one above it in linear space and changed back to sRGB only
+|   for output.  Averaging sRGB values directly darkens every level.
+|
+|   The filter is separable: a horizontal pass over the rows of the
+|   level above, then a vertical pass writing the rows of the new
+|   level.  Each pass runs over rows in parallel.  A pixel is 4 floats
+|   so it is filtered as one SSE register.
+|
+|   Textures drawn with alpha testing lose coverage in small levels:
+|   filtering pulls alpha toward the middle and pixels drop under the
+|   test value, so leaves and ghosts thin out with distance.  With an
+|   alpha test value given, each level's alpha is scaled so the share
+|   of pixels passing the test is the same as in level 0.
+|
+| Functions: Mip_Build
+|             Get_Taps
+|             Bessel_I0
+|             To_Linear
+|             Filter_Rows
+|             Filter_Columns
+|             Keep_Coverage
+|            Mip_Free
+|            Mip_Alpha_Coverage
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <math.h>
+
+#include "dp.h"
+
+#include "jobs.h"
+#include "mip.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1)) || defined(__SSE__)
+#define MIP_SSE
+#include <xmmintrin.h>
+#endif
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MAX_TAPS       6
+#define KAISER_WIDTH   1.5f    // in pixels of the new level
+#define KAISER_ALPHA   4.0f
+#define SRGB_LUT_SIZE  4096
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+// Filter weights for one axis, pixel x of the new level uses pixels 2x+offset.. of the level above
+typedef struct {
+  int   num;
+  int   offset;
+  float weight [MAX_TAPS];
+} Taps;
+
+// One level being filtered
+typedef struct {
+  int    src_dx, src_dy;
+  int    dx, dy;
+  Taps   x_taps, y_taps;
+  float *src;       // linear RGBA of the level above
+  float *tmp;       // src_dy rows of dx pixels after the horizontal pass
+  float *dst;       // linear RGBA of the new level
+  byte  *out;       // sRGB RGBA of the new level
+} MipLevel;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Get_Taps (int filter, int src_size, Taps *taps);
+static float Bessel_I0 (float x);
+static void To_Linear (int first, int last, void *params);
+static void Filter_Rows (int first, int last, void *params);
+static void Filter_Columns (int first, int last, void *params);
+static void Keep_Coverage (byte *rgba, int dx, int dy, int alpha_ref, float coverage);
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static float to_linear [256];
+static byte  to_srgb [SRGB_LUT_SIZE];
+static bool  luts_made = false;
+
+/*____________________________________________________________________
+|
+| Function: Mip_Build
+|
+| Input: Called from ____
+| Output: Builds the levels below an image, down to 1x1.  Returns true
+|   on success, else false.
+|___________________________________________________________________*/
+
+int Mip_Build (byte *rgba, int dx, int dy, int filter, int alpha_ref, MipChain *chain)
+{
+  int i, size;
+  float v, coverage;
+  float *t;
+  MipLevel level;
+
+  // sRGB <-> linear tables
+  if (NOT luts_made) {
+    for (i=0; i<256; i++) {
+      v = i / 255.0f;
+      to_linear[i] = (v <= 0.04045f) ? v / 12.92f : powf ((v + 0.055f) / 1.055f, 2.4f);
+    }
+    for (i=0; i<SRGB_LUT_SIZE; i++) {
+      v = (float)i / (SRGB_LUT_SIZE - 1);
+      v = (v <= 0.0031308f) ? v * 12.92f : 1.055f * powf (v, 1 / 2.4f) - 0.055f;
+      to_srgb[i] = (byte)(v * 255 + 0.5f);
+    }
+    luts_made = true;
+  }
+
+  // Sizes, all levels below 0 in one allocation
+  memset (chain, 0, sizeof(MipChain));
+  chain->dx[0]     = dx;
+  chain->dy[0]     = dy;
+  chain->levels[0] = rgba;
+  size = 0;
+  for (i=1; (i < MIP_MAX_LEVELS) AND ((chain->dx[i-1] > 1) OR (chain->dy[i-1] > 1)); i++) {
+    chain->dx[i] = (chain->dx[i-1] > 1) ? chain->dx[i-1] / 2 : 1;
+    chain->dy[i] = (chain->dy[i-1] > 1) ? chain->dy[i-1] / 2 : 1;
+    size += chain->dx[i] * chain->dy[i] * 4;
+  }
+  chain->num_levels = i;
+  if (chain->num_levels == 1)
+    return (TRUE);
+
+  level.src = (float *) malloc (dx * dy * 4 * sizeof(float));
+  level.tmp = (float *) malloc (chain->dx[1] * dy * 4 * sizeof(float));
+  level.dst = (float *) malloc (chain->dx[1] * chain->dy[1] * 4 * sizeof(float));
+  chain->levels[1] = (byte *) malloc (size);
+  if ((level.src == NULL) OR (level.tmp == NULL) OR (level.dst == NULL) OR (chain->levels[1] == NULL)) {
+    if (level.src)
+      free (level.src);
+    if (level.tmp)
+      free (level.tmp);
+    if (level.dst)
+      free (level.dst);
+    Mip_Free (chain);
+    return (FALSE);
+  }
+  for (i=2; i<chain->num_levels; i++)
+    chain->levels[i] = chain->levels[i-1] + chain->dx[i-1] * chain->dy[i-1] * 4;
+
+  // Level 0 to linear
+  level.src_dx = dx;
+  level.out    = rgba;
+  Jobs_Parallel_For (dy, 0, To_Linear, &level);
+
+  // Each level from the one above
+  for (i=1; i<chain->num_levels; i++) {
+    level.src_dx = chain->dx[i-1];
+    level.src_dy = chain->dy[i-1];
+    level.dx     = chain->dx[i];
+    level.dy     = chain->dy[i];
+    level.out    = chain->levels[i];
+    Get_Taps (filter, level.src_dx, &level.x_taps);
+    Get_Taps (filter, level.src_dy, &level.y_taps);
+    Jobs_Parallel_For (level.src_dy, 0, Filter_Rows, &level);
+    Jobs_Parallel_For (level.dy, 0, Filter_Columns, &level);
+    // New level is the source of the next
+    t         = level.src;
+    level.src = level.dst;
+    level.dst = t;
+  }
+  free (level.src);
+  free (level.tmp);
+  free (level.dst);
+
+  if (alpha_ref) {
+    coverage = Mip_Alpha_Coverage (rgba, dx, dy, alpha_ref);
+    for (i=1; i<chain->num_levels; i++)
+      Keep_Coverage (chain->levels[i], chain->dx[i], chain->dy[i], alpha_ref, coverage);
+  }
+
+  return (TRUE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Taps
+|
+| Input: Called from Mip_Build()
+| Output: Gets the filter weights for halving one axis.  A new pixel x
+|   is centered between pixels 2x and 2x+1 of the level above.
+|___________________________________________________________________*/
+
+static void Get_Taps (int filter, int src_size, Taps *taps)
+{
+  int i;
+  float t, w, sum;
+
+  if (src_size == 1) {
+    // Axis is not halved
+    taps->num       = 1;
+    taps->offset    = 0;
+    taps->weight[0] = 1;
+  }
+  else if (filter == MIP_BOX) {
+    taps->num       = 2;
+    taps->offset    = 0;
+    taps->weight[0] = 0.5f;
+    taps->weight[1] = 0.5f;
+  }
+  else {
+    // Windowed sinc, distances in pixels of the new level
+    taps->num    = MAX_TAPS;
+    taps->offset = -(MAX_TAPS / 2 - 1);
+    sum = 0;
+    for (i=0; i<MAX_TAPS; i++) {
+      t = (i - (MAX_TAPS - 1) / 2.0f) / 2;
+      w = sinf (3.14159265f * t) / (3.14159265f * t);
+      w *= Bessel_I0 (KAISER_ALPHA * sqrtf (1 - (t / KAISER_WIDTH) * (t / KAISER_WIDTH))) / Bessel_I0 (KAISER_ALPHA);
+      taps->weight[i] = w;
+      sum += w;
+    }
+    for (i=0; i<MAX_TAPS; i++)
+      taps->weight[i] /= sum;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Bessel_I0
+|
+| Input: Called from Get_Taps()
+| Output: Returns the modified Bessel function of order 0, used by the
+|   Kaiser window.
+|___________________________________________________________________*/
+
+static float Bessel_I0 (float x)
+{
+  int k;
+  float sum, term;
+
+  sum  = 1;
+  term = 1;
+  for (k=1; k<20; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum  += term;
+  }
+
+  return (sum);
+}
+
+/*____________________________________________________________________
+|
+| Function: To_Linear
+|
+| Input: Called from Mip_Build() through Jobs_Parallel_For()
+| Output: Changes a range of rows of level 0 to linear floats.  Alpha
+|   is already linear.
+|___________________________________________________________________*/
+
+static void To_Linear (int first, int last, void *params)
+{
+  int i, n;
+  byte *src;
+  float *dst;
+  MipLevel *level = (MipLevel *) params;
+
+  n   = (last - first) * level->src_dx;
+  src = level->out + first * level->src_dx * 4;
+  dst = level->src + first * level->src_dx * 4;
+  for (i=0; i<n; i++, src+=4, dst+=4) {
+    dst[0] = to_linear[src[0]];
+    dst[1] = to_linear[src[1]];
+    dst[2] = to_linear[src[2]];
+    dst[3] = src[3] / 255.0f;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Filter_Rows
+|
+| Input: Called from Mip_Build() through Jobs_Parallel_For()
+| Output: Filters a range of rows of the level above horizontally.
+|   Pixels past the edges repeat the edge pixel.
+|___________________________________________________________________*/
+
+static void Filter_Rows (int first, int last, void *params)
+{
+  int x, y, k, sx;
+  float *src, *dst, *p;
+  MipLevel *level = (MipLevel *) params;
+  Taps *taps = &level->x_taps;
+#ifdef MIP_SSE
+  __m128 sum, weight[MAX_TAPS];
+
+  for (k=0; k<taps->num; k++)
+    weight[k] = _mm_set1_ps (taps->weight[k]);
+#endif
+
+  for (y=first; y<last; y++) {
+    src = level->src + y * level->src_dx * 4;
+    dst = level->tmp + y * level->dx * 4;
+    for (x=0; x<level->dx; x++, dst+=4) {
+      sx = x * 2 + taps->offset;
+      if ((sx >= 0) AND (sx + taps->num <= level->src_dx)) {
+        // Inside the row
+        p = src + sx * 4;
+#ifdef MIP_SSE
+        sum = _mm_mul_ps (weight[0], _mm_loadu_ps (p));
+        for (k=1; k<taps->num; k++)
+          sum = _mm_add_ps (sum, _mm_mul_ps (weight[k], _mm_loadu_ps (p + k*4)));
+        _mm_storeu_ps (dst, sum);
+#else
+        dst[0] = dst[1] = dst[2] = dst[3] = 0;
+        for (k=0; k<taps->num; k++) {
+          dst[0] += taps->weight[k] * p[k*4];
+          dst[1] += taps->weight[k] * p[k*4+1];
+          dst[2] += taps->weight[k] * p[k*4+2];
+          dst[3] += taps->weight[k] * p[k*4+3];
+        }
+#endif
+      }
+      else {
+        // Past an edge, repeat the edge pixel
+        dst[0] = dst[1] = dst[2] = dst[3] = 0;
+        for (k=0; k<taps->num; k++) {
+          sx = x * 2 + taps->offset + k;
+          sx = (sx < 0) ? 0 : ((sx >= level->src_dx) ? level->src_dx - 1 : sx);
+          dst[0] += taps->weight[k] * src[sx*4];
+          dst[1] += taps->weight[k] * src[sx*4+1];
+          dst[2] += taps->weight[k] * src[sx*4+2];
+          dst[3] += taps->weight[k] * src[sx*4+3];
+        }
+      }
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Filter_Columns
+|
+| Input: Called from Mip_Build() through Jobs_Parallel_For()
+| Output: Filters a range of rows of the new level vertically, a row
+|   at a time.  Writes the linear row, clamped to 0-1 (sinc lobes can
+|   overshoot), and the sRGB row.
+|___________________________________________________________________*/
+
+static void Filter_Columns (int first, int last, void *params)
+{
+  int x, y, k, sy, i;
+  float w, *src, *dst, v[4];
+  byte *out;
+  MipLevel *level = (MipLevel *) params;
+  Taps *taps = &level->y_taps;
+
+  for (y=first; y<last; y++) {
+    dst = level->dst + y * level->dx * 4;
+    memset (dst, 0, level->dx * 4 * sizeof(float));
+    for (k=0; k<taps->num; k++) {
+      sy = y * 2 + taps->offset + k;
+      sy = (sy < 0) ? 0 : ((sy >= level->src_dy) ? level->src_dy - 1 : sy);
+      src = level->tmp + sy * level->dx * 4;
+      w = taps->weight[k];
+#ifdef MIP_SSE
+      __m128 vw = _mm_set1_ps (w);
+      for (x=0; x<level->dx; x++)
+        _mm_storeu_ps (dst + x*4, _mm_add_ps (_mm_loadu_ps (dst + x*4), _mm_mul_ps (vw, _mm_loadu_ps (src + x*4))));
+#else
+      for (x=0; x<level->dx*4; x++)
+        dst[x] += w * src[x];
+#endif
+    }
+
+    out = level->out + y * level->dx * 4;
+    for (x=0; x<level->dx; x++, dst+=4, out+=4) {
+#ifdef MIP_SSE
+      _mm_storeu_ps (dst, _mm_min_ps (_mm_max_ps (_mm_loadu_ps (dst), _mm_setzero_ps ()), _mm_set1_ps (1)));
+      _mm_storeu_ps (v, _mm_loadu_ps (dst));
+#else
+      for (i=0; i<4; i++) {
+        dst[i] = (dst[i] < 0) ? 0 : ((dst[i] > 1) ? 1 : dst[i]);
+        v[i] = dst[i];
+      }
+#endif
+      for (i=0; i<3; i++)
+        out[i] = to_srgb[(int)(v[i] * (SRGB_LUT_SIZE - 1) + 0.5f)];
+      out[3] = (byte)(v[3] * 255 + 0.5f);
+    }
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Keep_Coverage
+|
+| Input: Called from Mip_Build()
+| Output: Scales the alpha of a level so the share of pixels with alpha
+|   >= alpha_ref is as close as it can get to coverage.  The scale is
+|   found by bisection on a histogram of the level's alpha.
+|___________________________________________________________________*/
+
+static void Keep_Coverage (byte *rgba, int dx, int dy, int alpha_ref, float coverage)
+{
+  int i, a, n, step, count[256];
+  float lo, hi, scale, best, c, error, best_error;
+
+  n = dx * dy;
+  memset (count, 0, sizeof(count));
+  for (i=0; i<n; i++)
+    count[rgba[i*4+3]]++;
+
+  // Coverage rises with the scale, find where it crosses
+  best       = 1;
+  best_error = 2;
+  lo = 0;
+  hi = 8;
+  for (step=0; step<=24; step++) {
+    scale = (step == 0) ? 1 : (lo + hi) / 2;
+    c = 0;
+    for (a=1; a<256; a++)
+      if (a * scale + 0.5f >= alpha_ref)
+        c += count[a];
+    c /= n;
+    error = fabsf (c - coverage);
+    if (error < best_error) {
+      best_error = error;
+      best       = scale;
+    }
+    if (step) {
+      if (c < coverage)
+        lo = scale;
+      else
+        hi = scale;
+    }
+  }
+
+  if (best != 1)
+    for (i=0; i<n; i++) {
+      a = (int)(rgba[i*4+3] * best + 0.5f);
+      rgba[i*4+3] = (byte)((a > 255) ? 255 : a);
+    }
+}
+
+/*____________________________________________________________________
+|
+| Function: Mip_Free
+|
+| Input: Called from ____
+| Output: Frees the levels made by Mip_Build().
+|___________________________________________________________________*/
+
+void Mip_Free (MipChain *chain)
+{
+  if (chain->levels[1]) {
+    free (chain->levels[1]);
+    chain->levels[1] = NULL;
+  }
+  chain->num_levels = 0;
+}
+
+/*____________________________________________________________________
+|
+| Function: Mip_Alpha_Coverage
+|
+| Input: Called from ____
+| Output: Returns the share of pixels (0-1) with alpha >= alpha_ref.
+|___________________________________________________________________*/
+
+float Mip_Alpha_Coverage (const byte *rgba, int dx, int dy, int alpha_ref)
+{
+  int i, n, count;
+
+  n = dx * dy;
+  count = 0;
+  for (i=0; i<n; i++)
+    if (rgba[i*4+3] >= alpha_ref)
+      count++;
+
+  return ((float)count / n);
+}
@@ -0,0 +1,32 @@
+/*____________________________________________________________________
+|
+| File: mip.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define MIP_MAX_LEVELS 16
+
+// Filters
+#define MIP_BOX        0   // average of 2x2 pixels
+#define MIP_KAISER     1   // windowed sinc, 6x6 pixels, sharper
+
+// A mip chain, level 0 is the caller's image
+typedef struct {
+  int   num_levels;
+  int   dx [MIP_MAX_LEVELS];
+  int   dy [MIP_MAX_LEVELS];
+  byte *levels [MIP_MAX_LEVELS];  // RGBA, rows top to bottom
+} MipChain;
+
+// Builds every level down to 1x1 from an sRGB image, filtering in linear space.  If alpha_ref is not 0 each
+//   level's alpha is scaled so the share of pixels passing an alpha test at alpha_ref stays that of level 0.
+//   Returns true on success.
+int Mip_Build (byte *rgba, int dx, int dy, int filter, int alpha_ref, MipChain *chain);
+
+// Frees the levels made by Mip_Build()
+void Mip_Free (MipChain *chain);
+
+// Returns the share of pixels (0-1) with alpha >= alpha_ref
+float Mip_Alpha_Coverage (const byte *rgba, int dx, int dy, int alpha_ref);
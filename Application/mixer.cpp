@@ -0,0 +1,990 @@
+/*____________________________________________________________________
+|
+| File: mixer.cpp
+|
+| Description: Mixes sounds in software, so audio can run (and be
+|   timed and tested) without a sound device.
+|
+|   Sounds are kept as float samples at their own rate.  Each voice
+|   plays a sound with a gain, pan and pitch.  Voices are resampled to
+|   the output rate with a cubic (Catmull-Rom) kernel and added into a
+|   float stereo bus, a block of MIXER_BLOCK_FRAMES at a time.  With
+|   SSE2 4 output frames are done at once.  A voice at the output rate
+|   and normal pitch skips the kernel and is just scaled and added.
+|
+|   Changes to gain and pan are ramped over a block so they don't
+|   click.  The bus is then clipped to 16-bit and sent to the sink: a
+|   callback (to feed a sound device), a wave file, or nothing.
+|
+|   Samples past each end of a sound are padded (copies from the other
+|   end for sounds that loop, silence for those that don't) so the
+|   kernel never needs to check for the ends.
+|
+|   Sounds can be kept as IMA ADPCM (adpcm.cpp), a quarter the size of
+|   16-bit samples.  One decoded copy is made when such a sound starts
+|   playing and shared by all voices playing it.  Decoded copies are
+|   kept up to MIXER_DECODED_BYTES, then those of sounds not playing
+|   are freed, least recently played first.
+|
+|   Only uses the C library, wavstream.cpp and adpcm.cpp.
+|
+| Functions: Mixer_Init
+|            Mixer_Free
+|            Mixer_Load_Sound
+|            Mixer_Create_Sound
+|            Mixer_Create_Sound_ADPCM
+|             Fill_Sound
+|             Decode_Sound
+|            Mixer_Free_Sound
+|            Mixer_Get_Sound_Info
+|            Mixer_Play
+|            Mixer_Play_From
+|            Mixer_Set_Voice
+|             Set_Gains
+|            Mixer_Stop
+|            Mixer_Is_Playing
+|            Mixer_Get_Position
+|             Get_Voice
+|            Mixer_Update
+|             Mix_Voice
+|             Mix_Run
+|             Write_Wav_Header
+|            Mixer_Get_Stats
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define MIXER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "wavstream.h"
+#include "adpcm.h"
+#include "mixer.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define PAD_BEFORE   1              // frames of padding before the start of a sound (kernel reads 1 back)
+#define PAD_AFTER    2              // and after the end (kernel reads 2 ahead)
+
+#define FRACTION     4294967296.0   // 1.0 in 32.32 fixed point positions
+
+#define MIN_PITCH    0.01f
+#define MAX_PITCH    8.0f
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  bool      used;
+  bool      loop;
+  unsigned  generation;             // changes when slot is reused, so old handles don't work
+  int       channels, rate, frames;
+  float    *buffer;                 // padding, frames, padding, NULL if coded and not decoded
+  float    *data;                   // first frame in buffer
+  unsigned char *adpcm;             // coded frames, NULL if not coded
+  int       voices;                 // playing it
+  unsigned  last_played;            // mixer_plays when a voice last started it
+} Sound;
+
+typedef struct {
+  int                sound;         // index in sounds, -1 = not playing
+  unsigned           generation;
+  unsigned long long position;      // frames into the sound, 32.32 fixed point
+  unsigned long long step;          // frames per output frame, 32.32 fixed point
+  float              gain, pan, pitch;
+  float              target [2];    // left, right gains from gain and pan
+  float              current [2];   // gains at the start of the block
+} Voice;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void   Fill_Sound (Sound *s, const short *samples);
+static bool   Decode_Sound (Sound *s);
+static void   Set_Gains (Voice *v);
+static Voice *Get_Voice (MixerVoice voice);
+static void   Mix_Voice (Voice *v, int num_frames);
+static void   Mix_Run (Voice *v, Sound *s, float *bus, int num_frames, float *gains, const float *ramp);
+static void   Write_Wav_Header (unsigned data_bytes);
+static double Get_Time ();
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define HANDLE_OF(_i_,_g_) (((_g_) << 16) | (unsigned)((_i_) + 1))
+
+// Catmull-Rom spline through x0 and x1 at t (0-1), xm1 and x2 are the samples on either side
+#define CUBIC(_xm1_,_x0_,_x1_,_x2_,_t_) \
+  ((_x0_) + 0.5f * (_t_) * ((_x1_) - (_xm1_) + (_t_) * (2.0f * (_xm1_) - 5.0f * (_x0_) + 4.0f * (_x1_) - (_x2_) + (_t_) * (3.0f * ((_x0_) - (_x1_)) + (_x2_) - (_xm1_)))))
+
+#ifdef MIXER_SSE2
+// The same for 4 positions at once
+#define CUBIC4(_xm1_,_x0_,_x1_,_x2_,_t_)                                                                                   \
+  _mm_add_ps ((_x0_), _mm_mul_ps (_mm_mul_ps (_mm_set1_ps (0.5f), (_t_)),                                                 \
+    _mm_add_ps (_mm_sub_ps ((_x1_), (_xm1_)), _mm_mul_ps ((_t_),                                                           \
+      _mm_add_ps (_mm_sub_ps (_mm_add_ps (_mm_sub_ps (_mm_add_ps ((_xm1_), (_xm1_)), _mm_mul_ps (_mm_set1_ps (5.0f), (_x0_))), \
+                                          _mm_mul_ps (_mm_set1_ps (4.0f), (_x1_))), (_x2_)),                               \
+                  _mm_mul_ps ((_t_), _mm_sub_ps (_mm_add_ps (_mm_mul_ps (_mm_set1_ps (3.0f), _mm_sub_ps ((_x0_), (_x1_))), (_x2_)), (_xm1_))))))))
+#endif
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static bool          mixing = false;
+static int           mixer_rate;
+static int           mixer_sink;
+static MixerCallback mixer_callback;
+static void         *mixer_data;
+static FILE         *wav_fp;
+static unsigned      wav_bytes;
+
+static Sound         sounds [MIXER_MAX_SOUNDS];
+static Voice         voices [MIXER_MAX_VOICES];
+static int           active [MIXER_MAX_VOICES];  // indices of playing voices
+static int           num_active;
+
+static float         bus [MIXER_BLOCK_FRAMES * 2];
+static short         output [MIXER_BLOCK_FRAMES * 2];
+static unsigned      mixer_plays;                // voices started, to order decoded copies
+static MixerStats    mixer_stats;
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Init
+|
+| Input: Called from ____
+| Output: Starts the mixer.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+bool Mixer_Init (int rate, int sink, const char *wav_file, MixerCallback callback, void *data)
+{
+  int i;
+
+  if (mixing || (rate <= 0))
+    return (false);
+
+  mixer_rate     = rate;
+  mixer_sink     = sink;
+  mixer_callback = callback;
+  mixer_data     = data;
+  if (sink == MIXER_SINK_WAV) {
+    wav_fp = fopen (wav_file, "wb");
+    if (wav_fp == NULL)
+      return (false);
+    wav_bytes = 0;
+    Write_Wav_Header (0);
+  }
+  else if ((sink == MIXER_SINK_CALLBACK) && (callback == NULL))
+    return (false);
+
+  memset (sounds, 0, sizeof(sounds));
+  memset (voices, 0, sizeof(voices));
+  for (i=0; i<MIXER_MAX_VOICES; i++)
+    voices[i].sound = -1;
+  num_active  = 0;
+  mixer_plays = 0;
+  memset (&mixer_stats, 0, sizeof(mixer_stats));
+  mixing = true;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Free
+|
+| Input: Called from ____
+| Output: Stops all voices, frees all sounds and closes the sink.
+|___________________________________________________________________*/
+
+void Mixer_Free ()
+{
+  int i;
+
+  if (!mixing)
+    return;
+
+  for (i=0; i<MIXER_MAX_SOUNDS; i++)
+    if (sounds[i].used)
+      Mixer_Free_Sound (HANDLE_OF (i, sounds[i].generation));
+  if (wav_fp) {
+    // Now the sizes are known
+    Write_Wav_Header (wav_bytes);
+    fclose (wav_fp);
+    wav_fp = NULL;
+  }
+  mixing = false;
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Load_Sound
+|
+| Input: Called from ____
+| Output: Loads a wave file as a sound, kept as ADPCM if compress is
+|   true.  Returns the sound, or 0 on error.
+|___________________________________________________________________*/
+
+MixerSound Mixer_Load_Sound (const char *filename, bool loop, bool compress)
+{
+  short *samples;
+  WavFormat format;
+  MixerSound sound;
+
+  samples = Wav_Load (filename, &format);
+  if (samples == NULL)
+    return (0);
+  if (compress)
+    sound = Mixer_Create_Sound_ADPCM (samples, format.frames, format.channels, format.rate, loop);
+  else
+    sound = Mixer_Create_Sound (samples, format.frames, format.channels, format.rate, loop);
+  free (samples);
+
+  return (sound);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Create_Sound
+|
+| Input: Called from Mixer_Load_Sound(), ____
+| Output: Makes a sound from 16-bit samples.  Returns the sound, or 0
+|   on error.
+|___________________________________________________________________*/
+
+MixerSound Mixer_Create_Sound (const short *samples, int num_frames, int channels, int rate, bool loop)
+{
+  int i;
+  Sound *s;
+
+  if ((!mixing) || (num_frames <= 0) || (channels < 1) || (channels > 2) || (rate <= 0))
+    return (0);
+  for (i=0; (i < MIXER_MAX_SOUNDS) && sounds[i].used; i++);
+  if (i == MIXER_MAX_SOUNDS)
+    return (0);
+  s = &sounds[i];
+
+  s->buffer = (float *) malloc ((PAD_BEFORE + num_frames + PAD_AFTER) * channels * sizeof(float));
+  if (s->buffer == NULL)
+    return (0);
+  s->channels = channels;
+  s->rate     = rate;
+  s->frames   = num_frames;
+  s->loop     = loop;
+  s->adpcm    = NULL;
+  s->voices   = 0;
+  Fill_Sound (s, samples);
+  s->used = true;
+  mixer_stats.sounds++;
+  mixer_stats.sound_bytes += (PAD_BEFORE + num_frames + PAD_AFTER) * channels * sizeof(float);
+
+  return (HANDLE_OF (i, s->generation));
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Create_Sound_ADPCM
+|
+| Input: Called from Mixer_Load_Sound(), ____
+| Output: Makes a sound kept as IMA ADPCM from 16-bit samples.  Returns
+|   the sound, or 0 on error.
+|___________________________________________________________________*/
+
+MixerSound Mixer_Create_Sound_ADPCM (const short *samples, int num_frames, int channels, int rate, bool loop)
+{
+  int i;
+  Sound *s;
+
+  if ((!mixing) || (num_frames <= 0) || (channels < 1) || (channels > 2) || (rate <= 0))
+    return (0);
+  for (i=0; (i < MIXER_MAX_SOUNDS) && sounds[i].used; i++);
+  if (i == MIXER_MAX_SOUNDS)
+    return (0);
+  s = &sounds[i];
+
+  s->adpcm = (unsigned char *) malloc (Adpcm_Size (num_frames, channels));
+  if (s->adpcm == NULL)
+    return (0);
+  Adpcm_Encode (samples, num_frames, channels, s->adpcm);
+  s->buffer   = NULL;
+  s->data     = NULL;
+  s->channels = channels;
+  s->rate     = rate;
+  s->frames   = num_frames;
+  s->loop     = loop;
+  s->voices   = 0;
+  s->used = true;
+  mixer_stats.sounds++;
+  mixer_stats.sound_bytes += Adpcm_Size (num_frames, channels);
+
+  return (HANDLE_OF (i, s->generation));
+}
+
+/*____________________________________________________________________
+|
+| Function: Fill_Sound
+|
+| Input: Called from Mixer_Create_Sound(), Decode_Sound()
+| Output: Fills the buffer of a sound from 16-bit samples, with its
+|   padding.
+|___________________________________________________________________*/
+
+static void Fill_Sound (Sound *s, const short *samples)
+{
+  int j, n, src;
+
+  s->data = s->buffer + PAD_BEFORE * s->channels;
+  n = s->frames * s->channels;
+  for (j=0; j<n; j++)
+    s->data[j] = samples[j] * (1.0f / 32768);
+  // Padding, the other end of a sound that loops
+  for (j=-PAD_BEFORE*s->channels; j<0; j++) {
+    src = j + n;
+    s->data[j] = (s->loop && (src >= 0)) ? s->data[src] : 0;
+  }
+  for (j=n; j<n+PAD_AFTER*s->channels; j++) {
+    src = j - n;
+    s->data[j] = (s->loop && (src < n)) ? s->data[src] : 0;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Decode_Sound
+|
+| Input: Called from Mixer_Play_From()
+| Output: Decodes a sound kept as ADPCM, first freeing decoded copies
+|   of sounds not playing if over MIXER_DECODED_BYTES.  Returns true
+|   on success, else false.
+|___________________________________________________________________*/
+
+static bool Decode_Sound (Sound *s)
+{
+  int i, oldest;
+  unsigned bytes;
+  short *samples;
+  double start;
+
+  start = Get_Time ();
+  bytes = (PAD_BEFORE + s->frames + PAD_AFTER) * s->channels * sizeof(float);
+  while (mixer_stats.decoded_bytes + bytes > MIXER_DECODED_BYTES) {
+    oldest = -1;
+    for (i=0; i<MIXER_MAX_SOUNDS; i++)
+      if (sounds[i].used && sounds[i].adpcm && sounds[i].buffer && (sounds[i].voices == 0) &&
+          ((oldest == -1) || (mixer_plays - sounds[i].last_played > mixer_plays - sounds[oldest].last_played)))
+        oldest = i;
+    // All playing, go over
+    if (oldest == -1)
+      break;
+    free (sounds[oldest].buffer);
+    sounds[oldest].buffer = NULL;
+    sounds[oldest].data   = NULL;
+    mixer_stats.decoded_bytes -= (PAD_BEFORE + sounds[oldest].frames + PAD_AFTER) * sounds[oldest].channels * sizeof(float);
+  }
+
+  s->buffer = (float *) malloc (bytes);
+  samples = (short *) malloc (s->frames * s->channels * sizeof(short));
+  if ((s->buffer == NULL) || (samples == NULL)) {
+    free (s->buffer);
+    free (samples);
+    s->buffer = NULL;
+    return (false);
+  }
+  Adpcm_Decode (s->adpcm, s->frames, s->channels, samples);
+  Fill_Sound (s, samples);
+  free (samples);
+  mixer_stats.decoded_bytes += bytes;
+  mixer_stats.decodes++;
+  mixer_stats.decode_time += (float)(Get_Time () - start);
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Free_Sound
+|
+| Input: Called from Mixer_Free(), ____
+| Output: Stops any voices playing a sound and frees it.
+|___________________________________________________________________*/
+
+void Mixer_Free_Sound (MixerSound sound)
+{
+  int i, index;
+  Sound *s;
+
+  index = (int)(sound & 0xFFFF) - 1;
+  if ((index < 0) || (index >= MIXER_MAX_SOUNDS) || (!sounds[index].used) || (sounds[index].generation != (sound >> 16)))
+    return;
+  s = &sounds[index];
+
+  for (i=num_active-1; i>=0; i--)
+    if (voices[active[i]].sound == index)
+      Mixer_Stop (HANDLE_OF (active[i], voices[active[i]].generation));
+  if (s->adpcm) {
+    mixer_stats.sound_bytes -= Adpcm_Size (s->frames, s->channels);
+    if (s->buffer)
+      mixer_stats.decoded_bytes -= (PAD_BEFORE + s->frames + PAD_AFTER) * s->channels * sizeof(float);
+  }
+  else
+    mixer_stats.sound_bytes -= (PAD_BEFORE + s->frames + PAD_AFTER) * s->channels * sizeof(float);
+  free (s->buffer);
+  free (s->adpcm);
+  s->buffer = NULL;
+  s->data   = NULL;
+  s->adpcm  = NULL;
+  s->used   = false;
+  s->generation = (s->generation + 1) & 0xFFFF;
+  mixer_stats.sounds--;
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Get_Sound_Info
+|
+| Input: Called from ____
+| Output: Gets the length, rate and looping of a sound.  Returns false
+|   if the sound isn't loaded.
+|___________________________________________________________________*/
+
+bool Mixer_Get_Sound_Info (MixerSound sound, int *frames, int *rate, bool *loop)
+{
+  int index;
+
+  index = (int)(sound & 0xFFFF) - 1;
+  if ((!mixing) || (index < 0) || (index >= MIXER_MAX_SOUNDS) || (!sounds[index].used) || (sounds[index].generation != (sound >> 16)))
+    return (false);
+
+  *frames = sounds[index].frames;
+  *rate   = sounds[index].rate;
+  *loop   = sounds[index].loop;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Play
+|
+| Input: Called from ____
+| Output: Starts a voice playing a sound.  Returns the voice, or 0 if
+|   the sound isn't loaded or no voice is free.
+|___________________________________________________________________*/
+
+MixerVoice Mixer_Play (MixerSound sound, float gain, float pan)
+{
+  MixerVoice voice;
+  Voice *v;
+
+  voice = Mixer_Play_From (sound, gain, pan, 1, 0);
+  v = Get_Voice (voice);
+  if (v) {
+    // Starts at its gain, only later changes are ramped
+    v->current[0] = v->target[0];
+    v->current[1] = v->target[1];
+  }
+
+  return (voice);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Play_From
+|
+| Input: Called from Mixer_Play(), ____
+| Output: Starts a voice playing a sound part way in, fading in over
+|   the first block.  Returns the voice, or 0 if the sound isn't
+|   loaded or no voice is free.
+|___________________________________________________________________*/
+
+MixerVoice Mixer_Play_From (MixerSound sound, float gain, float pan, float pitch, double start_frame)
+{
+  int i, index;
+  Voice *v;
+
+  index = (int)(sound & 0xFFFF) - 1;
+  if ((!mixing) || (index < 0) || (index >= MIXER_MAX_SOUNDS) || (!sounds[index].used) || (sounds[index].generation != (sound >> 16)) ||
+      (num_active == MIXER_MAX_VOICES))
+    return (0);
+  // Past the end of a sound that doesn't loop there is nothing to play
+  if ((start_frame < 0) || ((start_frame >= sounds[index].frames) && (!sounds[index].loop)))
+    return (0);
+  start_frame = fmod (start_frame, (double) sounds[index].frames);
+  // Voices share one decoded copy
+  if ((sounds[index].buffer == NULL) && (!Decode_Sound (&sounds[index])))
+    return (0);
+  sounds[index].voices++;
+  sounds[index].last_played = ++mixer_plays;
+  for (i=0; voices[i].sound != -1; i++);
+  v = &voices[i];
+
+  v->sound    = index;
+  v->position = (unsigned long long)(start_frame * FRACTION);
+  v->gain     = gain;
+  v->pan      = pan;
+  v->pitch    = pitch;
+  Set_Gains (v);
+  v->current[0] = 0;
+  v->current[1] = 0;
+  active[num_active++] = i;
+
+  return (HANDLE_OF (i, v->generation));
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Set_Voice
+|
+| Input: Called from ____
+| Output: Changes the gain, pan and pitch of a playing voice.  The
+|   new gains are reached over the next block.
+|___________________________________________________________________*/
+
+void Mixer_Set_Voice (MixerVoice voice, float gain, float pan, float pitch)
+{
+  Voice *v;
+
+  v = Get_Voice (voice);
+  if (v == NULL)
+    return;
+
+  v->gain  = gain;
+  v->pan   = pan;
+  v->pitch = pitch;
+  Set_Gains (v);
+}
+
+/*____________________________________________________________________
+|
+| Function: Set_Gains
+|
+| Input: Called from Mixer_Play_From(), Mixer_Set_Voice()
+| Output: Sets the left and right gains and the step of a voice.  A
+|   mono sound is panned with constant power, a stereo sound by
+|   turning down the other side.
+|___________________________________________________________________*/
+
+static void Set_Gains (Voice *v)
+{
+  float pan, pitch, angle;
+  Sound *s = &sounds[v->sound];
+
+  pan = v->pan;
+  if (pan < -1)
+    pan = -1;
+  else if (pan > 1)
+    pan = 1;
+  if (s->channels == 1) {
+    angle = (pan + 1) * 0.78539816f;
+    v->target[0] = v->gain * (float) cos (angle);
+    v->target[1] = v->gain * (float) sin (angle);
+  }
+  else {
+    v->target[0] = v->gain * ((pan > 0) ? 1 - pan : 1);
+    v->target[1] = v->gain * ((pan < 0) ? 1 + pan : 1);
+  }
+
+  pitch = v->pitch;
+  if (pitch < MIN_PITCH)
+    pitch = MIN_PITCH;
+  else if (pitch > MAX_PITCH)
+    pitch = MAX_PITCH;
+  if ((pitch == 1) && (s->rate == mixer_rate))
+    v->step = (unsigned long long) 1 << 32;
+  else
+    v->step = (unsigned long long)((double)s->rate / mixer_rate * pitch * FRACTION);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Stop
+|
+| Input: Called from Mixer_Free_Sound(), ____
+| Output: Stops a voice.
+|___________________________________________________________________*/
+
+void Mixer_Stop (MixerVoice voice)
+{
+  int i;
+  Voice *v;
+
+  v = Get_Voice (voice);
+  if (v == NULL)
+    return;
+
+  for (i=0; active[i] != (int)(v - voices); i++);
+  active[i] = active[--num_active];
+  sounds[v->sound].voices--;
+  v->sound = -1;
+  v->generation = (v->generation + 1) & 0xFFFF;
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Is_Playing
+|
+| Input: Called from ____
+| Output: Returns true if a voice is still playing.
+|___________________________________________________________________*/
+
+bool Mixer_Is_Playing (MixerVoice voice)
+{
+  return (Get_Voice (voice) != NULL);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Get_Position
+|
+| Input: Called from ____
+| Output: Returns how many frames into its sound a voice is, or -1 if
+|   it has stopped.
+|___________________________________________________________________*/
+
+double Mixer_Get_Position (MixerVoice voice)
+{
+  Voice *v;
+
+  v = Get_Voice (voice);
+  if (v == NULL)
+    return (-1);
+
+  return ((double) v->position / FRACTION);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Voice
+|
+| Input: Called from Mixer_Play(), Mixer_Set_Voice(), Mixer_Stop(),
+|   Mixer_Is_Playing(), Mixer_Get_Position()
+| Output: Returns the voice of a handle, or NULL if it has stopped.
+|___________________________________________________________________*/
+
+static Voice *Get_Voice (MixerVoice voice)
+{
+  int index;
+
+  index = (int)(voice & 0xFFFF) - 1;
+  if ((!mixing) || (index < 0) || (index >= MIXER_MAX_VOICES) || (voices[index].sound == -1) || (voices[index].generation != (voice >> 16)))
+    return (NULL);
+
+  return (&voices[index]);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Update
+|
+| Input: Called from ____
+| Output: Mixes frames a block at a time and sends them to the sink.
+|___________________________________________________________________*/
+
+void Mixer_Update (int num_frames)
+{
+  int i, n;
+  double start;
+
+  if (!mixing)
+    return;
+
+  start = Get_Time ();
+  for (; num_frames>0; num_frames-=n) {
+    n = (num_frames < MIXER_BLOCK_FRAMES) ? num_frames : MIXER_BLOCK_FRAMES;
+    memset (bus, 0, n * 2 * sizeof(float));
+    // Backwards, since voices that end are removed
+    for (i=num_active-1; i>=0; i--)
+      Mix_Voice (&voices[active[i]], n);
+
+    // Clip to 16-bit
+    i = 0;
+#ifdef MIXER_SSE2
+    __m128 scale = _mm_set1_ps (32767.0f);
+    __m128 lo    = _mm_set1_ps (-32768.0f);
+    __m128 hi    = _mm_set1_ps (32767.0f);
+    __m128i a, b;
+    for (; i+8<=n*2; i+=8) {
+      a = _mm_cvtps_epi32 (_mm_min_ps (_mm_max_ps (_mm_mul_ps (_mm_loadu_ps (&bus[i]),   scale), lo), hi));
+      b = _mm_cvtps_epi32 (_mm_min_ps (_mm_max_ps (_mm_mul_ps (_mm_loadu_ps (&bus[i+4]), scale), lo), hi));
+      _mm_storeu_si128 ((__m128i *) &output[i], _mm_packs_epi32 (a, b));
+    }
+#endif
+    for (; i<n*2; i++) {
+      float x = bus[i] * 32767.0f;
+      output[i] = (short)((x >= 32767.0f) ? 32767 : ((x <= -32768.0f) ? -32768 : floor (x + 0.5f)));
+    }
+
+    if (mixer_sink == MIXER_SINK_WAV)
+      wav_bytes += (unsigned) fwrite (output, 1, n * 2 * sizeof(short), wav_fp);
+    else if (mixer_sink == MIXER_SINK_CALLBACK)
+      (*mixer_callback) (output, n, mixer_data);
+    mixer_stats.frames += n;
+  }
+  mixer_stats.voices = num_active;
+  mixer_stats.mix_time += (float)(Get_Time () - start);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mix_Voice
+|
+| Input: Called from Mixer_Update()
+| Output: Adds a block of a voice into the bus, looping or stopping
+|   it at the end of its sound.
+|___________________________________________________________________*/
+
+static void Mix_Voice (Voice *v, int num_frames)
+{
+  int i, n, done;
+  float gains[2], ramp[2];
+  unsigned long long end, left;
+  Sound *s = &sounds[v->sound];
+
+  gains[0] = v->current[0];
+  gains[1] = v->current[1];
+  ramp[0]  = (v->target[0] - gains[0]) / num_frames;
+  ramp[1]  = (v->target[1] - gains[1]) / num_frames;
+  end = (unsigned long long) s->frames << 32;
+
+  for (done=0; done<num_frames; done+=n) {
+    // Frames before the end of the sound
+    left = (end - v->position + v->step - 1) / v->step;
+    n = num_frames - done;
+    if ((unsigned long long)n > left)
+      n = (int) left;
+    Mix_Run (v, s, &bus[done * 2], n, gains, ramp);
+    if (v->position >= end) {
+      if (!s->loop) {
+        Mixer_Stop (HANDLE_OF (v - voices, v->generation));
+        return;
+      }
+      while (v->position >= end)
+        v->position -= end;
+    }
+  }
+  for (i=0; i<2; i++)
+    v->current[i] = v->target[i];
+}
+
+/*____________________________________________________________________
+|
+| Function: Mix_Run
+|
+| Input: Called from Mix_Voice()
+| Output: Resamples frames of a voice (all before the end of its
+|   sound) and adds them into the bus with ramped gains.  Advances the
+|   position and gains.
+|___________________________________________________________________*/
+
+static void Mix_Run (Voice *v, Sound *s, float *bus, int num_frames, float *gains, const float *ramp)
+{
+  int i;
+  float t, y, l, r, gl, gr;
+  const float *p, *d = s->data;
+  unsigned long long pos = v->position, step = v->step;
+  bool direct = (step == ((unsigned long long) 1 << 32)) && ((pos & 0xFFFFFFFF) == 0);
+
+  gl = gains[0];
+  gr = gains[1];
+  i = 0;
+#ifdef MIXER_SSE2
+  __m128 xm1, x0, x1, x2, tt, yl, yr, vgl, vgr, dgl, dgr, a, b, c, e, scale;
+  __m128i frac, frac_step;
+  const float *p0, *p1, *p2, *p3;
+
+  vgl   = _mm_setr_ps (gl, gl + ramp[0], gl + 2 * ramp[0], gl + 3 * ramp[0]);
+  vgr   = _mm_setr_ps (gr, gr + ramp[1], gr + 2 * ramp[1], gr + 3 * ramp[1]);
+  dgl   = _mm_set1_ps (4 * ramp[0]);
+  dgr   = _mm_set1_ps (4 * ramp[1]);
+  // Fractions of 4 positions, the low 32 bits wrap the same as the whole position
+  frac      = _mm_setr_epi32 ((int) pos, (int)(pos + step), (int)(pos + 2 * step), (int)(pos + 3 * step));
+  frac_step = _mm_set1_epi32 ((int)(4 * step));
+  scale     = _mm_set1_ps (1.0f / (1 << 24));
+
+  for (; i+4<=num_frames; i+=4) {
+    if (direct) {
+      // At the output rate, no resampling
+      p0 = d + (pos >> 32) * s->channels;
+      if (s->channels == 1)
+        yl = yr = _mm_loadu_ps (p0);
+      else {
+        a  = _mm_loadu_ps (p0);       // l0 r0 l1 r1
+        b  = _mm_loadu_ps (p0 + 4);   // l2 r2 l3 r3
+        yl = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+        yr = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+      }
+      pos += (unsigned long long) 4 << 32;
+    }
+    else {
+      p0 = d + (pos >> 32) * s->channels;
+      p1 = d + ((pos + step) >> 32) * s->channels;
+      p2 = d + ((pos + 2 * step) >> 32) * s->channels;
+      p3 = d + ((pos + 3 * step) >> 32) * s->channels;
+      pos += 4 * step;
+      tt = _mm_mul_ps (_mm_cvtepi32_ps (_mm_srli_epi32 (frac, 8)), scale);
+      frac = _mm_add_epi32 (frac, frac_step);
+      if (s->channels == 1) {
+        // The 4 samples around each position, then one register per sample
+        xm1 = _mm_loadu_ps (p0 - 1);
+        x0  = _mm_loadu_ps (p1 - 1);
+        x1  = _mm_loadu_ps (p2 - 1);
+        x2  = _mm_loadu_ps (p3 - 1);
+        _MM_TRANSPOSE4_PS (xm1, x0, x1, x2);
+        yl = yr = CUBIC4 (xm1, x0, x1, x2, tt);
+      }
+      else {
+        // lm1 rm1 l0 r0, l1 r1 l2 r2 of each position to lm1 l0 l1 l2 and rm1 r0 r1 r2
+        a   = _mm_loadu_ps (p0 - 2);  b = _mm_loadu_ps (p0 + 2);
+        xm1 = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+        c   = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+        a   = _mm_loadu_ps (p1 - 2);  b = _mm_loadu_ps (p1 + 2);
+        x0  = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+        e   = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+        a   = _mm_loadu_ps (p2 - 2);  b = _mm_loadu_ps (p2 + 2);
+        x1  = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+        yr  = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+        a   = _mm_loadu_ps (p3 - 2);  b = _mm_loadu_ps (p3 + 2);
+        x2  = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+        b   = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+        _MM_TRANSPOSE4_PS (xm1, x0, x1, x2);
+        yl = CUBIC4 (xm1, x0, x1, x2, tt);
+        _MM_TRANSPOSE4_PS (c, e, yr, b);
+        yr = CUBIC4 (c, e, yr, b, tt);
+      }
+    }
+    // Scale and add to the bus, l0 r0 l1 r1, l2 r2 l3 r3
+    yl = _mm_mul_ps (yl, vgl);
+    yr = _mm_mul_ps (yr, vgr);
+    _mm_storeu_ps (&bus[i*2],   _mm_add_ps (_mm_loadu_ps (&bus[i*2]),   _mm_unpacklo_ps (yl, yr)));
+    _mm_storeu_ps (&bus[i*2+4], _mm_add_ps (_mm_loadu_ps (&bus[i*2+4]), _mm_unpackhi_ps (yl, yr)));
+    vgl = _mm_add_ps (vgl, dgl);
+    vgr = _mm_add_ps (vgr, dgr);
+  }
+  gl += i * ramp[0];
+  gr += i * ramp[1];
+#endif
+
+  // The rest one at a time
+  for (; i<num_frames; i++) {
+    p = d + (pos >> 32) * s->channels;
+    t = (float)(int)((pos & 0xFFFFFFFF) >> 8) * (1.0f / (1 << 24));
+    if (s->channels == 1) {
+      y = CUBIC (p[-1], p[0], p[1], p[2], t);
+      l = r = y;
+    }
+    else {
+      l = CUBIC (p[-2], p[0], p[2], p[4], t);
+      r = CUBIC (p[-1], p[1], p[3], p[5], t);
+    }
+    bus[i*2]   += l * gl;
+    bus[i*2+1] += r * gr;
+    gl += ramp[0];
+    gr += ramp[1];
+    pos += step;
+  }
+
+  v->position = pos;
+  gains[0] = gl;
+  gains[1] = gr;
+}
+
+/*____________________________________________________________________
+|
+| Function: Write_Wav_Header
+|
+| Input: Called from Mixer_Init(), Mixer_Free()
+| Output: Writes the header of the wave file sink (16-bit stereo) at
+|   the start of the file.
+|___________________________________________________________________*/
+
+static void Write_Wav_Header (unsigned data_bytes)
+{
+  int i;
+  unsigned char header[44];
+  unsigned values[] = { 36 + data_bytes, 16, 1 | (2 << 16), (unsigned) mixer_rate, (unsigned) mixer_rate * 4, 4 | (16 << 16), data_bytes };
+  int offsets[] = { 4, 16, 20, 24, 28, 32, 40 };
+
+  memcpy (header,    "RIFF", 4);
+  memcpy (header+8,  "WAVEfmt ", 8);
+  memcpy (header+36, "data", 4);
+  // Little endian
+  for (i=0; i<7; i++) {
+    header[offsets[i]]   = (unsigned char) values[i];
+    header[offsets[i]+1] = (unsigned char)(values[i] >> 8);
+    header[offsets[i]+2] = (unsigned char)(values[i] >> 16);
+    header[offsets[i]+3] = (unsigned char)(values[i] >> 24);
+  }
+  fseek (wav_fp, 0, SEEK_SET);
+  fwrite (header, 1, sizeof(header), wav_fp);
+  fseek (wav_fp, 0, SEEK_END);
+}
+
+/*____________________________________________________________________
+|
+| Function: Mixer_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.
+|___________________________________________________________________*/
+
+void Mixer_Get_Stats (MixerStats *stats)
+{
+  *stats = mixer_stats;
+  stats->voices = num_active;
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Decode_Sound(), Mixer_Update()
+| Output: Returns a time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
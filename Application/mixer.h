@@ -0,0 +1,79 @@
+/*____________________________________________________________________
+|
+| File: mixer.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define MIXER_MAX_VOICES     256
+#define MIXER_MAX_SOUNDS     256
+#define MIXER_BLOCK_FRAMES   256   // frames mixed at once, gain changes are ramped over a block
+#define MIXER_DECODED_BYTES  (8 * 1024 * 1024)   // decoded copies of ADPCM sounds kept past this only while playing
+
+// Where mixed audio goes (always 16-bit stereo)
+#define MIXER_SINK_NULL      0     // dropped, for timing
+#define MIXER_SINK_WAV       1     // written to a wave file
+#define MIXER_SINK_CALLBACK  2     // passed to a function
+
+typedef unsigned MixerSound;       // 0 = none
+typedef unsigned MixerVoice;       // 0 = none
+
+typedef void (*MixerCallback) (const short *samples, int num_frames, void *data);
+
+typedef struct {
+  int      voices;                 // playing
+  int      sounds;                 // loaded
+  unsigned sound_bytes;            // memory used by loaded sounds (ADPCM ones coded)
+  unsigned decoded_bytes;          // memory used by decoded copies of ADPCM sounds
+  int      decodes;                // ADPCM sounds decoded
+  float    decode_time;            // milliseconds decoding
+  unsigned frames;                 // mixed
+  float    mix_time;               // milliseconds in Mixer_Update()
+} MixerStats;
+
+// Starts mixing at rate frames per second to a sink (wav_file for MIXER_SINK_WAV, callback and data for MIXER_SINK_CALLBACK),
+//   returns true on success
+bool Mixer_Init (int rate, int sink, const char *wav_file, MixerCallback callback, void *data);
+
+// Stops all voices, frees all sounds and closes the sink
+void Mixer_Free ();
+
+// Loads a wave file (8 or 16-bit PCM, mono or stereo, any rate), kept as IMA ADPCM if compress is true, returns 0 on error
+MixerSound Mixer_Load_Sound (const char *filename, bool loop, bool compress);
+
+// Makes a sound from 16-bit samples (channels interleaved, 1 or 2 channels), returns 0 on error
+MixerSound Mixer_Create_Sound (const short *samples, int num_frames, int channels, int rate, bool loop);
+
+// The same kept as IMA ADPCM, decoded when it starts playing (one copy for all voices playing it)
+MixerSound Mixer_Create_Sound_ADPCM (const short *samples, int num_frames, int channels, int rate, bool loop);
+
+// Stops any voices playing a sound and frees it
+void Mixer_Free_Sound (MixerSound sound);
+
+// Gets the length in frames, rate and looping of a sound, returns false if it isn't loaded
+bool Mixer_Get_Sound_Info (MixerSound sound, int *frames, int *rate, bool *loop);
+
+// Starts a voice playing a sound, gain is 0-1 and more, pan is -1 (left) to 1 (right), returns 0 if no voice is free
+MixerVoice Mixer_Play (MixerSound sound, float gain, float pan);
+
+// Starts a voice start_frame frames into a sound, fading in over a block so it doesn't click, returns 0 if no voice is free
+MixerVoice Mixer_Play_From (MixerSound sound, float gain, float pan, float pitch, double start_frame);
+
+// Changes a playing voice, pitch 1 = normal (2 = an octave up)
+void Mixer_Set_Voice (MixerVoice voice, float gain, float pan, float pitch);
+
+// Stops a voice
+void Mixer_Stop (MixerVoice voice);
+
+// Returns true if a voice is still playing
+bool Mixer_Is_Playing (MixerVoice voice);
+
+// Returns how many frames into its sound a voice is (not whole at other rates and pitches), or -1 if it has stopped
+double Mixer_Get_Position (MixerVoice voice);
+
+// Mixes num_frames frames and sends them to the sink, call from one thread only (as are the other functions)
+void Mixer_Update (int num_frames);
+
+// Gets counts and times
+void Mixer_Get_Stats (MixerStats *stats);
@@ -0,0 +1,253 @@
+/*____________________________________________________________________
+|
+| File: music.cpp
+|
+| Description: Plays music streamed from a wave file (wavstream.cpp)
+|   instead of loading the whole file into a sound buffer.
+|
+|   A thread keeps MUSIC_BUFFERS small buffers queued on the sound
+|   device (waveOut).  Each time the device is done with one, it is
+|   filled again from the stream's ring and queued again.  Reading the
+|   file is left to the stream's refilling thread, so this thread only
+|   copies and never waits for the disk.
+|
+| Functions: Music_Play
+|            Music_Set_Volume
+|            Music_Is_Playing
+|            Music_Stop
+|             Music_Thread
+|             Fill_Buffer
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <mmsystem.h>
+#include <process.h>
+
+#include "dp.h"
+
+#include "wavstream.h"
+#include "music.h"
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static unsigned __stdcall Music_Thread (void *params);
+static bool Fill_Buffer (WAVEHDR *header);
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static bool          playing = false;
+static volatile bool finished;
+static volatile int  music_volume;    // 0-256
+static WavStream     music_stream;
+static WavFormat     music_format;
+static HWAVEOUT      device;
+static HANDLE        music_thread;
+static HANDLE        done_event;      // set by the device when a buffer is played
+static HANDLE        stop_event;
+static WAVEHDR       headers [MUSIC_BUFFERS];
+static short        *buffer;
+static int           buffer_frames;
+
+/*____________________________________________________________________
+|
+| Function: Music_Play
+|
+| Input: Called from Program_Run()
+| Output: Starts streaming a wave file to the sound device, stopping
+|   any music playing.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+bool Music_Play (const char *filename, bool loop, int volume)
+{
+  int i;
+  WAVEFORMATEX wfx;
+
+  Music_Stop ();
+
+  music_stream = Wav_Stream_Open (filename, MUSIC_READ_AHEAD_MS, loop, &music_format);
+  if (music_stream == 0)
+    return (FALSE);
+
+  memset (&wfx, 0, sizeof(wfx));
+  wfx.wFormatTag      = WAVE_FORMAT_PCM;
+  wfx.nChannels       = music_format.channels;
+  wfx.nSamplesPerSec  = music_format.rate;
+  wfx.wBitsPerSample  = 16;
+  wfx.nBlockAlign     = music_format.channels * 2;
+  wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
+
+  done_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  stop_event = CreateEvent (NULL, TRUE, FALSE, NULL);
+  if (waveOutOpen (&device, WAVE_MAPPER, &wfx, (DWORD_PTR)done_event, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+    CloseHandle (done_event);
+    CloseHandle (stop_event);
+    Wav_Stream_Close (music_stream);
+    return (FALSE);
+  }
+
+  buffer_frames = music_format.rate * MUSIC_BUFFER_MS / 1000;
+  buffer = (short *) malloc (MUSIC_BUFFERS * buffer_frames * music_format.channels * sizeof(short));
+  for (i=0; i<MUSIC_BUFFERS; i++) {
+    memset (&headers[i], 0, sizeof(WAVEHDR));
+    headers[i].lpData         = (LPSTR)(buffer + i * buffer_frames * music_format.channels);
+    headers[i].dwBufferLength = buffer_frames * music_format.channels * sizeof(short);
+    waveOutPrepareHeader (device, &headers[i], sizeof(WAVEHDR));
+    // Mark as played so the thread fills it first
+    headers[i].dwFlags |= WHDR_DONE;
+  }
+
+  Music_Set_Volume (volume);
+  finished = FALSE;
+  playing = TRUE;
+  music_thread = (HANDLE) _beginthreadex (NULL, 0, Music_Thread, NULL, 0, NULL);
+
+  return (TRUE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Music_Set_Volume
+|
+| Input: Called from Program_Run(), Music_Play()
+| Output: Changes the volume (0-100) of the music.
+|___________________________________________________________________*/
+
+void Music_Set_Volume (int volume)
+{
+  if (volume < 0)
+    volume = 0;
+  else if (volume > 100)
+    volume = 100;
+  music_volume = volume * 256 / 100;
+}
+
+/*____________________________________________________________________
+|
+| Function: Music_Is_Playing
+|
+| Input: Called from ____
+| Output: Returns true while music plays (false once music that
+|   doesn't loop has ended).
+|___________________________________________________________________*/
+
+bool Music_Is_Playing ()
+{
+  return (playing AND (NOT finished));
+}
+
+/*____________________________________________________________________
+|
+| Function: Music_Stop
+|
+| Input: Called from Program_Run(), Music_Play()
+| Output: Stops the music and frees the device.
+|___________________________________________________________________*/
+
+void Music_Stop ()
+{
+  int i;
+
+  if (NOT playing)
+    return;
+
+  SetEvent (stop_event);
+  WaitForSingleObject (music_thread, INFINITE);
+  CloseHandle (music_thread);
+
+  waveOutReset (device);
+  for (i=0; i<MUSIC_BUFFERS; i++)
+    waveOutUnprepareHeader (device, &headers[i], sizeof(WAVEHDR));
+  waveOutClose (device);
+  free (buffer);
+  CloseHandle (done_event);
+  CloseHandle (stop_event);
+  Wav_Stream_Close (music_stream);
+  playing = FALSE;
+}
+
+/*____________________________________________________________________
+|
+| Function: Music_Thread
+|
+| Input: Called from Music_Play() through _beginthreadex()
+| Output: Queues buffers on the device as it plays them, until stopped
+|   or the music ends.
+|___________________________________________________________________*/
+
+static unsigned __stdcall Music_Thread (void *params)
+{
+  int i, queued;
+  bool ended;
+  HANDLE events[2];
+
+  events[0] = stop_event;
+  events[1] = done_event;
+  ended = FALSE;
+
+  for (;;) {
+    queued = 0;
+    for (i=0; i<MUSIC_BUFFERS; i++) {
+      if ((headers[i].dwFlags & WHDR_DONE) AND (NOT ended)) {
+        if (Fill_Buffer (&headers[i]))
+          waveOutWrite (device, &headers[i], sizeof(WAVEHDR));
+        else
+          ended = TRUE;
+      }
+      if (NOT (headers[i].dwFlags & WHDR_DONE))
+        queued++;
+    }
+    // Stream ended and the device played everything
+    if (ended AND (queued == 0)) {
+      finished = TRUE;
+      break;
+    }
+    if (WaitForMultipleObjects (2, events, FALSE, INFINITE) == WAIT_OBJECT_0)
+      break;
+  }
+
+  return (0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Fill_Buffer
+|
+| Input: Called from Music_Thread()
+| Output: Fills a device buffer from the stream at the current volume,
+|   with silence where the stream's ring ran dry.  Returns false if
+|   the stream has ended.
+|___________________________________________________________________*/
+
+static bool Fill_Buffer (WAVEHDR *header)
+{
+  int i, n, volume;
+  short *samples = (short *) header->lpData;
+
+  n = Wav_Stream_Read (music_stream, samples, buffer_frames);
+  if (n == -1)
+    return (FALSE);
+
+  n *= music_format.channels;
+  volume = music_volume;
+  if (volume != 256)
+    for (i=0; i<n; i++)
+      samples[i] = (short)((samples[i] * volume) >> 8);
+  memset (samples + n, 0, (buffer_frames * music_format.channels - n) * sizeof(short));
+  header->dwFlags &= ~WHDR_DONE;
+
+  return (TRUE);
+}
@@ -0,0 +1,23 @@
+/*____________________________________________________________________
+|
+| File: music.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define MUSIC_READ_AHEAD_MS  300   // audio read from the file ahead of the device
+#define MUSIC_BUFFERS        3     // device buffers
+#define MUSIC_BUFFER_MS      40
+
+// Starts streaming a wave file to the sound device, volume is 0-100, returns true on success
+bool Music_Play (const char *filename, bool loop, int volume);
+
+// Changes the volume (0-100)
+void Music_Set_Volume (int volume);
+
+// Returns true while music plays
+bool Music_Is_Playing ();
+
+// Stops the music
+void Music_Stop ();
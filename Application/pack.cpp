@@ -0,0 +1,726 @@
+/*____________________________________________________________________
+|
+| File: pack.cpp
+|
+| Description: Pack files.  Every asset file is put into one file
+|   that is opened and mapped once.  Entries start on 4K boundaries so
+|   an uncompressed entry can be used in place from the mapping.
+|
+|   Paths are found by a 64-bit hash of the path in lower case with '/'
+|   separators, so "Objects\\Images\\tree.bmp" and
+|   "objects/images/tree.bmp" are the same file.  The table of contents
+|   is sorted by hash and a bucket table gives the first entry for the
+|   top bits of a hash, so a lookup reads about one entry.  The path is
+|   stored too, to be sure of a match.
+|
+|   Entries can be compressed as LZ4 blocks (the LZ4 block format,
+|   written here so there is no library to add).  An entry is only
+|   stored compressed if that saves at least 1/8 of it.
+|
+|   Only uses the C library and filemap.cpp so it can be built into
+|   tools as well as the game.
+|
+| Functions: Pack_Build
+|             Add_Files
+|             Compare_Entries
+|             Lz4_Compress
+|             Write_Length
+|            Pack_Open
+|            Pack_Close
+|            Pack_Get_Info
+|             Find_Entry
+|             Path_Hash
+|            Pack_Map
+|            Pack_Read
+|             Lz4_Decompress
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "filemap.h"
+#include "pack.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define PACK_MAX_PATH     260
+#define MAX_BUCKET_BITS   16
+
+#define LZ4_HASH_BITS     12
+#define LZ4_MIN_MATCH     4
+#define LZ4_MAX_OFFSET    65535
+#define LZ4_LAST_LITERALS 5    // a block always ends with this many literals
+#define LZ4_MATCH_LIMIT   12   // no match starts within this many bytes of the end
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef unsigned char byte_t;
+
+// Files found by Pack_Build()
+typedef struct {
+  int        num, max;
+  PackEntry *entries;
+  char     **paths;     // relative, as found
+} FileList;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static bool Add_Files (const char *dir, const char *rel, FileList *list);
+static int Compare_Entries (const void *a, const void *b);
+static unsigned Lz4_Compress (const byte_t *src, unsigned size, byte_t *dst, unsigned max_size);
+static byte_t *Write_Length (byte_t *dst, unsigned length);
+static const PackEntry *Find_Entry (const char *path);
+static unsigned long long Path_Hash (const char *path, char *normalized);
+static bool Lz4_Decompress (const byte_t *src, unsigned src_size, byte_t *dst, unsigned size);
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static const byte_t     *pack_data = NULL;
+static unsigned          pack_size;
+static const PackHeader *pack_header;
+static const PackEntry  *pack_toc;
+static const unsigned   *pack_buckets;
+static const char       *pack_names;
+
+// Paths of the entries being sorted by Pack_Build()
+static char            **sort_paths;
+
+/*____________________________________________________________________
+|
+| Function: Pack_Build
+|
+| Input: Called from ____
+| Output: Packs every file under a directory into a pack file.  Returns
+|   # of files packed, or -1 on any error.
+|___________________________________________________________________*/
+
+int Pack_Build (const char *dir, const char *pack_file, bool compress)
+{
+  int i, n, num_buckets, bucket;
+  unsigned size, stored_size, names_size, offset, pad;
+  char path[PACK_MAX_PATH * 2], normalized[PACK_MAX_PATH];
+  unsigned long long write_time;
+  const byte_t *data;
+  byte_t *packed, zeros[PACK_ALIGN];
+  bool ok;
+  FileList list;
+  PackHeader header;
+  PackEntry *sorted;
+  unsigned *buckets;
+  FILE *fp;
+
+  memset (&list, 0, sizeof(list));
+  ok = Add_Files (dir, "", &list);
+
+  // Sort by hash (paths move with their entries), two paths with one hash can't be told apart
+  sorted  = NULL;
+  buckets = NULL;
+  if (ok && list.num) {
+    for (i=0; i<list.num; i++)
+      list.entries[i].name = i;
+    sort_paths = list.paths;
+    qsort (list.entries, list.num, sizeof(PackEntry), Compare_Entries);
+    for (i=1; i<list.num; i++)
+      if (list.entries[i].hash == list.entries[i-1].hash)
+        ok = false;
+  }
+
+  // Lay out the file: header, table of contents, buckets, names, data
+  memset (&header, 0, sizeof(header));
+  header.magic       = PACK_MAGIC;
+  header.version     = PACK_VERSION;
+  header.num_entries = list.num;
+  for (header.bucket_bits=0; (header.bucket_bits < MAX_BUCKET_BITS) && ((1 << header.bucket_bits) < list.num); header.bucket_bits++);
+  num_buckets = 1 << header.bucket_bits;
+  header.toc_offset    = sizeof(PackHeader);
+  header.bucket_offset = header.toc_offset + list.num * sizeof(PackEntry);
+  header.name_offset   = header.bucket_offset + (num_buckets + 1) * sizeof(unsigned);
+  names_size = 0;
+  for (i=0; i<list.num; i++)
+    names_size += (unsigned) strlen (list.paths[i]) + 1;   // same length normalized
+  offset = (header.name_offset + names_size + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1);
+
+  fp = NULL;
+  if (ok) {
+    sorted  = (PackEntry *) malloc (list.num * sizeof(PackEntry) + 1);
+    buckets = (unsigned *) malloc ((num_buckets + 1) * sizeof(unsigned));
+    fp = fopen (pack_file, "wb");
+    ok = sorted && buckets && fp && (fseek (fp, offset, SEEK_SET) == 0);
+  }
+
+  // Data of each entry
+  memset (zeros, 0, sizeof(zeros));
+  for (i=0; ok && (i<list.num); i++) {
+    sorted[i] = list.entries[i];
+    n = snprintf (path, sizeof(path), "%s/%s", dir, list.paths[list.entries[i].name]);
+    if ((n < 0) || (n >= (int)sizeof(path))) {
+      ok = false;
+      break;
+    }
+    data = (const byte_t *) File_Map (path, &size);
+    sorted[i].offset = offset;
+    sorted[i].size   = 0;
+    stored_size = 0;
+    // An empty file can't be mapped
+    if (data == NULL)
+      ok = File_Get_Info (path, &size, &write_time) && (size == 0);
+    else {
+      sorted[i].size = size;
+      stored_size = size;
+      packed = NULL;
+      if (compress) {
+        packed = (byte_t *) malloc (size);
+        if (packed) {
+          stored_size = Lz4_Compress (data, size, packed, size - size / 8);
+          if (stored_size)
+            sorted[i].flags = PACK_LZ4;
+          else
+            stored_size = size;
+        }
+      }
+      ok = (fwrite ((sorted[i].flags & PACK_LZ4) ? packed : data, stored_size, 1, fp) == 1);
+      if (packed)
+        free (packed);
+      File_Unmap (data, size);
+    }
+    sorted[i].stored_size = stored_size;
+    // Next entry on a 4K boundary
+    offset += stored_size;
+    pad = ((offset + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1)) - offset;
+    if (ok && pad && (i < list.num-1)) {
+      ok = (fwrite (zeros, pad, 1, fp) == 1);
+      offset += pad;
+    }
+  }
+  header.file_size = offset;
+
+  // Table of contents, buckets and names
+  if (ok) {
+    bucket = 0;
+    for (i=0; i<list.num; i++)
+      while (bucket <= (int)(header.bucket_bits ? sorted[i].hash >> (64 - header.bucket_bits) : 0))
+        buckets[bucket++] = i;
+    while (bucket <= num_buckets)
+      buckets[bucket++] = list.num;
+    ok = (fseek (fp, 0, SEEK_SET) == 0) &&
+         (fwrite (&header, sizeof(header), 1, fp) == 1) &&
+         ((list.num == 0) || (fwrite (sorted, list.num * sizeof(PackEntry), 1, fp) == 1)) &&
+         (fwrite (buckets, (num_buckets + 1) * sizeof(unsigned), 1, fp) == 1);
+    // Names in entry order, each entry points at its own
+    offset = 0;
+    for (i=0; ok && (i<list.num); i++) {
+      Path_Hash (list.paths[sorted[i].name], normalized);
+      size = (unsigned) strlen (normalized) + 1;
+      ok = (fwrite (normalized, size, 1, fp) == 1);
+      sorted[i].name = offset;
+      offset += size;
+    }
+    // Again with name offsets
+    ok = ok && (fseek (fp, header.toc_offset, SEEK_SET) == 0) &&
+         ((list.num == 0) || (fwrite (sorted, list.num * sizeof(PackEntry), 1, fp) == 1));
+  }
+  if (fp) {
+    if (fclose (fp) != 0)
+      ok = false;
+    if (!ok)
+      remove (pack_file);
+  }
+
+  for (i=0; i<list.num; i++)
+    free (list.paths[i]);
+  if (list.paths)
+    free (list.paths);
+  if (list.entries)
+    free (list.entries);
+  if (sorted)
+    free (sorted);
+  if (buckets)
+    free (buckets);
+
+  return (ok ? list.num : -1);
+}
+
+/*____________________________________________________________________
+|
+| Function: Add_Files
+|
+| Input: Called from Pack_Build(), Add_Files()
+| Output: Adds the files in a directory and its subdirectories to a
+|   list, skipping names that start with '.'.  Returns true on success,
+|   else false (a path too long is an error).
+|___________________________________________________________________*/
+
+static bool Add_Files (const char *dir, const char *rel, FileList *list)
+{
+  char path[PACK_MAX_PATH * 2], sub[PACK_MAX_PATH], normalized[PACK_MAX_PATH];
+  const char *name;
+  int n;
+  bool ok, is_dir;
+
+  ok = true;
+#ifdef _WIN32
+  HANDLE find;
+  WIN32_FIND_DATAA data;
+
+  n = snprintf (path, sizeof(path), "%s/%s*", dir, rel);
+  if ((n < 0) || (n >= (int)sizeof(path)))
+    return (false);
+  find = FindFirstFileA (path, &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return (true);
+  do {
+    name   = data.cFileName;
+    is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+  DIR *d;
+  struct dirent *e;
+  struct stat info;
+
+  n = snprintf (path, sizeof(path), "%s/%s", dir, rel);
+  if ((n < 0) || (n >= (int)sizeof(path)))
+    return (false);
+  d = opendir (path);
+  if (d == NULL)
+    return (true);
+  while (ok && ((e = readdir (d)) != NULL)) {
+    name = e->d_name;
+    n = snprintf (path, sizeof(path), "%s/%s%s", dir, rel, name);
+    if ((n < 0) || (n >= (int)sizeof(path))) {
+      ok = false;
+      break;
+    }
+    is_dir = (stat (path, &info) == 0) && S_ISDIR (info.st_mode);
+#endif
+    if (name[0] != '.') {
+      // Room for a '/' after a directory
+      n = snprintf (sub, sizeof(sub) - 1, "%s%s", rel, name);
+      if ((n < 0) || (n >= (int)sizeof(sub) - 1)) {
+        ok = false;
+        break;
+      }
+      if (is_dir) {
+        strcat (sub, "/");
+        ok = Add_Files (dir, sub, list);
+      }
+      else {
+        if (list->num == list->max) {
+          list->max     = list->max ? list->max * 2 : 64;
+          list->entries = (PackEntry *) realloc (list->entries, list->max * sizeof(PackEntry));
+          list->paths   = (char **) realloc (list->paths, list->max * sizeof(char *));
+          ok = list->entries && list->paths;
+        }
+        if (ok) {
+          memset (&list->entries[list->num], 0, sizeof(PackEntry));
+          list->entries[list->num].hash = Path_Hash (sub, normalized);
+          list->paths[list->num] = (char *) malloc (strlen (sub) + 1);
+          ok = (list->paths[list->num] != NULL);
+          if (ok)
+            strcpy (list->paths[list->num++], sub);
+        }
+      }
+    }
+#ifdef _WIN32
+  } while (ok && FindNextFileA (find, &data));
+  FindClose (find);
+#else
+  }
+  closedir (d);
+#endif
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Compare_Entries
+|
+| Input: Called from Pack_Build() through qsort()
+| Output: Orders entries by hash, then path.
+|___________________________________________________________________*/
+
+static int Compare_Entries (const void *a, const void *b)
+{
+  const PackEntry *ea = (const PackEntry *) a;
+  const PackEntry *eb = (const PackEntry *) b;
+
+  if (ea->hash != eb->hash)
+    return ((ea->hash < eb->hash) ? -1 : 1);
+
+  return (strcmp (sort_paths[ea->name], sort_paths[eb->name]));
+}
+
+/*____________________________________________________________________
+|
+| Function: Lz4_Compress
+|
+| Input: Called from Pack_Build()
+| Output: Compresses data into an LZ4 block, taking the first match a
+|   hash of the next 4 bytes finds.  Returns the compressed size, or 0
+|   if it would not fit in max_size.
+|___________________________________________________________________*/
+
+static unsigned Lz4_Compress (const byte_t *src, unsigned size, byte_t *dst, unsigned max_size)
+{
+  int table[1 << LZ4_HASH_BITS];
+  unsigned ip, anchor, ref, length, literals, h, v;
+  byte_t *op, *token, *end;
+
+  op  = dst;
+  end = dst + max_size;
+  memset (table, -1, sizeof(table));
+
+  ip = 0;
+  anchor = 0;
+  while (size > LZ4_MATCH_LIMIT && ip < size - LZ4_MATCH_LIMIT) {
+    memcpy (&v, src + ip, 4);
+    h = (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+    ref = (unsigned) table[h];
+    table[h] = (int) ip;
+    if ((ref == 0xFFFFFFFF) || (ip - ref > LZ4_MAX_OFFSET) || memcmp (src + ref, src + ip, 4)) {
+      ip++;
+      continue;
+    }
+
+    // Match, as long as it can go and still leave the last literals
+    length = LZ4_MIN_MATCH;
+    while ((ip + length < size - LZ4_LAST_LITERALS) && (src[ref + length] == src[ip + length]))
+      length++;
+
+    // Token, literals, offset, match length
+    literals = ip - anchor;
+    if (op + 1 + literals + literals / 255 + 2 + (length - LZ4_MIN_MATCH) / 255 + 1 > end)
+      return (0);
+    token = op++;
+    *token = (byte_t)(((literals >= 15) ? 15 : literals) << 4);
+    if (literals >= 15)
+      op = Write_Length (op, literals - 15);
+    memcpy (op, src + anchor, literals);
+    op += literals;
+    *op++ = (byte_t)(ip - ref);
+    *op++ = (byte_t)((ip - ref) >> 8);
+    *token |= (byte_t)((length - LZ4_MIN_MATCH >= 15) ? 15 : length - LZ4_MIN_MATCH);
+    if (length - LZ4_MIN_MATCH >= 15)
+      op = Write_Length (op, length - LZ4_MIN_MATCH - 15);
+
+    ip += length;
+    anchor = ip;
+  }
+
+  // Last literals
+  literals = size - anchor;
+  if (op + 1 + literals + literals / 255 + 1 > end)
+    return (0);
+  token = op++;
+  *token = (byte_t)(((literals >= 15) ? 15 : literals) << 4);
+  if (literals >= 15)
+    op = Write_Length (op, literals - 15);
+  memcpy (op, src + anchor, literals);
+  op += literals;
+
+  return ((unsigned)(op - dst));
+}
+
+/*____________________________________________________________________
+|
+| Function: Write_Length
+|
+| Input: Called from Lz4_Compress()
+| Output: Writes the rest of a length over 15 as 255s and a last byte.
+|   Returns the next output byte.
+|___________________________________________________________________*/
+
+static byte_t *Write_Length (byte_t *dst, unsigned length)
+{
+  while (length >= 255) {
+    *dst++ = 255;
+    length -= 255;
+  }
+  *dst++ = (byte_t) length;
+
+  return (dst);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pack_Open
+|
+| Input: Called from ____
+| Output: Opens and maps a pack file, closing any open one.  Returns true
+|   on success, else false.
+|___________________________________________________________________*/
+
+bool Pack_Open (const char *pack_file)
+{
+  const PackHeader *header;
+  unsigned num_buckets;
+
+  Pack_Close ();
+
+  pack_data = (const byte_t *) File_Map (pack_file, &pack_size);
+  if (pack_data == NULL)
+    return (false);
+
+  header = (const PackHeader *) pack_data;
+  num_buckets = 0;
+  if ((pack_size >= sizeof(PackHeader)) && (header->bucket_bits <= MAX_BUCKET_BITS))
+    num_buckets = 1 << header->bucket_bits;
+  if ((num_buckets == 0) ||
+      (header->magic != PACK_MAGIC) ||
+      (header->version != PACK_VERSION) ||
+      (header->file_size != pack_size) ||
+      (header->toc_offset + (unsigned long long)header->num_entries * sizeof(PackEntry) > pack_size) ||
+      (header->bucket_offset + (unsigned long long)(num_buckets + 1) * sizeof(unsigned) > pack_size) ||
+      (header->name_offset > pack_size)) {
+    Pack_Close ();
+    return (false);
+  }
+
+  pack_header  = header;
+  pack_toc     = (const PackEntry *) (pack_data + header->toc_offset);
+  pack_buckets = (const unsigned *) (pack_data + header->bucket_offset);
+  pack_names   = (const char *) (pack_data + header->name_offset);
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pack_Close
+|
+| Input: Called from Pack_Open(), ____
+| Output: Unmaps the pack file.
+|___________________________________________________________________*/
+
+void Pack_Close ()
+{
+  if (pack_data) {
+    File_Unmap (pack_data, pack_size);
+    pack_data = NULL;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Pack_Get_Info
+|
+| Input: Called from ____
+| Output: Gets the uncompressed size of a file in the pack.  Returns
+|   true if the file is in the pack, else false.
+|___________________________________________________________________*/
+
+bool Pack_Get_Info (const char *path, unsigned *size)
+{
+  const PackEntry *entry;
+
+  entry = Find_Entry (path);
+  if (entry == NULL)
+    return (false);
+  *size = entry->size;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Find_Entry
+|
+| Input: Called from Pack_Get_Info(), Pack_Map(), Pack_Read()
+| Output: Returns the entry of a path, or NULL if it is not in the pack,
+|   its data is not all in the file or it is uncompressed with a stored
+|   size other than its size.
+|___________________________________________________________________*/
+
+static const PackEntry *Find_Entry (const char *path)
+{
+  unsigned i, first, last, bucket;
+  unsigned long long hash;
+  char normalized[PACK_MAX_PATH];
+  const PackEntry *entry;
+
+  if ((pack_data == NULL) || (strlen (path) >= PACK_MAX_PATH))
+    return (NULL);
+
+  hash   = Path_Hash (path, normalized);
+  bucket = pack_header->bucket_bits ? (unsigned)(hash >> (64 - pack_header->bucket_bits)) : 0;
+  first  = pack_buckets[bucket];
+  last   = pack_buckets[bucket+1];
+  if (last > pack_header->num_entries)
+    return (NULL);
+
+  for (i=first; i<last; i++) {
+    entry = &pack_toc[i];
+    if (entry->hash == hash) {
+      if ((entry->name >= pack_size - pack_header->name_offset) ||
+          strncmp (pack_names + entry->name, normalized, pack_size - pack_header->name_offset - entry->name) ||
+          (entry->offset > pack_size) ||
+          (entry->stored_size > pack_size - entry->offset) ||
+          (!(entry->flags & PACK_LZ4) && (entry->stored_size != entry->size)))
+        return (NULL);
+      return (entry);
+    }
+  }
+
+  return (NULL);
+}
+
+/*____________________________________________________________________
+|
+| Function: Path_Hash
+|
+| Input: Called from Add_Files(), Find_Entry()
+| Output: Gets a path in lower case with '/' separators and without a
+|   leading "./", and returns its hash.
+|___________________________________________________________________*/
+
+static unsigned long long Path_Hash (const char *path, char *normalized)
+{
+  int i;
+
+  while ((path[0] == '.') && ((path[1] == '/') || (path[1] == '\\')))
+    path += 2;
+  for (i=0; path[i] && (i < PACK_MAX_PATH-1); i++)
+    normalized[i] = (path[i] == '\\') ? '/' : (char) tolower ((unsigned char)path[i]);
+  normalized[i] = 0;
+
+  return (File_Hash (normalized, i));
+}
+
+/*____________________________________________________________________
+|
+| Function: Pack_Map
+|
+| Input: Called from ____
+| Output: Returns the data of an uncompressed file in the pack, used in
+|   place.  Returns NULL if the file is not in the pack or compressed.
+|___________________________________________________________________*/
+
+const void *Pack_Map (const char *path, unsigned *size)
+{
+  const PackEntry *entry;
+
+  entry = Find_Entry (path);
+  if ((entry == NULL) || (entry->flags & PACK_LZ4))
+    return (NULL);
+  *size = entry->size;
+
+  return (pack_data + entry->offset);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pack_Read
+|
+| Input: Called from ____
+| Output: Reads a file in the pack into a buffer, decompressing it if
+|   needed.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+bool Pack_Read (const char *path, void *buffer)
+{
+  const PackEntry *entry;
+
+  entry = Find_Entry (path);
+  if (entry == NULL)
+    return (false);
+  if (entry->flags & PACK_LZ4)
+    return (Lz4_Decompress (pack_data + entry->offset, entry->stored_size, (byte_t *) buffer, entry->size));
+  memcpy (buffer, pack_data + entry->offset, entry->size);
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Lz4_Decompress
+|
+| Input: Called from Pack_Read()
+| Output: Decompresses an LZ4 block, checking every length and offset
+|   against both buffers.  Returns true if it makes exactly size bytes.
+|___________________________________________________________________*/
+
+static bool Lz4_Decompress (const byte_t *src, unsigned src_size, byte_t *dst, unsigned size)
+{
+  unsigned ip, op, token, length, offset, n;
+  byte_t b;
+
+  ip = 0;
+  op = 0;
+  while (ip < src_size) {
+    token = src[ip++];
+
+    // Literals
+    length = token >> 4;
+    if (length == 15)
+      do {
+        if (ip >= src_size)
+          return (false);
+        b = src[ip++];
+        length += b;
+      } while (b == 255);
+    if ((length > src_size - ip) || (length > size - op))
+      return (false);
+    memcpy (dst + op, src + ip, length);
+    ip += length;
+    op += length;
+    if (ip == src_size)
+      break;   // last sequence has no match
+
+    // Match
+    if (src_size - ip < 2)
+      return (false);
+    offset = src[ip] | (src[ip+1] << 8);
+    ip += 2;
+    if ((offset == 0) || (offset > op))
+      return (false);
+    length = (token & 15) + LZ4_MIN_MATCH;
+    if ((token & 15) == 15)
+      do {
+        if (ip >= src_size)
+          return (false);
+        b = src[ip++];
+        length += b;
+      } while (b == 255);
+    if (length > size - op)
+      return (false);
+    // A match can overlap what it writes (a run), then copy it in pieces of offset bytes
+    if (offset >= length) {
+      memcpy (dst + op, dst + op - offset, length);
+      op += length;
+    }
+    else
+      for (; length; length -= n, op += n) {
+        n = (length < offset) ? length : offset;
+        memcpy (dst + op, dst + op - offset, n);
+      }
+  }
+
+  return (op == size);
+}
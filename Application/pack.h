@@ -0,0 +1,54 @@
+/*____________________________________________________________________
+|
+| File: pack.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define PACK_MAGIC      0x4B434150  // "PACK"
+#define PACK_VERSION    1
+#define PACK_ALIGN      4096        // entry data alignment in bytes
+
+// Entry flags
+#define PACK_LZ4        1           // data is an LZ4 block
+
+// Pack file: header, table of contents sorted by hash, bucket table, names, then the data of each entry PACK_ALIGN aligned
+typedef struct {
+  unsigned magic;
+  unsigned version;
+  unsigned file_size;
+  unsigned num_entries;
+  unsigned toc_offset;       // bytes from the start of the file
+  unsigned bucket_offset;    // (1 << bucket_bits) + 1 first entries, by top bits of the hash
+  unsigned bucket_bits;
+  unsigned name_offset;
+} PackHeader;
+
+typedef struct {
+  unsigned long long hash;   // of the path, lower case with '/' separators
+  unsigned offset;           // of the data, bytes from the start of the file
+  unsigned stored_size;
+  unsigned size;             // uncompressed
+  unsigned name;             // offset of the path from header name_offset
+  unsigned flags;
+  unsigned reserved;
+} PackEntry;
+
+// Packs every file under a directory (paths relative to it), compressing entries that get smaller, returns # of files or -1 on error
+int Pack_Build (const char *dir, const char *pack_file, bool compress);
+
+// Opens a pack file, paths are then looked up in it, returns true on success
+bool Pack_Open (const char *pack_file);
+
+// Closes the pack file
+void Pack_Close ();
+
+// Gets the uncompressed size of a file in the pack, returns false if not found
+bool Pack_Get_Info (const char *path, unsigned *size);
+
+// Returns the data of an uncompressed file in the pack (no copy), or NULL if not found or compressed
+const void *Pack_Map (const char *path, unsigned *size);
+
+// Reads a file in the pack into a buffer of the size from Pack_Get_Info(), returns true on success
+bool Pack_Read (const char *path, void *buffer);
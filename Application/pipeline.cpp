@@ -0,0 +1,413 @@
+/*____________________________________________________________________
+|
+| File: pipeline.cpp
+|
+| Description: Runs the simulation on its own thread, a frame ahead of
+|   the render thread.
+|
+|   Each frame the sim fills a packet with everything the render needs
+|   to draw it (camera, what is visible where, lights), and the render
+|   draws from the packet only, so the two never touch the same game
+|   state.  A packet isn't changed once it's handed over.
+|
+|   There are PIPELINE_PACKETS packets: the one being drawn and the one
+|   being simulated (or finished, waiting to be drawn).  While the render
+|   draws frame N the sim works on frame N+1.  The sim doesn't start a
+|   frame until the render has taken the one before, so no simulated
+|   frame is thrown away and none is made from stale input: the packet
+|   drawn was simulated from the input of one frame before.  Input goes
+|   the other way: the render thread copies it in and the sim takes the
+|   latest copy at the start of each frame.
+|
+|   Not threaded, Pipeline_Begin_Render() simulates the frame itself,
+|   for comparing.
+|
+|   The sim thread's frame arena (arena.cpp) is reset after each frame.
+|
+|   Only uses the C library, the OS and arena.cpp.
+|
+| Functions: Pipeline_Init
+|            Pipeline_Free
+|            Pipeline_Set_Input
+|            Pipeline_Begin_Render
+|            Pipeline_End_Render
+|            Pipeline_Get_Stats
+|             Sim_Thread
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "pipeline.h"
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+#ifdef _WIN32
+static unsigned __stdcall Sim_Thread (void *params);
+#else
+static void *Sim_Thread (void *params);
+#endif
+static double Get_Time ();
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+// Each wait has one waiter, the sim waits for a packet to be taken, the render for one to be ready
+#ifdef _WIN32
+#define LOCK()         EnterCriticalSection (&packet_critsection)
+#define UNLOCK()       LeaveCriticalSection (&packet_critsection)
+#define WAIT_READY()   { UNLOCK (); WaitForSingleObject (ready_event, INFINITE); LOCK (); }
+#define WAIT_TAKEN()   { UNLOCK (); WaitForSingleObject (taken_event, INFINITE); LOCK (); }
+#define SIGNAL_READY() SetEvent (ready_event)
+#define SIGNAL_TAKEN() SetEvent (taken_event)
+#else
+#define LOCK()         pthread_mutex_lock (&packet_mutex)
+#define UNLOCK()       pthread_mutex_unlock (&packet_mutex)
+#define WAIT_READY()   pthread_cond_wait (&ready_cond, &packet_mutex)
+#define WAIT_TAKEN()   pthread_cond_wait (&taken_cond, &packet_mutex)
+#define SIGNAL_READY() pthread_cond_signal (&ready_cond)
+#define SIGNAL_TAKEN() pthread_cond_signal (&taken_cond)
+#endif
+
+#define PACKET(_i_) (packets + (size_t)(_i_) * packet_size)
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static bool             running = false;
+static bool             threaded;
+static bool             stopping;
+
+#ifdef _WIN32
+static HANDLE           sim_thread;
+static HANDLE           ready_event;         // set when a packet is ready
+static HANDLE           taken_event;         // set when the render takes the ready packet
+static CRITICAL_SECTION packet_critsection;  // guards ready, drawing, input and stats
+#else
+static pthread_t        sim_thread;
+static pthread_cond_t   ready_cond   = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   taken_cond   = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t  packet_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned char   *packets;             // PIPELINE_PACKETS packets
+static int              packet_size;
+static unsigned char   *input;               // latest input from the render thread
+static unsigned char   *sim_input;           // copy the sim thread is using
+static int              input_size;
+static int              ready;               // packet ready to draw (-1 = none)
+static int              drawing;             // packet being drawn (-1 = none)
+static PipelineSimulate simulate;
+static void            *simulate_data;
+static PipelineStats    pipeline_stats;
+
+/*____________________________________________________________________
+|
+| Function: Pipeline_Init
+|
+| Input: Called from Program_Run()
+| Output: Allocates the packets and, if threaded, starts the sim
+|   thread, which starts on the first frame right away.  Returns true
+|   on success, else false.
+|___________________________________________________________________*/
+
+bool Pipeline_Init (int packet_bytes, int input_bytes, bool threaded_sim, PipelineSimulate simulate_frame, void *data)
+{
+  if (running || (packet_bytes <= 0) || (input_bytes < 0) || (simulate_frame == NULL))
+    return (false);
+
+  packets   = (unsigned char *) calloc (PIPELINE_PACKETS, packet_bytes);
+  input     = (unsigned char *) calloc (1, input_bytes + 1);
+  sim_input = (unsigned char *) calloc (1, input_bytes + 1);
+  if ((packets == NULL) || (input == NULL) || (sim_input == NULL)) {
+    free (packets);
+    free (input);
+    free (sim_input);
+    return (false);
+  }
+  packet_size   = packet_bytes;
+  input_size    = input_bytes;
+  threaded      = threaded_sim;
+  simulate      = simulate_frame;
+  simulate_data = data;
+  ready         = -1;
+  drawing       = -1;
+  stopping      = false;
+  memset (&pipeline_stats, 0, sizeof(pipeline_stats));
+
+  if (threaded) {
+#ifdef _WIN32
+    InitializeCriticalSection (&packet_critsection);
+    ready_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+    taken_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+    sim_thread = (HANDLE) _beginthreadex (NULL, 0, Sim_Thread, NULL, 0, NULL);
+    if (sim_thread == 0) {
+      CloseHandle (taken_event);
+      CloseHandle (ready_event);
+      DeleteCriticalSection (&packet_critsection);
+#else
+    if (pthread_create (&sim_thread, NULL, Sim_Thread, NULL) != 0) {
+#endif
+      free (packets);
+      free (input);
+      free (sim_input);
+      return (false);
+    }
+  }
+  running = true;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pipeline_Free
+|
+| Input: Called from Program_Run()
+| Output: Stops the sim thread and frees the packets.  Call from the
+|   render thread.
+|___________________________________________________________________*/
+
+void Pipeline_Free ()
+{
+  if (!running)
+    return;
+
+  if (threaded) {
+    LOCK ();
+    stopping = true;
+    SIGNAL_TAKEN ();
+    SIGNAL_READY ();
+    UNLOCK ();
+#ifdef _WIN32
+    WaitForSingleObject (sim_thread, INFINITE);
+    CloseHandle (sim_thread);
+    CloseHandle (taken_event);
+    CloseHandle (ready_event);
+    DeleteCriticalSection (&packet_critsection);
+#else
+    pthread_join (sim_thread, NULL);
+#endif
+  }
+
+  free (packets);
+  free (input);
+  free (sim_input);
+  running = false;
+}
+
+/*____________________________________________________________________
+|
+| Function: Pipeline_Set_Input
+|
+| Input: Called from Program_Run()
+| Output: Copies the input the next frame simulated is made from.
+|   Input should hold totals (of mouse movement, say) rather than
+|   changes, since the sim may start a frame only every few calls.
+|___________________________________________________________________*/
+
+void Pipeline_Set_Input (const void *new_input)
+{
+  if (!running)
+    return;
+
+  if (threaded)
+    LOCK ();
+  memcpy (input, new_input, input_size);
+  if (threaded)
+    UNLOCK ();
+}
+
+/*____________________________________________________________________
+|
+| Function: Pipeline_Begin_Render
+|
+| Input: Called from Program_Run()
+| Output: Returns the newest packet, waiting for the sim to finish it
+|   if needed.  Not threaded, simulates the frame first.  Returns NULL
+|   if the pipeline isn't running.
+|___________________________________________________________________*/
+
+const void *Pipeline_Begin_Render ()
+{
+  double start;
+
+  if (!running)
+    return (NULL);
+
+  start = Get_Time ();
+
+  // Simulate the frame here
+  if (!threaded) {
+    (*simulate) (input, PACKET (0), simulate_data);
+    pipeline_stats.sim_time += Get_Time () - start;
+    pipeline_stats.frames++;
+    pipeline_stats.drawn++;
+    drawing = 0;
+    return (PACKET (0));
+  }
+
+  LOCK ();
+  while ((ready < 0) && (!stopping))
+    WAIT_READY ();
+  if (ready < 0) {
+    UNLOCK ();
+    return (NULL);
+  }
+  drawing = ready;
+  ready = -1;
+  pipeline_stats.render_wait += Get_Time () - start;
+  pipeline_stats.drawn++;
+  // The sim can publish its next packet
+  SIGNAL_TAKEN ();
+  UNLOCK ();
+
+  return (PACKET (drawing));
+}
+
+/*____________________________________________________________________
+|
+| Function: Pipeline_End_Render
+|
+| Input: Called from Program_Run()
+| Output: Frees the packet being drawn to be simulated into again.
+|___________________________________________________________________*/
+
+void Pipeline_End_Render ()
+{
+  if (!running)
+    return;
+
+  if (threaded)
+    LOCK ();
+  drawing = -1;
+  if (threaded)
+    UNLOCK ();
+}
+
+/*____________________________________________________________________
+|
+| Function: Pipeline_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.
+|___________________________________________________________________*/
+
+void Pipeline_Get_Stats (PipelineStats *stats)
+{
+  if (!running) {
+    memset (stats, 0, sizeof(PipelineStats));
+    return;
+  }
+
+  if (threaded)
+    LOCK ();
+  *stats = pipeline_stats;
+  if (threaded)
+    UNLOCK ();
+}
+
+/*____________________________________________________________________
+|
+| Function: Sim_Thread
+|
+| Input: Called from Pipeline_Init() through _beginthreadex() or
+|   pthread_create()
+| Output: Simulates frames into the packet not being drawn, starting
+|   each once the render has taken the one before, until stopped.
+|___________________________________________________________________*/
+
+#ifdef _WIN32
+static unsigned __stdcall Sim_Thread (void *params)
+#else
+static void *Sim_Thread (void *params)
+#endif
+{
+  int slot;
+  double start, end;
+
+  for (;;) {
+    LOCK ();
+    // Don't start on input older than the render's, wait for it to take the ready packet
+    start = Get_Time ();
+    while ((ready >= 0) && (!stopping))
+      WAIT_TAKEN ();
+    pipeline_stats.sim_wait += Get_Time () - start;
+    if (stopping) {
+      UNLOCK ();
+      break;
+    }
+    // The packet not being drawn
+    slot = (drawing == 0) ? 1 : 0;
+    memcpy (sim_input, input, input_size);
+    UNLOCK ();
+
+    start = Get_Time ();
+    (*simulate) (sim_input, PACKET (slot), simulate_data);
+    Arena_Reset ();
+    end = Get_Time ();
+
+    LOCK ();
+    pipeline_stats.sim_time += end - start;
+    pipeline_stats.frames++;
+    ready = slot;
+    SIGNAL_READY ();
+    UNLOCK ();
+  }
+
+#ifdef _WIN32
+  return (0);
+#else
+  return (NULL);
+#endif
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Pipeline_Begin_Render(), Sim_Thread()
+| Output: Returns the time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
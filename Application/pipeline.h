@@ -0,0 +1,39 @@
+/*____________________________________________________________________
+|
+| File: pipeline.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define PIPELINE_PACKETS 2         // frame packets: one drawn, one being simulated or ready
+
+// Fills a frame packet from the latest input, called on the sim thread (or the render thread if not threaded)
+typedef void (*PipelineSimulate) (const void *input, void *packet, void *data);
+
+typedef struct {
+  int    frames;                   // packets simulated
+  int    drawn;                    // packets drawn
+  double sim_time;                 // milliseconds simulating, in total
+  double sim_wait;                 // milliseconds the sim waited for the render to take a packet, in total
+  double render_wait;              // milliseconds the render waited for a packet, in total
+} PipelineStats;
+
+// Starts the pipeline, packets and input are copied as bytes, if threaded is false frames are simulated
+//   in Pipeline_Begin_Render(), returns true on success
+bool Pipeline_Init (int packet_bytes, int input_bytes, bool threaded, PipelineSimulate simulate, void *data);
+
+// Stops the sim thread and frees the packets
+void Pipeline_Free ();
+
+// Copies the input the next frame is simulated from
+void Pipeline_Set_Input (const void *input);
+
+// Waits for the newest packet and returns it, it doesn't change until Pipeline_End_Render(), returns NULL if stopped
+const void *Pipeline_Begin_Render ();
+
+// Gives the packet back to be simulated into again
+void Pipeline_End_Render ();
+
+// Gets counts and times
+void Pipeline_Get_Stats (PipelineStats *stats);
@@ -0,0 +1,373 @@
+/*____________________________________________________________________
+|
+| File: pool.cpp
+|
+| Description: Fixed size pools of game objects (ghosts, shots, lights,
+|   sound emitters) that are added and removed all the time, without
+|   calling malloc() for each one.
+|
+|   A pool holds up to a fixed number of items of one size.  The items
+|   are kept one after another with no holes: freeing one moves the
+|   last item into its place.  So a loop over every item is a loop over
+|   one array, and a pointer to an item only lasts until an item is
+|   freed.  Items are found by handle instead.
+|
+|   A handle is a slot index and the slot's generation.  The generation
+|   changes each time the slot's item is freed, so a handle kept after
+|   its item was freed doesn't find the item that took the slot.  Free
+|   slots are used again oldest first, which spreads the reuse over
+|   every slot, so generations wrap as late as they can.
+|
+|   Pools aren't locked, use each from one thread.  voices.cpp keeps
+|   its logical voices in one, started and stopped with every sound.
+|
+|   Only uses the C library.
+|
+| Functions: Pool_Create
+|            Pool_Destroy
+|            Pool_Alloc
+|            Pool_Free
+|            Pool_Get
+|            Pool_Is_Valid
+|            Pool_Count
+|            Pool_Items
+|            Pool_Handle_At
+|            Pool_Clear
+|            Pool_Get_Stats
+|             Slot_Of
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  unsigned generation;             // changes when the item is freed, so old handles don't work
+  int      index;                  // of the item, -1 = free
+  int      next_free;              // slot freed after this one, -1 = none
+} Slot;
+
+struct Pool {
+  unsigned char *items;            // count items, no holes
+  int           *item_slot;        // slot of each item
+  Slot          *slots;
+  int            item_size;
+  int            count;
+  int            first_free;       // freed longest ago, used next (-1 = none)
+  int            last_free;        // freed last
+  PoolStats      stats;
+};
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int Slot_Of (Pool *pool, PoolHandle handle);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define HANDLE_OF(_i_,_g_) (((_g_) << 16) | (unsigned)((_i_) + 1))
+#define ITEM(_pool_,_i_)   ((_pool_)->items + (size_t)(_i_) * (_pool_)->item_size)
+
+/*____________________________________________________________________
+|
+| Function: Pool_Create
+|
+| Input: Called from Voice_Init()
+| Output: Returns a new empty pool for up to max_items items, or NULL
+|   on error.
+|___________________________________________________________________*/
+
+Pool *Pool_Create (int item_size, int max_items)
+{
+  int i;
+  Pool *pool;
+
+  if ((item_size <= 0) || (max_items <= 0) || (max_items > POOL_MAX_ITEMS))
+    return (NULL);
+
+  pool = (Pool *) calloc (1, sizeof(Pool));
+  if (pool == NULL)
+    return (NULL);
+  pool->items     = (unsigned char *) malloc ((size_t)max_items * item_size);
+  pool->item_slot = (int *) malloc (max_items * sizeof(int));
+  pool->slots     = (Slot *) malloc (max_items * sizeof(Slot));
+  if ((pool->items == NULL) || (pool->item_slot == NULL) || (pool->slots == NULL)) {
+    Pool_Destroy (pool);
+    return (NULL);
+  }
+  pool->item_size = item_size;
+
+  for (i=0; i<max_items; i++) {
+    pool->slots[i].generation = 0;
+    pool->slots[i].index      = -1;
+  }
+  pool->stats.max_items = max_items;
+  pool->stats.bytes     = (unsigned)(sizeof(Pool) + (size_t)max_items * (item_size + sizeof(int) + sizeof(Slot)));
+  Pool_Clear (pool);
+
+  return (pool);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Destroy
+|
+| Input: Called from Voice_Free()
+| Output: Frees a pool and its items.
+|___________________________________________________________________*/
+
+void Pool_Destroy (Pool *pool)
+{
+  if (pool == NULL)
+    return;
+
+  free (pool->items);
+  free (pool->item_slot);
+  free (pool->slots);
+  free (pool);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Alloc
+|
+| Input: Called from Voice_Play()
+| Output: Adds an item, cleared to 0, at the end of the items.  Returns
+|   its handle, or 0 if the pool is full.
+|___________________________________________________________________*/
+
+PoolHandle Pool_Alloc (Pool *pool)
+{
+  int i;
+  Slot *s;
+
+  if (pool->first_free < 0) {
+    pool->stats.full++;
+    return (0);
+  }
+
+  // Take the slot freed longest ago
+  i = pool->first_free;
+  s = &pool->slots[i];
+  pool->first_free = s->next_free;
+  if (pool->first_free < 0)
+    pool->last_free = -1;
+
+  s->index = pool->count++;
+  pool->item_slot[s->index] = i;
+  memset (ITEM (pool, s->index), 0, pool->item_size);
+
+  pool->stats.allocs++;
+  if (pool->count > pool->stats.peak)
+    pool->stats.peak = pool->count;
+
+  return (HANDLE_OF (i, s->generation));
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Free
+|
+| Input: Called from Voice_Stop(), Voice_Update()
+| Output: Frees an item, moving the last item into its place.  Returns
+|   true on success, else false if the handle is stale.
+|___________________________________________________________________*/
+
+bool Pool_Free (Pool *pool, PoolHandle handle)
+{
+  int i, index, last;
+  Slot *s;
+
+  i = Slot_Of (pool, handle);
+  if (i < 0) {
+    if (handle != 0)
+      pool->stats.stale++;
+    return (false);
+  }
+  s = &pool->slots[i];
+
+  // Fill the hole with the last item
+  index = s->index;
+  last = --pool->count;
+  if (index != last) {
+    memcpy (ITEM (pool, index), ITEM (pool, last), pool->item_size);
+    pool->item_slot[index] = pool->item_slot[last];
+    pool->slots[pool->item_slot[index]].index = index;
+  }
+
+  s->index      = -1;
+  s->generation = (s->generation + 1) & 0xFFFF;
+  s->next_free  = -1;
+  // Used again after every slot freed before it
+  if (pool->last_free >= 0)
+    pool->slots[pool->last_free].next_free = i;
+  else
+    pool->first_free = i;
+  pool->last_free = i;
+
+  pool->stats.frees++;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Get
+|
+| Input: Called from Voice_Play(), Get_Logical(), Voice_Update(),
+|   Fade_Out()
+| Output: Returns the item of a handle, or NULL if it was freed.  The
+|   pointer is good until an item is freed.
+|___________________________________________________________________*/
+
+void *Pool_Get (Pool *pool, PoolHandle handle)
+{
+  int i;
+
+  i = Slot_Of (pool, handle);
+  if (i < 0) {
+    if (handle != 0)
+      pool->stats.stale++;
+    return (NULL);
+  }
+
+  return (ITEM (pool, pool->slots[i].index));
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Is_Valid
+|
+| Input: Called from Get_Logical()
+| Output: Returns true if the handle's item hasn't been freed, else
+|   false.
+|___________________________________________________________________*/
+
+bool Pool_Is_Valid (Pool *pool, PoolHandle handle)
+{
+  return (Slot_Of (pool, handle) >= 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Count
+|
+| Input: Called from Voice_Free(), Voice_Update()
+| Output: Returns # of items.
+|___________________________________________________________________*/
+
+int Pool_Count (Pool *pool)
+{
+  return (pool->count);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Items
+|
+| Input: Called from Voice_Free(), Voice_Update()
+| Output: Returns the items, Pool_Count() of them one after another.
+|___________________________________________________________________*/
+
+void *Pool_Items (Pool *pool)
+{
+  return (pool->items);
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Handle_At
+|
+| Input: Called from Voice_Update()
+| Output: Returns the handle of an item by its index in Pool_Items(),
+|   or 0 if out of range.
+|___________________________________________________________________*/
+
+PoolHandle Pool_Handle_At (Pool *pool, int index)
+{
+  int i;
+
+  if ((index < 0) || (index >= pool->count))
+    return (0);
+  i = pool->item_slot[index];
+
+  return (HANDLE_OF (i, pool->slots[i].generation));
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Clear
+|
+| Input: Called from Pool_Create(), ____
+| Output: Frees every item.  Generations of slots in use change, so
+|   their handles become stale.
+|___________________________________________________________________*/
+
+void Pool_Clear (Pool *pool)
+{
+  int i;
+  Slot *s;
+
+  for (i=0; i<pool->stats.max_items; i++) {
+    s = &pool->slots[i];
+    if (s->index >= 0)
+      s->generation = (s->generation + 1) & 0xFFFF;
+    s->index     = -1;
+    s->next_free = (i + 1 < pool->stats.max_items) ? i + 1 : -1;
+  }
+  pool->count      = 0;
+  pool->first_free = 0;
+  pool->last_free  = pool->stats.max_items - 1;
+}
+
+/*____________________________________________________________________
+|
+| Function: Pool_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts.
+|___________________________________________________________________*/
+
+void Pool_Get_Stats (Pool *pool, PoolStats *stats)
+{
+  *stats = pool->stats;
+  stats->count = pool->count;
+}
+
+/*____________________________________________________________________
+|
+| Function: Slot_Of
+|
+| Input: Called from Pool_Free(), Pool_Get(), Pool_Is_Valid()
+| Output: Returns the slot of a handle, or -1 if its item was freed.
+|___________________________________________________________________*/
+
+static int Slot_Of (Pool *pool, PoolHandle handle)
+{
+  int i;
+
+  i = (int)(handle & 0xFFFF) - 1;
+  if ((i < 0) || (i >= pool->stats.max_items) || (pool->slots[i].index < 0) || (pool->slots[i].generation != (handle >> 16)))
+    return (-1);
+
+  return (i);
+}
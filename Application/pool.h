@@ -0,0 +1,61 @@
+/*____________________________________________________________________
+|
+| File: pool.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define POOL_MAX_ITEMS 65535       // most items in one pool
+
+typedef struct Pool Pool;
+typedef unsigned PoolHandle;       // 0 = none
+
+typedef struct {
+  int count;                       // items in the pool now
+  int max_items;
+  int peak;                        // most items at once
+  int allocs;
+  int frees;
+  int full;                        // allocs that failed, the pool was full
+  int stale;                       // handles used after their item was freed
+  unsigned bytes;                  // of the pool, items and bookkeeping
+} PoolStats;
+
+// Typed use, items are plain data (no constructors or destructors run)
+#define POOL_CREATE(_type_,_max_)      Pool_Create ((int)sizeof(_type_), (_max_))
+#define POOL_GET(_type_,_pool_,_h_)    ((_type_ *) Pool_Get ((_pool_), (_h_)))
+#define POOL_ITEMS(_type_,_pool_)      ((_type_ *) Pool_Items (_pool_))
+
+// Makes a pool of up to max_items items of item_size bytes, returns NULL on error
+Pool *Pool_Create (int item_size, int max_items);
+
+// Frees a pool and its items
+void Pool_Destroy (Pool *pool);
+
+// Adds an item cleared to 0, returns its handle or 0 if the pool is full
+PoolHandle Pool_Alloc (Pool *pool);
+
+// Frees an item, the last item is moved into its place, returns false if the handle is stale
+bool Pool_Free (Pool *pool, PoolHandle handle);
+
+// Returns an item or NULL if the handle is stale, valid until an item is freed
+void *Pool_Get (Pool *pool, PoolHandle handle);
+
+// Returns true if the handle's item hasn't been freed
+bool Pool_Is_Valid (Pool *pool, PoolHandle handle);
+
+// Returns # of items
+int Pool_Count (Pool *pool);
+
+// Returns the items, one after another in no order, Pool_Count() of them
+void *Pool_Items (Pool *pool);
+
+// Returns the handle of the item at an index of Pool_Items()
+PoolHandle Pool_Handle_At (Pool *pool, int index);
+
+// Frees every item, their handles become stale
+void Pool_Clear (Pool *pool);
+
+// Gets counts
+void Pool_Get_Stats (Pool *pool, PoolStats *stats);
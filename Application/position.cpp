@@ -8,6 +8,7 @@
 |            Position_Free
 |            Position_Set_Speed
 |            Position_Update
+|            Position_Get_View_Matrix
 |
 | (C) Copyright 2013 Abonvita Software LLC.
 | Licensed under the GX Toolkit License, Version 1.0.
@@ -46,6 +47,7 @@ static gx3dVector current_heading;			// current heading (normalized)
 static float      current_speed;				// current move speed
 static float      current_xrotate;			// current rotation of camera	
 static float	    current_yrotate;
+static gx3dMatrix current_view;				// view matrix of the current position and heading
 
 /*____________________________________________________________________
 |
@@ -122,7 +124,7 @@ void Position_Update (
 {
 	int n;
 	float move_amount;
-  gx3dMatrix m, mx, my, mxy;
+  gx3dMatrix mx, my, mxy;
   gx3dVector to, world_up = { 0, 1, 0 };
 	gx3dVector v1, v_right;
 
@@ -223,9 +225,8 @@ void Position_Update (
 //		to.x = current_position.x + (current_heading.x * CAMERA_DISTANCE);
 //    to.y = current_position.y + (current_heading.y * CAMERA_DISTANCE);
 //    to.z = current_position.z + (current_heading.z * CAMERA_DISTANCE);
-    // Set new camera	position
-	  gx3d_ComputeViewMatrix (&m, &current_position, &to, &world_up);
-  	gx3d_SetViewMatrix (&m);
+    // Compute the new view matrix, the render thread sets it (this may be the sim thread)
+	  gx3d_ComputeViewMatrix (&current_view, &current_position, &to, &world_up);
     *camera_changed = true;
   }
   
@@ -237,3 +238,16 @@ void Position_Update (
   *new_position = current_position;
   *new_heading  = current_heading;
 }
+
+/*____________________________________________________________________
+|
+| Function: Position_Get_View_Matrix
+|
+| Input: Called from ____
+| Output: Returns the view matrix of the current position and heading.
+|___________________________________________________________________*/
+
+void Position_Get_View_Matrix (gx3dMatrix *view_matrix)
+{
+  *view_matrix = current_view;
+}
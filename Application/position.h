@@ -42,3 +42,6 @@ void Position_Update (
   bool       *camera_changed,   // return true if heading has changed
   gx3dVector *new_position,
   gx3dVector *new_heading );
+
+// Gets the view matrix of the current position (Position_Update() doesn't set it)
+void Position_Get_View_Matrix (gx3dMatrix *view_matrix);
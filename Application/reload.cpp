@@ -0,0 +1,667 @@
+/*____________________________________________________________________
+|
+| File: reload.cpp
+|
+| Description: Watches the asset directories for changed files so
+|   assets can be loaded again while the program runs.
+|
+|   One thread waits for change notifications from the OS
+|   (ReadDirectoryChangesW on Windows, inotify elsewhere).  A file is
+|   usually written in pieces, so it is only read once no notification
+|   came for it for a short time and it can be opened.  Then it is
+|   hashed, and a file written with the same contents is dropped.  A
+|   model with a cooked .mesh file next to it is cooked again on this
+|   thread.
+|
+|   Changed files wait in a list for the program thread, which takes
+|   them at the start of a frame and swaps in the new assets, so a
+|   frame never draws half old and half new assets.
+|
+|   Only uses the C library, the OS and filemap.cpp, mesh.cpp.
+|
+| Functions: Reload_Init
+|             Add_Watches
+|            Reload_Free
+|            Reload_Get_Changes
+|            Reload_Get_Stats
+|            Reload_Get_Time
+|             Watch_Thread
+|             Note_Change
+|             Cook_Settled
+|             Recook
+|             Has_Extension
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "filemap.h"
+#include "mesh.h"
+#include "reload.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MAX_PENDING      64
+#define MAX_READY        64
+#define MAX_KNOWN        256
+#define MAX_WATCHES      64
+#define NOTIFY_SIZE      16384    // bytes of notifications read at once
+
+#define SETTLE_TIME      20       // milliseconds with no notification before a file is read
+#define POLL_TIME        5        // milliseconds between checks while files are settling
+#define GIVE_UP_TIME     5000     // milliseconds to keep trying a file that can't be read
+
+#ifdef _WIN32
+#define PATH_SEPARATOR   '\\'
+#else
+#define PATH_SEPARATOR   '/'
+#endif
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  char   filename [RELOAD_MAX_PATH];
+  double first_time, last_time;     // first and last notification
+} Pending;
+
+typedef struct {
+  char               filename [RELOAD_MAX_PATH];
+  unsigned long long hash;
+} Known;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+#ifdef _WIN32
+static unsigned __stdcall Watch_Thread (void *params);
+#else
+static bool Add_Watches (const char *dir);
+static void *Watch_Thread (void *params);
+#endif
+static void Note_Change (const char *filename);
+static void Cook_Settled (bool all);
+static bool Recook (const char *filename);
+static bool Has_Extension (const char *filename, const char *ext);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#ifdef _WIN32
+#define LOCK()   EnterCriticalSection (&ready_critsection)
+#define UNLOCK() LeaveCriticalSection (&ready_critsection)
+#else
+#define LOCK()   pthread_mutex_lock (&ready_mutex)
+#define UNLOCK() pthread_mutex_unlock (&ready_mutex)
+#endif
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static bool             watching = false;
+static char             watch_dir [RELOAD_MAX_PATH];
+
+#ifdef _WIN32
+static HANDLE           watch_thread;
+static HANDLE           dir_handle;
+static HANDLE           stop_event;
+static CRITICAL_SECTION ready_critsection;   // guards ready list and stats
+#else
+static pthread_t        watch_thread;
+static int              notify_fd;
+static int              stop_pipe [2];
+static int              watch_wd [MAX_WATCHES];
+static char             watch_path [MAX_WATCHES][RELOAD_MAX_PATH];
+static int              num_watches;
+static pthread_mutex_t  ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+// Used by the watching thread only
+static Pending          pending [MAX_PENDING];
+static int              num_pending;
+static Known            known [MAX_KNOWN];
+static int              num_known;
+
+static ReloadChange     ready [MAX_READY];
+static int              num_ready;
+static ReloadStats      reload_stats;
+
+/*____________________________________________________________________
+|
+| Function: Reload_Init
+|
+| Input: Called from Program_Run()
+| Output: Starts watching a directory and its subdirectories.  Returns
+|   true on success, else false.
+|___________________________________________________________________*/
+
+bool Reload_Init (const char *dir)
+{
+  if (watching || (strlen (dir) >= RELOAD_MAX_PATH - 32))
+    return (false);
+
+  strcpy (watch_dir, dir);
+  num_pending = 0;
+  num_known   = 0;
+  num_ready   = 0;
+  memset (&reload_stats, 0, sizeof(reload_stats));
+
+#ifdef _WIN32
+  dir_handle = CreateFileA (dir, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+  if (dir_handle == INVALID_HANDLE_VALUE)
+    return (false);
+  InitializeCriticalSection (&ready_critsection);
+  stop_event = CreateEvent (NULL, TRUE, FALSE, NULL);
+  watch_thread = (HANDLE) _beginthreadex (NULL, 0, Watch_Thread, NULL, 0, NULL);
+  if (watch_thread == 0) {
+    CloseHandle (stop_event);
+    CloseHandle (dir_handle);
+    DeleteCriticalSection (&ready_critsection);
+    return (false);
+  }
+#else
+  notify_fd = inotify_init ();
+  if (notify_fd == -1)
+    return (false);
+  num_watches = 0;
+  if ((!Add_Watches (dir)) || (pipe (stop_pipe) != 0)) {
+    close (notify_fd);
+    return (false);
+  }
+  if (pthread_create (&watch_thread, NULL, Watch_Thread, NULL) != 0) {
+    close (stop_pipe[0]);
+    close (stop_pipe[1]);
+    close (notify_fd);
+    return (false);
+  }
+#endif
+  watching = true;
+
+  return (true);
+}
+
+#ifndef _WIN32
+/*____________________________________________________________________
+|
+| Function: Add_Watches
+|
+| Input: Called from Reload_Init(), Add_Watches(), Watch_Thread()
+| Output: Watches a directory and its subdirectories (inotify watches
+|   one directory each).  Returns true if the directory is watched.
+|___________________________________________________________________*/
+
+static bool Add_Watches (const char *dir)
+{
+  int wd, n;
+  char path[RELOAD_MAX_PATH];
+  DIR *d;
+  struct dirent *e;
+  struct stat info;
+
+  if (num_watches == MAX_WATCHES)
+    return (false);
+  wd = inotify_add_watch (notify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+  if (wd == -1)
+    return (false);
+  watch_wd[num_watches] = wd;
+  strcpy (watch_path[num_watches++], dir);
+
+  d = opendir (dir);
+  if (d) {
+    while ((e = readdir (d)) != NULL)
+      if (e->d_name[0] != '.') {
+        // Too long, skip it
+        n = snprintf (path, sizeof(path), "%s/%s", dir, e->d_name);
+        if ((n > 0) && (n < (int)sizeof(path)) && (stat (path, &info) == 0) && S_ISDIR (info.st_mode))
+          Add_Watches (path);
+      }
+    closedir (d);
+  }
+
+  return (true);
+}
+#endif
+
+/*____________________________________________________________________
+|
+| Function: Reload_Free
+|
+| Input: Called from Program_Run()
+| Output: Stops the watching thread.
+|___________________________________________________________________*/
+
+void Reload_Free ()
+{
+  if (!watching)
+    return;
+
+#ifdef _WIN32
+  SetEvent (stop_event);
+  WaitForSingleObject (watch_thread, INFINITE);
+  CloseHandle (watch_thread);
+  CloseHandle (stop_event);
+  CloseHandle (dir_handle);
+  DeleteCriticalSection (&ready_critsection);
+#else
+  if (write (stop_pipe[1], "", 1) == 1)
+    pthread_join (watch_thread, NULL);
+  close (stop_pipe[0]);
+  close (stop_pipe[1]);
+  close (notify_fd);
+#endif
+  watching = false;
+}
+
+/*____________________________________________________________________
+|
+| Function: Reload_Get_Changes
+|
+| Input: Called from Program_Run()
+| Output: Gets files changed since the last call, oldest first.
+|   Returns # of changes.
+|___________________________________________________________________*/
+
+int Reload_Get_Changes (ReloadChange *changes, int max_changes)
+{
+  int n;
+
+  if (!watching)
+    return (0);
+
+  LOCK ();
+  n = (num_ready < max_changes) ? num_ready : max_changes;
+  memcpy (changes, ready, n * sizeof(ReloadChange));
+  num_ready -= n;
+  memmove (ready, ready + n, num_ready * sizeof(ReloadChange));
+  UNLOCK ();
+
+  return (n);
+}
+
+/*____________________________________________________________________
+|
+| Function: Reload_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.
+|___________________________________________________________________*/
+
+void Reload_Get_Stats (ReloadStats *stats)
+{
+  if (!watching) {
+    *stats = reload_stats;
+    return;
+  }
+  LOCK ();
+  *stats = reload_stats;
+  UNLOCK ();
+}
+
+/*____________________________________________________________________
+|
+| Function: Reload_Get_Time
+|
+| Input: Called from Note_Change(), Cook_Settled(), Program_Run()
+| Output: Returns a time in milliseconds.
+|___________________________________________________________________*/
+
+double Reload_Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
+
+#ifdef _WIN32
+/*____________________________________________________________________
+|
+| Function: Watch_Thread
+|
+| Input: Called from Reload_Init() through _beginthreadex()
+| Output: Waits for change notifications and reads files once they
+|   settle, until stopped.
+|___________________________________________________________________*/
+
+static unsigned __stdcall Watch_Thread (void *params)
+{
+  int n;
+  DWORD bytes, wait;
+  char name[RELOAD_MAX_PATH];
+  DWORD buffer[NOTIFY_SIZE / sizeof(DWORD)];
+  HANDLE io_event, events[2];
+  OVERLAPPED overlapped;
+  FILE_NOTIFY_INFORMATION *info;
+  bool reading;
+
+  io_event = CreateEvent (NULL, TRUE, FALSE, NULL);
+  events[0] = stop_event;
+  events[1] = io_event;
+  reading = false;
+
+  for (;;) {
+    // Ask for the next notifications
+    if (!reading) {
+      memset (&overlapped, 0, sizeof(overlapped));
+      overlapped.hEvent = io_event;
+      ResetEvent (io_event);
+      reading = (ReadDirectoryChangesW (dir_handle, buffer, sizeof(buffer), TRUE,
+                                        FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE,
+                                        NULL, &overlapped, NULL) != 0);
+    }
+    wait = WaitForMultipleObjects (2, events, FALSE, (num_pending || !reading) ? POLL_TIME : INFINITE);
+    if (wait == WAIT_OBJECT_0)
+      break;
+
+    if (reading && (wait == WAIT_OBJECT_0 + 1)) {
+      reading = false;
+      // 0 bytes = too many changes to list, they are lost
+      if (GetOverlappedResult (dir_handle, &overlapped, &bytes, FALSE) && bytes) {
+        info = (FILE_NOTIFY_INFORMATION *) buffer;
+        for (;;) {
+          n = WideCharToMultiByte (CP_ACP, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), name, RELOAD_MAX_PATH-1, NULL, NULL);
+          name[n] = 0;
+          if ((info->Action != FILE_ACTION_REMOVED) && (info->Action != FILE_ACTION_RENAMED_OLD_NAME))
+            Note_Change (name);
+          if (info->NextEntryOffset == 0)
+            break;
+          info = (FILE_NOTIFY_INFORMATION *) ((char *)info + info->NextEntryOffset);
+        }
+      }
+    }
+    Cook_Settled (false);
+  }
+
+  if (reading) {
+    CancelIo (dir_handle);
+    GetOverlappedResult (dir_handle, &overlapped, &bytes, TRUE);
+  }
+  CloseHandle (io_event);
+
+  return (0);
+}
+#else
+/*____________________________________________________________________
+|
+| Function: Watch_Thread
+|
+| Input: Called from Reload_Init() through pthread_create()
+| Output: Waits for change notifications and reads files once they
+|   settle, until stopped.
+|___________________________________________________________________*/
+
+static void *Watch_Thread (void *params)
+{
+  int i, n, length;
+  char path[RELOAD_MAX_PATH], *p;
+  char buffer[NOTIFY_SIZE];
+  struct pollfd fds[2];
+  struct inotify_event *e;
+
+  fds[0].fd = stop_pipe[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = notify_fd;
+  fds[1].events = POLLIN;
+
+  for (;;) {
+    n = poll (fds, 2, num_pending ? POLL_TIME : -1);
+    if (fds[0].revents)
+      break;
+
+    if ((n > 0) && (fds[1].revents & POLLIN)) {
+      n = (int) read (notify_fd, buffer, sizeof(buffer));
+      for (p=buffer; p<buffer+n; p+=sizeof(struct inotify_event)+e->len) {
+        e = (struct inotify_event *) p;
+        if (e->len == 0)
+          continue;
+        for (i=0; (i < num_watches) && (watch_wd[i] != e->wd); i++);
+        if (i == num_watches)
+          continue;
+        length = snprintf (path, sizeof(path), "%s/%s", watch_path[i], e->name);
+        if ((length < 0) || (length >= (int)sizeof(path)))
+          continue;
+        if (e->mask & IN_ISDIR) {
+          if (e->mask & IN_CREATE)
+            Add_Watches (path);
+        }
+        else
+          Note_Change (path + strlen (watch_dir) + 1);
+      }
+    }
+    Cook_Settled (false);
+  }
+
+  return (NULL);
+}
+#endif
+
+/*____________________________________________________________________
+|
+| Function: Note_Change
+|
+| Input: Called from Watch_Thread()
+| Output: Adds a file (path in the watched directory) to the files
+|   waiting to settle, or notes another change to it.  Cooked files
+|   are skipped.
+|___________________________________________________________________*/
+
+static void Note_Change (const char *filename)
+{
+  int i, n;
+  double now;
+  char path[RELOAD_MAX_PATH];
+
+  if (Has_Extension (filename, ".mesh") || Has_Extension (filename, ".tex") || Has_Extension (filename, ".pack"))
+    return;
+  // Too long, skip it
+  n = snprintf (path, sizeof(path), "%s%c%s", watch_dir, PATH_SEPARATOR, filename);
+  if ((n < 0) || (n >= (int)sizeof(path)))
+    return;
+
+  now = Reload_Get_Time ();
+  LOCK ();
+  reload_stats.events++;
+  UNLOCK ();
+  for (i=0; i<num_pending; i++)
+    if (strcmp (pending[i].filename, path) == 0) {
+      pending[i].last_time = now;
+      return;
+    }
+  // Too many at once, read them all now (settled or not)
+  if (num_pending == MAX_PENDING)
+    Cook_Settled (true);
+  if (num_pending == MAX_PENDING)
+    return;
+  strcpy (pending[num_pending].filename, path);
+  pending[num_pending].first_time = now;
+  pending[num_pending].last_time  = now;
+  num_pending++;
+}
+
+/*____________________________________________________________________
+|
+| Function: Cook_Settled
+|
+| Input: Called from Watch_Thread(), Note_Change()
+| Output: Reads files with no notification for SETTLE_TIME (or all of
+|   them), recooks those with new contents and adds them to the ready
+|   list.  A file that can't be read yet (still open for writing) waits
+|   until GIVE_UP_TIME.
+|___________________________________________________________________*/
+
+static void Cook_Settled (bool all)
+{
+  int i, j;
+  unsigned size;
+  unsigned long long write_time, hash;
+  double now, start;
+  const void *data;
+  bool done, cooked;
+  Pending *p;
+  ReloadChange *c;
+
+  now = Reload_Get_Time ();
+  for (i=0; i<num_pending; ) {
+    p = &pending[i];
+    if ((!all) && (now - p->last_time < SETTLE_TIME)) {
+      i++;
+      continue;
+    }
+
+    start = Reload_Get_Time ();
+    done = false;
+    data = NULL;
+    if (File_Get_Info (p->filename, &size, &write_time))
+      data = File_Map (p->filename, &size);
+    if (data) {
+      hash = File_Hash (data, size);
+      File_Unmap (data, size);
+      done = true;
+
+      // Same contents as last time?
+      for (j=0; (j < num_known) && strcmp (known[j].filename, p->filename); j++);
+      if ((j < num_known) && (known[j].hash == hash)) {
+        LOCK ();
+        reload_stats.unchanged++;
+        UNLOCK ();
+      }
+      else {
+        if (j < num_known)
+          known[j].hash = hash;
+        else if (num_known < MAX_KNOWN) {
+          strcpy (known[num_known].filename, p->filename);
+          known[num_known++].hash = hash;
+        }
+        cooked = Recook (p->filename);
+
+        LOCK ();
+        // Replace an older change to the same file not taken yet
+        for (j=0; (j < num_ready) && strcmp (ready[j].filename, p->filename); j++);
+        if ((j == num_ready) && (num_ready == MAX_READY)) {
+          memmove (ready, ready + 1, (MAX_READY - 1) * sizeof(ReloadChange));
+          j = --num_ready;
+        }
+        c = &ready[j];
+        if (j == num_ready) {
+          strcpy (c->filename, p->filename);
+          c->change_time = p->first_time;
+          num_ready++;
+        }
+        c->size       = size;
+        c->write_time = write_time;
+        c->hash       = hash;
+        reload_stats.changed++;
+        if (cooked)
+          reload_stats.recooked++;
+        reload_stats.cook_time += (float)(Reload_Get_Time () - start);
+        UNLOCK ();
+      }
+    }
+    // Can't be read (removed, still open for writing), try again later
+    else if (now - p->first_time >= GIVE_UP_TIME)
+      done = true;
+
+    if (done)
+      *p = pending[--num_pending];
+    else
+      i++;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Recook
+|
+| Input: Called from Cook_Settled()
+| Output: Cooks a model again if it has a cooked .mesh file, keeping
+|   its vertex format.  Returns true if a file was cooked.
+|___________________________________________________________________*/
+
+static bool Recook (const char *filename)
+{
+  int vertex_format;
+  unsigned size;
+  char mesh_file[RELOAD_MAX_PATH];
+  const MeshHeader *header;
+
+  if (!Has_Extension (filename, ".lwo"))
+    return (false);
+
+  strcpy (mesh_file, filename);
+  strcpy (mesh_file + strlen (mesh_file) - 4, ".mesh");
+  header = (const MeshHeader *) File_Map (mesh_file, &size);
+  if (header == NULL)
+    return (false);
+  vertex_format = MESH_VERTEX_FLOAT;
+  if ((size >= sizeof(MeshHeader)) && (header->magic == MESH_MAGIC) && (header->version == MESH_VERSION))
+    vertex_format = header->vertex_format;
+  File_Unmap (header, size);
+
+  return (Mesh_Cook (filename, mesh_file, vertex_format, NULL) != 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Has_Extension
+|
+| Input: Called from Note_Change(), Recook()
+| Output: Returns true if a filename ends with an extension (any case).
+|___________________________________________________________________*/
+
+static bool Has_Extension (const char *filename, const char *ext)
+{
+  int i, n, length;
+
+  n = (int) strlen (ext);
+  length = (int) strlen (filename);
+  if (length < n)
+    return (false);
+  for (i=0; i<n; i++)
+    if (tolower ((unsigned char)filename[length - n + i]) != ext[i])
+      return (false);
+
+  return (true);
+}
@@ -0,0 +1,41 @@
+/*____________________________________________________________________
+|
+| File: reload.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define RELOAD_MAX_PATH 260
+
+// A file whose contents changed, read and recooked
+typedef struct {
+  char               filename [RELOAD_MAX_PATH];  // directory given to Reload_Init() + path in it
+  unsigned           size;
+  unsigned long long write_time;
+  unsigned long long hash;
+  double             change_time;                 // milliseconds (Reload_Get_Time) when the change was first seen
+} ReloadChange;
+
+typedef struct {
+  int   events;       // change notifications from the OS
+  int   changed;      // files with new contents
+  int   unchanged;    // files written with the same contents
+  int   recooked;     // cooked files (.mesh) made again
+  float cook_time;    // milliseconds reading and recooking on the watching thread
+} ReloadStats;
+
+// Watches a directory and its subdirectories for changed files, returns true on success
+bool Reload_Init (const char *dir);
+
+// Stops watching
+void Reload_Free ();
+
+// Gets files changed since the last call (up to max_changes, the rest wait for the next call), returns # of changes
+int Reload_Get_Changes (ReloadChange *changes, int max_changes);
+
+// Gets counts and times
+void Reload_Get_Stats (ReloadStats *stats);
+
+// Returns the time in milliseconds, for comparing with change_time
+double Reload_Get_Time ();
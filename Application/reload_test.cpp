@@ -0,0 +1,258 @@
+/*____________________________________________________________________
+|
+| File: reload_test.cpp
+|
+| Description: Times how long a changed asset takes to be picked up by
+|   reload.cpp, the way the game sees it: a file is rewritten, and a
+|   frame loop (one Reload_Get_Changes() call every 16.6 ms) waits for
+|   the change.  A model with a cooked .mesh beside it (recooked on the
+|   watching thread) and a texture are rewritten in turn, between two
+|   versions of each.  A rewrite with the same contents must not be
+|   reported.
+|
+|   A standalone program, not part of the game build.  Build it in
+|   Application\:
+|     cl /EHsc reload_test.cpp reload.cpp filemap.cpp mesh.cpp meshopt.cpp lwo.cpp
+|     g++ -O2 reload_test.cpp reload.cpp filemap.cpp mesh.cpp meshopt.cpp lwo.cpp -lpthread
+|   Run from the project directory (it reads Objects\), or give the
+|   objects directory as the argument.  Works in a new directory
+|   reload_test_dir, returns 0 if every change was picked up.
+|
+|   Only uses the C library, the OS and the modules above.
+|
+| Functions: main
+|             Copy_File
+|             Make_Dir
+|             Sleep_Ms
+|             Wait_For_Change
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filemap.h"
+#include "mesh.h"
+#include "reload.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define TEST_DIR      "reload_test_dir"
+#define REWRITES      20         // of each file
+#define FRAME_TIME    16.6       // milliseconds between Reload_Get_Changes() calls
+#define MAX_FRAMES    120        // to wait for a change before it counts as missed
+#define QUIET_FRAMES  12         // to wait for a rewrite with the same contents
+
+#ifdef _WIN32
+#define SEP "\\"
+#else
+#define SEP "/"
+#endif
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static bool Copy_File (const char *from, const char *to);
+static void Make_Dir (const char *dir);
+static void Sleep_Ms (double ms);
+static int  Wait_For_Change (const char *filename, int max_frames);
+
+/*____________________________________________________________________
+|
+| Function: main
+|
+| Input: Called from the OS
+| Output: Rewrites the files and prints the time each took to be picked
+|   up.  Returns 0 if all were picked up and the same contents weren't.
+|___________________________________________________________________*/
+
+int main (int argc, char **argv)
+{
+  int i, k, frames, failed;
+  double start, t, sum[2], worst[2];
+  char source[2][2][RELOAD_MAX_PATH], target[2][RELOAD_MAX_PATH];
+  const char *objects;
+  ReloadStats stats;
+
+  objects = (argc > 1) ? argv[1] : "Objects";
+
+  // Two versions of a model and of a texture, each rewritten over a copy of the first
+  sprintf (source[0][0], "%.200s" SEP "tree2.lwo", objects);
+  sprintf (source[0][1], "%.200s" SEP "ptree6.lwo", objects);
+  sprintf (source[1][0], "%.200s" SEP "Images" SEP "ghost.bmp", objects);
+  sprintf (source[1][1], "%.200s" SEP "Images" SEP "ghost1.bmp", objects);
+  strcpy (target[0], TEST_DIR SEP "tree2.lwo");
+  strcpy (target[1], TEST_DIR SEP "Images" SEP "ghost.bmp");
+
+  Make_Dir (TEST_DIR);
+  Make_Dir (TEST_DIR SEP "Images");
+  for (k=0; k<2; k++)
+    if (!Copy_File (source[k][0], target[k])) {
+      printf ("can't copy %s\n", source[k][0]);
+      return (1);
+    }
+  // So the model is recooked when it changes
+  if (!Mesh_Cook (target[0], TEST_DIR SEP "tree2.mesh", MESH_VERTEX_PACKED, NULL)) {
+    printf ("can't cook %s\n", target[0]);
+    return (1);
+  }
+  if (!Reload_Init (TEST_DIR)) {
+    printf ("can't watch %s\n", TEST_DIR);
+    return (1);
+  }
+
+/*____________________________________________________________________
+|
+| Rewrite each file, alternating versions, and wait for the change
+|___________________________________________________________________*/
+
+  failed = 0;
+  for (k=0; k<2; k++) {
+    sum[k]   = 0;
+    worst[k] = 0;
+  }
+  for (i=0; i<REWRITES*2; i++) {
+    k = i & 1;
+    start = Reload_Get_Time ();
+    Copy_File (source[k][((i >> 1) + 1) & 1], target[k]);
+    frames = Wait_For_Change (target[k], MAX_FRAMES);
+    t = Reload_Get_Time () - start;
+    if (frames < 0) {
+      printf ("missed change %d of %s\n", i / 2, target[k]);
+      failed++;
+      continue;
+    }
+    sum[k] += t;
+    if (t > worst[k])
+      worst[k] = t;
+  }
+  printf ("model + recook: %.1f ms average, %.1f ms worst\n", sum[0] / REWRITES, worst[0]);
+  printf ("texture:        %.1f ms average, %.1f ms worst\n", sum[1] / REWRITES, worst[1]);
+
+  // The same contents again
+  Copy_File (source[1][REWRITES & 1], target[1]);
+  if (Wait_For_Change (target[1], QUIET_FRAMES) >= 0) {
+    printf ("rewrite with the same contents was reported\n");
+    failed++;
+  }
+
+  Reload_Get_Stats (&stats);
+  printf ("%d notifications, %d changed, %d unchanged, %d recooked, %.1f ms reading and cooking\n",
+          stats.events, stats.changed, stats.unchanged, stats.recooked, stats.cook_time);
+  Reload_Free ();
+
+  return (failed ? 1 : 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Copy_File
+|
+| Input: Called from main()
+| Output: Copies a file.  Returns true on success, else false.
+|___________________________________________________________________*/
+
+static bool Copy_File (const char *from, const char *to)
+{
+  unsigned size;
+  const void *data;
+  bool ok;
+  FILE *fp;
+
+  data = File_Map (from, &size);
+  if (data == NULL)
+    return (false);
+  ok = false;
+  fp = fopen (to, "wb");
+  if (fp) {
+    ok = (fwrite (data, size, 1, fp) == 1);
+    if (fclose (fp) != 0)
+      ok = false;
+  }
+  File_Unmap (data, size);
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Make_Dir
+|
+| Input: Called from main()
+| Output: Makes a directory if it isn't there.
+|___________________________________________________________________*/
+
+static void Make_Dir (const char *dir)
+{
+#ifdef _WIN32
+  _mkdir (dir);
+#else
+  mkdir (dir, 0777);
+#endif
+}
+
+/*____________________________________________________________________
+|
+| Function: Sleep_Ms
+|
+| Input: Called from Wait_For_Change()
+| Output: Waits about ms milliseconds.
+|___________________________________________________________________*/
+
+static void Sleep_Ms (double ms)
+{
+#ifdef _WIN32
+  Sleep ((DWORD)ms);
+#else
+  struct timespec t;
+
+  t.tv_sec  = 0;
+  t.tv_nsec = (long)(ms * 1000000);
+  nanosleep (&t, NULL);
+#endif
+}
+
+/*____________________________________________________________________
+|
+| Function: Wait_For_Change
+|
+| Input: Called from main()
+| Output: Runs frames until a change to a file is picked up.  Returns
+|   the frames it took, or -1 if it wasn't in max_frames.
+|___________________________________________________________________*/
+
+static int Wait_For_Change (const char *filename, int max_frames)
+{
+  int i, frame, n;
+  ReloadChange changes[16];
+
+  for (frame=0; frame<max_frames; frame++) {
+    Sleep_Ms (FRAME_TIME);
+    n = Reload_Get_Changes (changes, 16);
+    for (i=0; i<n; i++)
+      if (strcmp (changes[i].filename, filename) == 0)
+        return (frame);
+  }
+
+  return (-1);
+}
@@ -0,0 +1,463 @@
+/*____________________________________________________________________
+|
+| File: spatial.cpp
+|
+| Description: Places many sound emitters in 3D around one listener.
+|
+|   Emitters are kept as arrays of each value (x of every emitter, y of
+|   every emitter ...).  Moving an emitter or the listener only stores
+|   the new position.  Once per frame Spatial_Update() computes the
+|   distance gain, pan and Doppler pitch of every emitter in one pass,
+|   4 emitters at a time with SSE2, then sets the mixer voice of each
+|   emitter that has one.  Nothing is recomputed per call, unlike
+|   setting positions with snd_3D_APPLY_NOW.
+|
+|   Gain follows the inverse distance rule DirectSound uses: full gain
+|   inside the min distance, min_distance / distance after that, and no
+|   quieter past the max distance.  Velocities for Doppler come from
+|   how far emitters and listener moved since the last update.
+|
+|   Only uses the C library and mixer.cpp.
+|
+| Functions: Spatial_Init
+|            Spatial_Free
+|            Spatial_Add_Emitter
+|            Spatial_Remove_Emitter
+|            Spatial_Set_Emitter_Position
+|            Spatial_Set_Emitter_Voice
+|            Spatial_Set_Listener
+|            Spatial_Update
+|            Spatial_Get_Emitter
+|            Spatial_Get_Stats
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define SPATIAL_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "mixer.h"
+#include "spatial.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MIN_DISTANCE  0.0001f     // closer than this there is no direction, pan is 0
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static double Get_Time ();
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static int         max_emitters = 0;
+static int         num_slots;            // slots used so far, free ones are in a list
+static int         first_free;           // -1 = none
+static int         num_emitters;
+
+// Emitters, by slot
+static float      *pos_x, *pos_y, *pos_z;
+static float      *prev_x, *prev_y, *prev_z;     // at the last update
+static float      *min_distance, *max_distance;
+static float      *base_gain;                    // 0 in free slots
+static MixerVoice *voice;
+static int        *next_free;                    // -2 = in use
+static float      *out_gain, *out_pan, *out_pitch;
+
+// Listener
+static bool        listener_set;
+static float       listener [3], listener_prev [3];
+static float       listener_right [3];
+
+static SpatialStats spatial_stats;
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Init
+|
+| Input: Called from ____
+| Output: Allocates room for emitters.  Returns true on success, else
+|   false.
+|___________________________________________________________________*/
+
+bool Spatial_Init (int max)
+{
+  float **arrays[12] = { &pos_x, &pos_y, &pos_z, &prev_x, &prev_y, &prev_z, &min_distance, &max_distance, &base_gain, &out_gain, &out_pan, &out_pitch };
+  int i;
+  bool ok;
+
+  if (max_emitters || (max <= 0))
+    return (false);
+
+  ok = true;
+  for (i=0; i<12; i++) {
+    *arrays[i] = (float *) malloc (max * sizeof(float));
+    ok = ok && (*arrays[i] != NULL);
+  }
+  voice     = (MixerVoice *) malloc (max * sizeof(MixerVoice));
+  next_free = (int *) malloc (max * sizeof(int));
+  max_emitters = max;
+  if ((!ok) || (voice == NULL) || (next_free == NULL)) {
+    Spatial_Free ();
+    return (false);
+  }
+
+  num_slots    = 0;
+  first_free   = -1;
+  num_emitters = 0;
+  listener_set = false;
+  memset (listener, 0, sizeof(listener));
+  memset (listener_prev, 0, sizeof(listener_prev));
+  listener_right[0] = 1;
+  listener_right[1] = 0;
+  listener_right[2] = 0;
+  memset (&spatial_stats, 0, sizeof(spatial_stats));
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Free
+|
+| Input: Called from Spatial_Init(), ____
+| Output: Frees all emitters.
+|___________________________________________________________________*/
+
+void Spatial_Free ()
+{
+  float **arrays[12] = { &pos_x, &pos_y, &pos_z, &prev_x, &prev_y, &prev_z, &min_distance, &max_distance, &base_gain, &out_gain, &out_pan, &out_pitch };
+  int i;
+
+  if (max_emitters == 0)
+    return;
+
+  for (i=0; i<12; i++) {
+    free (*arrays[i]);
+    *arrays[i] = NULL;
+  }
+  free (voice);
+  free (next_free);
+  voice     = NULL;
+  next_free = NULL;
+  max_emitters = 0;
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Add_Emitter
+|
+| Input: Called from ____
+| Output: Adds an emitter at a position.  Returns the emitter, or -1
+|   if there is no room.
+|___________________________________________________________________*/
+
+int Spatial_Add_Emitter (float x, float y, float z, float min_dist, float max_dist, float gain, MixerVoice v)
+{
+  int i;
+
+  if (first_free != -1) {
+    i = first_free;
+    first_free = next_free[i];
+  }
+  else if (num_slots < max_emitters)
+    i = num_slots++;
+  else
+    return (-1);
+
+  pos_x[i] = prev_x[i] = x;
+  pos_y[i] = prev_y[i] = y;
+  pos_z[i] = prev_z[i] = z;
+  min_distance[i] = (min_dist > MIN_DISTANCE) ? min_dist : MIN_DISTANCE;
+  max_distance[i] = (max_dist > min_distance[i]) ? max_dist : min_distance[i];
+  base_gain[i]    = gain;
+  voice[i]        = v;
+  next_free[i]    = -2;
+  out_gain[i]     = 0;
+  out_pan[i]      = 0;
+  out_pitch[i]    = 1;
+  num_emitters++;
+
+  return (i);
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Remove_Emitter
+|
+| Input: Called from ____
+| Output: Removes an emitter.  Its slot is still computed (silent)
+|   until reused.
+|___________________________________________________________________*/
+
+void Spatial_Remove_Emitter (int emitter)
+{
+  if ((emitter < 0) || (emitter >= num_slots) || (next_free[emitter] != -2))
+    return;
+
+  base_gain[emitter] = 0;
+  voice[emitter]     = 0;
+  next_free[emitter] = first_free;
+  first_free = emitter;
+  num_emitters--;
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Set_Emitter_Position
+|
+| Input: Called from ____
+| Output: Moves an emitter.  Takes effect at the next update.
+|___________________________________________________________________*/
+
+void Spatial_Set_Emitter_Position (int emitter, float x, float y, float z)
+{
+  if ((emitter < 0) || (emitter >= num_slots))
+    return;
+
+  pos_x[emitter] = x;
+  pos_y[emitter] = y;
+  pos_z[emitter] = z;
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Set_Emitter_Voice
+|
+| Input: Called from ____
+| Output: Changes the voice (0 = none) and gain of an emitter.
+|___________________________________________________________________*/
+
+void Spatial_Set_Emitter_Voice (int emitter, MixerVoice v, float gain)
+{
+  if ((emitter < 0) || (emitter >= num_slots) || (next_free[emitter] != -2))
+    return;
+
+  voice[emitter]     = v;
+  base_gain[emitter] = gain;
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Set_Listener
+|
+| Input: Called from ____
+| Output: Moves the listener.  Takes effect at the next update.
+|___________________________________________________________________*/
+
+void Spatial_Set_Listener (float x, float y, float z, float fx, float fy, float fz, float ux, float uy, float uz)
+{
+  listener[0] = x;
+  listener[1] = y;
+  listener[2] = z;
+  if (!listener_set) {
+    memcpy (listener_prev, listener, sizeof(listener));
+    listener_set = true;
+  }
+  // Right = up x forward (left handed, like gx3d)
+  listener_right[0] = uy * fz - uz * fy;
+  listener_right[1] = uz * fx - ux * fz;
+  listener_right[2] = ux * fy - uy * fx;
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Update
+|
+| Input: Called from ____
+| Output: Computes the gain, pan and pitch of every emitter, then sets
+|   the voices of the emitters that have one.
+|
+|   Pitch = (c + listener velocity toward the emitter) /
+|           (c + emitter velocity away from the listener)
+|___________________________________________________________________*/
+
+void Spatial_Update (unsigned elapsed_time)
+{
+  int i;
+  float inv_time, lv[3];
+  float dx, dy, dz, d, inv, clamped, vs, vl, pitch;
+  double start;
+
+  if (max_emitters == 0)
+    return;
+
+  start = Get_Time ();
+  // Per second, no Doppler if no time passed
+  inv_time = elapsed_time ? 1000.0f / elapsed_time : 0;
+  for (i=0; i<3; i++) {
+    lv[i] = (listener[i] - listener_prev[i]) * inv_time;
+    listener_prev[i] = listener[i];
+  }
+
+  i = 0;
+#ifdef SPATIAL_SSE2
+  __m128 x, y, z, vdx, vdy, vdz, vd, vinv, vmin, vmax, vs4, vl4, vpitch;
+  __m128 lx  = _mm_set1_ps (listener[0]), ly = _mm_set1_ps (listener[1]), lz = _mm_set1_ps (listener[2]);
+  __m128 rx  = _mm_set1_ps (listener_right[0]), ry = _mm_set1_ps (listener_right[1]), rz = _mm_set1_ps (listener_right[2]);
+  __m128 lvx = _mm_set1_ps (lv[0]), lvy = _mm_set1_ps (lv[1]), lvz = _mm_set1_ps (lv[2]);
+  __m128 vtime = _mm_set1_ps (inv_time);
+  __m128 c     = _mm_set1_ps (SPATIAL_SPEED_OF_SOUND);
+  __m128 one   = _mm_set1_ps (1.0f);
+  __m128 close = _mm_set1_ps (MIN_DISTANCE);
+  __m128 lo    = _mm_set1_ps (SPATIAL_MIN_PITCH);
+  __m128 hi    = _mm_set1_ps (SPATIAL_MAX_PITCH);
+
+  for (; i+4<=num_slots; i+=4) {
+    x = _mm_loadu_ps (&pos_x[i]);
+    y = _mm_loadu_ps (&pos_y[i]);
+    z = _mm_loadu_ps (&pos_z[i]);
+    vdx = _mm_sub_ps (x, lx);
+    vdy = _mm_sub_ps (y, ly);
+    vdz = _mm_sub_ps (z, lz);
+    vd  = _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (vdx, vdx), _mm_mul_ps (vdy, vdy)), _mm_mul_ps (vdz, vdz)));
+    // 1 / distance, 0 when too close to have a direction
+    vinv = _mm_and_ps (_mm_cmpgt_ps (vd, close), _mm_div_ps (one, _mm_max_ps (vd, close)));
+
+    // Gain
+    vmin = _mm_loadu_ps (&min_distance[i]);
+    vmax = _mm_loadu_ps (&max_distance[i]);
+    _mm_storeu_ps (&out_gain[i], _mm_div_ps (_mm_mul_ps (_mm_loadu_ps (&base_gain[i]), vmin), _mm_min_ps (_mm_max_ps (vd, vmin), vmax)));
+
+    // Pan, how far to the right of the listener
+    _mm_storeu_ps (&out_pan[i], _mm_mul_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (vdx, rx), _mm_mul_ps (vdy, ry)), _mm_mul_ps (vdz, rz)), vinv));
+
+    // Doppler, velocities along the line from the listener
+    vs4 = _mm_add_ps (_mm_add_ps (_mm_mul_ps (_mm_sub_ps (x, _mm_loadu_ps (&prev_x[i])), vdx),
+                                  _mm_mul_ps (_mm_sub_ps (y, _mm_loadu_ps (&prev_y[i])), vdy)),
+                                  _mm_mul_ps (_mm_sub_ps (z, _mm_loadu_ps (&prev_z[i])), vdz));
+    vs4 = _mm_mul_ps (_mm_mul_ps (vs4, vinv), vtime);
+    vl4 = _mm_mul_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (lvx, vdx), _mm_mul_ps (lvy, vdy)), _mm_mul_ps (lvz, vdz)), vinv);
+    // Past the speed of sound the limits take over
+    vpitch = _mm_div_ps (_mm_max_ps (_mm_add_ps (c, vl4), _mm_setzero_ps ()), _mm_max_ps (_mm_add_ps (c, vs4), close));
+    _mm_storeu_ps (&out_pitch[i], _mm_min_ps (_mm_max_ps (vpitch, lo), hi));
+
+    _mm_storeu_ps (&prev_x[i], x);
+    _mm_storeu_ps (&prev_y[i], y);
+    _mm_storeu_ps (&prev_z[i], z);
+  }
+#endif
+
+  // The rest one at a time
+  for (; i<num_slots; i++) {
+    dx = pos_x[i] - listener[0];
+    dy = pos_y[i] - listener[1];
+    dz = pos_z[i] - listener[2];
+    d = (float) sqrt (dx*dx + dy*dy + dz*dz);
+    inv = (d > MIN_DISTANCE) ? 1 / d : 0;
+
+    clamped = (d < min_distance[i]) ? min_distance[i] : ((d > max_distance[i]) ? max_distance[i] : d);
+    out_gain[i] = base_gain[i] * min_distance[i] / clamped;
+
+    out_pan[i] = (dx * listener_right[0] + dy * listener_right[1] + dz * listener_right[2]) * inv;
+
+    vs = ((pos_x[i] - prev_x[i]) * dx + (pos_y[i] - prev_y[i]) * dy + (pos_z[i] - prev_z[i]) * dz) * inv * inv_time;
+    vl = (lv[0] * dx + lv[1] * dy + lv[2] * dz) * inv;
+    pitch = ((SPATIAL_SPEED_OF_SOUND + vl > 0) ? SPATIAL_SPEED_OF_SOUND + vl : 0) /
+            ((SPATIAL_SPEED_OF_SOUND + vs > MIN_DISTANCE) ? SPATIAL_SPEED_OF_SOUND + vs : MIN_DISTANCE);
+    out_pitch[i] = (pitch < SPATIAL_MIN_PITCH) ? SPATIAL_MIN_PITCH : ((pitch > SPATIAL_MAX_PITCH) ? SPATIAL_MAX_PITCH : pitch);
+
+    prev_x[i] = pos_x[i];
+    prev_y[i] = pos_y[i];
+    prev_z[i] = pos_z[i];
+  }
+
+  // Commit to the voices all at once
+  spatial_stats.committed = 0;
+  for (i=0; i<num_slots; i++)
+    if (voice[i]) {
+      Mixer_Set_Voice (voice[i], out_gain[i], out_pan[i], out_pitch[i]);
+      spatial_stats.committed++;
+    }
+
+  spatial_stats.update_time = (float)(Get_Time () - start);
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Get_Emitter
+|
+| Input: Called from ____
+| Output: Gets the gain, pan and pitch of an emitter from the last
+|   update.
+|___________________________________________________________________*/
+
+void Spatial_Get_Emitter (int emitter, float *gain, float *pan, float *pitch)
+{
+  if ((emitter < 0) || (emitter >= num_slots)) {
+    *gain  = 0;
+    *pan   = 0;
+    *pitch = 1;
+    return;
+  }
+
+  *gain  = out_gain[emitter];
+  *pan   = out_pan[emitter];
+  *pitch = out_pitch[emitter];
+}
+
+/*____________________________________________________________________
+|
+| Function: Spatial_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.
+|___________________________________________________________________*/
+
+void Spatial_Get_Stats (SpatialStats *stats)
+{
+  *stats = spatial_stats;
+  stats->emitters = num_emitters;
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Spatial_Update()
+| Output: Returns a time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
@@ -0,0 +1,48 @@
+/*____________________________________________________________________
+|
+| File: spatial.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define SPATIAL_SPEED_OF_SOUND  1125.0f   // feet per second
+#define SPATIAL_MIN_PITCH       0.5f      // Doppler shift limits
+#define SPATIAL_MAX_PITCH       2.0f
+
+typedef struct {
+  int   emitters;
+  int   committed;      // voices changed by the last update
+  float update_time;    // milliseconds in the last Spatial_Update()
+} SpatialStats;
+
+// Makes room for max_emitters emitters, returns true on success
+bool Spatial_Init (int max_emitters);
+
+// Frees all emitters
+void Spatial_Free ();
+
+// Adds an emitter, gain is scaled down by distance past min_distance up to max_distance (like snd_SetSoundMinDistance(),
+//   snd_SetSoundMaxDistance()), voice (0 = none) gets the result, returns the emitter or -1 if full
+int Spatial_Add_Emitter (float x, float y, float z, float min_distance, float max_distance, float gain, MixerVoice voice);
+
+// Removes an emitter
+void Spatial_Remove_Emitter (int emitter);
+
+// Moves an emitter, nothing is computed until Spatial_Update()
+void Spatial_Set_Emitter_Position (int emitter, float x, float y, float z);
+
+// Changes the voice (0 = none) and gain of an emitter
+void Spatial_Set_Emitter_Voice (int emitter, MixerVoice voice, float gain);
+
+// Moves the listener, forward and up are unit vectors
+void Spatial_Set_Listener (float x, float y, float z, float forward_x, float forward_y, float forward_z, float up_x, float up_y, float up_z);
+
+// Computes gain, pan and Doppler pitch of every emitter and sets their voices, once per frame
+void Spatial_Update (unsigned elapsed_time);  // milliseconds since the last update
+
+// Gets the results of the last update for an emitter
+void Spatial_Get_Emitter (int emitter, float *gain, float *pan, float *pitch);
+
+// Gets counts and times
+void Spatial_Get_Stats (SpatialStats *stats);
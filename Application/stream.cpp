@@ -0,0 +1,508 @@
+/*____________________________________________________________________
+|
+| File: stream.cpp
+|
+| Description: Loads models and textures in the background.  A load
+|   request returns a handle right away and the asset's placeholder is
+|   used until the load is done.
+|
+|   A pool of loading threads does the slow part, reading the files:
+|   each file is read from disk once and its contents hashed for the
+|   asset cache.  The gx loaders can only be called on the program
+|   thread and only load from a file, so the program thread finishes
+|   each load in Stream_Update() through the asset cache, reading the
+|   files again from the OS file cache.
+|
+|   So reading overlaps the frames drawn with placeholders, and only
+|   the finish (decode and upload) is on the program thread.  With a
+|   fast disk one loading thread keeps up and the loads finished per
+|   frame set the total time; more threads help when each file waits
+|   on a seek.
+|
+|   Loads are done nearest the camera first.  Stream_Update() updates
+|   the distance of each waiting load, loading threads always take the
+|   nearest one and Stream_Update() finishes the nearest ones first.
+|
+| Functions: Stream_Init
+|            Stream_Free
+|            Stream_Load_Object
+|            Stream_Load_Texture
+|             New_Request
+|            Stream_Update
+|             Finish_Request
+|            Stream_Is_Done
+|            Stream_Get_Object
+|            Stream_Get_Texture
+|            Stream_Get_Stats
+|             Get_Time
+|             Loader_Thread
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <float.h>
+#include <process.h>
+
+#include "dp.h"
+
+#include "filemap.h"
+#include "asset.h"
+#include "stream.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MAX_LOADER_THREADS 16
+#define MAX_REQUESTS       256
+#define MAX_PATH_SIZE      260
+
+#define STREAM_OBJECT      1
+#define STREAM_TEXTURE     2
+
+// Request states
+#define REQUEST_PENDING    0   // waiting for a loading thread
+#define REQUEST_READING    1   // being read by a loading thread
+#define REQUEST_READY      2   // read, waiting for Stream_Update()
+#define REQUEST_DONE       3   // loaded or failed
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  int                 type;
+  volatile int        state;
+  char                files [2][MAX_PATH_SIZE];  // model or color, alpha ("" = none)
+  unsigned            format, flags;
+  bool                has_position;
+  gx3dVector          position;
+  float               distance;                  // squared, from camera
+  gx3dObject         *placeholder_object;
+  gx3dTexture         placeholder_texture;
+  // Set by loading thread
+  bool                read_ok;
+  unsigned            size [2];
+  unsigned long long  time [2], hash [2];
+  // Set when done
+  AssetHandle         asset;
+} StreamRequest;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static StreamRequest *New_Request (int type, const char *file0, const char *file1, unsigned format, unsigned flags, gx3dVector *position);
+static void Finish_Request (StreamRequest *r);
+static double Get_Time ();
+static unsigned __stdcall Loader_Thread (void *params);
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static HANDLE           loader_threads [MAX_LOADER_THREADS];
+static int              num_loaders = 0;
+static HANDLE           work_semaphore;      // released once per request
+static CRITICAL_SECTION request_critsection; // guards request states and stats
+static volatile LONG    quit_loaders;
+
+static StreamRequest    requests [MAX_REQUESTS];
+static int              num_requests;
+static StreamStats      stream_stats;
+
+/*____________________________________________________________________
+|
+| Function: Stream_Init
+|
+| Input: Called from Program_Run()
+| Output: Starts the loading threads.
+|___________________________________________________________________*/
+
+void Stream_Init (int num_threads)
+{
+  int i;
+  SYSTEM_INFO sysinfo;
+
+  if (num_threads <= 0) {
+    GetSystemInfo (&sysinfo);
+    num_threads = (int)sysinfo.dwNumberOfProcessors;
+  }
+  if (num_threads > MAX_LOADER_THREADS)
+    num_threads = MAX_LOADER_THREADS;
+
+  InitializeCriticalSection (&request_critsection);
+  work_semaphore = CreateSemaphore (NULL, 0, MAX_REQUESTS + MAX_LOADER_THREADS, NULL);
+  quit_loaders   = FALSE;
+  num_requests   = 0;
+  memset (&stream_stats, 0, sizeof(stream_stats));
+
+  num_loaders = 0;
+  for (i=0; i<num_threads; i++) {
+    loader_threads[i] = (HANDLE) _beginthreadex (NULL, 0, Loader_Thread, NULL, 0, NULL);
+    if (loader_threads[i] == 0)
+      break;
+    num_loaders++;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Free
+|
+| Input: Called from Program_Run()
+| Output: Stops the loading threads.  Loads not finished are dropped.
+|___________________________________________________________________*/
+
+void Stream_Free ()
+{
+  int i;
+
+  InterlockedExchange (&quit_loaders, TRUE);
+  if (num_loaders) {
+    ReleaseSemaphore (work_semaphore, num_loaders, NULL);
+    WaitForMultipleObjects (num_loaders, loader_threads, TRUE, INFINITE);
+    for (i=0; i<num_loaders; i++)
+      CloseHandle (loader_threads[i]);
+  }
+  num_loaders  = 0;
+  num_requests = 0;
+
+  CloseHandle (work_semaphore);
+  DeleteCriticalSection (&request_critsection);
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Load_Object
+|
+| Input: Called from ____
+| Output: Starts loading a model.  Returns a handle, or 0 if there is
+|   no room for another request.
+|___________________________________________________________________*/
+
+StreamHandle Stream_Load_Object (const char *filename, unsigned vertex_format, unsigned flags, gx3dVector *position, gx3dObject *placeholder)
+{
+  StreamRequest *r;
+
+  r = New_Request (STREAM_OBJECT, filename, NULL, vertex_format, flags, position);
+  if (r == NULL)
+    return (0);
+  r->placeholder_object = placeholder;
+  ReleaseSemaphore (work_semaphore, 1, NULL);
+
+  return ((StreamHandle)(r - requests + 1));
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Load_Texture
+|
+| Input: Called from ____
+| Output: Starts loading a texture.  Returns a handle, or 0 if there is
+|   no room for another request.
+|___________________________________________________________________*/
+
+StreamHandle Stream_Load_Texture (const char *color_file, const char *alpha_file, unsigned flags, gx3dVector *position, gx3dTexture placeholder)
+{
+  StreamRequest *r;
+
+  r = New_Request (STREAM_TEXTURE, color_file, alpha_file, 0, flags, position);
+  if (r == NULL)
+    return (0);
+  r->placeholder_texture = placeholder;
+  ReleaseSemaphore (work_semaphore, 1, NULL);
+
+  return ((StreamHandle)(r - requests + 1));
+}
+
+/*____________________________________________________________________
+|
+| Function: New_Request
+|
+| Input: Called from Stream_Load_Object(), Stream_Load_Texture()
+| Output: Fills in a new request.  Returns NULL if there is no room or
+|   a filename is too long.
+|___________________________________________________________________*/
+
+static StreamRequest *New_Request (int type, const char *file0, const char *file1, unsigned format, unsigned flags, gx3dVector *position)
+{
+  StreamRequest *r;
+
+  if ((num_requests == MAX_REQUESTS) OR (strlen (file0) >= MAX_PATH_SIZE) OR (file1 AND (strlen (file1) >= MAX_PATH_SIZE)))
+    return (NULL);
+
+  r = &requests[num_requests];
+  memset (r, 0, sizeof(StreamRequest));
+  r->type   = type;
+  r->state  = REQUEST_PENDING;
+  r->format = format;
+  r->flags  = flags;
+  strcpy (r->files[0], file0);
+  if (file1)
+    strcpy (r->files[1], file1);
+  if (position) {
+    r->has_position = true;
+    r->position     = *position;
+    r->distance     = FLT_MAX;   // until the first Stream_Update()
+  }
+
+  // Make it visible to loading threads
+  EnterCriticalSection (&request_critsection);
+  num_requests++;
+  stream_stats.requested++;
+  stream_stats.pending++;
+  LeaveCriticalSection (&request_critsection);
+
+  return (r);
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Update
+|
+| Input: Called from Program_Run()
+| Output: Updates the distance of each load not yet finished, then
+|   finishes up to max_loads read loads, nearest first.  Returns # of
+|   loads finished.
+|___________________________________________________________________*/
+
+int Stream_Update (gx3dVector *camera, int max_loads)
+{
+  int i, n;
+  float dx, dy, dz;
+  StreamRequest *r, *nearest;
+
+  EnterCriticalSection (&request_critsection);
+  for (i=0; i<num_requests; i++) {
+    r = &requests[i];
+    if ((r->state != REQUEST_DONE) AND r->has_position) {
+      dx = r->position.x - camera->x;
+      dy = r->position.y - camera->y;
+      dz = r->position.z - camera->z;
+      r->distance = dx*dx + dy*dy + dz*dz;
+    }
+  }
+  LeaveCriticalSection (&request_critsection);
+
+  for (n=0; n<max_loads; n++) {
+    // Nearest read request (state only changes from READY on this thread)
+    nearest = NULL;
+    for (i=0; i<num_requests; i++) {
+      r = &requests[i];
+      if ((r->state == REQUEST_READY) AND ((nearest == NULL) OR (r->distance < nearest->distance)))
+        nearest = r;
+    }
+    if (nearest == NULL)
+      break;
+    Finish_Request (nearest);
+  }
+
+  return (n);
+}
+
+/*____________________________________________________________________
+|
+| Function: Finish_Request
+|
+| Input: Called from Stream_Update()
+| Output: Loads a read request through the asset cache, giving it the
+|   file hashes from the loading thread.
+|___________________________________________________________________*/
+
+static void Finish_Request (StreamRequest *r)
+{
+  int i;
+  double start;
+
+  start = Get_Time ();
+
+  if (r->read_ok) {
+    for (i=0; i<2; i++)
+      if (r->files[i][0])
+        Asset_Set_File_Hash (r->files[i], r->size[i], r->time[i], r->hash[i]);
+    if (r->type == STREAM_OBJECT)
+      r->asset = Asset_Load_Object (r->files[0], r->format, r->flags);
+    else
+      r->asset = Asset_Load_Texture (r->files[0], r->files[1][0] ? r->files[1] : NULL, r->flags);
+  }
+
+  EnterCriticalSection (&request_critsection);
+  r->state = REQUEST_DONE;
+  stream_stats.ready--;
+  if (r->asset)
+    stream_stats.loaded++;
+  else
+    stream_stats.failed++;
+  stream_stats.finish_time += (float)(Get_Time () - start);
+  LeaveCriticalSection (&request_critsection);
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Is_Done
+|
+| Input: Called from ____
+| Output: Returns true if an asset is loaded or failed to load.
+|___________________________________________________________________*/
+
+bool Stream_Is_Done (StreamHandle handle)
+{
+  if ((handle == 0) OR (handle > (StreamHandle)num_requests))
+    return (true);
+
+  return (requests[handle-1].state == REQUEST_DONE);
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Get_Object
+|
+| Input: Called from ____
+| Output: Returns the model, or its placeholder if not loaded.
+|___________________________________________________________________*/
+
+gx3dObject *Stream_Get_Object (StreamHandle handle)
+{
+  StreamRequest *r;
+  gx3dObject *object;
+
+  if ((handle == 0) OR (handle > (StreamHandle)num_requests))
+    return (NULL);
+  r = &requests[handle-1];
+  object = NULL;
+  if (r->state == REQUEST_DONE)
+    object = Asset_Get_Object (r->asset);
+
+  return (object ? object : r->placeholder_object);
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Get_Texture
+|
+| Input: Called from ____
+| Output: Returns the texture, or its placeholder if not loaded.
+|___________________________________________________________________*/
+
+gx3dTexture Stream_Get_Texture (StreamHandle handle)
+{
+  StreamRequest *r;
+  gx3dTexture texture;
+
+  if ((handle == 0) OR (handle > (StreamHandle)num_requests))
+    return (0);
+  r = &requests[handle-1];
+  texture = 0;
+  if (r->state == REQUEST_DONE)
+    texture = Asset_Get_Texture (r->asset);
+
+  return (texture ? texture : r->placeholder_texture);
+}
+
+/*____________________________________________________________________
+|
+| Function: Stream_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.
+|___________________________________________________________________*/
+
+void Stream_Get_Stats (StreamStats *stats)
+{
+  EnterCriticalSection (&request_critsection);
+  *stats = stream_stats;
+  LeaveCriticalSection (&request_critsection);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Finish_Request(), Loader_Thread()
+| Output: Returns a time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+  LARGE_INTEGER count, freq;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&freq);
+
+  return ((double)count.QuadPart * 1000 / freq.QuadPart);
+}
+
+/*____________________________________________________________________
+|
+| Function: Loader_Thread
+|
+| Input: Started from Stream_Init()
+| Output: Waits for a request, takes the nearest pending one and reads
+|   and hashes its files.  Repeats until Stream_Free() is called.
+|___________________________________________________________________*/
+
+static unsigned __stdcall Loader_Thread (void *params)
+{
+  int i;
+  double start;
+  const void *data;
+  StreamRequest *r, *nearest;
+
+  for (;;) {
+    WaitForSingleObject (work_semaphore, INFINITE);
+    if (quit_loaders)
+      break;
+
+    // Take the nearest pending request
+    EnterCriticalSection (&request_critsection);
+    nearest = NULL;
+    for (i=0; i<num_requests; i++) {
+      r = &requests[i];
+      if ((r->state == REQUEST_PENDING) AND ((nearest == NULL) OR (r->distance < nearest->distance)))
+        nearest = r;
+    }
+    if (nearest)
+      nearest->state = REQUEST_READING;
+    LeaveCriticalSection (&request_critsection);
+    if (nearest == NULL)
+      continue;
+
+    // Read each file once, hashing it for the asset cache
+    start = Get_Time ();
+    nearest->read_ok = true;
+    for (i=0; (i < 2) AND nearest->read_ok; i++) {
+      if (nearest->files[i][0] == 0)
+        continue;
+      nearest->read_ok = false;
+      if (File_Get_Info (nearest->files[i], &nearest->size[i], &nearest->time[i])) {
+        data = File_Map (nearest->files[i], &nearest->size[i]);
+        if (data) {
+          nearest->hash[i] = File_Hash (data, nearest->size[i]);
+          File_Unmap (data, nearest->size[i]);
+          nearest->read_ok = true;
+        }
+      }
+    }
+
+    EnterCriticalSection (&request_critsection);
+    nearest->state = REQUEST_READY;
+    stream_stats.pending--;
+    stream_stats.ready++;
+    stream_stats.read_time += (float)(Get_Time () - start);
+    LeaveCriticalSection (&request_critsection);
+  }
+
+  return (0);
+}
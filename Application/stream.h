@@ -0,0 +1,45 @@
+/*____________________________________________________________________
+|
+| File: stream.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// Handle to a streamed asset, 0 = none
+typedef unsigned StreamHandle;
+
+typedef struct {
+  int   requested;
+  int   pending;     // waiting for or being read by a loading thread
+  int   ready;       // read, waiting for Stream_Update()
+  int   loaded;
+  int   failed;
+  float read_time;   // milliseconds spent reading on loading threads
+  float finish_time; // milliseconds spent finishing loads in Stream_Update()
+} StreamStats;
+
+// Starts loading threads (0 = one per processor)
+void Stream_Init (int num_threads);
+
+// Stops loading threads, assets that were loaded stay in the asset cache
+void Stream_Free ();
+
+// Starts loading a model, position is where it is used (NULL = always needed first)
+StreamHandle Stream_Load_Object (const char *filename, unsigned vertex_format, unsigned flags, gx3dVector *position, gx3dObject *placeholder);
+
+// Starts loading a texture, position is where it is used (NULL = always needed first)
+StreamHandle Stream_Load_Texture (const char *color_file, const char *alpha_file, unsigned flags, gx3dVector *position, gx3dTexture placeholder);
+
+// Reorders loads nearest the camera first and finishes up to max_loads loads, returns # finished
+int Stream_Update (gx3dVector *camera, int max_loads);
+
+// Returns true when an asset is loaded (or failed to load)
+bool Stream_Is_Done (StreamHandle handle);
+
+// Gets the asset, or its placeholder until it is loaded
+gx3dObject *Stream_Get_Object (StreamHandle handle);
+gx3dTexture Stream_Get_Texture (StreamHandle handle);
+
+// Gets counts and times
+void Stream_Get_Stats (StreamStats *stats);
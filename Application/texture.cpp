@@ -0,0 +1,443 @@
+/*____________________________________________________________________
+|
+| File: texture.cpp
+|
+| Description: Cooked texture files.  A BMP file and its alpha (_fa)
+|   file are cooked once into a file holding the full mip chain block
+|   compressed, BC1 for opaque textures and BC3 for textures with
+|   alpha.  Levels are found by offsets from the start of the file, so
+|   loading is just mapping the file.  Mips are made by mip.cpp, with
+|   a Kaiser filter in linear space, keeping the alpha test coverage of
+|   textures with alpha.
+|
+|   Blocks are compressed in parallel, one job per row of blocks over
+|   all levels.  Each block is decoded again to measure the error of
+|   level 0.
+|
+|   The header records the size, write time and content hash of both
+|   BMP files.  If a size or time changed the file is hashed, and the
+|   texture is cooked again only if the hash changed too.
+|
+| Functions: Texture_Cook
+|             Encode_Rows
+|             Record_Source
+|            Texture_Load
+|             Source_Changed
+|             Map_Texture
+|             Get_Texture_Filename
+|            Texture_Free
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+#include <math.h>
+
+#include "dp.h"
+
+#include "bmp.h"
+#include "bc.h"
+#include "jobs.h"
+#include "mip.h"
+#include "filemap.h"
+#include "texture.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+// Everything the compress jobs need
+typedef struct {
+  unsigned  format;
+  int       block_size;
+  int       num_levels;
+  int       dx [TEXTURE_MAX_LEVELS];
+  int       dy [TEXTURE_MAX_LEVELS];
+  byte     *pixels [TEXTURE_MAX_LEVELS];      // RGBA
+  byte     *blocks [TEXTURE_MAX_LEVELS];      // into the file
+  int       first_row [TEXTURE_MAX_LEVELS+1]; // first job of each level
+  double   *row_error;                        // squared error of each level 0 row
+} CookParams;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Encode_Rows (int first, int last, void *params);
+static void Record_Source (const char *filename, unsigned *size, unsigned long long *time, unsigned long long *hash);
+static bool Source_Changed (const char *filename, unsigned size, unsigned long long time, unsigned long long hash);
+static bool Map_Texture (const char *texture_file, Texture *texture, unsigned *size);
+static void Get_Texture_Filename (const char *color_file, char *texture_file);
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#define ALIGN_UP(_n_) (((_n_) + 15) & ~15)
+
+#define TEXTURE_MAX_PATH 260
+
+#define ALPHA_TEST_REF   128  // alpha test value textures with alpha are drawn with
+
+/*____________________________________________________________________
+|
+| Function: Texture_Cook
+|
+| Input: Called from Texture_Load()
+| Output: Cooks a BMP file and its alpha file into a texture file.
+|   Returns true on success, else false.
+|___________________________________________________________________*/
+
+int Texture_Cook (const char *color_file, const char *alpha_file, const char *texture_file, TextureReport *report)
+{
+  int i, dx, dy, bitdepth, num_rows, ok;
+  unsigned size, channels;
+  double error = 0;
+  LARGE_INTEGER start, encode_start, encode_end, end, freq;
+  byte *file;
+  TextureHeader *header;
+  CookParams cook;
+  MipChain chain;
+  FILE *fp;
+
+  QueryPerformanceCounter (&start);
+
+  if (NOT Bmp_Read_Info (color_file, &dx, &dy, &bitdepth))
+    return (FALSE);
+
+  // Sizes of the mip chain, down to 1x1 (as mip.cpp makes them)
+  memset (&cook, 0, sizeof(cook));
+  cook.format     = alpha_file ? TEXTURE_BC3 : TEXTURE_BC1;
+  cook.block_size = alpha_file ? BC3_BLOCK_SIZE : BC1_BLOCK_SIZE;
+  cook.dx[0]      = dx;
+  cook.dy[0]      = dy;
+  for (i=1; (i < TEXTURE_MAX_LEVELS) AND ((cook.dx[i-1] > 1) OR (cook.dy[i-1] > 1)); i++) {
+    cook.dx[i] = (cook.dx[i-1] > 1) ? cook.dx[i-1] / 2 : 1;
+    cook.dy[i] = (cook.dy[i-1] > 1) ? cook.dy[i-1] / 2 : 1;
+  }
+  cook.num_levels = i;
+
+  // Lay out the file
+  size = ALIGN_UP (sizeof(TextureHeader));
+  for (i=0; i<cook.num_levels; i++)
+    size += ALIGN_UP (((cook.dx[i] + 3) / 4) * ((cook.dy[i] + 3) / 4) * cook.block_size);
+  file = (byte *) calloc (size, 1);
+  if (file == NULL)
+    return (FALSE);
+  header = (TextureHeader *) file;
+  header->magic      = TEXTURE_MAGIC;
+  header->version    = TEXTURE_VERSION;
+  header->format     = cook.format;
+  header->file_size  = size;
+  header->dx         = dx;
+  header->dy         = dy;
+  header->num_levels = cook.num_levels;
+  header->level_offset[0] = ALIGN_UP (sizeof(TextureHeader));
+  for (i=0; i<cook.num_levels; i++) {
+    header->level_size[i] = ((cook.dx[i] + 3) / 4) * ((cook.dy[i] + 3) / 4) * cook.block_size;
+    if (i)
+      header->level_offset[i] = header->level_offset[i-1] + ALIGN_UP (header->level_size[i-1]);
+    cook.blocks[i] = file + header->level_offset[i];
+  }
+
+  // Record the sources so a stale texture can be found
+  Record_Source (color_file, &header->source_size[0], &header->source_time[0], &header->source_hash[0]);
+  if (alpha_file)
+    Record_Source (alpha_file, &header->source_size[1], &header->source_time[1], &header->source_hash[1]);
+
+  // Decode level 0 and build the rest of the chain
+  memset (&chain, 0, sizeof(chain));
+  cook.pixels[0] = (byte *) malloc (dx * dy * 4);
+  ok = (cook.pixels[0] != NULL) AND
+       Bmp_Decode (color_file, alpha_file, cook.pixels[0], dx, dy, dx * 4) AND
+       Mip_Build (cook.pixels[0], dx, dy, MIP_KAISER, alpha_file ? ALPHA_TEST_REF : 0, &chain);
+  for (i=1; ok AND (i<cook.num_levels); i++)
+    cook.pixels[i] = chain.levels[i];
+
+  // Compress every row of blocks of every level
+  if (ok) {
+    num_rows = 0;
+    for (i=0; i<cook.num_levels; i++) {
+      cook.first_row[i] = num_rows;
+      num_rows += (cook.dy[i] + 3) / 4;
+    }
+    cook.first_row[cook.num_levels] = num_rows;
+    cook.row_error = (double *) calloc (num_rows, sizeof(double));
+    ok = (cook.row_error != NULL);
+  }
+  if (ok) {
+    QueryPerformanceCounter (&encode_start);
+    Jobs_Parallel_For (num_rows, 1, Encode_Rows, &cook);
+    QueryPerformanceCounter (&encode_end);
+
+    // Error of level 0, summed in row order so it is the same for any number of threads
+    error = 0;
+    for (i=0; i<cook.first_row[1]; i++)
+      error += cook.row_error[i];
+    free (cook.row_error);
+  }
+  if (cook.pixels[0])
+    free (cook.pixels[0]);
+  Mip_Free (&chain);
+
+  // Write it
+  if (ok) {
+    ok = FALSE;
+    fp = fopen (texture_file, "wb");
+    if (fp) {
+      ok = (fwrite (file, size, 1, fp) == 1);
+      if (fclose (fp) != 0)
+        ok = FALSE;
+      if (NOT ok)
+        remove (texture_file);
+    }
+  }
+
+  if (ok AND report) {
+    QueryPerformanceCounter (&end);
+    QueryPerformanceFrequency (&freq);
+    channels = alpha_file ? 4 : 3;
+    report->cook_time    = (float)((double)(end.QuadPart - start.QuadPart) * 1000 / freq.QuadPart);
+    report->encode_time  = (float)((double)(encode_end.QuadPart - encode_start.QuadPart) * 1000 / freq.QuadPart);
+    report->rmse         = (float) sqrt (error / ((double)dx * dy * channels));
+    report->psnr         = (report->rmse > 0) ? (float)(20 * log10 (255 / report->rmse)) : 99;
+    report->source_bytes = header->source_size[0] + header->source_size[1];
+    report->cooked_bytes = size;
+  }
+  free (file);
+
+  return (ok);
+}
+
+/*____________________________________________________________________
+|
+| Function: Encode_Rows
+|
+| Input: Called from Texture_Cook() through Jobs_Parallel_For()
+| Output: Compresses a range of rows of blocks.  Pixels past the edge
+|   of a level smaller than a block repeat the last row or column.
+|   For level 0 the block is decoded to get its squared error.
+|___________________________________________________________________*/
+
+static void Encode_Rows (int first, int last, void *params)
+{
+  int row, level, by, bx, x, y, sx, sy, c, d, num_blocks_x;
+  double error = 0;
+  byte in[64], out[64], *block, *src;
+  CookParams *cook = (CookParams *) params;
+
+  for (row=first; row<last; row++) {
+    for (level=0; row >= cook->first_row[level+1]; level++);
+    by = row - cook->first_row[level];
+    num_blocks_x = (cook->dx[level] + 3) / 4;
+    error = 0;
+    for (bx=0; bx<num_blocks_x; bx++) {
+      for (y=0; y<4; y++) {
+        sy = by * 4 + y;
+        if (sy >= cook->dy[level])
+          sy = cook->dy[level] - 1;
+        for (x=0; x<4; x++) {
+          sx = bx * 4 + x;
+          if (sx >= cook->dx[level])
+            sx = cook->dx[level] - 1;
+          src = cook->pixels[level] + (sy * cook->dx[level] + sx) * 4;
+          for (c=0; c<4; c++)
+            in[(y * 4 + x) * 4 + c] = src[c];
+        }
+      }
+      block = cook->blocks[level] + (by * num_blocks_x + bx) * cook->block_size;
+      if (cook->format == TEXTURE_BC3)
+        Bc3_Encode_Block (in, block);
+      else
+        Bc1_Encode_Block (in, block);
+
+      if (level == 0) {
+        if (cook->format == TEXTURE_BC3)
+          Bc3_Decode_Block (block, out);
+        else
+          Bc1_Decode_Block (block, out);
+        for (y=0; y<4; y++)
+          for (x=0; x<4; x++)
+            if ((by * 4 + y < cook->dy[0]) AND (bx * 4 + x < cook->dx[0]))
+              for (c=0; c<((cook->format == TEXTURE_BC3) ? 4 : 3); c++) {
+                d = in[(y * 4 + x) * 4 + c] - out[(y * 4 + x) * 4 + c];
+                error += d * d;
+              }
+      }
+    }
+    cook->row_error[row] = error;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Record_Source
+|
+| Input: Called from Texture_Cook()
+| Output: Gets size, write time and content hash of a source file.
+|___________________________________________________________________*/
+
+static void Record_Source (const char *filename, unsigned *size, unsigned long long *time, unsigned long long *hash)
+{
+  const void *data;
+
+  File_Get_Info (filename, size, time);
+  data = File_Map (filename, size);
+  if (data) {
+    *hash = File_Hash (data, *size);
+    File_Unmap (data, *size);
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Texture_Load
+|
+| Input: Called from ____
+| Output: Loads the cooked version of a BMP file.  Cooks it first if it
+|   is missing, from an older version or a BMP file changed.  Returns
+|   true on success, else false.
+|___________________________________________________________________*/
+
+int Texture_Load (const char *color_file, const char *alpha_file, Texture *texture)
+{
+  char texture_file[TEXTURE_MAX_PATH];
+  unsigned size;
+  const TextureHeader *header;
+
+  Get_Texture_Filename (color_file, texture_file);
+
+  if (Map_Texture (texture_file, texture, &size)) {
+    header = texture->header;
+    // Still cooked from the same files? (no sources is a shipped build, use it as is)
+    if ((header->format == (alpha_file ? (unsigned)TEXTURE_BC3 : (unsigned)TEXTURE_BC1)) AND
+        NOT Source_Changed (color_file, header->source_size[0], header->source_time[0], header->source_hash[0]) AND
+        ((alpha_file == NULL) OR NOT Source_Changed (alpha_file, header->source_size[1], header->source_time[1], header->source_hash[1])))
+      return (TRUE);
+    Texture_Free (texture);
+  }
+
+  // Cook it and map it again
+  if (NOT Texture_Cook (color_file, alpha_file, texture_file, NULL))
+    return (FALSE);
+
+  return (Map_Texture (texture_file, texture, &size));
+}
+
+/*____________________________________________________________________
+|
+| Function: Source_Changed
+|
+| Input: Called from Texture_Load()
+| Output: Returns true if a source file's content is not what it was
+|   when the texture was cooked.  Only hashes the file if its size or
+|   time changed.
+|___________________________________________________________________*/
+
+static bool Source_Changed (const char *filename, unsigned size, unsigned long long time, unsigned long long hash)
+{
+  unsigned source_size;
+  unsigned long long source_time;
+  const void *source;
+  bool changed;
+
+  if (NOT File_Get_Info (filename, &source_size, &source_time))
+    return (false);
+  if ((source_size == size) AND (source_time == time))
+    return (false);
+
+  changed = true;
+  source = File_Map (filename, &source_size);
+  if (source) {
+    changed = (source_size != size) OR (File_Hash (source, source_size) != hash);
+    File_Unmap (source, source_size);
+  }
+
+  return (changed);
+}
+
+/*____________________________________________________________________
+|
+| Function: Map_Texture
+|
+| Input: Called from Texture_Load()
+| Output: Maps a texture file and sets pointers to its levels.  Returns
+|   true if the file is a texture of the current version, else false.
+|___________________________________________________________________*/
+
+static bool Map_Texture (const char *texture_file, Texture *texture, unsigned *size)
+{
+  unsigned i;
+  const byte *data;
+  const TextureHeader *header;
+  bool ok;
+
+  data = (const byte *) File_Map (texture_file, size);
+  if (data == NULL)
+    return (false);
+  header = (const TextureHeader *) data;
+  ok = (*size >= sizeof(TextureHeader)) AND
+       (header->magic == TEXTURE_MAGIC) AND
+       (header->version == TEXTURE_VERSION) AND
+       (header->file_size == *size) AND
+       (header->num_levels >= 1) AND
+       (header->num_levels <= TEXTURE_MAX_LEVELS);
+  for (i=0; ok AND (i<header->num_levels); i++)
+    ok = (header->level_offset[i] <= *size) AND (header->level_size[i] <= *size - header->level_offset[i]);
+  if (NOT ok) {
+    File_Unmap (data, *size);
+    return (false);
+  }
+
+  texture->header = header;
+  for (i=0; i<TEXTURE_MAX_LEVELS; i++)
+    texture->levels[i] = (i < header->num_levels) ? data + header->level_offset[i] : NULL;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Texture_Filename
+|
+| Input: Called from Texture_Load()
+| Output: Gets the texture filename for a BMP file, the same name with a
+|   .tex extension.
+|___________________________________________________________________*/
+
+static void Get_Texture_Filename (const char *color_file, char *texture_file)
+{
+  char *dot;
+
+  strncpy (texture_file, color_file, TEXTURE_MAX_PATH-5);
+  texture_file[TEXTURE_MAX_PATH-5] = 0;
+  dot = strrchr (texture_file, '.');
+  if (dot AND (strpbrk (dot, "\\/") == NULL))
+    *dot = 0;
+  strcat (texture_file, ".tex");
+}
+
+/*____________________________________________________________________
+|
+| Function: Texture_Free
+|
+| Input: Called from ____
+| Output: Frees a texture loaded by Texture_Load().
+|___________________________________________________________________*/
+
+void Texture_Free (Texture *texture)
+{
+  if (texture->header) {
+    File_Unmap (texture->header, texture->header->file_size);
+    texture->header = NULL;
+  }
+}
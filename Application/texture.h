@@ -0,0 +1,55 @@
+/*____________________________________________________________________
+|
+| File: texture.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define TEXTURE_MAGIC       0x58455443  // "CTEX"
+#define TEXTURE_VERSION     2
+#define TEXTURE_MAX_LEVELS  16
+
+// Block formats
+#define TEXTURE_BC1         1           // rgb, 8 bytes per 4x4 block
+#define TEXTURE_BC3         3           // rgb + alpha, 16 bytes per 4x4 block
+
+// Cooked texture file: header then each mip level (largest first), each level 16-byte aligned
+typedef struct {
+  unsigned           magic;
+  unsigned           version;
+  unsigned           format;
+  unsigned           file_size;         // this file
+  unsigned           dx, dy;            // level 0 in pixels
+  unsigned           num_levels;
+  unsigned           reserved;
+  unsigned           level_offset [TEXTURE_MAX_LEVELS];  // bytes from the start of the file
+  unsigned           level_size [TEXTURE_MAX_LEVELS];
+  unsigned           source_size [2];   // color and alpha BMP files it was cooked from
+  unsigned long long source_time [2];
+  unsigned long long source_hash [2];
+} TextureHeader;
+
+// A loaded texture, all pointers are into the mapped file
+typedef struct {
+  const TextureHeader *header;
+  const void          *levels [TEXTURE_MAX_LEVELS];  // blocks, rows top to bottom
+} Texture;
+
+typedef struct {
+  float    cook_time;      // milliseconds, total
+  float    encode_time;    // milliseconds compressing blocks
+  float    rmse;           // level 0, over rgb (BC1) or rgba (BC3)
+  float    psnr;           // dB
+  unsigned source_bytes;   // BMP files
+  unsigned cooked_bytes;   // texture file, all levels
+} TextureReport;
+
+// Cooks a BMP file and its alpha (_fa) file (NULL = opaque, BC1) into a texture file, report can be NULL, returns true on success
+int Texture_Cook (const char *color_file, const char *alpha_file, const char *texture_file, TextureReport *report);
+
+// Loads the cooked version of a BMP file (same name, .tex), cooking it first if it is missing or stale, returns true on success
+int Texture_Load (const char *color_file, const char *alpha_file, Texture *texture);
+
+// Frees a texture loaded by Texture_Load()
+void Texture_Free (Texture *texture);
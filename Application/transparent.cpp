@@ -0,0 +1,343 @@
+/*____________________________________________________________________
+|
+| File: transparent.cpp
+|
+| Description: One pass for all transparent objects.  Every object adds
+|   an item (view depth, state, draw callback) and the pass draws them in
+|   one order, so different kinds of objects (trees, ghosts) composite
+|   correctly with each other.
+|
+|   Alpha tested items write the zbuffer and don't need any order, so
+|   they go in a separate list and are drawn first.  Only alpha blended
+|   items are sorted, back to front, with a 2 pass radix sort on a 16-bit
+|   quantized depth, its scratch lists taken from the frame arena.
+|   Texture and texture matrix are only set when they change from the
+|   item before.
+|
+| Functions: Transparent_Init
+|            Transparent_Free
+|            Transparent_Begin
+|            Transparent_Add
+|            Transparent_Draw
+|             Sort_Blended
+|             Draw_Item
+|            Transparent_Get_State_Changes
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#include <first_header.h>
+
+#include "dp.h"
+
+#include "arena.h"
+#include "transparent.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  gx3dTexture              texture;
+  gx3dMatrix              *texture_matrix;
+  TransparentDrawCallback  draw;
+  void                    *params;
+  int                      item;
+} TransparentItem;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static void Sort_Blended ();
+static void Draw_Item (TransparentItem *t);
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static int              max_items = 0;
+static float            depth_near, depth_scale;
+
+// Alpha tested items, in the order added
+static TransparentItem *tested;
+static int              num_tested;
+
+// Alpha blended items and their sort keys
+static TransparentItem *blended;
+static int              num_blended;
+static word            *sort_key;
+static int             *sort_index;
+
+// State set by the last item drawn
+static gx3dTexture      current_texture;
+static gx3dMatrix      *current_texture_matrix;
+static bool             texture_matrix_enabled;
+static int              state_changes;
+
+/*____________________________________________________________________
+|
+| Function: Transparent_Init
+|
+| Input: Called from Program_Run()
+| Output: Allocates item lists.
+|___________________________________________________________________*/
+
+void Transparent_Init (int n)
+{
+  max_items       = n;
+  tested          = (TransparentItem *) malloc (max_items * sizeof(TransparentItem));
+  blended         = (TransparentItem *) malloc (max_items * sizeof(TransparentItem));
+  sort_key        = (word *) malloc (max_items * sizeof(word));
+  sort_index      = (int *)  malloc (max_items * sizeof(int));
+  num_tested      = 0;
+  num_blended     = 0;
+  state_changes   = 0;
+}
+
+/*____________________________________________________________________
+|
+| Function: Transparent_Free
+|
+| Input: Called from Program_Run()
+| Output: Frees item lists.
+|___________________________________________________________________*/
+
+void Transparent_Free ()
+{
+  if (max_items) {
+    free (tested);
+    free (blended);
+    free (sort_key);
+    free (sort_index);
+    max_items = 0;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Transparent_Begin
+|
+| Input: Called from Program_Run()
+| Output: Empties the item lists for a new frame.
+|___________________________________________________________________*/
+
+void Transparent_Begin (float near_plane, float far_plane)
+{
+  num_tested  = 0;
+  num_blended = 0;
+  depth_near  = near_plane;
+  depth_scale = 65535 / (far_plane - near_plane);
+}
+
+/*____________________________________________________________________
+|
+| Function: Transparent_Add
+|
+| Input: Called from ____
+| Output: Adds an item to the tested or blended list.  Returns false if
+|   the list is full.
+|___________________________________________________________________*/
+
+bool Transparent_Add (
+  int                      type,
+  float                    view_depth,      // z in camera space
+  gx3dTexture              texture,
+  gx3dMatrix              *texture_matrix,  // stage 0 texture matrix (NULL = none)
+  TransparentDrawCallback  draw,
+  void                    *params,
+  int                      item )
+{
+  TransparentItem *t;
+  float d;
+  int key;
+
+  if (type == TRANSPARENT_TESTED) {
+    if (num_tested == max_items)
+      return (false);
+    t = &tested[num_tested++];
+  }
+  else {
+    if (num_blended == max_items)
+      return (false);
+    // Farthest gets the smallest key so an ascending sort draws back to front
+    d = (view_depth - depth_near) * depth_scale;
+    if (d < 0)
+      d = 0;
+    else if (d > 65535)
+      d = 65535;
+    key = 65535 - (int)d;
+    sort_key[num_blended] = (word)key;
+    t = &blended[num_blended++];
+  }
+
+  t->texture        = texture;
+  t->texture_matrix = texture_matrix;
+  t->draw           = draw;
+  t->params         = params;
+  t->item           = item;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Transparent_Draw
+|
+| Input: Called from Program_Run()
+| Output: Draws alpha tested items then alpha blended items back to
+|   front.  Alpha blending must be enabled.  Leaves alpha testing and
+|   the stage 0 texture matrix disabled.
+|___________________________________________________________________*/
+
+void Transparent_Draw ()
+{
+  int i;
+
+  current_texture        = 0;
+  current_texture_matrix = NULL;
+  texture_matrix_enabled = false;
+  state_changes          = 0;
+
+  // Tested items, in any order
+  if (num_tested) {
+    gx3d_EnableAlphaTesting (128);
+    for (i=0; i<num_tested; i++)
+      Draw_Item (&tested[i]);
+    gx3d_DisableAlphaTesting ();
+  }
+
+  // Blended items, back to front
+  Sort_Blended ();
+  for (i=0; i<num_blended; i++)
+    Draw_Item (&blended[sort_index[i]]);
+
+  if (texture_matrix_enabled)
+    gx3d_DisableTextureMatrix (0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Sort_Blended
+|
+| Input: Called from Transparent_Draw()
+| Output: Sorts blended items by key with an LSD radix sort, 8 bits per
+|   pass.  The result is in sort_index[].  The sort is stable so items
+|   at the same depth keep the order they were added in.  Without arena
+|   memory for the scratch lists they stay in that order.
+|___________________________________________________________________*/
+
+static void Sort_Blended ()
+{
+  int i, pass, shift, sum, n;
+  int count[256];
+  word *keys_in, *keys_out, *swap_keys;
+  int  *index_in, *index_out, *swap_index;
+  ArenaMarker marker;
+
+  for (i=0; i<num_blended; i++)
+    sort_index[i] = i;
+  if (num_blended == 0)
+    return;
+
+  // Scratch lists only needed during the sort
+  marker = Arena_Get_Marker ();
+  keys_in   = sort_key;
+  keys_out  = ARENA_ARRAY (word, num_blended);
+  index_in  = sort_index;
+  index_out = ARENA_ARRAY (int, num_blended);
+  if ((keys_out == NULL) OR (index_out == NULL)) {
+    Arena_Free_To_Marker (marker);
+    return;
+  }
+
+  for (pass=0; pass<2; pass++) {
+    shift = pass * 8;
+
+    memset (count, 0, sizeof(count));
+    for (i=0; i<num_blended; i++)
+      count[(keys_in[i] >> shift) & 0xFF]++;
+
+    // Skip the pass if every key has the same digit
+    if (count[(keys_in[0] >> shift) & 0xFF] == num_blended)
+      continue;
+
+    sum = 0;
+    for (i=0; i<256; i++) {
+      n = count[i];
+      count[i] = sum;
+      sum += n;
+    }
+    for (i=0; i<num_blended; i++) {
+      n = count[(keys_in[i] >> shift) & 0xFF]++;
+      keys_out[n]  = keys_in[i];
+      index_out[n] = index_in[i];
+    }
+
+    swap_keys  = keys_in;  keys_in  = keys_out;  keys_out  = swap_keys;
+    swap_index = index_in; index_in = index_out; index_out = swap_index;
+  }
+
+  // Result must end up in sort_index[]
+  if (index_in != sort_index)
+    memcpy (sort_index, index_in, num_blended * sizeof(int));
+
+  Arena_Free_To_Marker (marker);
+}
+
+/*____________________________________________________________________
+|
+| Function: Draw_Item
+|
+| Input: Called from Transparent_Draw()
+| Output: Sets texture and texture matrix if they changed, then draws.
+|___________________________________________________________________*/
+
+static void Draw_Item (TransparentItem *t)
+{
+  if (t->texture != current_texture) {
+    gx3d_SetTexture (0, t->texture);
+    current_texture = t->texture;
+    state_changes++;
+  }
+  if (t->texture_matrix != current_texture_matrix) {
+    if (t->texture_matrix) {
+      if (NOT texture_matrix_enabled) {
+        gx3d_EnableTextureMatrix (0);
+        texture_matrix_enabled = true;
+      }
+      gx3d_SetTextureMatrix (0, t->texture_matrix);
+    }
+    else {
+      gx3d_DisableTextureMatrix (0);
+      texture_matrix_enabled = false;
+    }
+    current_texture_matrix = t->texture_matrix;
+    state_changes++;
+  }
+
+  (*t->draw) (t->params, t->item);
+}
+
+/*____________________________________________________________________
+|
+| Function: Transparent_Get_State_Changes
+|
+| Input: Called from ____
+| Output: Returns # of texture and texture matrix changes in the last
+|   Transparent_Draw().
+|___________________________________________________________________*/
+
+int Transparent_Get_State_Changes ()
+{
+  return (state_changes);
+}
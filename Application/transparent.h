@@ -0,0 +1,39 @@
+/*____________________________________________________________________
+|
+| File: transparent.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+// How an item is drawn
+#define TRANSPARENT_BLENDED 0  // alpha blended, drawn back to front
+#define TRANSPARENT_TESTED  1  // alpha tested only, drawn in any order before blended items
+
+// Draws one item, texture and texture matrix are already set
+typedef void (*TransparentDrawCallback) (void *params, int item);
+
+// Allocates room for max_items items per frame
+void Transparent_Init (int max_items);
+
+// Free any resources
+void Transparent_Free ();
+
+// Starts a new frame, view depths are sorted in the range near to far
+void Transparent_Begin (float near_plane, float far_plane);
+
+// Adds an item, returns false if there is no room
+bool Transparent_Add (
+  int                      type,
+  float                    view_depth,      // z in camera space
+  gx3dTexture              texture,
+  gx3dMatrix              *texture_matrix,  // stage 0 texture matrix (NULL = none)
+  TransparentDrawCallback  draw,
+  void                    *params,
+  int                      item );
+
+// Draws all items added since Transparent_Begin()
+void Transparent_Draw ();
+
+// Returns # of texture and texture matrix changes in the last Transparent_Draw()
+int Transparent_Get_State_Changes ();
@@ -0,0 +1,573 @@
+/*____________________________________________________________________
+|
+| File: voices.cpp
+|
+| Description: Plays many more sounds than the mixer has voices by
+|   only mixing the ones that can be heard best.
+|
+|   Each voice played here is logical.  Once per frame Voice_Update()
+|   scores every logical voice by volume * priority * attenuation and
+|   picks the most audible (up to max_real) to be real, playing on a
+|   mixer voice.  The rest are virtual: nothing is mixed, only their
+|   position is moved along by the frames the mixer played, so they
+|   come back in the right place.  Picking is a partial sort (only the
+|   top ones are found, not sorted), so the time per frame grows
+|   slowly with the number of voices while the mixing stays the same.
+|
+|   A voice that becomes real starts part way into its sound and fades
+|   in over a block.  One that becomes virtual is faded to silence over
+|   a block and only then stopped, where its position is read back.
+|   Neither clicks.  Mixed voices count a bit louder when picking, so
+|   voices near the cut don't flip back and forth.
+|
+|   Logical voices are kept in a pool (pool.cpp), one after another, so
+|   starting and stopping them doesn't allocate and each update loops
+|   over just the playing ones.  A voice's handle is its pool handle.
+|
+|   Only uses the C library, mixer.cpp and pool.cpp.
+|
+| Functions: Voice_Init
+|            Voice_Free
+|            Voice_Play
+|            Voice_Set
+|            Voice_Stop
+|            Voice_Is_Playing
+|            Voice_Is_Real
+|             Get_Logical
+|            Voice_Update
+|             Fade_Out
+|             Remove_Fade
+|             Select_Top
+|            Voice_Get_Stats
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mixer.h"
+#include "pool.h"
+#include "voices.h"
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  MixerSound sound;
+  float      volume, priority;
+  float      attenuation, pan, pitch;
+  double     position;              // frames into the sound, while virtual
+  double     step;                  // sound frames per mixer frame at normal pitch
+  int        frames;                // in the sound
+  bool       loop;
+  MixerVoice real;                  // 0 = virtual
+  bool       fading;                // real voice is fading out, to become virtual
+  bool       chosen;                // picked to be mixed by this update
+} Logical;
+
+typedef struct {
+  MixerVoice   voice;
+  unsigned     frames;              // mixer frames mixed when the fade started
+  VirtualVoice logical;             // 0 = voice was stopped
+} Fade;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static Logical *Get_Logical (VirtualVoice voice);
+static void     Fade_Out (VirtualVoice logical_voice, MixerVoice voice);
+static void     Remove_Fade (int index);
+static void     Select_Top (float *score, int *order, int n, int k);
+static double   Get_Time ();
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static int        max_logical = 0;
+static int        max_real;
+static int        mixer_rate;
+static unsigned   last_frames;      // mixer frames mixed at the last update
+
+static Pool      *logical;          // playing voices
+static float     *score;            // per playing voice, scratch for picking
+static int       *order;
+
+static Fade       fades [MIXER_MAX_VOICES];
+static int        num_fades;
+
+static VoiceStats voice_stats;
+
+/*____________________________________________________________________
+|
+| Function: Voice_Init
+|
+| Input: Called from ____
+| Output: Makes room for logical voices.  Returns true on success,
+|   else false.
+|___________________________________________________________________*/
+
+bool Voice_Init (int max, int real, int rate)
+{
+  MixerStats stats;
+
+  if (max_logical || (max <= 0) || (max > VOICE_MAX_LOGICAL) || (real <= 0) || (rate <= 0))
+    return (false);
+
+  num_fades = 0;
+  logical = POOL_CREATE (Logical, max);
+  score   = (float *) malloc (max * sizeof(float));
+  order   = (int *) malloc (max * sizeof(int));
+  max_logical = max;
+  if ((logical == NULL) || (score == NULL) || (order == NULL)) {
+    Voice_Free ();
+    return (false);
+  }
+
+  max_real   = (real < MIXER_MAX_VOICES) ? real : MIXER_MAX_VOICES;
+  mixer_rate = rate;
+  Mixer_Get_Stats (&stats);
+  last_frames = stats.frames;
+  memset (&voice_stats, 0, sizeof(voice_stats));
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Free
+|
+| Input: Called from Voice_Init(), ____
+| Output: Stops all voices.
+|___________________________________________________________________*/
+
+void Voice_Free ()
+{
+  int i;
+  Logical *items;
+
+  if (max_logical == 0)
+    return;
+
+  if (logical) {
+    items = POOL_ITEMS (Logical, logical);
+    for (i=0; i<Pool_Count (logical); i++)
+      if (items[i].real)
+        Mixer_Stop (items[i].real);
+    for (i=0; i<num_fades; i++)
+      Mixer_Stop (fades[i].voice);
+  }
+  Pool_Destroy (logical);
+  free (score);
+  free (order);
+  logical = NULL;
+  score   = NULL;
+  order   = NULL;
+  max_logical = 0;
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Play
+|
+| Input: Called from ____
+| Output: Starts a logical voice, virtual until the next update.
+|   Returns the voice, or 0 if the sound isn't loaded or there is no
+|   room.
+|___________________________________________________________________*/
+
+VirtualVoice Voice_Play (MixerSound sound, float volume, float priority)
+{
+  int frames, rate;
+  bool loop;
+  VirtualVoice voice;
+  Logical *v;
+
+  if ((max_logical == 0) || (!Mixer_Get_Sound_Info (sound, &frames, &rate, &loop)))
+    return (0);
+  voice = Pool_Alloc (logical);
+  if (voice == 0)
+    return (0);
+  v = POOL_GET (Logical, logical, voice);
+
+  v->sound       = sound;
+  v->volume      = volume;
+  v->priority    = priority;
+  v->attenuation = 1;
+  v->pan         = 0;
+  v->pitch       = 1;
+  v->position    = 0;
+  v->step        = (double) rate / mixer_rate;
+  v->frames      = frames;
+  v->loop        = loop;
+  v->real        = 0;
+  v->fading      = false;
+  v->chosen      = false;
+
+  return (voice);
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Set
+|
+| Input: Called from ____
+| Output: Changes the attenuation, pan and pitch of a voice.  Takes
+|   effect at the next update.
+|___________________________________________________________________*/
+
+void Voice_Set (VirtualVoice voice, float attenuation, float pan, float pitch)
+{
+  Logical *v;
+
+  v = Get_Logical (voice);
+  if (v == NULL)
+    return;
+
+  v->attenuation = attenuation;
+  v->pan         = pan;
+  v->pitch       = pitch;
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Stop
+|
+| Input: Called from ____
+| Output: Stops a voice, fading it out if it is being mixed.
+|___________________________________________________________________*/
+
+void Voice_Stop (VirtualVoice voice)
+{
+  int i;
+  Logical *v;
+
+  v = Get_Logical (voice);
+  if (v == NULL)
+    return;
+
+  if (v->fading) {
+    // Let the fade finish without it
+    for (i=0; fades[i].voice != v->real; i++);
+    fades[i].logical = 0;
+  }
+  else if (v->real)
+    Fade_Out (0, v->real);
+  Pool_Free (logical, voice);
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Is_Playing
+|
+| Input: Called from ____
+| Output: Returns true if a voice is still playing.
+|___________________________________________________________________*/
+
+bool Voice_Is_Playing (VirtualVoice voice)
+{
+  return (Get_Logical (voice) != NULL);
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Is_Real
+|
+| Input: Called from ____
+| Output: Returns true if a voice is being mixed (and not fading
+|   out).
+|___________________________________________________________________*/
+
+bool Voice_Is_Real (VirtualVoice voice)
+{
+  Logical *v;
+
+  v = Get_Logical (voice);
+
+  return ((v != NULL) && v->real && (!v->fading));
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Logical
+|
+| Input: Called from Voice_Set(), Voice_Stop(), Voice_Is_Playing(),
+|   Voice_Is_Real()
+| Output: Returns the logical voice of a handle, or NULL if it has
+|   stopped.
+|___________________________________________________________________*/
+
+static Logical *Get_Logical (VirtualVoice voice)
+{
+  // Asking about a voice that ended is normal here, don't count it as stale
+  if ((max_logical == 0) || (!Pool_Is_Valid (logical, voice)))
+    return (NULL);
+
+  return (POOL_GET (Logical, logical, voice));
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Update
+|
+| Input: Called from ____
+| Output: Moves virtual voices along by the frames mixed since the
+|   last update, finishes fades, then makes the most audible voices
+|   real and the rest virtual.
+|___________________________________________________________________*/
+
+void Voice_Update ()
+{
+  int i, j, n, k, count;
+  unsigned mixed;
+  double position;
+  float s;
+  MixerStats stats;
+  Logical *items, *v;
+  double start;
+
+  if (max_logical == 0)
+    return;
+
+  start = Get_Time ();
+  Mixer_Get_Stats (&stats);
+  mixed = stats.frames - last_frames;
+  last_frames = stats.frames;
+
+  // Voices faded out over a whole block can stop, their position is where a virtual voice carries on
+  for (i=num_fades-1; i>=0; i--)
+    if (stats.frames != fades[i].frames) {
+      if (fades[i].logical != 0) {
+        v = POOL_GET (Logical, logical, fades[i].logical);
+        position = Mixer_Get_Position (v->real);
+        v->real   = 0;
+        v->fading = false;
+        if (position < 0)
+          Pool_Free (logical, fades[i].logical);    // ended while fading
+        else
+          v->position = position;
+      }
+      Mixer_Stop (fades[i].voice);
+      Remove_Fade (i);
+    }
+
+  // Move along (backwards, since a voice that ends is replaced by the last one)
+  items = POOL_ITEMS (Logical, logical);
+  for (i=Pool_Count (logical)-1; i>=0; i--) {
+    v = &items[i];
+    if (v->real) {
+      if ((!v->fading) && (!Mixer_Is_Playing (v->real)))
+        // Sound ran out
+        Pool_Free (logical, Pool_Handle_At (logical, i));
+    }
+    else {
+      v->position += mixed * v->step * v->pitch;
+      if (v->position >= v->frames) {
+        if (!v->loop)
+          Pool_Free (logical, Pool_Handle_At (logical, i));
+        else
+          v->position = fmod (v->position, (double) v->frames);
+      }
+    }
+  }
+
+  // Score, voices stay where they are from here on
+  count = Pool_Count (logical);
+  n = 0;
+  for (i=0; i<count; i++) {
+    v = &items[i];
+    v->chosen = false;
+    s = v->volume * v->priority * v->attenuation;
+    if (v->real && (!v->fading))
+      s *= VOICE_HYSTERESIS;
+    if (s >= VOICE_MIN_AUDIBILITY) {
+      score[n] = s;
+      order[n] = i;
+      n++;
+    }
+  }
+
+  // Pick the most audible
+  k = (n < max_real) ? n : max_real;
+  if (k < n)
+    Select_Top (score, order, n, k);
+  for (i=0; i<k; i++)
+    items[order[i]].chosen = true;
+
+  // Voices no longer picked fade out first, so their mixer voices come back soonest
+  for (i=0; i<count; i++) {
+    v = &items[i];
+    if (v->real && (!v->fading) && (!v->chosen)) {
+      Mixer_Set_Voice (v->real, 0, v->pan, v->pitch);
+      Fade_Out (Pool_Handle_At (logical, i), v->real);
+      voice_stats.demotions++;
+    }
+  }
+  voice_stats.real = 0;
+  for (i=0; i<k; i++) {
+    v = &items[order[i]];
+    if (v->real == 0) {
+      // If the mixer is full of voices fading out, try again next update
+      v->real = Mixer_Play_From (v->sound, v->volume * v->attenuation, v->pan, v->pitch, v->position);
+      if (v->real == 0)
+        continue;
+      voice_stats.promotions++;
+    }
+    else {
+      if (v->fading) {
+        // Picked again before the fade finished, just turn it back up
+        for (j=0; fades[j].voice != v->real; j++);
+        Remove_Fade (j);
+        v->fading = false;
+        voice_stats.promotions++;
+      }
+      Mixer_Set_Voice (v->real, v->volume * v->attenuation, v->pan, v->pitch);
+    }
+    voice_stats.real++;
+  }
+
+  voice_stats.logical = count;
+  voice_stats.fading  = num_fades;
+  voice_stats.update_time = (float)(Get_Time () - start);
+}
+
+/*____________________________________________________________________
+|
+| Function: Fade_Out
+|
+| Input: Called from Voice_Stop(), Voice_Update()
+| Output: Remembers a mixer voice that is fading to silence, to stop
+|   it after the next block is mixed.  logical_voice is its logical
+|   voice, or 0 if that was stopped.
+|___________________________________________________________________*/
+
+static void Fade_Out (VirtualVoice logical_voice, MixerVoice voice)
+{
+  MixerStats stats;
+
+  Mixer_Get_Stats (&stats);
+  if (logical_voice == 0)
+    Mixer_Set_Voice (voice, 0, 0, 1);
+  else
+    POOL_GET (Logical, logical, logical_voice)->fading = true;
+  // One fade per mixer voice, so there is always room
+  fades[num_fades].voice   = voice;
+  fades[num_fades].frames  = stats.frames;
+  fades[num_fades].logical = logical_voice;
+  num_fades++;
+}
+
+/*____________________________________________________________________
+|
+| Function: Remove_Fade
+|
+| Input: Called from Voice_Update()
+| Output: Removes a fade from the list.
+|___________________________________________________________________*/
+
+static void Remove_Fade (int index)
+{
+  fades[index] = fades[--num_fades];
+}
+
+/*____________________________________________________________________
+|
+| Function: Select_Top
+|
+| Input: Called from Voice_Update()
+| Output: Reorders score (and order with it) so the k highest scores
+|   come first, in no particular order.  Takes time in proportion to
+|   n (quickselect).
+|___________________________________________________________________*/
+
+static void Select_Top (float *score, int *order, int n, int k)
+{
+  int lo, hi, i, j, t;
+  float pivot, f;
+
+  lo = 0;
+  hi = n - 1;
+  while (lo < hi) {
+    pivot = score[(lo + hi) / 2];
+    i = lo;
+    j = hi;
+    // Higher scores to the left
+    while (i <= j) {
+      while (score[i] > pivot)
+        i++;
+      while (score[j] < pivot)
+        j--;
+      if (i <= j) {
+        f = score[i]; score[i] = score[j]; score[j] = f;
+        t = order[i]; order[i] = order[j]; order[j] = t;
+        i++;
+        j--;
+      }
+    }
+    // Only keep going on the side with the cut
+    if (k - 1 <= j)
+      hi = j;
+    else if (k - 1 >= i)
+      lo = i;
+    else
+      break;
+  }
+}
+
+/*____________________________________________________________________
+|
+| Function: Voice_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.
+|___________________________________________________________________*/
+
+void Voice_Get_Stats (VoiceStats *stats)
+{
+  *stats = voice_stats;
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Voice_Update()
+| Output: Returns a time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
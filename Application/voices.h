@@ -0,0 +1,51 @@
+/*____________________________________________________________________
+|
+| File: voices.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define VOICE_MAX_LOGICAL     65535     // most voices that can be played at once, mixed or not (POOL_MAX_ITEMS)
+#define VOICE_HYSTERESIS      1.25f     // a mixed voice counts this much louder when choosing, so voices near the cut don't flip every frame
+#define VOICE_MIN_AUDIBILITY  0.001f    // quieter voices are never mixed
+
+typedef unsigned VirtualVoice;          // 0 = none
+
+typedef struct {
+  int   logical;                        // playing voices
+  int   real;                           // of those, being mixed
+  int   fading;                         // mixer voices fading out after a voice stopped being mixed
+  int   promotions;                     // voices that started being mixed
+  int   demotions;                      // voices that stopped being mixed
+  float update_time;                    // milliseconds in the last Voice_Update()
+} VoiceStats;
+
+// Makes room for max_logical voices, of which the max_real most audible are mixed (the mixer needs room for as many
+//   again fading out), returns true on success
+bool Voice_Init (int max_logical, int max_real, int rate);  // rate = the mixer's output rate
+
+// Stops all voices
+void Voice_Free ();
+
+// Starts a voice, audibility is volume * priority * attenuation (see Voice_Set()), it is mixed from the next update on if
+//   it's loud enough, returns 0 if full
+VirtualVoice Voice_Play (MixerSound sound, float volume, float priority);
+
+// Changes the attenuation (distance gain), pan and pitch of a voice, like Spatial_Get_Emitter() gives
+void Voice_Set (VirtualVoice voice, float attenuation, float pan, float pitch);
+
+// Stops a voice
+void Voice_Stop (VirtualVoice voice);
+
+// Returns true if a voice is still playing
+bool Voice_Is_Playing (VirtualVoice voice);
+
+// Returns true if a voice is being mixed
+bool Voice_Is_Real (VirtualVoice voice);
+
+// Moves the voices that aren't mixed along, then mixes the most audible ones, once per frame before Mixer_Update()
+void Voice_Update ();
+
+// Gets counts and times
+void Voice_Get_Stats (VoiceStats *stats);
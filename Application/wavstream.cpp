@@ -0,0 +1,642 @@
+/*____________________________________________________________________
+|
+| File: wavstream.cpp
+|
+| Description: Plays long sounds (music) from RIFF/WAVE files without
+|   loading the whole file.
+|
+|   Each stream has a ring of WAV_STREAM_CHUNKS chunks, together
+|   holding the read ahead time given to Wav_Stream_Open().  One thread
+|   refills the chunks of every stream as they are played, reading the
+|   file a chunk at a time, so a stream only ever holds a few hundred
+|   milliseconds of audio.  The first chunk is read when a stream is
+|   opened, so it can start playing right away.
+|
+|   Wav_Stream_Read() only copies from the ring and never waits for the
+|   file, so it can be called from an audio thread.  If the ring runs
+|   dry it returns what it has and the caller plays silence.
+|
+|   Short sounds can be loaded whole with Wav_Load(), which reads them
+|   the same way.
+|
+|   Only uses the C library and the OS.
+|
+| Functions: Wav_Stream_Init
+|            Wav_Stream_Free
+|            Wav_Stream_Open
+|             Read_Header
+|            Wav_Stream_Close
+|            Wav_Stream_Read
+|            Wav_Stream_Get_Stats
+|            Wav_Load
+|             Refill_Thread
+|             Fill_Chunk
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavstream.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define MIN_BUFFER_MS     30        // shortest read ahead allowed
+
+#define WAVE_FORMAT_PCM         1
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+/*___________________
+|
+| Type definitions
+|__________________*/
+
+typedef struct {
+  bool      used;
+  bool      loop;
+  bool      at_end;                         // the last chunk has been filled (no loop)
+  FILE     *fp;
+  unsigned  data_offset, data_bytes;        // of the sample data in the file
+  unsigned  data_pos;                       // bytes of sample data read
+  int       channels, bits, block_align;
+  int       chunk_frames;
+  short    *buffer;                         // WAV_STREAM_CHUNKS chunks of chunk_frames frames
+  int       frames [WAV_STREAM_CHUNKS];     // frames in each filled chunk
+  int       filled;                         // chunks filled so far, written by the refilling thread
+  int       played;                         // chunks played so far, written by the reader
+  int       play_pos;                       // frame in the chunk being played (reader only)
+} Stream;
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static bool Read_Header (Stream *s, WavFormat *format);
+#ifdef _WIN32
+static unsigned __stdcall Refill_Thread (void *params);
+#else
+static void *Refill_Thread (void *params);
+#endif
+static int  Fill_Chunk (Stream *s, bool *end);
+static double Get_Time ();
+
+/*___________________
+|
+| Macros
+|__________________*/
+
+#ifdef _WIN32
+#define LOCK()        EnterCriticalSection (&ring_critsection)
+#define UNLOCK()      LeaveCriticalSection (&ring_critsection)
+#define LOCK_FILL()   EnterCriticalSection (&fill_critsection)
+#define UNLOCK_FILL() LeaveCriticalSection (&fill_critsection)
+#define WAKE()        SetEvent (refill_event)
+#else
+#define LOCK()        pthread_mutex_lock (&ring_mutex)
+#define UNLOCK()      pthread_mutex_unlock (&ring_mutex)
+#define LOCK_FILL()   pthread_mutex_lock (&fill_mutex)
+#define UNLOCK_FILL() pthread_mutex_unlock (&fill_mutex)
+#define WAKE()        { LOCK (); refill_wake = true; pthread_cond_signal (&refill_cond); UNLOCK (); }
+#endif
+
+// Reads little endian values from a header
+#define GET16(_p_) ((unsigned)(_p_)[0] | ((unsigned)(_p_)[1] << 8))
+#define GET32(_p_) (GET16(_p_) | (GET16((_p_)+2) << 16))
+
+/*___________________
+|
+| Global variables
+|__________________*/
+
+static bool             running = false;
+static bool             stopping;
+
+#ifdef _WIN32
+static HANDLE           refill_thread;
+static HANDLE           refill_event;
+static CRITICAL_SECTION ring_critsection;   // guards filled, played, at_end and stats
+static CRITICAL_SECTION fill_critsection;   // held while filling, so a stream isn't closed under the thread
+#else
+static pthread_t        refill_thread;
+static pthread_cond_t   refill_cond = PTHREAD_COND_INITIALIZER;
+static bool             refill_wake;
+static pthread_mutex_t  ring_mutex  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  fill_mutex  = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static Stream           streams [MAX_WAV_STREAMS];
+static WavStreamStats   wav_stream_stats;
+
+/*____________________________________________________________________
+|
+| Function: Wav_Stream_Init
+|
+| Input: Called from Program_Run()
+| Output: Starts the thread that refills streams.  Returns true on
+|   success, else false.
+|___________________________________________________________________*/
+
+bool Wav_Stream_Init ()
+{
+  if (running)
+    return (false);
+
+  memset (streams, 0, sizeof(streams));
+  memset (&wav_stream_stats, 0, sizeof(wav_stream_stats));
+  stopping = false;
+
+#ifdef _WIN32
+  InitializeCriticalSection (&ring_critsection);
+  InitializeCriticalSection (&fill_critsection);
+  refill_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  refill_thread = (HANDLE) _beginthreadex (NULL, 0, Refill_Thread, NULL, 0, NULL);
+  if (refill_thread == 0) {
+    CloseHandle (refill_event);
+    DeleteCriticalSection (&fill_critsection);
+    DeleteCriticalSection (&ring_critsection);
+    return (false);
+  }
+#else
+  refill_wake = false;
+  if (pthread_create (&refill_thread, NULL, Refill_Thread, NULL) != 0)
+    return (false);
+#endif
+  running = true;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Wav_Stream_Free
+|
+| Input: Called from Program_Run()
+| Output: Closes all streams and stops the refilling thread.
+|___________________________________________________________________*/
+
+void Wav_Stream_Free ()
+{
+  int i;
+
+  if (!running)
+    return;
+
+  LOCK ();
+  stopping = true;
+  UNLOCK ();
+#ifdef _WIN32
+  SetEvent (refill_event);
+  WaitForSingleObject (refill_thread, INFINITE);
+  CloseHandle (refill_thread);
+  CloseHandle (refill_event);
+#else
+  WAKE ();
+  pthread_join (refill_thread, NULL);
+#endif
+
+  for (i=0; i<MAX_WAV_STREAMS; i++)
+    if (streams[i].used)
+      Wav_Stream_Close (i+1);
+
+#ifdef _WIN32
+  DeleteCriticalSection (&fill_critsection);
+  DeleteCriticalSection (&ring_critsection);
+#endif
+  running = false;
+}
+
+/*____________________________________________________________________
+|
+| Function: Wav_Stream_Open
+|
+| Input: Called from ____
+| Output: Opens a wave file to stream, reading the first chunk.
+|   Returns a stream, or 0 on error.
+|___________________________________________________________________*/
+
+WavStream Wav_Stream_Open (const char *filename, int buffer_ms, bool loop, WavFormat *format)
+{
+  int i;
+  bool end;
+  Stream s;
+  WavFormat f;
+
+  if (!running)
+    return (0);
+  for (i=0; (i < MAX_WAV_STREAMS) && streams[i].used; i++);
+  if (i == MAX_WAV_STREAMS)
+    return (0);
+
+  memset (&s, 0, sizeof(s));
+  s.fp = fopen (filename, "rb");
+  if (s.fp == NULL)
+    return (0);
+  if (!Read_Header (&s, &f)) {
+    fclose (s.fp);
+    return (0);
+  }
+  if (buffer_ms < MIN_BUFFER_MS)
+    buffer_ms = MIN_BUFFER_MS;
+  s.chunk_frames = (int)((long long)f.rate * buffer_ms / (1000 * WAV_STREAM_CHUNKS));
+  if (s.chunk_frames < 1)
+    s.chunk_frames = 1;
+  s.buffer = (short *) malloc (WAV_STREAM_CHUNKS * s.chunk_frames * s.channels * sizeof(short));
+  if (s.buffer == NULL) {
+    fclose (s.fp);
+    return (0);
+  }
+  s.loop = loop;
+  s.used = true;
+
+  // Read the first chunk now so the stream can start playing
+  if (Fill_Chunk (&s, &end))
+    s.filled = 1;
+  s.at_end = end;
+
+  LOCK_FILL ();
+  LOCK ();
+  streams[i] = s;
+  wav_stream_stats.streams++;
+  wav_stream_stats.ring_bytes += WAV_STREAM_CHUNKS * s.chunk_frames * s.channels * sizeof(short);
+  wav_stream_stats.chunks_read++;
+  UNLOCK ();
+  UNLOCK_FILL ();
+  WAKE ();
+
+  if (format)
+    *format = f;
+
+  return (i+1);
+}
+
+/*____________________________________________________________________
+|
+| Function: Read_Header
+|
+| Input: Called from Wav_Stream_Open(), Wav_Load()
+| Output: Reads the chunks of a wave file up to the sample data,
+|   leaving the file there.  Returns true if it is 8 or 16-bit PCM.
+|___________________________________________________________________*/
+
+static bool Read_Header (Stream *s, WavFormat *format)
+{
+  unsigned size, file_size, tag;
+  unsigned char header[12], fmt[40];
+  bool have_fmt;
+
+  if (fseek (s->fp, 0, SEEK_END) != 0)
+    return (false);
+  file_size = (unsigned) ftell (s->fp);
+  rewind (s->fp);
+
+  if ((fread (header, 12, 1, s->fp) != 1) || (memcmp (header, "RIFF", 4) != 0) || (memcmp (header+8, "WAVE", 4) != 0))
+    return (false);
+
+  have_fmt = false;
+  for (;;) {
+    if (fread (header, 8, 1, s->fp) != 1)
+      return (false);
+    size = GET32 (header+4);
+    if (memcmp (header, "fmt ", 4) == 0) {
+      if ((size < 16) || (fread (fmt, size < sizeof(fmt) ? size : sizeof(fmt), 1, s->fp) != 1))
+        return (false);
+      tag            = GET16 (fmt);
+      s->channels    = GET16 (fmt+2);
+      format->rate   = GET32 (fmt+4);
+      s->block_align = GET16 (fmt+12);
+      s->bits        = GET16 (fmt+14);
+      // Extensible format, the sub format starts with the format tag
+      if ((tag == WAVE_FORMAT_EXTENSIBLE) && (size >= 26))
+        tag = GET16 (fmt+24);
+      if ((tag != WAVE_FORMAT_PCM) || ((s->bits != 8) && (s->bits != 16)) || (s->channels < 1) || (s->channels > 8) ||
+          (s->block_align != s->channels * s->bits / 8) || (format->rate == 0))
+        return (false);
+      have_fmt = true;
+      size -= size < sizeof(fmt) ? size : sizeof(fmt);
+    }
+    else if (memcmp (header, "data", 4) == 0) {
+      if (!have_fmt)
+        return (false);
+      s->data_offset = (unsigned) ftell (s->fp);
+      // Some writers leave the size too big, stop at the end of the file
+      if (size > file_size - s->data_offset)
+        size = file_size - s->data_offset;
+      s->data_bytes = size - size % s->block_align;
+      s->data_pos   = 0;
+      break;
+    }
+    // Chunks are padded to an even size
+    if (fseek (s->fp, size + (size & 1), SEEK_CUR) != 0)
+      return (false);
+  }
+
+  format->channels = s->channels;
+  format->bits     = s->bits;
+  format->frames   = s->data_bytes / s->block_align;
+
+  return (true);
+}
+
+/*____________________________________________________________________
+|
+| Function: Wav_Stream_Close
+|
+| Input: Called from ____, Wav_Stream_Free()
+| Output: Closes a stream.  Waits if the stream is being filled.  Don't
+|   close a stream while another thread reads it.
+|___________________________________________________________________*/
+
+void Wav_Stream_Close (WavStream stream)
+{
+  Stream *s;
+
+  if ((stream < 1) || (stream > MAX_WAV_STREAMS) || !streams[stream-1].used)
+    return;
+  s = &streams[stream-1];
+
+  LOCK_FILL ();
+  LOCK ();
+  wav_stream_stats.streams--;
+  wav_stream_stats.ring_bytes -= WAV_STREAM_CHUNKS * s->chunk_frames * s->channels * sizeof(short);
+  s->used = false;
+  UNLOCK ();
+  fclose (s->fp);
+  free (s->buffer);
+  memset (s, 0, sizeof(Stream));
+  UNLOCK_FILL ();
+}
+
+/*____________________________________________________________________
+|
+| Function: Wav_Stream_Read
+|
+| Input: Called from ____
+| Output: Copies frames from the ring, letting the refilling thread
+|   reuse chunks that have been played.  Returns # of frames copied,
+|   or -1 if the stream has ended (or isn't open).
+|___________________________________________________________________*/
+
+int Wav_Stream_Read (WavStream stream, short *samples, int num_frames)
+{
+  int k, n, done, filled;
+  bool at_end;
+  Stream *s;
+
+  if ((stream < 1) || (stream > MAX_WAV_STREAMS) || !streams[stream-1].used)
+    return (-1);
+  s = &streams[stream-1];
+
+  LOCK ();
+  filled = s->filled;
+  at_end = s->at_end;
+  UNLOCK ();
+
+  done = 0;
+  while ((done < num_frames) && (s->played < filled)) {
+    k = s->played % WAV_STREAM_CHUNKS;
+    n = s->frames[k] - s->play_pos;
+    if (n > num_frames - done)
+      n = num_frames - done;
+    memcpy (samples + done * s->channels, s->buffer + (k * s->chunk_frames + s->play_pos) * s->channels, n * s->channels * sizeof(short));
+    done += n;
+    s->play_pos += n;
+    // Done with this chunk, give it back to be filled
+    if (s->play_pos == s->frames[k]) {
+      s->play_pos = 0;
+      LOCK ();
+      s->played++;
+      UNLOCK ();
+      WAKE ();
+    }
+  }
+
+  if (done < num_frames) {
+    // Filled before at_end was read, so nothing more is coming
+    if (at_end && (s->played == filled))
+      return (done ? done : -1);
+    LOCK ();
+    wav_stream_stats.underruns++;
+    UNLOCK ();
+  }
+
+  return (done);
+}
+
+/*____________________________________________________________________
+|
+| Function: Wav_Stream_Get_Stats
+|
+| Input: Called from ____
+| Output: Gets counts and times.
+|___________________________________________________________________*/
+
+void Wav_Stream_Get_Stats (WavStreamStats *stats)
+{
+  if (!running) {
+    memset (stats, 0, sizeof(WavStreamStats));
+    return;
+  }
+  LOCK ();
+  *stats = wav_stream_stats;
+  UNLOCK ();
+}
+
+/*____________________________________________________________________
+|
+| Function: Wav_Load
+|
+| Input: Called from ____
+| Output: Reads a whole wave file.  Returns its 16-bit samples
+|   (channels interleaved, free with free()), or NULL on error.
+|___________________________________________________________________*/
+
+short *Wav_Load (const char *filename, WavFormat *format)
+{
+  bool end;
+  Stream s;
+
+  memset (&s, 0, sizeof(s));
+  s.fp = fopen (filename, "rb");
+  if (s.fp == NULL)
+    return (NULL);
+  if (!Read_Header (&s, format)) {
+    fclose (s.fp);
+    return (NULL);
+  }
+  // One chunk holding every frame
+  s.chunk_frames = format->frames;
+  s.buffer = (short *) malloc ((format->frames + 1) * s.channels * sizeof(short));
+  if (s.buffer)
+    format->frames = Fill_Chunk (&s, &end);
+  fclose (s.fp);
+
+  return (s.buffer);
+}
+
+/*____________________________________________________________________
+|
+| Function: Refill_Thread
+|
+| Input: Called from Wav_Stream_Init() through _beginthreadex() or
+|   pthread_create()
+| Output: Fills played chunks of every stream until stopped.
+|___________________________________________________________________*/
+
+#ifdef _WIN32
+static unsigned __stdcall Refill_Thread (void *params)
+#else
+static void *Refill_Thread (void *params)
+#endif
+{
+  int i, n;
+  bool more, room, end, stop;
+  double start;
+  Stream *s;
+
+  for (;;) {
+#ifdef _WIN32
+    WaitForSingleObject (refill_event, INFINITE);
+    LOCK ();
+#else
+    LOCK ();
+    while (!refill_wake && !stopping)
+      pthread_cond_wait (&refill_cond, &ring_mutex);
+    refill_wake = false;
+#endif
+    stop = stopping;
+    UNLOCK ();
+    if (stop)
+      break;
+
+    // Fill a chunk of each stream in turn until all rings are full
+    LOCK_FILL ();
+    do {
+      more = false;
+      for (i=0; i<MAX_WAV_STREAMS; i++) {
+        s = &streams[i];
+        if (!s->used)
+          continue;
+        LOCK ();
+        room = (!s->at_end) && (s->filled - s->played < WAV_STREAM_CHUNKS);
+        UNLOCK ();
+        if (!room)
+          continue;
+        start = Get_Time ();
+        n = Fill_Chunk (s, &end);
+        LOCK ();
+        if (n)
+          s->filled++;
+        s->at_end = end;
+        wav_stream_stats.chunks_read++;
+        wav_stream_stats.read_time += (float)(Get_Time () - start);
+        UNLOCK ();
+        more = true;
+      }
+    } while (more);
+    UNLOCK_FILL ();
+  }
+
+#ifdef _WIN32
+  return (0);
+#else
+  return (NULL);
+#endif
+}
+
+/*____________________________________________________________________
+|
+| Function: Fill_Chunk
+|
+| Input: Called from Wav_Stream_Open(), Refill_Thread(), Wav_Load()
+| Output: Reads the next chunk of a stream from its file, going back
+|   to the start of the samples if it loops.  Sets end if the stream
+|   doesn't loop and this is the last chunk.  Returns # of frames read.
+|___________________________________________________________________*/
+
+static int Fill_Chunk (Stream *s, bool *end)
+{
+  int j, n, k, frames;
+  unsigned bytes;
+  short *chunk;
+  unsigned char *data;
+
+  k = s->filled % WAV_STREAM_CHUNKS;
+  chunk = s->buffer + k * s->chunk_frames * s->channels;
+  *end = false;
+
+  for (frames=0; frames<s->chunk_frames; frames+=n) {
+    if (s->data_pos == s->data_bytes) {
+      if ((!s->loop) || (s->data_bytes == 0)) {
+        *end = true;
+        break;
+      }
+      fseek (s->fp, s->data_offset, SEEK_SET);
+      s->data_pos = 0;
+    }
+    bytes = (s->chunk_frames - frames) * s->block_align;
+    if (bytes > s->data_bytes - s->data_pos)
+      bytes = s->data_bytes - s->data_pos;
+    // Read 8-bit samples into the start of where they go, then widen them from the end
+    data = (unsigned char *)(chunk + frames * s->channels);
+    n = (int) fread (data, 1, bytes, s->fp) / s->block_align;
+    s->data_pos += n * s->block_align;
+    if (s->bits == 8)
+      for (j=n*s->channels-1; j>=0; j--)
+        ((short *)data)[j] = (short)((data[j] - 128) * 256);
+    // File is shorter than its header says, end it here
+    if ((unsigned)n * s->block_align < bytes) {
+      frames += n;
+      *end = true;
+      break;
+    }
+  }
+  s->frames[k] = frames;
+
+  return (frames);
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from Refill_Thread()
+| Output: Returns a time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}
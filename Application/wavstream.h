@@ -0,0 +1,49 @@
+/*____________________________________________________________________
+|
+| File: wavstream.h
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+#define WAV_STREAM_CHUNKS   3     // chunks in each stream's ring (triple buffered)
+#define MAX_WAV_STREAMS     8
+
+typedef int WavStream;            // 0 = none
+
+typedef struct {
+  int      channels;
+  int      rate;                  // frames per second
+  int      bits;                  // in the file, samples read are always 16-bit
+  unsigned frames;                // in the file
+} WavFormat;
+
+typedef struct {
+  int      streams;               // open streams
+  unsigned ring_bytes;            // memory used by the rings of open streams
+  int      chunks_read;           // chunks filled from files
+  int      underruns;             // reads that found the ring empty before the end
+  float    read_time;             // milliseconds reading files on the refilling thread
+} WavStreamStats;
+
+// Starts the thread that refills streams, returns true on success
+bool Wav_Stream_Init ();
+
+// Closes all streams and stops the thread
+void Wav_Stream_Free ();
+
+// Opens a RIFF/WAVE file (8 or 16-bit PCM) to play with buffer_ms milliseconds read ahead, returns 0 on error
+WavStream Wav_Stream_Open (const char *filename, int buffer_ms, bool loop, WavFormat *format);
+
+// Closes a stream
+void Wav_Stream_Close (WavStream stream);
+
+// Gets up to num_frames frames of 16-bit samples (channels interleaved), can be called from any one thread per stream,
+//   returns # of frames (fewer if the ring ran dry), or -1 once a stream that doesn't loop has ended
+int Wav_Stream_Read (WavStream stream, short *samples, int num_frames);
+
+// Gets counts and times
+void Wav_Stream_Get_Stats (WavStreamStats *stats);
+
+// Reads a whole wave file (8 or 16-bit PCM) for short sounds, returns 16-bit samples (free with free()) or NULL on error
+short *Wav_Load (const char *filename, WavFormat *format);
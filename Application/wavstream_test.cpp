@@ -0,0 +1,251 @@
+/*____________________________________________________________________
+|
+| File: wavstream_test.cpp
+|
+| Description: Decodes a wave file to a null sink with wavstream.cpp,
+|   headless, and compares it with loading the whole file.
+|
+|   Reports the time until the first samples can be played and the
+|   memory holding samples, for Wav_Load() and for a stream with the
+|   read ahead music uses.  Then reads the stream as fast as it fills,
+|   checking every sample against the whole file, and reads it again
+|   at real time in 10 ms blocks (as the device would), counting the
+|   blocks the ring couldn't fill.
+|
+|   A standalone program, not part of the game build.  Build it in
+|   Application\:
+|     cl /EHsc wavstream_test.cpp wavstream.cpp
+|     g++ -O2 wavstream_test.cpp wavstream.cpp -lpthread
+|   Run from the project directory (it plays wav\song1.wav), or give a
+|   wave file as the argument.  Returns 0 if the stream matched the
+|   file and never ran dry at real time.
+|
+|   Only uses the C library, the OS and wavstream.cpp.
+|
+| Functions: main
+|             Decode
+|             Sleep_Ms
+|             Get_Time
+|
+| (C) Copyright 2013 Abonvita Software LLC.
+| Licensed under the GX Toolkit License, Version 1.0.
+|___________________________________________________________________*/
+
+/*___________________
+|
+| Include Files
+|__________________*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavstream.h"
+
+/*___________________
+|
+| Constants
+|__________________*/
+
+#define BUFFER_MS     300        // read ahead, as music.cpp uses
+#define FIRST_FRAMES  512        // read right after opening
+#define BLOCK_MS      10         // real time read size
+#define REAL_TIME_MS  5000       // how long to read at real time
+
+#ifdef _WIN32
+#define SONG "wav\\song1.wav"
+#else
+#define SONG "wav/song1.wav"
+#endif
+
+/*___________________
+|
+| Function Prototypes
+|__________________*/
+
+static int    Decode (const char *filename, const short *whole, WavFormat *whole_format, bool real_time);
+static void   Sleep_Ms (int ms);
+static double Get_Time ();
+
+/*____________________________________________________________________
+|
+| Function: main
+|
+| Input: Called from the OS
+| Output: Loads the file whole, then decodes it streamed, and prints
+|   both.  Returns 0 if the stream matched and didn't run dry.
+|___________________________________________________________________*/
+
+int main (int argc, char **argv)
+{
+  int failed;
+  double start, load_time;
+  short *whole;
+  const char *filename;
+  WavFormat format;
+
+  filename = (argc > 1) ? argv[1] : SONG;
+
+  // Whole file
+  start = Get_Time ();
+  whole = Wav_Load (filename, &format);
+  load_time = Get_Time () - start;
+  if (whole == NULL) {
+    printf ("can't load %s\n", filename);
+    return (1);
+  }
+  printf ("%s: %d channels, %d Hz, %d-bit, %u frames (%.1f s)\n", filename, format.channels, format.rate, format.bits,
+          format.frames, (double)format.frames / format.rate);
+  printf ("whole:  %.2f ms to the first sample, %u KB of samples\n", load_time,
+          (unsigned)((size_t)format.frames * format.channels * sizeof(short) / 1024));
+
+  if (!Wav_Stream_Init ()) {
+    printf ("can't start the stream thread\n");
+    free (whole);
+    return (1);
+  }
+  failed = 0;
+  if (Decode (filename, whole, &format, false) != 0)
+    failed++;
+  if (Decode (filename, whole, &format, true) != 0)
+    failed++;
+  Wav_Stream_Free ();
+  free (whole);
+
+  return (failed ? 1 : 0);
+}
+
+/*____________________________________________________________________
+|
+| Function: Decode
+|
+| Input: Called from main()
+| Output: Streams a file to the end (or for REAL_TIME_MS at real time),
+|   comparing each sample with the whole file.  Returns # of errors:
+|   samples that differ, a wrong length, and at real time the blocks
+|   the ring couldn't fill.
+|___________________________________________________________________*/
+
+static int Decode (const char *filename, const short *whole, WavFormat *whole_format, bool real_time)
+{
+  int n, block, max_frames, errors;
+  unsigned pos, ring_bytes;
+  double start, first_time;
+  short *samples;
+  WavStream stream;
+  WavFormat format;
+  WavStreamStats stats_before, stats;
+
+  Wav_Stream_Get_Stats (&stats_before);
+  start = Get_Time ();
+  stream = Wav_Stream_Open (filename, BUFFER_MS, false, &format);
+  if (stream == 0) {
+    printf ("can't open %s\n", filename);
+    return (1);
+  }
+  block = real_time ? format.rate * BLOCK_MS / 1000 : FIRST_FRAMES;
+  samples = (short *) malloc ((FIRST_FRAMES + block) * format.channels * sizeof(short));
+  if (samples == NULL) {
+    Wav_Stream_Close (stream);
+    return (1);
+  }
+  Wav_Stream_Get_Stats (&stats);
+  ring_bytes = stats.ring_bytes;
+
+  errors = 0;
+  pos = 0;
+  first_time = 0;
+  // Real time stops after REAL_TIME_MS, else at the end
+  max_frames = real_time ? format.rate * (REAL_TIME_MS / 1000) : FIRST_FRAMES + block;
+  for (n = Wav_Stream_Read (stream, samples, FIRST_FRAMES); n >= 0; n = Wav_Stream_Read (stream, samples, block)) {
+    if (first_time == 0)
+      first_time = Get_Time () - start;
+    if (pos + n > whole_format->frames) {
+      errors++;
+      break;
+    }
+    if (memcmp (samples, whole + (size_t)pos * format.channels, (size_t)n * format.channels * sizeof(short)) != 0)
+      errors++;
+    pos += n;
+    if (real_time) {
+      if (pos >= (unsigned)max_frames)
+        break;
+      Sleep_Ms (BLOCK_MS);
+    }
+    // As fast as it fills, wait for the refilling thread
+    else if (n < block)
+      Sleep_Ms (1);
+  }
+  Wav_Stream_Get_Stats (&stats);
+  Wav_Stream_Close (stream);
+  free (samples);
+
+  if (!real_time) {
+    printf ("stream: %.2f ms to the first sample, %u KB of samples\n", first_time, ring_bytes / 1024);
+    if (pos != whole_format->frames) {
+      printf ("stream ended after %u of %u frames\n", pos, whole_format->frames);
+      errors++;
+    }
+    printf ("        %u frames, %s, %d chunks read in %.1f ms\n", pos, errors ? "DIFFERENT from the whole file" : "same as the whole file",
+            stats.chunks_read - stats_before.chunks_read, stats.read_time - stats_before.read_time);
+  }
+  else {
+    printf ("real time: %u frames in %d ms blocks, %d underruns%s\n", pos, BLOCK_MS, stats.underruns - stats_before.underruns,
+            errors ? ", DIFFERENT from the whole file" : "");
+    errors += stats.underruns - stats_before.underruns;
+  }
+
+  return (errors);
+}
+
+/*____________________________________________________________________
+|
+| Function: Sleep_Ms
+|
+| Input: Called from Decode()
+| Output: Waits about ms milliseconds.
+|___________________________________________________________________*/
+
+static void Sleep_Ms (int ms)
+{
+#ifdef _WIN32
+  Sleep (ms);
+#else
+  struct timespec t;
+
+  t.tv_sec  = ms / 1000;
+  t.tv_nsec = (long)(ms % 1000) * 1000000;
+  nanosleep (&t, NULL);
+#endif
+}
+
+/*____________________________________________________________________
+|
+| Function: Get_Time
+|
+| Input: Called from main(), Decode()
+| Output: Returns the time in milliseconds.
+|___________________________________________________________________*/
+
+static double Get_Time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter (&count);
+  QueryPerformanceFrequency (&frequency);
+
+  return ((double)count.QuadPart * 1000 / (double)frequency.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+
+  return ((double)t.tv_sec * 1000 + (double)t.tv_nsec / 1000000);
+#endif
+}